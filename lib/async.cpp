@@ -0,0 +1,27 @@
+#include "async.h"
+
+using namespace jbkv;
+
+namespace {
+
+/// Pools live until exit, so coroutines resumed during exit find them
+struct Pools {
+  ThreadPool executor_pool;
+  PoolExecutor executor{executor_pool};
+  ThreadPool blocking_pool;
+};
+
+Pools& GetPools() {
+  static auto* pools = new Pools();
+  return *pools;
+}
+
+}  // namespace
+
+Executor& jbkv::DefaultExecutor() {
+  return GetPools().executor;
+}
+
+void jbkv::RunBlocking(std::function<void()> function) {
+  GetPools().blocking_pool.Submit(std::move(function));
+}
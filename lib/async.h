@@ -0,0 +1,333 @@
+#pragma once
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <future>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include "noncopyable.h"
+#include "thread_pool.h"
+
+namespace jbkv {
+
+/// Resumes suspended coroutines, e.g. on threads of coroutine runtime of
+/// application
+class Executor : NonCopyableNonMovable {
+ public:
+  virtual ~Executor() = default;
+
+  /// Resumes coroutine on thread of executor
+  /// @note must not resume coroutine before returning
+  virtual void Schedule(std::coroutine_handle<> handle) = 0;
+};
+
+/// Executor resuming coroutines on threads of pool
+class PoolExecutor final : public Executor {
+ public:
+  explicit PoolExecutor(ThreadPool& pool)
+      : pool_(pool) {
+  }
+
+  void Schedule(std::coroutine_handle<> handle) override {
+    pool_.Submit([handle]() {
+      handle.resume();
+    });
+  }
+
+ private:
+  ThreadPool& pool_;
+};
+
+/// @return executor on process-wide pool of hardware concurrency threads
+Executor& DefaultExecutor();
+
+/// Runs function on process-wide pool of threads dedicated to blocking
+/// calls, e.g. file I/O, so threads of executors are not blocked by them
+void RunBlocking(std::function<void()> function);
+
+template <typename T>
+class Task;
+
+namespace detail {
+
+class TaskPromiseBase {
+ public:
+  std::suspend_always initial_suspend() noexcept {
+    return {};
+  }
+
+  /// Resumes awaiting coroutine
+  struct Continue {
+    bool await_ready() noexcept {
+      return false;
+    }
+
+    template <typename Promise>
+    std::coroutine_handle<> await_suspend(
+        std::coroutine_handle<Promise> handle) noexcept {
+      const auto continuation = handle.promise().continuation_;
+      return continuation ? continuation : std::noop_coroutine();
+    }
+
+    void await_resume() noexcept {
+    }
+  };
+
+  Continue final_suspend() noexcept {
+    return {};
+  }
+
+  void unhandled_exception() noexcept {
+    error_ = std::current_exception();
+  }
+
+  void SetContinuation(std::coroutine_handle<> continuation) {
+    continuation_ = continuation;
+  }
+
+ protected:
+  void Rethrow() const {
+    if (error_) {
+      std::rethrow_exception(error_);
+    }
+  }
+
+ private:
+  std::coroutine_handle<> continuation_;
+  std::exception_ptr error_;
+};
+
+template <typename T>
+class TaskPromise final : public TaskPromiseBase {
+ public:
+  Task<T> get_return_object() noexcept;
+
+  template <typename U>
+  void return_value(U&& value) {
+    result_.emplace(std::forward<U>(value));
+  }
+
+  T Result() {
+    Rethrow();
+    return std::move(*result_);
+  }
+
+ private:
+  std::optional<T> result_;
+};
+
+template <>
+class TaskPromise<void> final : public TaskPromiseBase {
+ public:
+  Task<void> get_return_object() noexcept;
+
+  void return_void() noexcept {
+  }
+
+  void Result() const {
+    Rethrow();
+  }
+};
+
+}  // namespace detail
+
+/// Lazily started coroutine returning T
+/// Task starts when awaited and resumes awaiting coroutine when it
+/// completes, on thread which completes it
+template <typename T = void>
+class [[nodiscard]] Task {
+ public:
+  using promise_type = detail::TaskPromise<T>;
+  using Handle = std::coroutine_handle<promise_type>;
+
+ public:
+  explicit Task(Handle handle)
+      : handle_(handle) {
+  }
+
+  Task(Task&& other) noexcept
+      : handle_(std::exchange(other.handle_, nullptr)) {
+  }
+
+  Task& operator=(Task&& other) noexcept {
+    if (this != &other) {
+      Reset();
+      handle_ = std::exchange(other.handle_, nullptr);
+    }
+
+    return *this;
+  }
+
+  Task(const Task&) = delete;
+  Task& operator=(const Task&) = delete;
+
+  ~Task() {
+    Reset();
+  }
+
+  auto operator co_await() const noexcept {
+    struct Awaiter {
+      bool await_ready() const noexcept {
+        return handle.done();
+      }
+
+      std::coroutine_handle<> await_suspend(
+          std::coroutine_handle<> continuation) const noexcept {
+        handle.promise().SetContinuation(continuation);
+        return handle;
+      }
+
+      T await_resume() const {
+        return handle.promise().Result();
+      }
+
+      Handle handle;
+    };
+
+    return Awaiter{handle_};
+  }
+
+ private:
+  void Reset() {
+    if (handle_) {
+      handle_.destroy();
+    }
+  }
+
+ private:
+  Handle handle_;
+};
+
+template <typename T>
+Task<T> detail::TaskPromise<T>::get_return_object() noexcept {
+  return Task<T>(Task<T>::Handle::from_promise(*this));
+}
+
+inline Task<void> detail::TaskPromise<void>::get_return_object() noexcept {
+  return Task<void>(Task<void>::Handle::from_promise(*this));
+}
+
+/// Suspends awaiting coroutine and resumes it on executor
+inline auto ScheduleOn(Executor& executor) {
+  struct Awaiter {
+    bool await_ready() const noexcept {
+      return false;
+    }
+
+    void await_suspend(std::coroutine_handle<> handle) const {
+      executor.Schedule(handle);
+    }
+
+    void await_resume() const noexcept {
+    }
+
+    Executor& executor;
+  };
+
+  return Awaiter{executor};
+}
+
+/// Runs function by RunBlocking, awaiting coroutine is resumed on executor
+/// when function completes
+/// @return result of function
+template <typename Function>
+Task<std::invoke_result_t<Function&>> Offload(Function function,
+                                              Executor& executor) {
+  using Result = std::invoke_result_t<Function&>;
+  struct Awaiter {
+    bool await_ready() const noexcept {
+      return false;
+    }
+
+    void await_suspend(std::coroutine_handle<> handle) {
+      RunBlocking([this, handle]() {
+        try {
+          if constexpr (std::is_void_v<Result>) {
+            function();
+          } else {
+            result.emplace(function());
+          }
+        } catch (...) {
+          error = std::current_exception();
+        }
+
+        executor.Schedule(handle);
+      });
+    }
+
+    Result await_resume() {
+      if (error) {
+        std::rethrow_exception(error);
+      }
+
+      if constexpr (!std::is_void_v<Result>) {
+        return std::move(*result);
+      }
+    }
+
+    Function& function;
+    Executor& executor;
+    std::conditional_t<std::is_void_v<Result>, bool, std::optional<Result>>
+        result{};
+    std::exception_ptr error{};
+  };
+
+  co_return co_await Awaiter{function, executor};
+}
+
+namespace detail {
+
+/// Coroutine which starts right away and destroys itself when completed
+struct Detached {
+  struct promise_type {
+    Detached get_return_object() noexcept {
+      return {};
+    }
+
+    std::suspend_never initial_suspend() noexcept {
+      return {};
+    }
+
+    std::suspend_never final_suspend() noexcept {
+      return {};
+    }
+
+    void return_void() noexcept {
+    }
+
+    void unhandled_exception() noexcept {
+      std::terminate();
+    }
+  };
+};
+
+template <typename T>
+Detached Complete(Task<T> task, std::promise<T> promise) {
+  try {
+    if constexpr (std::is_void_v<T>) {
+      co_await task;
+      promise.set_value();
+    } else {
+      promise.set_value(co_await task);
+    }
+  } catch (...) {
+    promise.set_exception(std::current_exception());
+  }
+}
+
+}  // namespace detail
+
+/// Runs task, blocking calling thread until it completes
+/// Task starts on calling thread and continues on threads which resume it
+/// @return result of task
+/// @note must not be called from thread of executor which task waits for
+template <typename T>
+T SyncWait(Task<T> task) {
+  std::promise<T> promise;
+  auto future = promise.get_future();
+  detail::Complete(std::move(task), std::move(promise));
+  return future.get();
+}
+
+}  // namespace jbkv
@@ -0,0 +1,786 @@
+#include "async_file.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#if defined(_WIN32)
+#include <process.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define JBKV_IO_URING 1
+#endif
+#endif
+
+using namespace jbkv::io;
+
+namespace {
+
+uint64_t ProcessId() {
+#if defined(_WIN32)
+  return static_cast<uint64_t>(::_getpid());
+#else
+  return static_cast<uint64_t>(::getpid());
+#endif
+}
+
+/// @return name next to path unique among sinks of all processes, so
+/// concurrent saves to path and files of user do not clobber each other
+std::filesystem::path TemporaryPath(const std::filesystem::path& path) {
+  static std::atomic<uint64_t> counter = 0;
+  std::string suffix = ".";
+  suffix.append(std::to_string(ProcessId()));
+  suffix.append(".");
+  suffix.append(
+      std::to_string(counter.fetch_add(1, std::memory_order_relaxed)));
+  suffix.append(".tmp");
+  auto temp = path;
+  temp += suffix;
+  return temp;
+}
+
+}  // namespace
+
+#if defined(_WIN32)
+
+struct AsyncFileSink::Impl {
+  std::filesystem::path path;
+  std::filesystem::path temp;
+  std::unique_ptr<FileSink> sink;
+  bool committed = false;
+};
+
+AsyncFileSink::AsyncFileSink(const std::filesystem::path& path,
+                             const AsyncFileOptions&)
+    : impl_(std::make_unique<Impl>()) {
+  impl_->path = path;
+  impl_->temp = TemporaryPath(path);
+  impl_->sink = std::make_unique<FileSink>(impl_->temp);
+}
+
+AsyncFileSink::~AsyncFileSink() {
+  impl_->sink.reset();
+  if (!impl_->committed) {
+    std::error_code ignored;
+    std::filesystem::remove(impl_->temp, ignored);
+  }
+}
+
+void AsyncFileSink::Write(const std::vector<ByteSpan>& parts) {
+  impl_->sink->Write(parts);
+}
+
+void AsyncFileSink::Commit() {
+  impl_->sink.reset();
+  std::filesystem::rename(impl_->temp, impl_->path);
+  impl_->committed = true;
+}
+
+const char* AsyncFileSink::Backend() const {
+  return "stream";
+}
+
+struct AsyncFileSource::Impl {
+  std::unique_ptr<FileSource> source;
+};
+
+AsyncFileSource::AsyncFileSource(const std::filesystem::path& path,
+                                 const AsyncFileOptions&)
+    : impl_(std::make_unique<Impl>()) {
+  impl_->source = std::make_unique<FileSource>(path);
+}
+
+AsyncFileSource::~AsyncFileSource() = default;
+
+uint64_t AsyncFileSource::Read(void* data, uint64_t size) {
+  return impl_->source->Read(data, size);
+}
+
+const char* AsyncFileSource::Backend() const {
+  return "stream";
+}
+
+#else
+
+namespace {
+
+/// Alignment of buffers, offsets and sizes required by O_DIRECT
+constexpr size_t kAlignment = 4096;
+
+struct AlignedDelete {
+  void operator()(uint8_t* data) const {
+    ::operator delete[](data, std::align_val_t(kAlignment));
+  }
+};
+
+using AlignedBuffer = std::unique_ptr<uint8_t[], AlignedDelete>;
+
+AlignedBuffer AllocateAligned(size_t size) {
+  return AlignedBuffer(static_cast<uint8_t*>(
+      ::operator new[](size, std::align_val_t(kAlignment))));
+}
+
+/// Positional read or write of single buffer
+struct Request {
+  bool write = false;
+  uint8_t* data = nullptr;
+  /// bytes submitted to kernel, read may transfer less at the end of file
+  size_t capacity = 0;
+  /// bytes expected to be transferred
+  size_t size = 0;
+  uint64_t offset = 0;
+  /// bytes transferred
+  size_t done = 0;
+  /// errno of failed transfer
+  int error = 0;
+  bool pending = false;
+};
+
+/// Executes requests in background, completions may come out of order
+class IoQueue {
+ public:
+  virtual ~IoQueue() = default;
+
+  virtual const char* Name() const = 0;
+
+  /// Starts transfer of remaining bytes of request
+  /// @note request must stay valid until it is returned by Wait
+  virtual void Submit(int fd, Request& request) = 0;
+
+  /// Waits for completion of any submitted request
+  /// @return request which transferred its size, reached end of file or
+  /// failed
+  virtual Request& Wait() = 0;
+};
+
+/// Performs transfer of request by blocking system calls
+void Transfer(int fd, Request& request) {
+  while (request.done < request.size) {
+    auto* data = request.data + request.done;
+    const auto size = request.capacity - request.done;
+    const auto offset = static_cast<off_t>(request.offset + request.done);
+    const auto result = request.write ? ::pwrite(fd, data, size, offset)
+                                      : ::pread(fd, data, size, offset);
+    if (result < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      request.error = errno;
+      return;
+    }
+
+    if (result == 0) {
+      request.error = request.write ? EIO : 0;
+      return;
+    }
+
+    request.done += static_cast<size_t>(result);
+  }
+}
+
+/// Portable backend: requests are executed in order by single thread
+class ThreadQueue final : public IoQueue {
+ public:
+  ThreadQueue()
+      : worker_([this]() { Run(); }) {
+  }
+
+  ~ThreadQueue() override {
+    {
+      std::lock_guard lock(mutex_);
+      stop_ = true;
+    }
+
+    submitted_cv_.notify_one();
+    worker_.join();
+  }
+
+  const char* Name() const override {
+    return "threads";
+  }
+
+  void Submit(int fd, Request& request) override {
+    {
+      std::lock_guard lock(mutex_);
+      submitted_.push_back({fd, &request});
+    }
+
+    submitted_cv_.notify_one();
+  }
+
+  Request& Wait() override {
+    std::unique_lock lock(mutex_);
+    completed_cv_.wait(lock, [this]() { return !completed_.empty(); });
+    auto& request = *completed_.front();
+    completed_.pop_front();
+    return request;
+  }
+
+ private:
+  void Run() {
+    while (true) {
+      std::unique_lock lock(mutex_);
+      submitted_cv_.wait(lock,
+                         [this]() { return stop_ || !submitted_.empty(); });
+      if (submitted_.empty()) {
+        return;
+      }
+
+      const auto [fd, request] = submitted_.front();
+      submitted_.pop_front();
+      lock.unlock();
+
+      Transfer(fd, *request);
+
+      lock.lock();
+      completed_.push_back(request);
+      lock.unlock();
+      completed_cv_.notify_one();
+    }
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable submitted_cv_;
+  std::condition_variable completed_cv_;
+  std::deque<std::pair<int, Request*>> submitted_;
+  std::deque<Request*> completed_;
+  bool stop_ = false;
+  std::thread worker_;
+};
+
+#if defined(JBKV_IO_URING)
+
+/// Linux io_uring backend driven by raw system calls
+/// Requests are placed to submission ring shared with kernel, which
+/// executes them concurrently and posts results to completion ring
+class UringQueue final : public IoQueue {
+ public:
+  /// @return nullptr if kernel does not provide io_uring
+  static std::unique_ptr<IoQueue> Create(unsigned entries) {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    const auto fd = static_cast<int>(
+        ::syscall(__NR_io_uring_setup, entries, &params));
+    if (fd < 0) {
+      return nullptr;
+    }
+
+    std::unique_ptr<UringQueue> queue(new UringQueue(fd));
+    // IORING_OP_READ and IORING_OP_WRITE come with the same kernel (5.6)
+    if (!(params.features & IORING_FEAT_RW_CUR_POS) || !queue->Map(params)) {
+      return nullptr;
+    }
+
+    return queue;
+  }
+
+  ~UringQueue() override {
+    if (sqes_ != MAP_FAILED) {
+      ::munmap(sqes_, sqes_size_);
+    }
+
+    if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_) {
+      ::munmap(cq_ring_, cq_ring_size_);
+    }
+
+    if (sq_ring_ != MAP_FAILED) {
+      ::munmap(sq_ring_, sq_ring_size_);
+    }
+
+    ::close(fd_);
+  }
+
+  const char* Name() const override {
+    return "io_uring";
+  }
+
+  void Submit(int fd, Request& request) override {
+    const auto tail = *sq_tail_;
+    const auto index = tail & *sq_mask_;
+    auto& sqe = sqes_[index];
+    std::memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = request.write ? IORING_OP_WRITE : IORING_OP_READ;
+    sqe.fd = fd;
+    sqe.addr = reinterpret_cast<uint64_t>(request.data + request.done);
+    sqe.len = static_cast<uint32_t>(request.capacity - request.done);
+    sqe.off = request.offset + request.done;
+    sqe.user_data = reinterpret_cast<uint64_t>(&request);
+    sq_array_[index] = index;
+    std::atomic_ref(*sq_tail_).store(tail + 1, std::memory_order_release);
+    Enter(1, 0, 0);
+  }
+
+  Request& Wait() override {
+    while (true) {
+      const auto head = *cq_head_;
+      if (head == std::atomic_ref(*cq_tail_).load(std::memory_order_acquire)) {
+        Enter(0, 1, IORING_ENTER_GETEVENTS);
+        continue;
+      }
+
+      const auto& cqe = cqes_[head & *cq_mask_];
+      auto& request = *reinterpret_cast<Request*>(cqe.user_data);
+      const auto result = cqe.res;
+      std::atomic_ref(*cq_head_).store(head + 1, std::memory_order_release);
+      if (result < 0) {
+        request.error = -result;
+        return request;
+      }
+
+      if (result == 0) {
+        request.error = request.write ? EIO : 0;
+        return request;
+      }
+
+      request.done += static_cast<size_t>(result);
+      if (request.done >= request.size) {
+        return request;
+      }
+
+      Submit(fd_, request);
+    }
+  }
+
+ private:
+  explicit UringQueue(int fd)
+      : fd_(fd) {
+  }
+
+  bool Map(const io_uring_params& params) {
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    cq_ring_size_ =
+        params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single) {
+      sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    }
+
+    sq_ring_ = ::mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+    if (sq_ring_ == MAP_FAILED) {
+      return false;
+    }
+
+    cq_ring_ = single ? sq_ring_
+                      : ::mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE,
+                               MAP_SHARED | MAP_POPULATE, fd_,
+                               IORING_OFF_CQ_RING);
+    if (cq_ring_ == MAP_FAILED) {
+      return false;
+    }
+
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = ::mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+      return false;
+    }
+
+    sqes_ = static_cast<io_uring_sqe*>(sqes);
+    auto* sq = static_cast<uint8_t*>(sq_ring_);
+    sq_tail_ = reinterpret_cast<uint32_t*>(sq + params.sq_off.tail);
+    sq_mask_ = reinterpret_cast<uint32_t*>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<uint32_t*>(sq + params.sq_off.array);
+    auto* cq = static_cast<uint8_t*>(cq_ring_);
+    cq_head_ = reinterpret_cast<uint32_t*>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<uint32_t*>(cq + params.cq_off.tail);
+    cq_mask_ = reinterpret_cast<uint32_t*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    return true;
+  }
+
+  void Enter(unsigned submit, unsigned wait, unsigned flags) {
+    while (::syscall(__NR_io_uring_enter, fd_, submit, wait, flags, nullptr,
+                     0) < 0) {
+      if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+        throw std::runtime_error("io_uring_enter failed: " +
+                                 std::string(std::strerror(errno)));
+      }
+    }
+  }
+
+ private:
+  const int fd_;
+  void* sq_ring_ = MAP_FAILED;
+  void* cq_ring_ = MAP_FAILED;
+  size_t sq_ring_size_ = 0;
+  size_t cq_ring_size_ = 0;
+  io_uring_sqe* sqes_ = static_cast<io_uring_sqe*>(MAP_FAILED);
+  size_t sqes_size_ = 0;
+  uint32_t* sq_tail_ = nullptr;
+  uint32_t* sq_mask_ = nullptr;
+  uint32_t* sq_array_ = nullptr;
+  uint32_t* cq_head_ = nullptr;
+  uint32_t* cq_tail_ = nullptr;
+  uint32_t* cq_mask_ = nullptr;
+  io_uring_cqe* cqes_ = nullptr;
+};
+
+#endif
+
+std::unique_ptr<IoQueue> CreateQueue(const AsyncFileOptions& options) {
+#if defined(JBKV_IO_URING)
+  if (options.io_uring) {
+    if (auto queue =
+            UringQueue::Create(static_cast<unsigned>(options.buffers))) {
+      return queue;
+    }
+  }
+#endif
+
+  return std::make_unique<ThreadQueue>();
+}
+
+/// @return descriptor of opened file, O_DIRECT is dropped if file system
+/// does not support it
+int OpenFile(const std::filesystem::path& path, int flags, bool& direct) {
+#if defined(O_DIRECT)
+  if (direct) {
+    const auto fd = ::open(path.c_str(), flags | O_DIRECT | O_CLOEXEC, 0644);
+    if (fd >= 0 || errno != EINVAL) {
+      return fd;
+    }
+  }
+#endif
+
+  direct = false;
+  return ::open(path.c_str(), flags | O_CLOEXEC, 0644);
+}
+
+/// Makes rename of file durable by syncing its directory
+/// @throw std::runtime_error if directory cannot be synced, file systems
+/// which do not support sync of directories are not reported
+void SyncDirectory(const std::filesystem::path& path) {
+  auto directory = path.parent_path();
+  if (directory.empty()) {
+    directory = ".";
+  }
+
+  const auto fd = ::open(directory.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    throw std::runtime_error("Cannot open directory: " + directory.string());
+  }
+
+  const bool synced = ::fsync(fd) == 0 || errno == EINVAL;
+  ::close(fd);
+  if (!synced) {
+    throw std::runtime_error("Cannot sync directory: " + directory.string());
+  }
+}
+
+void CheckOptions(const AsyncFileOptions& options) {
+  if (options.buffer_size == 0 || options.buffer_size % kAlignment != 0 ||
+      options.buffers == 0) {
+    throw std::runtime_error("Bad file buffers");
+  }
+}
+
+/// Buffers and requests of single file
+class Pipeline {
+ public:
+  Pipeline(const AsyncFileOptions& options, int fd)
+      : queue_(CreateQueue(options)),
+        fd_(fd),
+        buffer_size_(options.buffer_size),
+        requests_(options.buffers) {
+    for (size_t i = 0; i < options.buffers; ++i) {
+      buffers_.push_back(AllocateAligned(buffer_size_));
+    }
+  }
+
+  /// Buffers are not released before backend is done with them
+  /// If backend fails to report completions, buffers are leaked, since
+  /// kernel may still transfer them
+  ~Pipeline() {
+    try {
+      for (auto& request : requests_) {
+        while (request.pending) {
+          queue_->Wait().pending = false;
+        }
+      }
+    } catch (const std::exception&) {
+      for (auto& buffer : buffers_) {
+        buffer.release();
+      }
+    }
+  }
+
+  const char* Backend() const {
+    return queue_->Name();
+  }
+
+  size_t BufferSize() const {
+    return buffer_size_;
+  }
+
+  size_t Count() const {
+    return buffers_.size();
+  }
+
+  uint8_t* Buffer(size_t index) {
+    return buffers_[index].get();
+  }
+
+  Request& At(size_t index) {
+    return requests_[index];
+  }
+
+  void Submit(size_t index, bool write, size_t capacity, size_t size,
+              uint64_t offset) {
+    auto& request = requests_[index];
+    request = {write, Buffer(index), capacity, size, offset};
+    request.pending = true;
+    queue_->Submit(fd_, request);
+  }
+
+  /// Waits for completion of request of buffer
+  /// @throw std::runtime_error if transfer failed
+  Request& WaitFor(size_t index) {
+    auto& request = requests_[index];
+    while (request.pending) {
+      queue_->Wait().pending = false;
+    }
+
+    if (request.error != 0) {
+      throw std::runtime_error("File I/O failed: " +
+                               std::string(std::strerror(request.error)));
+    }
+
+    return request;
+  }
+
+  void WaitAll() {
+    for (size_t i = 0; i < requests_.size(); ++i) {
+      WaitFor(i);
+    }
+  }
+
+ private:
+  std::unique_ptr<IoQueue> queue_;
+  const int fd_;
+  const size_t buffer_size_;
+  std::vector<AlignedBuffer> buffers_;
+  std::vector<Request> requests_;
+};
+
+}  // namespace
+
+struct AsyncFileSink::Impl {
+  std::filesystem::path path;
+  std::filesystem::path temp;
+  int fd = -1;
+  bool direct = false;
+  std::unique_ptr<Pipeline> pipeline;
+  /// buffer being filled
+  size_t current = 0;
+  size_t filled = 0;
+  /// offset of current buffer in file
+  uint64_t offset = 0;
+  bool committed = false;
+
+  /// Submits current buffer and waits until next one is free
+  void SubmitCurrent() {
+    auto size = filled;
+    if (direct) {
+      size = (size + kAlignment - 1) / kAlignment * kAlignment;
+      std::fill(pipeline->Buffer(current) + filled,
+                pipeline->Buffer(current) + size, 0);
+    }
+
+    pipeline->Submit(current, true, size, size, offset);
+    offset += filled;
+    filled = 0;
+    current = (current + 1) % pipeline->Count();
+    pipeline->WaitFor(current);
+  }
+};
+
+AsyncFileSink::AsyncFileSink(const std::filesystem::path& path,
+                             const AsyncFileOptions& options)
+    : impl_(std::make_unique<Impl>()) {
+  CheckOptions(options);
+  impl_->path = path;
+  impl_->temp = TemporaryPath(path);
+  impl_->direct = options.direct;
+  impl_->fd = OpenFile(impl_->temp, O_WRONLY | O_CREAT | O_TRUNC,
+                       impl_->direct);
+  if (impl_->fd < 0) {
+    throw std::runtime_error("Cannot open file for writing: " +
+                             impl_->temp.string());
+  }
+
+  try {
+    impl_->pipeline = std::make_unique<Pipeline>(options, impl_->fd);
+  } catch (...) {
+    ::close(impl_->fd);
+    throw;
+  }
+}
+
+AsyncFileSink::~AsyncFileSink() {
+  impl_->pipeline.reset();
+  if (impl_->fd >= 0) {
+    ::close(impl_->fd);
+  }
+
+  if (!impl_->committed) {
+    std::error_code ignored;
+    std::filesystem::remove(impl_->temp, ignored);
+  }
+}
+
+void AsyncFileSink::Write(const std::vector<ByteSpan>& parts) {
+  auto& impl = *impl_;
+  const auto buffer_size = impl.pipeline->BufferSize();
+  for (const auto& part : parts) {
+    const auto* data = static_cast<const uint8_t*>(part.data);
+    auto size = part.size;
+    while (size > 0) {
+      const auto count =
+          std::min<uint64_t>(size, buffer_size - impl.filled);
+      std::copy_n(data, count, impl.pipeline->Buffer(impl.current) +
+                                   impl.filled);
+      impl.filled += static_cast<size_t>(count);
+      data += count;
+      size -= count;
+      if (impl.filled == buffer_size) {
+        impl.SubmitCurrent();
+      }
+    }
+  }
+}
+
+void AsyncFileSink::Commit() {
+  auto& impl = *impl_;
+  const auto size = impl.offset + impl.filled;
+  if (impl.filled > 0) {
+    impl.SubmitCurrent();
+  }
+
+  impl.pipeline->WaitAll();
+  if (impl.direct && ::ftruncate(impl.fd, static_cast<off_t>(size)) != 0) {
+    throw std::runtime_error("Cannot truncate file");
+  }
+
+  if (::fsync(impl.fd) != 0) {
+    throw std::runtime_error("Cannot sync file");
+  }
+
+  impl.pipeline.reset();
+  ::close(impl.fd);
+  impl.fd = -1;
+  std::filesystem::rename(impl.temp, impl.path);
+  impl.committed = true;
+
+  SyncDirectory(impl.path);
+}
+
+const char* AsyncFileSink::Backend() const {
+  return impl_->pipeline->Backend();
+}
+
+struct AsyncFileSource::Impl {
+  int fd = -1;
+  uint64_t file_size = 0;
+  std::unique_ptr<Pipeline> pipeline;
+  /// offset of next buffer to read ahead
+  uint64_t next = 0;
+  /// buffer being consumed
+  size_t current = 0;
+  size_t pos = 0;
+  std::vector<bool> used;
+
+  /// Starts read of next part of file into buffer
+  void ReadAhead(size_t index) {
+    if (next >= file_size) {
+      used[index] = false;
+      return;
+    }
+
+    const auto size = static_cast<size_t>(
+        std::min<uint64_t>(pipeline->BufferSize(), file_size - next));
+    pipeline->Submit(index, false, pipeline->BufferSize(), size, next);
+    used[index] = true;
+    next += size;
+  }
+};
+
+AsyncFileSource::AsyncFileSource(const std::filesystem::path& path,
+                                 const AsyncFileOptions& options)
+    : impl_(std::make_unique<Impl>()) {
+  CheckOptions(options);
+  bool direct = options.direct;
+  impl_->fd = OpenFile(path, O_RDONLY, direct);
+  if (impl_->fd < 0) {
+    throw std::runtime_error("Cannot open file for reading: " + path.string());
+  }
+
+  try {
+    struct stat info;
+    if (::fstat(impl_->fd, &info) != 0) {
+      throw std::runtime_error("Cannot read file: " + path.string());
+    }
+
+    impl_->file_size = static_cast<uint64_t>(info.st_size);
+    impl_->pipeline = std::make_unique<Pipeline>(options, impl_->fd);
+    impl_->used.resize(options.buffers);
+    for (size_t i = 0; i < options.buffers; ++i) {
+      impl_->ReadAhead(i);
+    }
+  } catch (...) {
+    impl_->pipeline.reset();
+    ::close(impl_->fd);
+    throw;
+  }
+}
+
+AsyncFileSource::~AsyncFileSource() {
+  impl_->pipeline.reset();
+  ::close(impl_->fd);
+}
+
+uint64_t AsyncFileSource::Read(void* data, uint64_t size) {
+  auto& impl = *impl_;
+  auto* out = static_cast<uint8_t*>(data);
+  uint64_t total = 0;
+  while (total < size && impl.used[impl.current]) {
+    const auto& request = impl.pipeline->WaitFor(impl.current);
+    const auto count =
+        std::min<uint64_t>(size - total, request.done - impl.pos);
+    std::copy_n(request.data + impl.pos, count, out + total);
+    impl.pos += static_cast<size_t>(count);
+    total += count;
+    if (impl.pos == request.done) {
+      impl.ReadAhead(impl.current);
+      impl.current = (impl.current + 1) % impl.pipeline->Count();
+      impl.pos = 0;
+    }
+  }
+
+  return total;
+}
+
+const char* AsyncFileSource::Backend() const {
+  return impl_->pipeline->Backend();
+}
+
+#endif
@@ -0,0 +1,72 @@
+#pragma once
+#include <filesystem>
+#include <memory>
+#include "buffered_io.h"
+
+/// Asynchronous file I/O used by file overloads of Save and Load
+/// Several large aligned buffers are kept in flight, so encoding of next
+/// buffer overlaps with I/O of previous ones. Linux io_uring is used where
+/// kernel provides it, otherwise positional reads and writes are made by
+/// background thread.
+/// @note not a part of public interface
+namespace jbkv::io {
+
+struct AsyncFileOptions {
+  /// size of every buffer, multiple of 4096
+  size_t buffer_size = 1 << 20;
+  /// number of buffers
+  size_t buffers = 4;
+  /// bypasses page cache (O_DIRECT) where file system supports it
+  bool direct = false;
+  /// false forces thread backend
+  bool io_uring = true;
+};
+
+/// Writes file atomically: bytes are written to a file of unique name next
+/// to path, and file replaces path only on Commit after its contents are
+/// synced to storage, so path holds either previous or new complete file,
+/// even if several sinks write to path at once
+class AsyncFileSink final : public Sink {
+ public:
+  /// @throw std::runtime_error if file cannot be created
+  explicit AsyncFileSink(const std::filesystem::path& path,
+                         const AsyncFileOptions& options = {});
+  /// Waits for pending writes and removes file unless it is committed
+  ~AsyncFileSink() override;
+
+  /// @throw std::runtime_error if previous write failed
+  void Write(const std::vector<ByteSpan>& parts) override;
+
+  /// Writes remaining bytes, syncs file and renames it over path
+  /// @throw std::runtime_error if any write failed or if rename cannot be
+  /// made durable
+  void Commit();
+
+  /// @return name of I/O backend
+  const char* Backend() const;
+
+ private:
+  struct Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+/// Reads file sequentially, buffers ahead of current one are read in
+/// background
+class AsyncFileSource final : public Source {
+ public:
+  /// @throw std::runtime_error if file cannot be opened
+  explicit AsyncFileSource(const std::filesystem::path& path,
+                           const AsyncFileOptions& options = {});
+  /// Waits for pending reads
+  ~AsyncFileSource() override;
+
+  uint64_t Read(void* data, uint64_t size) override;
+
+  /// @return name of I/O backend
+  const char* Backend() const;
+
+ private:
+  struct Impl;
+  std::unique_ptr<Impl> impl_;
+};
+}  // namespace jbkv::io
@@ -0,0 +1,133 @@
+#include "async_mutex.h"
+#include <utility>
+
+using namespace jbkv;
+
+void AsyncSharedMutex::Wait(bool exclusive) {
+  Waiter waiter(exclusive);
+  if (Enqueue(waiter)) {
+    return;
+  }
+
+  std::unique_lock lock(waiter.mutex);
+  waiter.granted_cv.wait(lock, [&waiter]() {
+    return waiter.granted;
+  });
+}
+
+bool AsyncSharedMutex::Enqueue(Waiter& waiter) {
+  Waiter* granted = nullptr;
+  {
+    std::lock_guard lock(queue_mutex_);
+    if (!head_ &&
+        (waiter.exclusive ? TryAcquire() : TryAcquireShared())) {
+      return true;
+    }
+
+    if (tail_) {
+      tail_->next = &waiter;
+    } else {
+      head_ = &waiter;
+    }
+
+    tail_ = &waiter;
+    state_.fetch_or(kWaiters, std::memory_order_relaxed);
+    /// holders may have released lock before they could see waiters
+    granted = Grant();
+  }
+
+  return Wake(granted, &waiter);
+}
+
+void AsyncSharedMutex::Release(uint64_t held) {
+  Waiter* granted = nullptr;
+  {
+    std::lock_guard lock(queue_mutex_);
+    if (held) {
+      state_.fetch_and(~held, std::memory_order_release);
+    }
+
+    granted = Grant();
+  }
+
+  Wake(granted, nullptr);
+}
+
+AsyncSharedMutex::Waiter* AsyncSharedMutex::Grant() {
+  Waiter* granted = nullptr;
+  Waiter** granted_tail = &granted;
+  auto state = state_.load(std::memory_order_relaxed);
+  while (head_) {
+    const bool exclusive = head_->exclusive;
+    if (state & (exclusive ? kWriter | kReaders : kWriter)) {
+      break;
+    }
+
+    const auto acquired = exclusive ? state | kWriter : state + 1;
+    if (!state_.compare_exchange_weak(state, acquired,
+                                      std::memory_order_acq_rel,
+                                      std::memory_order_relaxed)) {
+      continue;
+    }
+
+    state = acquired;
+    auto* waiter = head_;
+    head_ = waiter->next;
+    waiter->next = nullptr;
+    *granted_tail = waiter;
+    granted_tail = &waiter->next;
+  }
+
+  if (!head_) {
+    tail_ = nullptr;
+    state_.fetch_and(~kWaiters, std::memory_order_relaxed);
+  }
+
+  return granted;
+}
+
+bool AsyncSharedMutex::Wake(Waiter* granted, const Waiter* self) {
+  bool self_granted = false;
+  while (granted) {
+    /// resumed waiter may be destroyed right away
+    auto* waiter = granted;
+    granted = waiter->next;
+    if (waiter == self) {
+      self_granted = true;
+    } else if (waiter->handle) {
+      if (!waiter->exclusive || RevokeFor(*waiter)) {
+        waiter->executor->Schedule(waiter->handle);
+      }
+    } else {
+      std::lock_guard lock(waiter->mutex);
+      waiter->granted = true;
+      waiter->granted_cv.notify_one();
+    }
+  }
+
+  return self_granted;
+}
+
+bool AsyncSharedMutex::RevokeFor(Waiter& waiter) {
+  std::lock_guard lock(queue_mutex_);
+  if (bias_.TryRevoke()) {
+    return true;
+  }
+
+  revoking_ = &waiter;
+  return false;
+}
+
+void AsyncSharedMutex::ResumeRevoking() {
+  Waiter* waiter = nullptr;
+  {
+    std::lock_guard lock(queue_mutex_);
+    if (!revoking_ || !bias_.TryRevoke()) {
+      return;
+    }
+
+    waiter = std::exchange(revoking_, nullptr);
+  }
+
+  waiter->executor->Schedule(waiter->handle);
+}
@@ -0,0 +1,252 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <mutex>
+#include <shared_mutex>
+#include "async.h"
+#include "noncopyable.h"
+#include "reader_bias.h"
+
+/// Shared mutex acquired either by blocking or by suspending coroutine
+/// @note not a part of public interface
+namespace jbkv {
+
+/// Shared mutex whose waiters are queued in FIFO order, so coroutine waits
+/// for contended lock suspended and is resumed on its executor once lock is
+/// granted to it, while blocking callers wait on their own threads
+/// Uncontended lock and unlock take single atomic operation. Meets
+/// requirements of SharedMutex, so it is used by std::shared_lock and
+/// std::lock_guard. Blocking readers take it by ReaderBias when it is
+/// enabled at build time.
+class AsyncSharedMutex : NonCopyableNonMovable {
+ public:
+  void lock() {
+    if (!TryAcquire()) {
+      Wait(true);
+    }
+
+    bias_.Revoke();
+  }
+
+  bool try_lock() {
+    if (!TryAcquire()) {
+      return false;
+    }
+
+    if (!bias_.Revoke(false)) {
+      unlock();
+      return false;
+    }
+
+    return true;
+  }
+
+  void unlock() {
+    uint64_t expected = kWriter;
+    if (!state_.compare_exchange_strong(expected, 0, std::memory_order_release,
+                                        std::memory_order_relaxed)) {
+      Release(kWriter);
+    }
+  }
+
+  void lock_shared() {
+    if (bias_.TryLockShared()) {
+      return;
+    }
+
+    /// slot may be taken and released while writer drains
+    if (bias_.Draining()) {
+      ResumeRevoking();
+    }
+
+    if (!TryAcquireShared()) {
+      Wait(false);
+    }
+
+    bias_.Restore();
+  }
+
+  bool try_lock_shared() {
+    if (bias_.TryLockShared()) {
+      return true;
+    }
+
+    if (bias_.Draining()) {
+      ResumeRevoking();
+    }
+
+    if (!TryAcquireShared()) {
+      return false;
+    }
+
+    bias_.Restore();
+    return true;
+  }
+
+  void unlock_shared() {
+    if (bias_.UnlockShared()) {
+      if (bias_.Draining()) {
+        ResumeRevoking();
+      }
+
+      return;
+    }
+
+    const auto state = state_.fetch_sub(1, std::memory_order_release) - 1;
+    if ((state & kWaiters) && !(state & kReaders)) {
+      Release(0);
+    }
+  }
+
+  /// @return awaitable resuming coroutine on executor once lock is held,
+  /// which yields std::unique_lock
+  auto LockAsync(Executor& executor) {
+    return Awaiter<true>{*this, executor};
+  }
+
+  /// @return awaitable resuming coroutine on executor once shared lock is
+  /// held, which yields std::shared_lock
+  auto LockSharedAsync(Executor& executor) {
+    return Awaiter<false>{*this, executor};
+  }
+
+ private:
+  static constexpr uint64_t kWriter = uint64_t(1) << 63;
+  /// set while queue of waiters is not empty, so new lockers join queue
+  static constexpr uint64_t kWaiters = uint64_t(1) << 62;
+  static constexpr uint64_t kReaders = kWaiters - 1;
+
+  struct Waiter {
+    explicit Waiter(bool exclusive)
+        : exclusive(exclusive) {
+    }
+
+    const bool exclusive;
+    Waiter* next = nullptr;
+    /// suspended coroutine, or blocked thread if handle is empty
+    std::coroutine_handle<> handle;
+    Executor* executor = nullptr;
+    std::mutex mutex;
+    std::condition_variable granted_cv;
+    bool granted = false;
+  };
+
+  template <bool Exclusive>
+  class Awaiter {
+   public:
+    Awaiter(AsyncSharedMutex& mutex, Executor& executor)
+        : mutex_(mutex),
+          executor_(executor),
+          waiter_(Exclusive) {
+    }
+
+    /// shared lock is not taken by reader bias, since coroutine may
+    /// release it on other thread
+    bool await_ready() {
+      if constexpr (Exclusive) {
+        held_ = mutex_.TryAcquire();
+        return held_ && mutex_.bias_.TryRevoke();
+      } else {
+        return mutex_.TryAcquireShared();
+      }
+    }
+
+    /// Writer holding lock stays suspended while readers hold it by bias,
+    /// so thread of executor does not wait for them
+    bool await_suspend(std::coroutine_handle<> handle) {
+      waiter_.handle = handle;
+      waiter_.executor = &executor_;
+      /// once waiter is queued, coroutine may be resumed by other thread
+      if (!held_ && !mutex_.Enqueue(waiter_)) {
+        return true;
+      }
+
+      return Exclusive && !mutex_.RevokeFor(waiter_);
+    }
+
+    auto await_resume() {
+      if constexpr (Exclusive) {
+        return std::unique_lock(mutex_, std::adopt_lock);
+      } else {
+        return std::shared_lock(mutex_, std::adopt_lock);
+      }
+    }
+
+   private:
+    AsyncSharedMutex& mutex_;
+    Executor& executor_;
+    Waiter waiter_;
+    /// lock is acquired by await_ready
+    bool held_ = false;
+  };
+
+ private:
+  /// Acquires lock by state alone
+  /// @{
+  bool TryAcquire() {
+    uint64_t expected = 0;
+    return state_.compare_exchange_strong(expected, kWriter,
+                                          std::memory_order_acquire,
+                                          std::memory_order_relaxed);
+  }
+
+  bool TryAcquireShared() {
+    auto state = state_.load(std::memory_order_relaxed);
+    while (!(state & (kWriter | kWaiters))) {
+      if (state_.compare_exchange_weak(state, state + 1,
+                                       std::memory_order_acquire,
+                                       std::memory_order_relaxed)) {
+        return true;
+      }
+    }
+
+    return false;
+  }
+  /// @}
+
+  /// Blocks calling thread until lock is granted
+  void Wait(bool exclusive);
+
+  /// Acquires lock for waiter right away or queues it
+  /// @return true if lock is acquired, otherwise waiter is granted lock and
+  /// resumed later
+  bool Enqueue(Waiter& waiter);
+
+  /// Releases held bits and grants lock to waiters
+  void Release(uint64_t held);
+
+  /// Grants lock to waiters at the head of queue while they are compatible
+  /// with holders
+  /// @return list of granted waiters
+  /// @note called under queue mutex
+  Waiter* Grant();
+
+  /// Resumes granted waiters except self, writer coroutines once reader
+  /// bias is revoked
+  /// @return true if self is granted
+  bool Wake(Waiter* granted, const Waiter* self);
+
+  /// Revokes reader bias for writer coroutine holding lock
+  /// @return true if no reader holds lock by bias, otherwise waiter is
+  /// resumed once the last of them releases it
+  bool RevokeFor(Waiter& waiter);
+
+  /// Resumes writer coroutine waiting for revocation if readers which took
+  /// lock by bias are gone
+  /// @note called by reader which released slot while bias is drained
+  void ResumeRevoking();
+
+ private:
+  std::atomic<uint64_t> state_ = 0;
+  [[no_unique_address]] ReaderBias bias_;
+
+  std::mutex queue_mutex_;
+  Waiter* head_ = nullptr;
+  Waiter* tail_ = nullptr;
+  /// writer coroutine holding lock while bias is drained
+  Waiter* revoking_ = nullptr;
+};
+
+}  // namespace jbkv
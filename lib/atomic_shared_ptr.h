@@ -0,0 +1,65 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <version>
+#include "noncopyable.h"
+
+namespace jbkv {
+
+/// Shared pointer which can be loaded and published concurrently
+/// Load writes reference count and may take internal lock of standard
+/// library, so loads of different threads contend on cache line of pointer;
+/// hot read paths read raw pointers under EpochGuard instead
+/// @note falls back to std::atomic_* free functions for standard libraries
+/// without std::atomic<std::shared_ptr> support
+template <typename T>
+class AtomicSharedPtr : NonCopyableNonMovable {
+ public:
+  using Ptr = std::shared_ptr<T>;
+
+ public:
+  AtomicSharedPtr() = default;
+
+  explicit AtomicSharedPtr(Ptr ptr)
+      : ptr_(std::move(ptr)) {
+  }
+
+  Ptr Load() const {
+#if defined(__cpp_lib_atomic_shared_ptr)
+    return ptr_.load(std::memory_order_acquire);
+#else
+    return std::atomic_load_explicit(&ptr_, std::memory_order_acquire);
+#endif
+  }
+
+  void Store(Ptr ptr) {
+#if defined(__cpp_lib_atomic_shared_ptr)
+    ptr_.store(std::move(ptr), std::memory_order_release);
+#else
+    std::atomic_store_explicit(&ptr_, std::move(ptr),
+                               std::memory_order_release);
+#endif
+  }
+
+  /// @return true if pointer was replaced with desired, otherwise false and
+  /// expected is updated to current value
+  bool CompareExchange(Ptr& expected, Ptr desired) {
+#if defined(__cpp_lib_atomic_shared_ptr)
+    return ptr_.compare_exchange_weak(expected, std::move(desired),
+                                      std::memory_order_acq_rel,
+                                      std::memory_order_acquire);
+#else
+    return std::atomic_compare_exchange_weak_explicit(
+        &ptr_, &expected, std::move(desired), std::memory_order_acq_rel,
+        std::memory_order_acquire);
+#endif
+  }
+
+ private:
+#if defined(__cpp_lib_atomic_shared_ptr)
+  std::atomic<Ptr> ptr_;
+#else
+  Ptr ptr_;
+#endif
+};
+}  // namespace jbkv
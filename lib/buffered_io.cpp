@@ -0,0 +1,299 @@
+#include "buffered_io.h"
+#include "crc32c.h"
+#include <algorithm>
+#include <cerrno>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+using namespace jbkv::io;
+
+namespace {
+
+/// Upper bound of parts in single vectored write, guaranteed by POSIX
+constexpr size_t kMaxParts = 16;
+
+std::streamsize ConvertSize(uint64_t size) {
+  if constexpr (sizeof(std::streamsize) < sizeof(size)) {
+    const uint64_t native_max = std::numeric_limits<std::streamsize>::max();
+    if (size > native_max) {
+      throw std::runtime_error("Size is too big");
+    }
+  }
+
+  return static_cast<std::streamsize>(size);
+}
+
+}  // namespace
+
+void StreamSink::Write(const std::vector<ByteSpan>& parts) {
+  for (const auto& part : parts) {
+    if (!stream_.write(static_cast<const char*>(part.data),
+                       ConvertSize(part.size))) {
+      throw std::runtime_error("Bad stream");
+    }
+  }
+}
+
+uint64_t StreamSource::Read(void* data, uint64_t size) {
+  stream_.read(static_cast<char*>(data), ConvertSize(size));
+  if (stream_.bad()) {
+    throw std::runtime_error("Bad stream");
+  }
+
+  return static_cast<uint64_t>(stream_.gcount());
+}
+
+#if defined(_WIN32)
+
+struct FileSink::Impl {
+  std::ofstream stream;
+  std::unique_ptr<StreamSink> sink;
+};
+
+FileSink::FileSink(const std::filesystem::path& path)
+    : impl_(std::make_unique<Impl>()) {
+  impl_->stream.open(path, std::ios_base::binary);
+  if (!impl_->stream.is_open()) {
+    throw std::runtime_error("Cannot open file for writing: " + path.string());
+  }
+
+  impl_->sink = std::make_unique<StreamSink>(impl_->stream);
+}
+
+FileSink::~FileSink() = default;
+
+void FileSink::Write(const std::vector<ByteSpan>& parts) {
+  impl_->sink->Write(parts);
+}
+
+struct FileSource::Impl {
+  std::ifstream stream;
+  std::unique_ptr<StreamSource> source;
+};
+
+FileSource::FileSource(const std::filesystem::path& path)
+    : impl_(std::make_unique<Impl>()) {
+  impl_->stream.open(path, std::ios_base::binary);
+  if (!impl_->stream.is_open()) {
+    throw std::runtime_error("Cannot open file for reading: " + path.string());
+  }
+
+  impl_->source = std::make_unique<StreamSource>(impl_->stream);
+}
+
+FileSource::~FileSource() = default;
+
+uint64_t FileSource::Read(void* data, uint64_t size) {
+  return impl_->source->Read(data, size);
+}
+
+#else
+
+struct FileSink::Impl {
+  int fd = -1;
+  std::vector<iovec> iov;
+};
+
+FileSink::FileSink(const std::filesystem::path& path)
+    : impl_(std::make_unique<Impl>()) {
+  impl_->fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                     0644);
+  if (impl_->fd < 0) {
+    throw std::runtime_error("Cannot open file for writing: " + path.string());
+  }
+}
+
+FileSink::~FileSink() {
+  ::close(impl_->fd);
+}
+
+void FileSink::Write(const std::vector<ByteSpan>& parts) {
+  auto& iov = impl_->iov;
+  iov.clear();
+  for (const auto& part : parts) {
+    if (part.size > 0) {
+      iov.push_back({const_cast<void*>(part.data),
+                     static_cast<size_t>(part.size)});
+    }
+  }
+
+  size_t first = 0;
+  while (first < iov.size()) {
+    const auto count = std::min<size_t>(iov.size() - first, kMaxParts);
+    const auto written =
+        ::writev(impl_->fd, iov.data() + first, static_cast<int>(count));
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      throw std::runtime_error("Cannot write file");
+    }
+
+    // Skip fully written parts and advance partially written one
+    auto rest = static_cast<size_t>(written);
+    while (first < iov.size() && rest >= iov[first].iov_len) {
+      rest -= iov[first++].iov_len;
+    }
+
+    if (rest > 0) {
+      iov[first].iov_base = static_cast<char*>(iov[first].iov_base) + rest;
+      iov[first].iov_len -= rest;
+    }
+  }
+}
+
+struct FileSource::Impl {
+  int fd = -1;
+  uint64_t offset = 0;
+};
+
+FileSource::FileSource(const std::filesystem::path& path)
+    : impl_(std::make_unique<Impl>()) {
+  impl_->fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (impl_->fd < 0) {
+    throw std::runtime_error("Cannot open file for reading: " + path.string());
+  }
+}
+
+FileSource::~FileSource() {
+  ::close(impl_->fd);
+}
+
+uint64_t FileSource::Read(void* data, uint64_t size) {
+  auto* bytes = static_cast<uint8_t*>(data);
+  uint64_t total = 0;
+  while (total < size) {
+    const auto chunk = std::min<uint64_t>(
+        size - total, std::numeric_limits<int32_t>::max());
+    const auto read = ::pread(impl_->fd, bytes + total,
+                              static_cast<size_t>(chunk),
+                              static_cast<off_t>(impl_->offset));
+    if (read < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      throw std::runtime_error("Cannot read file");
+    }
+
+    if (read == 0) {
+      break;
+    }
+
+    total += static_cast<uint64_t>(read);
+    impl_->offset += static_cast<uint64_t>(read);
+  }
+
+  return total;
+}
+
+#endif
+
+uint32_t MemoryWriter::Crc() const {
+  return Crc32c(0, buffer_.data() + crc_start_, buffer_.size() - crc_start_);
+}
+
+BufferedWriter::BufferedWriter(Sink& sink, size_t capacity)
+    : sink_(sink),
+      capacity_(capacity) {
+  buffer_.reserve(capacity_);
+}
+
+void BufferedWriter::Flush() {
+  if (buffer_.empty()) {
+    return;
+  }
+
+  UpdateCrc();
+  parts_.assign({{buffer_.data(), buffer_.size()}});
+  sink_.Write(parts_);
+  buffer_.clear();
+}
+
+uint32_t BufferedWriter::Crc() const {
+  return Crc32c(crc_, buffer_.data() + crc_start_,
+                buffer_.size() - crc_start_);
+}
+
+void BufferedWriter::WriteSlow(const void* data, uint64_t size) {
+  if (size < capacity_ / 2) {
+    Flush();
+    const auto* bytes = static_cast<const uint8_t*>(data);
+    buffer_.insert(buffer_.end(), bytes, bytes + size);
+  } else {
+    UpdateCrc();
+    if (crc_active_) {
+      crc_ = Crc32c(crc_, data, static_cast<size_t>(size));
+    }
+
+    parts_.assign({{buffer_.data(), buffer_.size()}, {data, size}});
+    sink_.Write(parts_);
+    buffer_.clear();
+  }
+
+  written_ += size;
+}
+
+void BufferedWriter::UpdateCrc() {
+  if (crc_active_) {
+    crc_ = Crc();
+  }
+
+  crc_start_ = 0;
+}
+
+BufferedReader::BufferedReader(Source& source, size_t capacity)
+    : source_(source),
+      buffer_(capacity) {
+}
+
+uint32_t BufferedReader::Crc() const {
+  return Crc32c(crc_, buffer_.data() + crc_start_, pos_ - crc_start_);
+}
+
+void BufferedReader::ReadSlow(void* data, uint64_t size) {
+  auto* bytes = static_cast<uint8_t*>(data);
+  const auto available = size_ - pos_;
+  std::copy_n(buffer_.data() + pos_, available, bytes);
+  bytes += available;
+  size -= available;
+  pos_ = size_;
+  if (crc_active_) {
+    crc_ = Crc();
+  }
+
+  pos_ = size_ = crc_start_ = 0;
+
+  if (size >= buffer_.size()) {
+    if (source_.Read(bytes, size) != size) {
+      throw std::runtime_error("Data truncated");
+    }
+
+    if (crc_active_) {
+      crc_ = Crc32c(crc_, bytes, static_cast<size_t>(size));
+    }
+
+    return;
+  }
+
+  while (size_ < size) {
+    const auto read =
+        source_.Read(buffer_.data() + size_, buffer_.size() - size_);
+    if (read == 0) {
+      throw std::runtime_error("Data truncated");
+    }
+
+    size_ += static_cast<size_t>(read);
+  }
+
+  std::copy_n(buffer_.data(), size, bytes);
+  pos_ = static_cast<size_t>(size);
+}
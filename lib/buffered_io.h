@@ -0,0 +1,241 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <vector>
+#include "noncopyable.h"
+
+/// Buffered binary I/O used by volume serialization
+/// @note not a part of public interface
+namespace jbkv::io {
+
+struct ByteSpan {
+  const void* data = nullptr;
+  uint64_t size = 0;
+};
+
+/// Destination of bytes
+class Sink : NonCopyableNonMovable {
+ public:
+  virtual ~Sink() = default;
+
+  /// Writes parts sequentially, as single vectored write if possible
+  virtual void Write(const std::vector<ByteSpan>& parts) = 0;
+};
+
+/// Source of bytes
+class Source : NonCopyableNonMovable {
+ public:
+  virtual ~Source() = default;
+
+  /// @return number of bytes read, less than size only at the end of data
+  virtual uint64_t Read(void* data, uint64_t size) = 0;
+};
+
+class StreamSink final : public Sink {
+ public:
+  explicit StreamSink(std::ostream& stream)
+      : stream_(stream) {
+  }
+
+  void Write(const std::vector<ByteSpan>& parts) override;
+
+ private:
+  std::ostream& stream_;
+};
+
+class StreamSource final : public Source {
+ public:
+  explicit StreamSource(std::istream& stream)
+      : stream_(stream) {
+  }
+
+  uint64_t Read(void* data, uint64_t size) override;
+
+ private:
+  std::istream& stream_;
+};
+
+/// Writes file with vectored writes (writev) where available
+class FileSink final : public Sink {
+ public:
+  /// @throw std::runtime_error if file cannot be opened
+  explicit FileSink(const std::filesystem::path& path);
+  ~FileSink() override;
+
+  void Write(const std::vector<ByteSpan>& parts) override;
+
+ private:
+  struct Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+/// Reads file with positional reads (pread) where available
+class FileSource final : public Source {
+ public:
+  /// @throw std::runtime_error if file cannot be opened
+  explicit FileSource(const std::filesystem::path& path);
+  ~FileSource() override;
+
+  uint64_t Read(void* data, uint64_t size) override;
+
+ private:
+  struct Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+/// Accumulates all writes in memory
+class MemoryWriter {
+ public:
+  void Write(const void* data, uint64_t size) {
+    const auto* bytes = static_cast<const uint8_t*>(data);
+    buffer_.insert(buffer_.end(), bytes, bytes + size);
+  }
+
+  uint64_t Offset() const {
+    return buffer_.size();
+  }
+
+  ByteSpan Data() const {
+    return {buffer_.data(), buffer_.size()};
+  }
+
+  void Clear() {
+    buffer_.clear();
+    crc_start_ = 0;
+  }
+
+  /// Checksum of bytes written after StartCrc, computed at once by Crc
+  /// @{
+  void StartCrc() {
+    crc_start_ = buffer_.size();
+  }
+
+  uint32_t Crc() const;
+
+  void StopCrc() {
+  }
+  /// @}
+
+ private:
+  std::vector<uint8_t> buffer_;
+  size_t crc_start_ = 0;
+};
+
+/// Accumulates small writes in large contiguous buffer
+/// Payloads larger than half of buffer bypass it and are written together
+/// with buffered bytes by single vectored write
+class BufferedWriter : NonCopyableNonMovable {
+ public:
+  static constexpr size_t kDefaultCapacity = 1 << 20;
+
+ public:
+  explicit BufferedWriter(Sink& sink, size_t capacity = kDefaultCapacity);
+
+  void Write(const void* data, uint64_t size) {
+    if (size <= capacity_ - buffer_.size()) {
+      const auto* bytes = static_cast<const uint8_t*>(data);
+      buffer_.insert(buffer_.end(), bytes, bytes + size);
+      written_ += size;
+      return;
+    }
+
+    WriteSlow(data, size);
+  }
+
+  /// @return number of bytes written so far
+  uint64_t Offset() const {
+    return written_;
+  }
+
+  /// Passes buffered bytes to sink
+  void Flush();
+
+  /// Checksum of bytes written between StartCrc and StopCrc
+  /// Buffered bytes are checksummed by single call when they leave buffer
+  /// or when Crc is called, not by every write; checksums do not nest
+  /// @{
+  void StartCrc() {
+    crc_ = 0;
+    crc_start_ = buffer_.size();
+    crc_active_ = true;
+  }
+
+  /// @return CRC-32C of bytes written since StartCrc
+  uint32_t Crc() const;
+
+  void StopCrc() {
+    crc_active_ = false;
+  }
+  /// @}
+
+ private:
+  void WriteSlow(const void* data, uint64_t size);
+  /// Adds bytes buffered since start of checksum to it
+  void UpdateCrc();
+
+ private:
+  Sink& sink_;
+  const size_t capacity_;
+  std::vector<uint8_t> buffer_;
+  std::vector<ByteSpan> parts_;
+  uint64_t written_ = 0;
+  uint32_t crc_ = 0;
+  size_t crc_start_ = 0;
+  bool crc_active_ = false;
+};
+
+/// Reads source by large blocks
+/// Reads larger than buffer bypass it
+class BufferedReader : NonCopyableNonMovable {
+ public:
+  static constexpr size_t kDefaultCapacity = 1 << 20;
+
+ public:
+  explicit BufferedReader(Source& source, size_t capacity = kDefaultCapacity);
+
+  /// @throw std::runtime_error if data ends before size bytes are read
+  void Read(void* data, uint64_t size) {
+    if (size <= size_ - pos_) {
+      std::copy_n(buffer_.data() + pos_, size, static_cast<uint8_t*>(data));
+      pos_ += size;
+      return;
+    }
+
+    ReadSlow(data, size);
+  }
+
+  /// Checksum of bytes read between StartCrc and StopCrc
+  /// Buffered bytes are checksummed by single call when block is consumed
+  /// or when Crc is called, not by every read; checksums do not nest
+  /// @{
+  void StartCrc() {
+    crc_ = 0;
+    crc_start_ = pos_;
+    crc_active_ = true;
+  }
+
+  /// @return CRC-32C of bytes read since StartCrc
+  uint32_t Crc() const;
+
+  void StopCrc() {
+    crc_active_ = false;
+  }
+  /// @}
+
+ private:
+  void ReadSlow(void* data, uint64_t size);
+
+ private:
+  Source& source_;
+  std::vector<uint8_t> buffer_;
+  size_t size_ = 0;
+  size_t pos_ = 0;
+  uint32_t crc_ = 0;
+  size_t crc_start_ = 0;
+  bool crc_active_ = false;
+};
+}  // namespace jbkv::io
@@ -0,0 +1,302 @@
+#include "codec.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace jbkv;
+
+namespace {
+constexpr auto kCorrupted = "Compressed data corrupted";
+
+/// Compressed block is a sequence of:
+/// - token: high nibble is number of literals, low nibble is length of match
+///   minus kMinMatch, value 15 of nibble is continued by bytes of length
+///   extension, each of them is added to length until byte is not 255
+/// - literals
+/// - 16-bit little-endian offset of match back from current position and
+///   extension of match length
+/// Last sequence has no match and ends the block
+class LzCodecImpl final : public Codec {
+ public:
+  static constexpr uint8_t kId = 1;
+
+ public:
+  uint8_t Id() const override {
+    return kId;
+  }
+
+  size_t CompressBound(size_t size) const override {
+    return size + size / 255 + 16;
+  }
+
+  size_t Compress(const uint8_t* src, size_t size,
+                  uint8_t* dst) const override;
+
+  void Decompress(const uint8_t* src, size_t size, uint8_t* dst,
+                  size_t raw_size) const override;
+
+ private:
+  static constexpr size_t kMinMatch = 4;
+  static constexpr size_t kMaxOffset = 0xFFFF;
+  static constexpr int kHashBits = 14;
+  /// last bytes of block are always literals, so matching reads whole words
+  static constexpr size_t kTailSize = 8;
+  /// every 32 missed positions in a row increase step of search by one
+  static constexpr int kSkipShift = 5;
+  static constexpr uint8_t kNibbleMax = 15;
+
+ private:
+  static uint32_t Load32(const uint8_t* data) {
+    uint32_t result = 0;
+    std::memcpy(&result, data, sizeof(result));
+    return result;
+  }
+
+  static uint64_t Load64(const uint8_t* data) {
+    uint64_t result = 0;
+    std::memcpy(&result, data, sizeof(result));
+    return result;
+  }
+
+  static uint32_t Hash(uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - kHashBits);
+  }
+
+  /// @return number of equal leading bytes in memory order
+  static size_t CommonBytes(uint64_t diff) {
+    if constexpr (std::endian::native == std::endian::little) {
+      return static_cast<size_t>(std::countr_zero(diff)) / 8;
+    } else {
+      return static_cast<size_t>(std::countl_zero(diff)) / 8;
+    }
+  }
+
+  /// @return end of match extended from given position up to limit
+  static const uint8_t* MatchEnd(const uint8_t* pos, const uint8_t* ref,
+                                 const uint8_t* limit) {
+    for (; pos + sizeof(uint64_t) <= limit;
+         pos += sizeof(uint64_t), ref += sizeof(uint64_t)) {
+      const auto diff = Load64(pos) ^ Load64(ref);
+      if (diff != 0) {
+        return pos + CommonBytes(diff);
+      }
+    }
+
+    for (; pos < limit && *pos == *ref; ++pos, ++ref) {
+    }
+
+    return pos;
+  }
+
+  static uint8_t* WriteLength(uint8_t* out, size_t length) {
+    for (; length >= 255; length -= 255) {
+      *out++ = 255;
+    }
+
+    *out++ = static_cast<uint8_t>(length);
+    return out;
+  }
+
+  static size_t ReadLength(const uint8_t*& in, const uint8_t* end) {
+    size_t length = 0;
+    uint8_t byte = 255;
+    while (byte == 255) {
+      if (in == end) {
+        throw std::runtime_error(kCorrupted);
+      }
+
+      byte = *in++;
+      length += byte;
+    }
+
+    return length;
+  }
+
+  static uint8_t* WriteLiterals(uint8_t* out, const uint8_t* literals,
+                                size_t size, uint8_t match_nibble) {
+    const auto nibble = static_cast<uint8_t>(std::min<size_t>(size, kNibbleMax));
+    *out++ = static_cast<uint8_t>(nibble << 4 | match_nibble);
+    if (nibble == kNibbleMax) {
+      out = WriteLength(out, size - kNibbleMax);
+    }
+
+    std::memcpy(out, literals, size);
+    return out + size;
+  }
+};
+
+size_t LzCodecImpl::Compress(const uint8_t* src, size_t size,
+                             uint8_t* dst) const {
+  auto* out = dst;
+  const auto* anchor = src;
+  if (size > kTailSize + kMinMatch) {
+    std::vector<uint32_t> table(size_t(1) << kHashBits, 0);
+    const auto* const match_limit = src + size - kTailSize;
+    const auto* ip = src;
+    size_t misses = 0;
+    while (ip + kMinMatch <= match_limit) {
+      const auto sequence = Load32(ip);
+      auto& slot = table[Hash(sequence)];
+      const auto* ref = src + slot;
+      slot = static_cast<uint32_t>(ip - src);
+      if (ref >= ip || static_cast<size_t>(ip - ref) > kMaxOffset ||
+          Load32(ref) != sequence) {
+        ip += 1 + (misses++ >> kSkipShift);
+        continue;
+      }
+
+      while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+        --ip;
+        --ref;
+      }
+
+      const auto offset = static_cast<size_t>(ip - ref);
+      const auto* end =
+          MatchEnd(ip + kMinMatch, ref + kMinMatch, match_limit);
+      const auto match_size = static_cast<size_t>(end - ip) - kMinMatch;
+      out = WriteLiterals(out, anchor, static_cast<size_t>(ip - anchor),
+                          static_cast<uint8_t>(std::min<size_t>(
+                              match_size, kNibbleMax)));
+      *out++ = static_cast<uint8_t>(offset & 0xFF);
+      *out++ = static_cast<uint8_t>(offset >> 8);
+      if (match_size >= kNibbleMax) {
+        out = WriteLength(out, match_size - kNibbleMax);
+      }
+
+      ip = anchor = end;
+      misses = 0;
+      /// position before end of match is likely to start another match
+      table[Hash(Load32(ip - 2))] = static_cast<uint32_t>(ip - 2 - src);
+    }
+  }
+
+  out = WriteLiterals(out, anchor, static_cast<size_t>(src + size - anchor),
+                      0);
+  return static_cast<size_t>(out - dst);
+}
+
+void LzCodecImpl::Decompress(const uint8_t* src, size_t size, uint8_t* dst,
+                             size_t raw_size) const {
+  const auto* in = src;
+  const auto* const in_end = src + size;
+  auto* out = dst;
+  auto* const out_end = dst + raw_size;
+  while (true) {
+    if (in == in_end) {
+      throw std::runtime_error(kCorrupted);
+    }
+
+    const auto token = *in++;
+    size_t literals = token >> 4;
+    if (literals == kNibbleMax) {
+      literals += ReadLength(in, in_end);
+    }
+
+    if (literals > static_cast<size_t>(in_end - in) ||
+        literals > static_cast<size_t>(out_end - out)) {
+      throw std::runtime_error(kCorrupted);
+    }
+
+    std::memcpy(out, in, literals);
+    in += literals;
+    out += literals;
+    if (in == in_end) {
+      break;
+    }
+
+    if (in_end - in < 2) {
+      throw std::runtime_error(kCorrupted);
+    }
+
+    const size_t offset = in[0] | size_t(in[1]) << 8;
+    in += 2;
+    size_t match = (token & kNibbleMax) + kMinMatch;
+    if ((token & kNibbleMax) == kNibbleMax) {
+      match += ReadLength(in, in_end);
+    }
+
+    if (offset == 0 || offset > static_cast<size_t>(out - dst) ||
+        match > static_cast<size_t>(out_end - out)) {
+      throw std::runtime_error(kCorrupted);
+    }
+
+    /// match overlaps output when offset is less than its length, which
+    /// repeats last offset bytes
+    const auto* ref = out - offset;
+    if (offset >= match) {
+      std::memcpy(out, ref, match);
+    } else if (offset == 1) {
+      std::memset(out, *ref, match);
+    } else {
+      for (size_t i = 0; i < match; ++i) {
+        out[i] = ref[i];
+      }
+    }
+
+    out += match;
+  }
+
+  if (out != out_end) {
+    throw std::runtime_error(kCorrupted);
+  }
+}
+
+/// Codecs by id
+class Registry {
+ public:
+  Registry() {
+    codecs_[LzCodec()->Id()] = LzCodec();
+  }
+
+  void Add(Codec::Ptr codec) {
+    std::lock_guard lock(mutex_);
+    auto& slot = codecs_[codec->Id()];
+    if (slot) {
+      throw std::runtime_error("Codec is already registered: " +
+                               std::to_string(codec->Id()));
+    }
+
+    slot = std::move(codec);
+  }
+
+  Codec::Ptr Find(uint8_t id) const {
+    std::lock_guard lock(mutex_);
+    if (!codecs_[id]) {
+      throw std::runtime_error("Unknown codec: " + std::to_string(id));
+    }
+
+    return codecs_[id];
+  }
+
+ private:
+  mutable std::mutex mutex_;
+  std::array<Codec::Ptr, 256> codecs_;
+};
+
+Registry& GetRegistry() {
+  static Registry registry;
+  return registry;
+}
+}  // namespace
+
+const Codec::Ptr& jbkv::LzCodec() {
+  static const Codec::Ptr codec = std::make_shared<const LzCodecImpl>();
+  return codec;
+}
+
+void jbkv::RegisterCodec(Codec::Ptr codec) {
+  if (!codec || codec->Id() == 0) {
+    throw std::runtime_error("Bad codec");
+  }
+
+  GetRegistry().Add(std::move(codec));
+}
+
+Codec::Ptr jbkv::FindCodec(uint8_t id) {
+  return GetRegistry().Find(id);
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace jbkv {
+
+/// Block compression algorithm of saved volumes
+/// Saved file records id of codec, so Load finds codec in registry
+class Codec {
+ public:
+  using Ptr = std::shared_ptr<const Codec>;
+
+ public:
+  virtual ~Codec() = default;
+
+  /// Identifies codec in saved files, zero is reserved
+  virtual uint8_t Id() const = 0;
+
+  /// @return upper bound of compressed size of block of given size
+  virtual size_t CompressBound(size_t size) const = 0;
+
+  /// @param dst has at least CompressBound(size) bytes
+  /// @return size of compressed block
+  virtual size_t Compress(const uint8_t* src, size_t size,
+                          uint8_t* dst) const = 0;
+
+  /// @param raw_size size of block before compression
+  /// @throw std::runtime_error if compressed block is corrupted
+  virtual void Decompress(const uint8_t* src, size_t size, uint8_t* dst,
+                          size_t raw_size) const = 0;
+};
+
+/// Built-in byte-oriented LZ77 codec
+/// Favours speed over ratio: greedy matching in 64 KiB window through hash
+/// table, literals and matches are not entropy-coded
+const Codec::Ptr& LzCodec();
+
+/// Makes codec available to Load, built-in codecs are registered already
+/// @throw std::runtime_error if another codec with the same id is registered
+void RegisterCodec(Codec::Ptr codec);
+
+/// @throw std::runtime_error if codec with given id is not registered
+Codec::Ptr FindCodec(uint8_t id);
+
+}  // namespace jbkv
@@ -0,0 +1,80 @@
+#include "compressed_io.h"
+
+using namespace jbkv;
+using namespace jbkv::io;
+
+CompressingSink::CompressingSink(Sink& sink, const Codec& codec,
+                                 uint32_t block_size)
+    : sink_(sink),
+      codec_(codec),
+      block_size_(block_size) {
+  if (block_size_ == 0) {
+    throw std::runtime_error("Bad block size");
+  }
+
+  block_.reserve(block_size_);
+  compressed_.resize(codec_.CompressBound(block_size_));
+
+  MemoryWriter header;
+  format::SerializeHeader(header, format::kCompressedMagic,
+                          format::kCompressedFormatVersion);
+  format::Serialize(codec_.Id(), header);
+  format::Serialize(block_size_, header);
+  sink_.Write({header.Data()});
+}
+
+void CompressingSink::Write(const std::vector<ByteSpan>& parts) {
+  for (const auto& part : parts) {
+    const auto* data = static_cast<const uint8_t*>(part.data);
+    auto size = part.size;
+    while (size > 0) {
+      const auto count = std::min<uint64_t>(size, block_size_ - block_.size());
+      block_.insert(block_.end(), data, data + count);
+      data += count;
+      size -= count;
+      if (block_.size() == block_size_) {
+        WriteBlock();
+      }
+    }
+  }
+}
+
+void CompressingSink::Finish() {
+  if (!block_.empty()) {
+    WriteBlock();
+  }
+
+  static const format::BlockHeader kEnd;
+  sink_.Write({{&kEnd, sizeof(kEnd)}});
+}
+
+void CompressingSink::WriteBlock() {
+  format::BlockHeader header;
+  header.raw_size = static_cast<uint32_t>(block_.size());
+  const auto compressed_size =
+      codec_.Compress(block_.data(), block_.size(), compressed_.data());
+
+  ByteSpan stored = {block_.data(), block_.size()};
+  if (compressed_size < block_.size()) {
+    stored = {compressed_.data(), compressed_size};
+  }
+
+  header.stored_size = static_cast<uint32_t>(stored.size);
+  header.crc = Crc32c(0, stored.data, stored.size);
+  sink_.Write({{&header, sizeof(header)}, stored});
+  block_.clear();
+}
+
+void jbkv::io::DecodeBlock(const Codec& codec,
+                           const format::BlockHeader& header,
+                           const uint8_t* stored, uint8_t* raw) {
+  if (Crc32c(0, stored, header.stored_size) != header.crc) {
+    throw std::runtime_error("Data corrupted");
+  }
+
+  if (header.stored_size == header.raw_size) {
+    std::copy_n(stored, header.raw_size, raw);
+  } else {
+    codec.Decompress(stored, header.stored_size, raw, header.raw_size);
+  }
+}
@@ -0,0 +1,106 @@
+#pragma once
+#include "buffered_io.h"
+#include "codec.h"
+#include "volume_format.h"
+
+/// Block compression of serialized volumes
+/// @note not a part of public interface
+namespace jbkv::io {
+
+/// Writes compressed file: splits bytes into blocks and compresses every
+/// block by codec, blocks which codec does not shrink are stored as is
+class CompressingSink final : public Sink {
+ public:
+  static constexpr uint32_t kDefaultBlockSize = 1 << 20;
+
+ public:
+  /// Writes header of compressed file
+  CompressingSink(Sink& sink, const Codec& codec,
+                  uint32_t block_size = kDefaultBlockSize);
+
+  void Write(const std::vector<ByteSpan>& parts) override;
+
+  /// Writes buffered bytes and closes file
+  void Finish();
+
+ private:
+  void WriteBlock();
+
+ private:
+  Sink& sink_;
+  const Codec& codec_;
+  const uint32_t block_size_;
+  std::vector<uint8_t> block_;
+  std::vector<uint8_t> compressed_;
+};
+
+/// Verifies and decodes stored bytes of block into raw_size bytes of raw
+/// @throw std::runtime_error if block is corrupted
+void DecodeBlock(const Codec& codec, const format::BlockHeader& header,
+                 const uint8_t* stored, uint8_t* raw);
+
+/// Reads contents of compressed file block by block
+/// @note reader is expected to be positioned after magic of file
+template <typename Reader>
+class DecompressingSource final : public Source {
+ public:
+  /// @throw std::runtime_error if codec of file is not registered
+  explicit DecompressingSource(Reader& in)
+      : in_(in) {
+    format::DeserializeVersion(in_, format::kCompressedFormatVersion);
+    uint8_t codec = 0;
+    format::Deserialize(codec, in_);
+    format::Deserialize(block_size_, in_);
+    codec_ = FindCodec(codec);
+  }
+
+  uint64_t Read(void* data, uint64_t size) override {
+    auto* out = static_cast<uint8_t*>(data);
+    uint64_t done = 0;
+    while (done < size && (pos_ < block_.size() || NextBlock())) {
+      const auto count = std::min<uint64_t>(size - done, block_.size() - pos_);
+      std::copy_n(block_.data() + pos_, count, out + done);
+      pos_ += count;
+      done += count;
+    }
+
+    return done;
+  }
+
+ private:
+  /// @return false at the end of file
+  bool NextBlock() {
+    if (finished_) {
+      return false;
+    }
+
+    format::BlockHeader header;
+    format::Deserialize(header, in_);
+    if (header.raw_size == 0) {
+      finished_ = true;
+      return false;
+    }
+
+    if (header.raw_size > block_size_ ||
+        header.stored_size > header.raw_size) {
+      throw std::runtime_error("Data corrupted");
+    }
+
+    stored_.resize(header.stored_size);
+    in_.Read(stored_.data(), stored_.size());
+    block_.resize(header.raw_size);
+    DecodeBlock(*codec_, header, stored_.data(), block_.data());
+    pos_ = 0;
+    return true;
+  }
+
+ private:
+  Reader& in_;
+  Codec::Ptr codec_;
+  uint32_t block_size_ = 0;
+  std::vector<uint8_t> stored_;
+  std::vector<uint8_t> block_;
+  size_t pos_ = 0;
+  bool finished_ = false;
+};
+}  // namespace jbkv::io
@@ -0,0 +1,166 @@
+#include "crc32c.h"
+#include <array>
+#include <bit>
+#include <cstring>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#include <nmmintrin.h>
+#define JBKV_CRC32C_X86
+#elif defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <nmmintrin.h>
+#define JBKV_CRC32C_X86
+#elif defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define JBKV_CRC32C_ARM
+#endif
+
+using namespace jbkv;
+
+namespace {
+
+/// Reflected Castagnoli polynomial
+constexpr uint32_t kPolynomial = 0x82F63B78;
+
+using Tables = std::array<std::array<uint32_t, 256>, 8>;
+
+constexpr Tables MakeTables() {
+  Tables tables = {};
+  for (uint32_t i = 0; i < 256; ++i) {
+    uint32_t crc = i;
+    for (int bit = 0; bit < 8; ++bit) {
+      crc = (crc >> 1) ^ (crc & 1 ? kPolynomial : 0);
+    }
+
+    tables[0][i] = crc;
+  }
+
+  for (uint32_t i = 0; i < 256; ++i) {
+    for (size_t slice = 1; slice < tables.size(); ++slice) {
+      const auto previous = tables[slice - 1][i];
+      tables[slice][i] = (previous >> 8) ^ tables[0][previous & 0xFF];
+    }
+  }
+
+  return tables;
+}
+
+constexpr Tables kTables = MakeTables();
+
+constexpr uint32_t ByteSwap(uint32_t value) {
+  return (value >> 24) | ((value >> 8) & 0xFF00) | ((value << 8) & 0xFF0000) |
+         (value << 24);
+}
+
+/// @note crc is not inverted
+uint32_t SoftwareCrc(uint32_t crc, const uint8_t* data, size_t size) {
+  for (; size >= 8; size -= 8, data += 8) {
+    uint32_t low;
+    uint32_t high;
+    std::memcpy(&low, data, sizeof(low));
+    std::memcpy(&high, data + 4, sizeof(high));
+    if constexpr (std::endian::native == std::endian::big) {
+      low = ByteSwap(low);
+      high = ByteSwap(high);
+    }
+
+    low ^= crc;
+    crc = kTables[7][low & 0xFF] ^ kTables[6][(low >> 8) & 0xFF] ^
+          kTables[5][(low >> 16) & 0xFF] ^ kTables[4][low >> 24] ^
+          kTables[3][high & 0xFF] ^ kTables[2][(high >> 8) & 0xFF] ^
+          kTables[1][(high >> 16) & 0xFF] ^ kTables[0][high >> 24];
+  }
+
+  for (; size > 0; --size, ++data) {
+    crc = (crc >> 8) ^ kTables[0][(crc ^ *data) & 0xFF];
+  }
+
+  return crc;
+}
+
+#if defined(JBKV_CRC32C_X86)
+
+#if !defined(_MSC_VER)
+__attribute__((target("sse4.2")))
+#endif
+uint32_t HardwareCrc(uint32_t crc, const uint8_t* data, size_t size) {
+#if defined(_M_X64) || defined(__x86_64__)
+  uint64_t crc64 = crc;
+  for (; size >= 8; size -= 8, data += 8) {
+    uint64_t word;
+    std::memcpy(&word, data, sizeof(word));
+    crc64 = _mm_crc32_u64(crc64, word);
+  }
+
+  crc = static_cast<uint32_t>(crc64);
+#endif
+  for (; size >= 4; size -= 4, data += 4) {
+    uint32_t word;
+    std::memcpy(&word, data, sizeof(word));
+    crc = _mm_crc32_u32(crc, word);
+  }
+
+  for (; size > 0; --size, ++data) {
+    crc = _mm_crc32_u8(crc, *data);
+  }
+
+  return crc;
+}
+
+bool HasHardwareCrc() {
+#if defined(_MSC_VER)
+  int info[4] = {};
+  __cpuid(info, 1);
+  return (info[2] & (1 << 20)) != 0;
+#else
+  unsigned int eax = 0;
+  unsigned int ebx = 0;
+  unsigned int ecx = 0;
+  unsigned int edx = 0;
+  return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_SSE4_2) != 0;
+#endif
+}
+
+#elif defined(JBKV_CRC32C_ARM)
+
+uint32_t HardwareCrc(uint32_t crc, const uint8_t* data, size_t size) {
+  for (; size >= 8; size -= 8, data += 8) {
+    uint64_t word;
+    std::memcpy(&word, data, sizeof(word));
+    crc = __crc32cd(crc, word);
+  }
+
+  for (; size > 0; --size, ++data) {
+    crc = __crc32cb(crc, *data);
+  }
+
+  return crc;
+}
+
+/// instructions are enabled at compile time
+bool HasHardwareCrc() {
+  return true;
+}
+
+#else
+
+uint32_t HardwareCrc(uint32_t crc, const uint8_t* data, size_t size) {
+  return SoftwareCrc(crc, data, size);
+}
+
+bool HasHardwareCrc() {
+  return false;
+}
+
+#endif
+
+using CrcFunction = uint32_t (*)(uint32_t, const uint8_t*, size_t);
+
+}  // namespace
+
+uint32_t jbkv::Crc32c(uint32_t crc, const void* data, size_t size) {
+  static const CrcFunction function =
+      HasHardwareCrc() ? HardwareCrc : SoftwareCrc;
+  return ~function(~crc, static_cast<const uint8_t*>(data), size);
+}
@@ -0,0 +1,13 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+namespace jbkv {
+
+/// CRC-32C (Castagnoli) of data, continuing from crc of preceding data
+/// Uses SSE4.2 or ARMv8 CRC instructions if CPU supports them, otherwise
+/// slicing-by-8 tables
+/// @param crc zero for the first chunk
+uint32_t Crc32c(uint32_t crc, const void* data, size_t size);
+
+}  // namespace jbkv
@@ -0,0 +1,178 @@
+#include "epoch.h"
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace jbkv;
+
+namespace {
+
+/// Epoch pinned by thread, zero if thread does not read
+struct Record {
+  std::atomic<uint64_t> epoch = 0;
+  std::atomic<bool> owned = true;
+  Record* next = nullptr;
+};
+
+struct Retired {
+  uint64_t epoch = 0;
+  std::function<void()> deleter;
+};
+
+struct Epochs {
+  std::atomic<uint64_t> current = 1;
+  /// records are reused by new threads and never freed
+  std::atomic<Record*> records = nullptr;
+
+  /// retiring writers advance epoch
+  std::mutex retired_mutex;
+  std::vector<Retired> retired;
+};
+
+Epochs& Global() {
+  /// leaked, so threads may exit after static destruction
+  static auto* epochs = new Epochs;
+  return *epochs;
+}
+
+Record* AcquireRecord() {
+  auto& epochs = Global();
+  for (auto* record = epochs.records.load(std::memory_order_acquire); record;
+       record = record->next) {
+    bool owned = false;
+    if (record->owned.compare_exchange_strong(owned, true)) {
+      return record;
+    }
+  }
+
+  auto* record = new Record;
+  record->next = epochs.records.load(std::memory_order_relaxed);
+  while (!epochs.records.compare_exchange_weak(record->next, record,
+                                               std::memory_order_release,
+                                               std::memory_order_relaxed)) {
+  }
+
+  return record;
+}
+
+struct ThreadRecord {
+  ~ThreadRecord() {
+    record->epoch.store(0, std::memory_order_release);
+    record->owned.store(false, std::memory_order_release);
+  }
+
+  Record* const record = AcquireRecord();
+  size_t depth = 0;
+};
+
+ThreadRecord& Thread() {
+  thread_local ThreadRecord thread;
+  return thread;
+}
+
+/// Advances epoch if every pinned thread has seen the current one
+/// @note called under retired mutex
+bool TryAdvance(Epochs& epochs) {
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  const auto current = epochs.current.load(std::memory_order_relaxed);
+  for (auto* record = epochs.records.load(std::memory_order_acquire); record;
+       record = record->next) {
+    const auto epoch = record->epoch.load(std::memory_order_acquire);
+    if (epoch != 0 && epoch != current) {
+      return false;
+    }
+  }
+
+  epochs.current.store(current + 1, std::memory_order_release);
+  return true;
+}
+
+/// Moves retired memory which no reader can reach to ready
+/// @note called under retired mutex
+void TakeReady(Epochs& epochs, std::vector<Retired>& ready) {
+  const auto current = epochs.current.load(std::memory_order_relaxed);
+  std::erase_if(epochs.retired, [current, &ready](Retired& retired) {
+    if (retired.epoch + 2 > current) {
+      return false;
+    }
+
+    ready.push_back(std::move(retired));
+    return true;
+  });
+}
+
+}  // namespace
+
+EpochGuard::EpochGuard() {
+  auto& thread = Thread();
+  if (thread.depth++ == 0) {
+    /// read-modify-write continues release sequence of unpinning, so
+    /// writer seeing any later epoch of thread sees its reads finished
+    thread.record->epoch.exchange(
+        Global().current.load(std::memory_order_relaxed),
+        std::memory_order_seq_cst);
+  }
+}
+
+EpochGuard::~EpochGuard() {
+  auto& thread = Thread();
+  if (--thread.depth == 0) {
+    thread.record->epoch.store(0, std::memory_order_release);
+  }
+}
+
+void jbkv::RetireAfterEpoch(std::function<void()> deleter) {
+  auto& epochs = Global();
+  std::vector<Retired> ready;
+  {
+    std::lock_guard lock(epochs.retired_mutex);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    epochs.retired.push_back(
+        {epochs.current.load(std::memory_order_relaxed), std::move(deleter)});
+
+    /// readers pinned before retirement have left after two advances
+    if (TryAdvance(epochs)) {
+      TryAdvance(epochs);
+    }
+
+    TakeReady(epochs, ready);
+  }
+
+  for (const auto& retired : ready) {
+    retired.deleter();
+  }
+}
+
+void jbkv::SynchronizeEpoch() {
+  auto& epochs = Global();
+  std::vector<Retired> ready;
+  uint64_t target = 0;
+  {
+    std::lock_guard lock(epochs.retired_mutex);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    target = epochs.current.load(std::memory_order_relaxed) + 2;
+  }
+
+  for (;;) {
+    {
+      std::lock_guard lock(epochs.retired_mutex);
+      while (epochs.current.load(std::memory_order_relaxed) < target &&
+             TryAdvance(epochs)) {
+      }
+
+      if (epochs.current.load(std::memory_order_relaxed) >= target) {
+        TakeReady(epochs, ready);
+        break;
+      }
+    }
+
+    /// readers pinned at older epoch are still running
+    std::this_thread::yield();
+  }
+
+  for (const auto& retired : ready) {
+    retired.deleter();
+  }
+}
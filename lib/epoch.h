@@ -0,0 +1,30 @@
+#pragma once
+#include <functional>
+#include "noncopyable.h"
+
+/// Epoch-based reclamation of memory read without locks
+/// @note not a part of public interface
+namespace jbkv {
+
+/// Pins current epoch while calling thread reads memory without locks, so
+/// memory retired meanwhile is not freed
+/// Pinning exchanges epoch in record of calling thread, so readers of
+/// different threads do not write to shared cache lines. Guards
+/// of the same thread may nest.
+class EpochGuard : NonCopyableNonMovable {
+ public:
+  EpochGuard();
+  ~EpochGuard();
+};
+
+/// Calls deleter of memory unlinked from structures read under EpochGuard
+/// once no reader which could see it is pinned, possibly right away
+/// @note memory must be unlinked before it is retired
+void RetireAfterEpoch(std::function<void()> deleter);
+
+/// Waits until readers pinned before the call leave their epochs, so
+/// memory they could reach and which is unlinked already may be reused
+/// @note must not be called under EpochGuard
+void SynchronizeEpoch();
+
+}  // namespace jbkv
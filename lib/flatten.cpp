@@ -0,0 +1,70 @@
+#include "storage_node.h"
+#include "thread_pool.h"
+
+namespace {
+using namespace jbkv;
+
+class Flattener {
+ public:
+  explicit Flattener(ThreadPool& pool)
+      : group_(pool),
+        /// keep pool busy, but do not flood its queue with tiny subtrees
+        max_pending_(pool.Size() * 4) {
+  }
+
+  VolumeNode::Ptr Run(const StorageNode::Ptr& root) {
+    auto result = CreateVolume();
+    Copy(root, result);
+    group_.Wait();
+    return result;
+  }
+
+ private:
+  /// Copies subtree depth-first, offloading subtrees into pool while it has
+  /// free capacity
+  void Copy(StorageNode::Ptr source, VolumeNode::Ptr target) {
+    std::vector<std::pair<StorageNode::Ptr, VolumeNode::Ptr>> stack;
+    stack.emplace_back(std::move(source), std::move(target));
+    while (!stack.empty()) {
+      auto [from, to] = std::move(stack.back());
+      stack.pop_back();
+
+      auto data = to->Open();
+      /// storage data enumeration already respects layer precedence
+      for (auto&& [key, value] : from->Open()->Enumerate()) {
+        data->Write(key, std::move(value));
+      }
+
+      /// storage children include mounted subtrees
+      for (auto&& child : from->Enumerate()) {
+        auto to_child = to->Create(child->GetName());
+        if (group_.Pending() < max_pending_) {
+          group_.Submit([this, child = std::move(child),
+                         to_child = std::move(to_child)]() mutable {
+            Copy(std::move(child), std::move(to_child));
+          });
+        } else {
+          stack.emplace_back(std::move(child), std::move(to_child));
+        }
+      }
+    }
+  }
+
+ private:
+  TaskGroup group_;
+  const size_t max_pending_;
+};
+}  // namespace
+
+VolumeNode::Ptr jbkv::Flatten(const StorageNode::Ptr& root) {
+  ThreadPool pool;
+  return Flatten(root, pool);
+}
+
+VolumeNode::Ptr jbkv::Flatten(const StorageNode::Ptr& root, ThreadPool& pool) {
+  if (!root) {
+    throw std::runtime_error("Unable to flatten: root is nullptr");
+  }
+
+  return Flattener(pool).Run(root);
+}
@@ -0,0 +1,265 @@
+#include "volume_node_impl.h"
+#include <algorithm>
+#include <deque>
+#include <limits>
+
+namespace {
+using namespace jbkv;
+
+constexpr auto kFrozenError = "Volume is frozen";
+
+/// Immutable open-addressing hash index over array of named items
+/// Slot keeps part of hash to skip most of name comparisons on probing
+class FrozenIndex {
+ public:
+  static constexpr size_t kNotFound = std::numeric_limits<size_t>::max();
+
+ public:
+  template <typename Items, typename NameOf>
+  FrozenIndex(const Items& items, NameOf&& name_of) {
+    size_t capacity = 1;
+    while (capacity < items.size() * 2) {
+      capacity *= 2;
+    }
+
+    mask_ = capacity - 1;
+    slots_.resize(items.size() == 0 ? 0 : capacity);
+    for (size_t i = 0; i < items.size(); ++i) {
+      const auto hash = Hash(name_of(items[i]));
+      auto pos = hash & mask_;
+      while (slots_[pos].position != 0) {
+        pos = (pos + 1) & mask_;
+      }
+
+      slots_[pos] = {static_cast<uint32_t>(hash), static_cast<uint32_t>(i + 1)};
+    }
+  }
+
+  /// @return position of item in array or kNotFound
+  template <typename Items, typename NameOf>
+  size_t Find(const Items& items, const std::string& name,
+              NameOf&& name_of) const {
+    if (slots_.empty()) {
+      return kNotFound;
+    }
+
+    const auto hash = Hash(name);
+    for (auto pos = hash & mask_; slots_[pos].position != 0;
+         pos = (pos + 1) & mask_) {
+      const auto& slot = slots_[pos];
+      if (slot.hash == static_cast<uint32_t>(hash) &&
+          name_of(items[slot.position - 1]) == name) {
+        return slot.position - 1;
+      }
+    }
+
+    return kNotFound;
+  }
+
+ private:
+  struct Slot {
+    uint32_t hash = 0;
+    /// position in array + 1, zero marks empty slot
+    uint32_t position = 0;
+  };
+
+  static size_t Hash(const std::string& name) {
+    return std::hash<std::string>{}(name);
+  }
+
+ private:
+  size_t mask_ = 0;
+  std::vector<Slot> slots_;
+};
+
+/// Immutable key-value storage packed into array sorted by key and indexed
+/// by hash
+class FrozenNodeData final : public NodeData {
+ public:
+  explicit FrozenNodeData(KeyValueList&& data)
+      : data_(Sorted(std::move(data))),
+        index_(data_, KeyOf) {
+  }
+
+  std::optional<Value> Read(const Key& key) const override {
+    const auto it = Search(key);
+    if (it == data_.end()) {
+      return std::nullopt;
+    }
+
+    return it->second;
+  }
+
+  void Write(const Key&, Value&&) override {
+    throw std::runtime_error(kFrozenError);
+  }
+
+  bool Update(const Key& key, Value&&) override {
+    ThrowIfExists(key);
+    return false;
+  }
+
+  bool Remove(const Key& key) override {
+    ThrowIfExists(key);
+    return false;
+  }
+
+  KeyValueList Enumerate() const override {
+    return data_;
+  }
+
+  bool IsReadOnly() const override {
+    return true;
+  }
+
+ private:
+  static const Key& KeyOf(const KeyValueList::value_type& kv) {
+    return kv.first;
+  }
+
+  static KeyValueList Sorted(KeyValueList&& data) {
+    std::sort(data.begin(), data.end(), [](const auto& lhs, const auto& rhs) {
+      return lhs.first < rhs.first;
+    });
+    data.shrink_to_fit();
+    return std::move(data);
+  }
+
+  KeyValueList::const_iterator Search(const Key& key) const {
+    const auto pos = index_.Find(data_, key, KeyOf);
+    if (pos == FrozenIndex::kNotFound) {
+      return data_.end();
+    }
+
+    return data_.begin() + static_cast<std::ptrdiff_t>(pos);
+  }
+
+  void ThrowIfExists(const Key& key) const {
+    if (Search(key) != data_.end()) {
+      throw std::runtime_error(kFrozenError);
+    }
+  }
+
+ private:
+  const KeyValueList data_;
+  const FrozenIndex index_;
+};
+
+/// Immutable node with children packed into array sorted by name and indexed
+/// by hash
+/// @note children are filled by Freeze before node gets published
+class FrozenVolumeNode final : public VolumeNode {
+ public:
+  FrozenVolumeNode(const Name& name, NodeData::KeyValueList&& data)
+      : name_(name),
+        data_(std::make_shared<FrozenNodeData>(std::move(data))) {
+  }
+
+  const Name& GetName() const override {
+    return name_;
+  }
+
+  VolumeNode::Ptr Create(const Name&) override {
+    throw std::runtime_error(kFrozenError);
+  }
+
+  VolumeNode::Ptr Find(const Name& name) const override {
+    const auto it = Search(name);
+    if (it == children_.end()) {
+      return NullVolumeNode::Instance();
+    }
+
+    return *it;
+  }
+
+  bool Unlink(const Name& name) override {
+    if (Search(name) != children_.end()) {
+      throw std::runtime_error(kFrozenError);
+    }
+
+    return false;
+  }
+
+  NodeData::Ptr Open() const override {
+    return data_;
+  }
+
+  VolumeNode::List Enumerate() const override {
+    return children_;
+  }
+
+  bool IsValid() const override {
+    return true;
+  }
+
+  bool IsReadOnly() const override {
+    return true;
+  }
+
+ public:
+  static VolumeNode::Ptr Build(const VolumeNode::Ptr& root) {
+    using Task = std::pair<VolumeNode::Ptr, FrozenVolumeNode*>;
+
+    auto result = Copy(*root);
+    std::deque<Task> tasks{{root, result.get()}};
+    while (!tasks.empty()) {
+      auto [source, target] = std::move(tasks.front());
+      tasks.pop_front();
+
+      auto children = source->Enumerate();
+      std::sort(children.begin(), children.end(),
+                [](const auto& lhs, const auto& rhs) {
+                  return lhs->GetName() < rhs->GetName();
+                });
+
+      target->children_.reserve(children.size());
+      for (auto& child : children) {
+        auto frozen = Copy(*child);
+        tasks.push_back({std::move(child), frozen.get()});
+        target->children_.push_back(std::move(frozen));
+      }
+
+      target->index_.emplace(target->children_, NameOf);
+    }
+
+    return result;
+  }
+
+ private:
+  static std::shared_ptr<FrozenVolumeNode> Copy(const VolumeNode& node) {
+    return std::make_shared<FrozenVolumeNode>(node.GetName(),
+                                              node.Open()->Enumerate());
+  }
+
+  static const Name& NameOf(const VolumeNode::Ptr& child) {
+    return child->GetName();
+  }
+
+  VolumeNode::List::const_iterator Search(const Name& name) const {
+    if (!index_) {
+      return children_.end();
+    }
+
+    const auto pos = index_->Find(children_, name, NameOf);
+    if (pos == FrozenIndex::kNotFound) {
+      return children_.end();
+    }
+
+    return children_.begin() + static_cast<std::ptrdiff_t>(pos);
+  }
+
+ private:
+  const Name name_;
+  const NodeData::Ptr data_;
+  VolumeNode::List children_;
+  std::optional<FrozenIndex> index_;
+};
+}  // namespace
+
+VolumeNode::Ptr jbkv::Freeze(const VolumeNode::Ptr& root) {
+  if (!root) {
+    throw std::runtime_error("Unable to freeze: root is nullptr");
+  }
+
+  return FrozenVolumeNode::Build(root);
+}
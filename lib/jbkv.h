@@ -1,4 +1,11 @@
 #pragma once
+#include "async.h"
+#include "lsm_volume.h"
+#include "sharded_volume.h"
+#include "spilling_volume.h"
 #include "storage_node.h"
+#include "transaction.h"
+#include "volume_builder.h"
 #include "volume_io.h"
 #include "volume_node.h"
+#include "write_ahead_log.h"
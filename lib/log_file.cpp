@@ -0,0 +1,106 @@
+#include "log_file.h"
+#include <algorithm>
+#include <cerrno>
+#include <stdexcept>
+#include "volume_format.h"
+
+#if defined(_WIN32)
+#include <fcntl.h>
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace jbkv::io;
+
+LogFile::LogFile(const std::filesystem::path& path) {
+#if defined(_WIN32)
+  fd_ = ::_wopen(path.c_str(), _O_WRONLY | _O_CREAT | _O_APPEND | _O_BINARY,
+                 _S_IREAD | _S_IWRITE);
+#else
+  fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+#endif
+  if (fd_ < 0) {
+    throw std::runtime_error("Cannot open log: " + path.string());
+  }
+}
+
+LogFile::~LogFile() {
+#if defined(_WIN32)
+  ::_close(fd_);
+#else
+  ::close(fd_);
+#endif
+}
+
+void LogFile::Write(ByteSpan data) {
+  const auto* bytes = static_cast<const char*>(data.data);
+  auto size = data.size;
+  while (size > 0) {
+    const auto chunk = std::min<uint64_t>(size, 1 << 30);
+#if defined(_WIN32)
+    const auto written = ::_write(fd_, bytes, static_cast<unsigned int>(chunk));
+#else
+    const auto written = ::write(fd_, bytes, static_cast<size_t>(chunk));
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+#endif
+    if (written < 0) {
+      throw std::runtime_error("Cannot write log");
+    }
+
+    bytes += written;
+    size -= static_cast<uint64_t>(written);
+  }
+}
+
+void LogFile::Sync() {
+#if defined(_WIN32)
+  const bool synced = ::_commit(fd_) == 0;
+#elif defined(__APPLE__)
+  const bool synced = ::fsync(fd_) == 0;
+#else
+  const bool synced = ::fdatasync(fd_) == 0;
+#endif
+  if (!synced) {
+    throw std::runtime_error("Cannot sync log");
+  }
+}
+
+void jbkv::io::SyncFile(const std::filesystem::path& path) {
+#if defined(_WIN32)
+  const int fd = ::_wopen(path.c_str(), _O_RDWR | _O_BINARY);
+  const bool synced = fd >= 0 && ::_commit(fd) == 0;
+  if (fd >= 0) {
+    ::_close(fd);
+  }
+#else
+  const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  const bool synced = fd >= 0 && ::fsync(fd) == 0;
+  if (fd >= 0) {
+    ::close(fd);
+  }
+
+  /// directory sync is best effort, not every file system supports it
+  auto directory = path.parent_path();
+  const int dir_fd = ::open(directory.empty() ? "." : directory.c_str(),
+                            O_RDONLY | O_CLOEXEC);
+  if (dir_fd >= 0) {
+    ::fsync(dir_fd);
+    ::close(dir_fd);
+  }
+#endif
+  if (!synced) {
+    throw std::runtime_error("Cannot sync file: " + path.string());
+  }
+}
+
+void jbkv::io::AppendFramed(ByteSpan payload, MemoryWriter& out) {
+  format::Serialize(payload.size, out);
+  out.Write(payload.data, payload.size);
+  format::Serialize(
+      Crc32c(0, payload.data, static_cast<size_t>(payload.size)), out);
+}
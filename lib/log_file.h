@@ -0,0 +1,33 @@
+#pragma once
+#include <filesystem>
+#include "buffered_io.h"
+#include "noncopyable.h"
+
+/// Append-only files of logged changes
+/// @note not a part of public interface
+namespace jbkv::io {
+
+/// Log file opened for appending
+class LogFile : NonCopyableNonMovable {
+ public:
+  /// Opens file, creating it if it does not exist
+  /// @throw std::runtime_error if file cannot be opened
+  explicit LogFile(const std::filesystem::path& path);
+  ~LogFile();
+
+  void Write(ByteSpan data);
+
+  /// Makes written bytes durable
+  void Sync();
+
+ private:
+  int fd_ = -1;
+};
+
+/// Makes file and its directory entry durable
+void SyncFile(const std::filesystem::path& path);
+
+/// Frames payload of record: size, payload and its CRC
+void AppendFramed(ByteSpan payload, MemoryWriter& out);
+
+}  // namespace jbkv::io
@@ -0,0 +1,1384 @@
+#include "lsm_tree.h"
+#include <algorithm>
+#include <unordered_set>
+#include "async_file.h"
+#include "log_file.h"
+#include "mapped_file.h"
+#include "volume_format.h"
+
+using namespace jbkv;
+using namespace jbkv::format;
+using namespace jbkv::lsm;
+
+namespace {
+
+/// size of segment block, block is closed by entry which reaches it
+constexpr size_t kBlockSize = 4096;
+/// every 16th entry of block starts at restart point, offsets of restart
+/// points close block and let lookup binary search it
+constexpr size_t kRestartInterval = 16;
+/// bloom filter of 10 bits per key with 7 probes gives ~1% false positives
+constexpr size_t kFilterBitsPerKey = 10;
+constexpr uint8_t kFilterProbes = 7;
+/// memory taken by entry of memtable besides key and value
+constexpr size_t kEntryOverhead = 64;
+constexpr auto kManifestName = "MANIFEST";
+
+enum class EntryKind : uint8_t { Value = 0, Removal = 1 };
+
+/// Entry of segment or batch, views point into mapped file or batch
+struct EntryView {
+  std::string_view key;
+  /// nullopt for removal
+  std::optional<std::string_view> value;
+};
+
+/// FNV-1a
+uint64_t Hash(std::string_view key) {
+  uint64_t hash = 14695981039346656037ull;
+  for (const char c : key) {
+    hash ^= static_cast<uint8_t>(c);
+    hash *= 1099511628211ull;
+  }
+
+  return hash;
+}
+
+/// Calls fn with every bit probed for hash, probes are made by double hashing
+template <typename Fn>
+void ProbeFilter(uint64_t hash, uint64_t bits, uint8_t probes, Fn&& fn) {
+  const uint64_t delta = hash >> 33 | hash << 31;
+  for (uint8_t i = 0; i < probes; ++i) {
+    fn(hash % bits);
+    hash += delta;
+  }
+}
+
+template <typename Writer>
+void SerializeBytes(std::string_view bytes, Writer& out) {
+  SerializeVarint(bytes.size(), out);
+  out.Write(bytes.data(), bytes.size());
+}
+
+std::string_view DeserializeBytes(MemoryReader& in) {
+  const auto size = DeserializeVarint(in);
+  return {reinterpret_cast<const char*>(in.Skip(size)),
+          static_cast<size_t>(size)};
+}
+
+template <typename Writer>
+void SerializeEntry(std::string_view key,
+                    const std::optional<std::string_view>& value,
+                    Writer& out) {
+  SerializeBytes(key, out);
+  Serialize(value ? EntryKind::Value : EntryKind::Removal, out);
+  if (value) {
+    SerializeBytes(*value, out);
+  }
+}
+
+void DeserializeEntry(MemoryReader& in, EntryView& entry) {
+  entry.key = DeserializeBytes(in);
+  EntryKind kind = EntryKind::Value;
+  Deserialize(kind, in);
+  switch (kind) {
+    case EntryKind::Value:
+      entry.value = DeserializeBytes(in);
+      return;
+    case EntryKind::Removal:
+      entry.value = std::nullopt;
+      return;
+  }
+
+  throw std::runtime_error("Data corrupted");
+}
+
+std::optional<std::string_view> View(const std::optional<std::string>& value) {
+  if (!value) {
+    return std::nullopt;
+  }
+
+  return *value;
+}
+
+/// @return number of file named by zero-padded number, e.g. 000042.seg
+std::optional<uint64_t> ParseNumber(const std::string& stem) {
+  if (stem.empty() || stem.size() > 19 ||
+      !std::all_of(stem.begin(), stem.end(),
+                   [](char c) { return c >= '0' && c <= '9'; })) {
+    return std::nullopt;
+  }
+
+  return std::stoull(stem);
+}
+
+/// Writes segment of entries added in ascending order of keys
+class SegmentWriter : NonCopyableNonMovable {
+ public:
+  explicit SegmentWriter(const std::filesystem::path& path)
+      : sink_(path),
+        out_(sink_) {
+    SerializeHeader(out_, kSegmentMagic, kSegmentFormatVersion);
+  }
+
+  void Add(std::string_view key, const std::optional<std::string_view>& value) {
+    if (block_.Offset() == 0) {
+      blocks_.push_back({std::string(key), out_.Offset(), 0});
+    }
+
+    if (entries_ % kRestartInterval == 0) {
+      restarts_.push_back(static_cast<uint32_t>(block_.Offset()));
+    }
+
+    SerializeEntry(key, value, block_);
+    ++entries_;
+    hashes_.push_back(Hash(key));
+    last_key_.assign(key);
+    if (block_.Offset() >= kBlockSize) {
+      FinishBlock();
+    }
+  }
+
+  /// @return number of bytes written so far
+  uint64_t Size() const {
+    return out_.Offset() + block_.Offset();
+  }
+
+  /// Writes index, filter and footer and replaces file by segment
+  void Finish() {
+    if (block_.Offset() > 0) {
+      FinishBlock();
+    }
+
+    SegmentFooter footer;
+    footer.index_offset = out_.Offset();
+    io::MemoryWriter tail;
+    SerializeVarint(blocks_.size(), tail);
+    for (const auto& block : blocks_) {
+      SerializeBytes(block.first_key, tail);
+      SerializeVarint(block.offset, tail);
+      SerializeVarint(block.size, tail);
+    }
+
+    SerializeBytes(last_key_, tail);
+    footer.filter_offset = footer.index_offset + tail.Offset();
+
+    const uint64_t bits =
+        std::max<uint64_t>(64, hashes_.size() * kFilterBitsPerKey);
+    std::vector<uint8_t> filter((bits + 7) / 8);
+    for (const auto hash : hashes_) {
+      ProbeFilter(hash, bits, kFilterProbes, [&filter](uint64_t bit) {
+        filter[bit / 8] |= static_cast<uint8_t>(1u << bit % 8);
+      });
+    }
+
+    SerializeVarint(bits, tail);
+    Serialize(kFilterProbes, tail);
+    tail.Write(filter.data(), filter.size());
+
+    const auto data = tail.Data();
+    footer.crc = Crc32c(0, data.data, static_cast<size_t>(data.size));
+    out_.Write(data.data, data.size);
+    Serialize(footer, out_);
+    out_.Flush();
+    sink_.Commit();
+  }
+
+ private:
+  struct Block {
+    std::string first_key;
+    uint64_t offset = 0;
+    uint64_t size = 0;
+  };
+
+ private:
+  void FinishBlock() {
+    for (const auto restart : restarts_) {
+      Serialize(restart, block_);
+    }
+
+    Serialize(static_cast<uint32_t>(restarts_.size()), block_);
+    restarts_.clear();
+    entries_ = 0;
+    const auto data = block_.Data();
+    blocks_.back().size = data.size;
+    out_.Write(data.data, data.size);
+    Serialize(Crc32c(0, data.data, static_cast<size_t>(data.size)), out_);
+    block_.Clear();
+  }
+
+ private:
+  io::AsyncFileSink sink_;
+  io::BufferedWriter out_;
+  io::MemoryWriter block_;
+  std::vector<uint32_t> restarts_;
+  size_t entries_ = 0;
+  std::vector<Block> blocks_;
+  std::vector<uint64_t> hashes_;
+  std::string last_key_;
+};
+}  // namespace
+
+namespace jbkv::lsm {
+
+/// Immutable sorted file of entries, mapped to memory
+/// Blocks are located by index of their first keys, keys absent from
+/// segment are mostly rejected by bloom filter without reading blocks
+class Segment : NonCopyableNonMovable {
+ public:
+  enum class Lookup { Missing, Removed, Found };
+
+ public:
+  Segment(std::filesystem::path path, uint64_t number)
+      : path_(std::move(path)),
+        number_(number),
+        file_(MappedFile::Open(path_)) {
+    Parse();
+  }
+
+  /// Removes file of retired segment
+  ~Segment() {
+    if (retired_.load(std::memory_order_acquire)) {
+      file_.reset();
+      std::error_code error;
+      std::filesystem::remove(path_, error);
+    }
+  }
+
+  uint64_t Number() const {
+    return number_;
+  }
+
+  uint64_t Size() const {
+    return file_->Size();
+  }
+
+  const std::string& Smallest() const {
+    return blocks_.front().first_key;
+  }
+
+  const std::string& Largest() const {
+    return largest_;
+  }
+
+  size_t Blocks() const {
+    return blocks_.size();
+  }
+
+  /// Marks segment replaced by compaction, so its file is removed when
+  /// last reader releases it
+  void Retire() const {
+    retired_.store(true, std::memory_order_release);
+  }
+
+  /// @return index of block which would hold key
+  size_t SeekBlock(std::string_view key) const {
+    const auto it = std::upper_bound(
+        blocks_.begin(), blocks_.end(), key,
+        [](std::string_view key, const Block& block) {
+          return key < block.first_key;
+        });
+    return it == blocks_.begin() ? 0 : it - blocks_.begin() - 1;
+  }
+
+  /// @return reader of block entries positioned at the last restart point
+  /// not greater than key
+  /// @throw std::runtime_error if block is corrupted
+  MemoryReader SeekEntry(size_t index, std::string_view key) const {
+    const auto* begin = file_->Data() + blocks_[index].offset;
+    const auto size = static_cast<size_t>(blocks_[index].size);
+    /// mapping is immutable, so block is verified on first access only
+    auto& verified = verified_[index];
+    if (!verified.load(std::memory_order_acquire)) {
+      uint32_t stored_crc = 0;
+      std::memcpy(&stored_crc, begin + size, sizeof(stored_crc));
+      if (Crc32c(0, begin, size) != stored_crc) {
+        throw std::runtime_error("Data corrupted: " + path_.string());
+      }
+
+      verified.store(true, std::memory_order_release);
+    }
+
+    uint32_t count = 0;
+    if (size >= sizeof(count)) {
+      std::memcpy(&count, begin + size - sizeof(count), sizeof(count));
+    }
+
+    if (count == 0 || (size - sizeof(count)) / sizeof(count) < count) {
+      throw std::runtime_error("Data corrupted: " + path_.string());
+    }
+
+    const auto* restarts = begin + size - sizeof(count) * (count + 1);
+    auto restart = [begin, restarts, this](uint32_t i) {
+      uint32_t offset = 0;
+      std::memcpy(&offset, restarts + i * sizeof(offset), sizeof(offset));
+      if (begin + offset >= restarts) {
+        throw std::runtime_error("Data corrupted: " + path_.string());
+      }
+
+      return begin + offset;
+    };
+
+    /// first restart point greater than key
+    uint32_t low = 0;
+    uint32_t high = count;
+    while (low < high) {
+      const auto middle = low + (high - low) / 2;
+      MemoryReader in(restart(middle), restarts);
+      if (DeserializeBytes(in) <= key) {
+        low = middle + 1;
+      } else {
+        high = middle;
+      }
+    }
+
+    return {restart(low == 0 ? 0 : low - 1), restarts};
+  }
+
+  Lookup Find(std::string_view key, std::string& value) const {
+    if (key < Smallest() || key > largest_ || !MayContain(key)) {
+      return Lookup::Missing;
+    }
+
+    auto in = SeekEntry(SeekBlock(key), key);
+    EntryView entry;
+    while (in.Remaining() > 0) {
+      DeserializeEntry(in, entry);
+      if (entry.key == key) {
+        if (!entry.value) {
+          return Lookup::Removed;
+        }
+
+        value.assign(*entry.value);
+        return Lookup::Found;
+      }
+
+      if (entry.key > key) {
+        break;
+      }
+    }
+
+    return Lookup::Missing;
+  }
+
+ private:
+  struct Block {
+    std::string first_key;
+    uint64_t offset = 0;
+    uint64_t size = 0;
+  };
+
+ private:
+  void Parse() {
+    const auto* data = file_->Data();
+    const auto size = file_->Size();
+    MemoryReader in(data, data + size);
+    if (DeserializeMagic(in) != kSegmentMagic) {
+      throw std::runtime_error("Bad segment format: " + path_.string());
+    }
+
+    DeserializeVersion(in, kSegmentFormatVersion);
+    const auto header_size = size - in.Remaining();
+    SegmentFooter footer;
+    if (in.Remaining() < sizeof(footer)) {
+      throw std::runtime_error("Data truncated");
+    }
+
+    const auto footer_offset = size - sizeof(footer);
+    std::memcpy(&footer, data + footer_offset, sizeof(footer));
+    if (footer.index_offset < header_size ||
+        footer.index_offset > footer.filter_offset ||
+        footer.filter_offset > footer_offset ||
+        Crc32c(0, data + footer.index_offset,
+               static_cast<size_t>(footer_offset - footer.index_offset)) !=
+            footer.crc) {
+      throw std::runtime_error("Data corrupted: " + path_.string());
+    }
+
+    MemoryReader index(data + footer.index_offset, data + footer.filter_offset);
+    const auto count = DeserializeVarint(index);
+    for (uint64_t i = 0; i < count; ++i) {
+      Block block;
+      block.first_key = DeserializeBytes(index);
+      block.offset = DeserializeVarint(index);
+      block.size = DeserializeVarint(index);
+      if (block.offset < header_size ||
+          block.offset > footer.index_offset ||
+          footer.index_offset - block.offset < block.size + sizeof(uint32_t)) {
+        throw std::runtime_error("Data corrupted: " + path_.string());
+      }
+
+      blocks_.push_back(std::move(block));
+    }
+
+    verified_ = std::make_unique<std::atomic<bool>[]>(blocks_.size());
+
+    largest_ = DeserializeBytes(index);
+
+    MemoryReader filter(data + footer.filter_offset, data + footer_offset);
+    filter_bits_ = DeserializeVarint(filter);
+    Deserialize(filter_probes_, filter);
+    if (blocks_.empty() || filter_bits_ == 0) {
+      throw std::runtime_error("Data corrupted: " + path_.string());
+    }
+
+    filter_ = filter.Skip((filter_bits_ + 7) / 8);
+  }
+
+  bool MayContain(std::string_view key) const {
+    bool result = true;
+    ProbeFilter(Hash(key), filter_bits_, filter_probes_,
+                [this, &result](uint64_t bit) {
+                  result = result && (filter_[bit / 8] >> bit % 8 & 1) != 0;
+                });
+    return result;
+  }
+
+ private:
+  const std::filesystem::path path_;
+  const uint64_t number_;
+  MappedFile::Ptr file_;
+  mutable std::atomic<bool> retired_ = false;
+
+  std::vector<Block> blocks_;
+  std::unique_ptr<std::atomic<bool>[]> verified_;
+  std::string largest_;
+  const uint8_t* filter_ = nullptr;
+  uint64_t filter_bits_ = 0;
+  uint8_t filter_probes_ = 0;
+};
+
+struct Tree::Compaction {
+  size_t level = 0;
+  std::vector<std::shared_ptr<const Segment>> inputs;
+  /// segments of next level overlapping inputs
+  std::vector<std::shared_ptr<const Segment>> overlaps;
+};
+}  // namespace jbkv::lsm
+
+namespace {
+
+using Segments = std::vector<std::shared_ptr<const Segment>>;
+
+/// tree whose writer lock calling thread holds
+thread_local const Tree* writing = nullptr;
+
+/// Sorted sequence of entries
+class Cursor {
+ public:
+  virtual ~Cursor() = default;
+  virtual bool Valid() const = 0;
+  virtual std::string_view Key() const = 0;
+  /// @return nullopt for removal
+  virtual std::optional<std::string_view> Value() const = 0;
+  virtual void Next() = 0;
+};
+
+using Cursors = std::vector<std::unique_ptr<Cursor>>;
+
+/// Entries of memtable or its copy
+template <typename It>
+class RangeCursor final : public Cursor {
+ public:
+  RangeCursor(It begin, It end)
+      : it_(begin),
+        end_(end) {
+  }
+
+  bool Valid() const override {
+    return it_ != end_;
+  }
+
+  std::string_view Key() const override {
+    return it_->first;
+  }
+
+  std::optional<std::string_view> Value() const override {
+    return View(it_->second);
+  }
+
+  void Next() override {
+    ++it_;
+  }
+
+ private:
+  It it_;
+  const It end_;
+};
+
+template <typename It>
+std::unique_ptr<Cursor> MakeRangeCursor(It begin, It end) {
+  return std::make_unique<RangeCursor<It>>(begin, end);
+}
+
+class SegmentCursor final : public Cursor {
+ public:
+  /// Positions cursor at first key not less than start
+  SegmentCursor(std::shared_ptr<const Segment> segment, std::string_view start)
+      : segment_(std::move(segment)),
+        block_(segment_->SeekBlock(start)),
+        in_(segment_->SeekEntry(block_, start)) {
+    Next();
+    while (valid_ && entry_.key < start) {
+      Next();
+    }
+  }
+
+  bool Valid() const override {
+    return valid_;
+  }
+
+  std::string_view Key() const override {
+    return entry_.key;
+  }
+
+  std::optional<std::string_view> Value() const override {
+    return entry_.value;
+  }
+
+  void Next() override {
+    while (in_.Remaining() == 0) {
+      if (++block_ == segment_->Blocks()) {
+        valid_ = false;
+        return;
+      }
+
+      in_ = segment_->SeekEntry(block_, std::string_view());
+    }
+
+    DeserializeEntry(in_, entry_);
+    valid_ = true;
+  }
+
+ private:
+  const std::shared_ptr<const Segment> segment_;
+  size_t block_ = 0;
+  MemoryReader in_;
+  EntryView entry_;
+  bool valid_ = false;
+};
+
+/// Disjoint sorted segments of level read one after another
+class LevelCursor final : public Cursor {
+ public:
+  LevelCursor(const Segments& segments, std::string_view start)
+      : segments_(segments) {
+    while (segment_ < segments_.size() &&
+           segments_[segment_]->Largest() < start) {
+      ++segment_;
+    }
+
+    if (segment_ < segments_.size()) {
+      cursor_.emplace(segments_[segment_], start);
+    }
+  }
+
+  bool Valid() const override {
+    return cursor_ && cursor_->Valid();
+  }
+
+  std::string_view Key() const override {
+    return cursor_->Key();
+  }
+
+  std::optional<std::string_view> Value() const override {
+    return cursor_->Value();
+  }
+
+  void Next() override {
+    cursor_->Next();
+    if (!cursor_->Valid() && ++segment_ < segments_.size()) {
+      cursor_.emplace(segments_[segment_], std::string_view());
+    }
+  }
+
+ private:
+  const Segments segments_;
+  size_t segment_ = 0;
+  std::optional<SegmentCursor> cursor_;
+};
+
+/// Merges sources ordered from newest to oldest, entry of newest source
+/// hides entries of older ones with the same key
+class MergeCursor final : public Cursor {
+ public:
+  explicit MergeCursor(Cursors sources)
+      : sources_(std::move(sources)) {
+    Select();
+  }
+
+  bool Valid() const override {
+    return current_ != nullptr;
+  }
+
+  std::string_view Key() const override {
+    return current_->Key();
+  }
+
+  std::optional<std::string_view> Value() const override {
+    return current_->Value();
+  }
+
+  void Next() override {
+    /// sources keep their entries in memory, so key outlives advance
+    const auto key = current_->Key();
+    for (const auto& source : sources_) {
+      if (source->Valid() && source->Key() == key) {
+        source->Next();
+      }
+    }
+
+    Select();
+  }
+
+ private:
+  void Select() {
+    current_ = nullptr;
+    for (const auto& source : sources_) {
+      if (source->Valid() && (!current_ || source->Key() < current_->Key())) {
+        current_ = source.get();
+      }
+    }
+  }
+
+ private:
+  const Cursors sources_;
+  Cursor* current_ = nullptr;
+};
+
+/// Adds cursors over segments of every level starting at start key
+void AddSegmentCursors(
+    const std::vector<Segments>& levels, std::string_view start,
+    Cursors& sources) {
+  for (const auto& segment : levels[0]) {
+    if (segment->Largest() >= start) {
+      sources.push_back(std::make_unique<SegmentCursor>(segment, start));
+    }
+  }
+
+  for (size_t level = 1; level < levels.size(); ++level) {
+    if (!levels[level].empty()) {
+      sources.push_back(std::make_unique<LevelCursor>(levels[level], start));
+    }
+  }
+}
+
+uint64_t LevelSize(const Segments& segments) {
+  uint64_t size = 0;
+  for (const auto& segment : segments) {
+    size += segment->Size();
+  }
+
+  return size;
+}
+
+bool Contains(const Segments& segments,
+              const std::shared_ptr<const Segment>& segment) {
+  return std::find(segments.begin(), segments.end(), segment) !=
+         segments.end();
+}
+}  // namespace
+
+Tree::Tree(const std::filesystem::path& directory, const LsmOptions& options)
+    : directory_(directory),
+      options_(options),
+      compact_pointers_(kLevels) {
+  std::filesystem::create_directories(directory_);
+  Recover();
+  background_ = std::thread([this]() {
+    RunBackground();
+  });
+}
+
+Tree::~Tree() {
+  {
+    std::lock_guard lock(mutex_);
+    stop_ = true;
+  }
+
+  changed_.notify_all();
+  background_.join();
+}
+
+std::optional<std::string> Tree::Get(std::string_view key) const {
+  std::shared_ptr<const Version> version;
+  {
+    std::shared_lock lock(mutex_);
+    if (IsWriter()) {
+      const auto it = pending_.find(key);
+      if (it != pending_.end()) {
+        return it->second.value;
+      }
+    }
+
+    const Memtable* tables[] = {memtable_.get(), immutable_.get()};
+    for (const auto* table : tables) {
+      if (!table) {
+        continue;
+      }
+
+      const auto it = table->entries.find(key);
+      if (it != table->entries.end()) {
+        return it->second;
+      }
+    }
+
+    version = version_;
+  }
+
+  std::string value;
+  auto lookup = [&key, &value](const Segment& segment) {
+    return segment.Find(key, value);
+  };
+
+  /// level 0 is ordered from newest segment, the first one holding key wins
+  for (const auto& segment : version->levels[0]) {
+    const auto result = lookup(*segment);
+    if (result != Segment::Lookup::Missing) {
+      return result == Segment::Lookup::Found ? std::optional(value)
+                                              : std::nullopt;
+    }
+  }
+
+  for (size_t level = 1; level < kLevels; ++level) {
+    const auto& segments = version->levels[level];
+    const auto it = std::lower_bound(
+        segments.begin(), segments.end(), key,
+        [](const std::shared_ptr<const Segment>& segment,
+           std::string_view key) {
+          return segment->Largest() < key;
+        });
+    if (it == segments.end()) {
+      continue;
+    }
+
+    const auto result = lookup(**it);
+    if (result != Segment::Lookup::Missing) {
+      return result == Segment::Lookup::Found ? std::optional(value)
+                                              : std::nullopt;
+    }
+  }
+
+  return std::nullopt;
+}
+
+void Tree::Scan(std::string_view prefix, const Visitor& visitor) const {
+  /// live memtable changes under readers, so its range is copied
+  std::vector<std::pair<std::string, std::optional<std::string>>> pending;
+  std::vector<std::pair<std::string, std::optional<std::string>>> recent;
+  std::shared_ptr<const Memtable> immutable;
+  std::shared_ptr<const Version> version;
+  {
+    std::shared_lock lock(mutex_);
+    if (IsWriter()) {
+      for (auto it = pending_.lower_bound(prefix);
+           it != pending_.end() && it->first.starts_with(prefix); ++it) {
+        pending.emplace_back(it->first, it->second.value);
+      }
+    }
+
+    const auto& entries = memtable_->entries;
+    for (auto it = entries.lower_bound(prefix);
+         it != entries.end() && it->first.starts_with(prefix); ++it) {
+      recent.emplace_back(*it);
+    }
+
+    immutable = immutable_;
+    version = version_;
+  }
+
+  Cursors sources;
+  sources.push_back(MakeRangeCursor(pending.begin(), pending.end()));
+  sources.push_back(MakeRangeCursor(recent.begin(), recent.end()));
+  if (immutable) {
+    sources.push_back(MakeRangeCursor(immutable->entries.lower_bound(prefix),
+                                      immutable->entries.end()));
+  }
+
+  AddSegmentCursors(version->levels, prefix, sources);
+  for (MergeCursor cursor(std::move(sources));
+       cursor.Valid() && cursor.Key().starts_with(prefix); cursor.Next()) {
+    const auto value = cursor.Value();
+    if (value && !visitor(cursor.Key(), *value)) {
+      return;
+    }
+  }
+}
+
+void Tree::Flush() {
+  std::lock_guard write_lock(write_mutex_);
+  std::unique_lock lock(mutex_);
+  if (!memtable_->entries.empty()) {
+    Rotate(lock);
+  }
+
+  changed_.wait(lock, [this]() {
+    return (!immutable_ && idle_) || error_;
+  });
+  if (error_) {
+    std::rethrow_exception(error_);
+  }
+}
+
+std::vector<size_t> Tree::Levels() const {
+  std::shared_lock lock(mutex_);
+  std::vector<size_t> result;
+  for (const auto& segments : version_->levels) {
+    result.push_back(segments.size());
+  }
+
+  return result;
+}
+
+void Tree::Apply(Batch& batch, std::unique_lock<std::mutex>& lock) {
+  if (batch.Empty()) {
+    return;
+  }
+
+  io::MemoryWriter payload;
+  SerializeVarint(batch.changes_.size(), payload);
+  for (const auto& [key, value] : batch.changes_) {
+    SerializeEntry(key, View(value), payload);
+  }
+
+  io::MemoryWriter record;
+  io::AppendFramed(payload.Data(), record);
+
+  /// memtable_ and log_ are replaced under write lock only, so writer reads
+  /// them without state lock; size of memtable grows as pending batches are
+  /// published, so it is read under state lock
+  bool full = false;
+  {
+    std::shared_lock state_lock(mutex_);
+    if (error_) {
+      std::rethrow_exception(error_);
+    }
+
+    full = memtable_->bytes >= options_.memtable_size;
+  }
+
+  if (full) {
+    std::unique_lock state_lock(mutex_);
+    Rotate(state_lock);
+  }
+
+  auto log = log_;
+  log->Write(record.Data());
+  uint64_t sequence = 0;
+  {
+    std::lock_guard state_lock(mutex_);
+    sequence = ++logged_;
+    if (!options_.sync) {
+      for (auto& [key, value] : batch.changes_) {
+        Insert(*memtable_, std::move(key), std::move(value));
+      }
+
+      published_ = sequence;
+      return;
+    }
+
+    for (const auto& [key, value] : batch.changes_) {
+      pending_.insert_or_assign(key, Pending{value, sequence});
+    }
+  }
+
+  /// writers which follow append to log while this one waits for sync
+  lock.unlock();
+  Publish(batch, sequence, *log);
+}
+
+void Tree::Publish(Batch& batch, uint64_t sequence, io::LogFile& log) {
+  std::exception_ptr error;
+  try {
+    uint64_t logged = 0;
+    {
+      std::shared_lock state_lock(mutex_);
+      logged = synced_ < sequence ? logged_ : 0;
+    }
+
+    /// sync covers every batch logged before it started
+    if (logged != 0) {
+      log.Sync();
+      std::lock_guard state_lock(mutex_);
+      synced_ = std::max(synced_, logged);
+    }
+  } catch (...) {
+    error = std::current_exception();
+  }
+
+  std::unique_lock state_lock(mutex_);
+  changed_.wait(state_lock, [this, sequence]() {
+    return published_ + 1 == sequence;
+  });
+
+  for (auto& [key, value] : batch.changes_) {
+    const auto it = pending_.find(key);
+    if (it != pending_.end() && it->second.sequence == sequence) {
+      pending_.erase(it);
+    }
+
+    if (!error) {
+      Insert(*memtable_, std::move(key), std::move(value));
+    }
+  }
+
+  /// batch may be in log without being durable, so tree stops accepting
+  /// changes
+  if (error && !error_) {
+    error_ = error;
+  }
+
+  published_ = sequence;
+  changed_.notify_all();
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+bool Tree::IsWriter() const {
+  return writing == this;
+}
+
+Tree::WriterScope::WriterScope(const Tree& tree)
+    : previous_(writing) {
+  writing = &tree;
+}
+
+Tree::WriterScope::~WriterScope() {
+  writing = previous_;
+}
+
+void Tree::Rotate(std::unique_lock<std::shared_mutex>& lock) {
+  /// changes of batches being synced belong to memtable of their log
+  changed_.wait(lock, [this]() {
+    return (!immutable_ && published_ == logged_) || error_;
+  });
+  if (error_) {
+    std::rethrow_exception(error_);
+  }
+
+  const auto number = next_file_++;
+  log_ = CreateLog(number);
+  immutable_ = std::move(memtable_);
+  memtable_ = std::make_shared<Memtable>();
+  memtable_->logs.push_back(number);
+  changed_.notify_all();
+}
+
+std::shared_ptr<io::LogFile> Tree::CreateLog(uint64_t number) const {
+  const auto path = FilePath(number, ".log");
+  auto log = std::make_shared<io::LogFile>(path);
+  io::MemoryWriter header;
+  SerializeHeader(header, kBatchLogMagic, kBatchLogFormatVersion);
+  log->Write(header.Data());
+  if (options_.sync) {
+    io::SyncFile(path);
+  }
+
+  return log;
+}
+
+void Tree::Insert(Memtable& memtable, std::string&& key,
+                  std::optional<std::string>&& value) {
+  memtable.bytes += key.size() + (value ? value->size() : 0) + kEntryOverhead;
+  memtable.entries.insert_or_assign(std::move(key), std::move(value));
+}
+
+void Tree::Recover() {
+  auto version = std::make_shared<Version>();
+  version->levels.resize(kLevels);
+  std::unordered_set<uint64_t> live;
+
+  const auto manifest_path = directory_ / kManifestName;
+  if (std::filesystem::exists(manifest_path)) {
+    const MappedFile file(manifest_path);
+    MemoryReader in(file.Data(), file.Data() + file.Size());
+    if (DeserializeMagic(in) != kManifestMagic) {
+      throw std::runtime_error("Bad manifest format: " +
+                               manifest_path.string());
+    }
+
+    DeserializeVersion(in, kManifestFormatVersion);
+    CrcReader crc_in(in);
+    next_file_ = DeserializeVarint(crc_in);
+    log_number_ = DeserializeVarint(crc_in);
+    const auto levels = DeserializeVarint(crc_in);
+    if (levels > kLevels) {
+      throw std::runtime_error("Data corrupted");
+    }
+
+    std::vector<std::vector<uint64_t>> numbers(levels);
+    for (auto& level : numbers) {
+      level.resize(static_cast<size_t>(DeserializeVarint(crc_in)));
+      for (auto& number : level) {
+        number = DeserializeVarint(crc_in);
+      }
+    }
+
+    CheckCrc(crc_in, in);
+    for (size_t level = 0; level < numbers.size(); ++level) {
+      for (const auto number : numbers[level]) {
+        version->levels[level].push_back(std::make_shared<const Segment>(
+            FilePath(number, ".seg"), number));
+        live.insert(number);
+      }
+    }
+  }
+
+  std::vector<uint64_t> logs;
+  for (const auto& entry : std::filesystem::directory_iterator(directory_)) {
+    const auto& path = entry.path();
+    const auto extension = path.extension();
+    if (extension == ".tmp") {
+      std::filesystem::remove(path);
+      continue;
+    }
+
+    const auto number = ParseNumber(path.stem().string());
+    if (!number) {
+      continue;
+    }
+
+    next_file_ = std::max(next_file_.load(), *number + 1);
+    if (extension == ".seg" && live.count(*number) == 0) {
+      /// written by flush or compaction which did not publish it
+      std::filesystem::remove(path);
+    } else if (extension == ".log") {
+      if (*number < log_number_) {
+        std::filesystem::remove(path);
+      } else {
+        logs.push_back(*number);
+      }
+    }
+  }
+
+  std::sort(logs.begin(), logs.end());
+  auto replayed = std::make_shared<Memtable>();
+  for (const auto number : logs) {
+    Replay(FilePath(number, ".log"), *replayed);
+    replayed->logs.push_back(number);
+  }
+
+  version_ = std::move(version);
+  const auto number = next_file_++;
+  log_ = CreateLog(number);
+  memtable_ = std::make_shared<Memtable>();
+  memtable_->logs.push_back(number);
+  if (!replayed->entries.empty()) {
+    /// replayed changes are written to segment by background thread, and
+    /// their logs are removed after that
+    immutable_ = std::move(replayed);
+  } else {
+    for (const auto log : logs) {
+      std::filesystem::remove(FilePath(log, ".log"));
+    }
+  }
+}
+
+void Tree::Replay(const std::filesystem::path& path, Memtable& memtable) {
+  const MappedFile file(path);
+  if (file.Size() == 0) {
+    return;
+  }
+
+  MemoryReader in(file.Data(), file.Data() + file.Size());
+  if (DeserializeMagic(in) != kBatchLogMagic) {
+    throw std::runtime_error("Bad log format: " + path.string());
+  }
+
+  DeserializeVersion(in, kBatchLogFormatVersion);
+  EntryView entry;
+  for (;;) {
+    uint64_t size = 0;
+    if (in.Remaining() < sizeof(size)) {
+      break;
+    }
+
+    Deserialize(size, in);
+    if (size > in.Remaining() || in.Remaining() - size < sizeof(uint32_t)) {
+      break;
+    }
+
+    const auto* payload = in.Skip(size);
+    uint32_t stored_crc = 0;
+    Deserialize(stored_crc, in);
+    if (Crc32c(0, payload, static_cast<size_t>(size)) != stored_crc) {
+      break;
+    }
+
+    MemoryReader batch(payload, payload + size);
+    const auto count = DeserializeVarint(batch);
+    for (uint64_t i = 0; i < count; ++i) {
+      DeserializeEntry(batch, entry);
+      std::optional<std::string> value;
+      if (entry.value) {
+        value.emplace(*entry.value);
+      }
+
+      Insert(memtable, std::string(entry.key), std::move(value));
+    }
+  }
+}
+
+void Tree::WriteManifest(const Version& version, uint64_t log_number) const {
+  io::AsyncFileOptions options;
+  options.buffer_size = 64 << 10;
+  options.buffers = 1;
+  io::AsyncFileSink sink(directory_ / kManifestName, options);
+  io::BufferedWriter out(sink, options.buffer_size);
+  SerializeHeader(out, kManifestMagic, kManifestFormatVersion);
+  CrcWriter crc_out(out);
+  SerializeVarint(next_file_.load(), crc_out);
+  SerializeVarint(log_number, crc_out);
+  SerializeVarint(version.levels.size(), crc_out);
+  for (const auto& segments : version.levels) {
+    SerializeVarint(segments.size(), crc_out);
+    for (const auto& segment : segments) {
+      SerializeVarint(segment->Number(), crc_out);
+    }
+  }
+
+  Serialize(crc_out.Crc(), out);
+  out.Flush();
+  sink.Commit();
+}
+
+void Tree::RunBackground() {
+  std::unique_lock lock(mutex_);
+  while (!stop_) {
+    const auto memtable = immutable_;
+    std::optional<Compaction> compaction;
+    if (!memtable) {
+      compaction = PickCompaction(*version_);
+    }
+
+    if (!memtable && !compaction) {
+      idle_ = true;
+      changed_.notify_all();
+      changed_.wait(lock);
+      continue;
+    }
+
+    idle_ = false;
+    lock.unlock();
+    try {
+      if (memtable) {
+        FlushImmutable(memtable);
+      } else {
+        Compact(*compaction);
+      }
+    } catch (...) {
+      lock.lock();
+      error_ = std::current_exception();
+      changed_.notify_all();
+      return;
+    }
+
+    lock.lock();
+  }
+}
+
+void Tree::FlushImmutable(const std::shared_ptr<const Memtable>& memtable) {
+  std::shared_ptr<const Version> version;
+  uint64_t log_number = 0;
+  {
+    /// memtable is not rotated until immutable one is flushed
+    std::shared_lock lock(mutex_);
+    version = version_;
+    log_number = memtable_->logs.front();
+  }
+
+  /// removals hide nothing if there are no segments
+  const bool drop_removals = std::all_of(
+      version->levels.begin(), version->levels.end(),
+      [](const Segments& segments) { return segments.empty(); });
+
+  auto next = std::make_shared<Version>(*version);
+  std::unique_ptr<SegmentWriter> writer;
+  const auto number = next_file_++;
+  const auto path = FilePath(number, ".seg");
+  for (const auto& [key, value] : memtable->entries) {
+    if (!value && drop_removals) {
+      continue;
+    }
+
+    if (!writer) {
+      writer = std::make_unique<SegmentWriter>(path);
+    }
+
+    writer->Add(key, View(value));
+  }
+
+  if (writer) {
+    writer->Finish();
+    next->levels[0].insert(next->levels[0].begin(),
+                           std::make_shared<const Segment>(path, number));
+  }
+
+  WriteManifest(*next, log_number);
+  {
+    std::lock_guard lock(mutex_);
+    version_ = std::move(next);
+    log_number_ = log_number;
+    immutable_.reset();
+    changed_.notify_all();
+  }
+
+  for (const auto log : memtable->logs) {
+    std::error_code error;
+    std::filesystem::remove(FilePath(log, ".log"), error);
+  }
+}
+
+std::optional<Tree::Compaction> Tree::PickCompaction(const Version& version) {
+  const auto& levels = version.levels;
+  Compaction compaction;
+  if (levels[0].size() >= std::max<size_t>(options_.level0_segments, 1)) {
+    compaction.inputs = levels[0];
+  } else {
+    uint64_t limit = options_.level1_size;
+    for (size_t level = 1; level + 1 < kLevels; ++level) {
+      const auto& segments = levels[level];
+      if (LevelSize(segments) > limit) {
+        /// segments of level are compacted in turn
+        auto& pointer = compact_pointers_[level];
+        auto it = std::find_if(
+            segments.begin(), segments.end(),
+            [&pointer](const std::shared_ptr<const Segment>& segment) {
+              return segment->Smallest() > pointer;
+            });
+        if (it == segments.end()) {
+          it = segments.begin();
+        }
+
+        pointer = (*it)->Largest();
+        compaction.level = level;
+        compaction.inputs.push_back(*it);
+        break;
+      }
+
+      limit *= std::max<uint64_t>(options_.level_ratio, 1);
+    }
+
+    if (compaction.inputs.empty()) {
+      return std::nullopt;
+    }
+  }
+
+  std::string_view smallest = compaction.inputs.front()->Smallest();
+  std::string_view largest = compaction.inputs.front()->Largest();
+  for (const auto& segment : compaction.inputs) {
+    smallest = std::min<std::string_view>(smallest, segment->Smallest());
+    largest = std::max<std::string_view>(largest, segment->Largest());
+  }
+
+  for (const auto& segment : levels[compaction.level + 1]) {
+    if (segment->Largest() >= smallest && segment->Smallest() <= largest) {
+      compaction.overlaps.push_back(segment);
+    }
+  }
+
+  return compaction;
+}
+
+void Tree::Compact(const Compaction& compaction) {
+  std::shared_ptr<const Version> version;
+  uint64_t log_number = 0;
+  {
+    std::shared_lock lock(mutex_);
+    version = version_;
+    log_number = log_number_;
+  }
+
+  const auto target = compaction.level + 1;
+  auto next = std::make_shared<Version>(*version);
+  auto& inputs = next->levels[compaction.level];
+  auto& outputs = next->levels[target];
+  std::erase_if(inputs, [&compaction](const auto& segment) {
+    return Contains(compaction.inputs, segment);
+  });
+  std::erase_if(outputs, [&compaction](const auto& segment) {
+    return Contains(compaction.overlaps, segment);
+  });
+
+  if (compaction.level > 0 && compaction.overlaps.empty()) {
+    /// segment which overlaps nothing is moved without rewriting
+    outputs.push_back(compaction.inputs.front());
+  } else {
+    /// removals hide nothing if there are no deeper segments
+    const bool drop_removals =
+        std::all_of(version->levels.begin() + target + 1,
+                    version->levels.end(),
+                    [](const Segments& segments) { return segments.empty(); });
+
+    Cursors sources;
+    for (const auto& segment : compaction.inputs) {
+      sources.push_back(
+          std::make_unique<SegmentCursor>(segment, std::string_view()));
+    }
+
+    sources.push_back(std::make_unique<LevelCursor>(compaction.overlaps,
+                                                    std::string_view()));
+
+    std::unique_ptr<SegmentWriter> writer;
+    uint64_t number = 0;
+    auto finish = [this, &writer, &number, &outputs]() {
+      writer->Finish();
+      writer.reset();
+      outputs.push_back(
+          std::make_shared<const Segment>(FilePath(number, ".seg"), number));
+    };
+
+    for (MergeCursor cursor(std::move(sources)); cursor.Valid();
+         cursor.Next()) {
+      const auto value = cursor.Value();
+      if (!value && drop_removals) {
+        continue;
+      }
+
+      if (!writer) {
+        number = next_file_++;
+        writer = std::make_unique<SegmentWriter>(FilePath(number, ".seg"));
+      }
+
+      writer->Add(cursor.Key(), value);
+      if (writer->Size() >= options_.segment_size) {
+        finish();
+      }
+    }
+
+    if (writer) {
+      finish();
+    }
+  }
+
+  std::sort(outputs.begin(), outputs.end(),
+            [](const auto& lhs, const auto& rhs) {
+              return lhs->Smallest() < rhs->Smallest();
+            });
+
+  WriteManifest(*next, log_number);
+  {
+    std::lock_guard lock(mutex_);
+    version_ = std::move(next);
+    changed_.notify_all();
+  }
+
+  for (const auto& segments : {compaction.inputs, compaction.overlaps}) {
+    for (const auto& segment : segments) {
+      if (!Contains(version_->levels[target], segment)) {
+        segment->Retire();
+      }
+    }
+  }
+}
+
+std::filesystem::path Tree::FilePath(uint64_t number,
+                                     const char* suffix) const {
+  auto name = std::to_string(number);
+  if (name.size() < 6) {
+    name.insert(0, 6 - name.size(), '0');
+  }
+
+  return directory_ / (name + suffix);
+}
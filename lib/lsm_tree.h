@@ -0,0 +1,207 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "lsm_volume.h"
+#include "noncopyable.h"
+
+namespace jbkv::io {
+class LogFile;
+}
+
+/// Log-structured merge tree of byte strings
+/// Changes are appended to log and applied to sorted in-memory table, full
+/// table is written to immutable sorted segment file of level 0 by
+/// background thread. Segments of level 0 may overlap, segments of deeper
+/// levels are sorted and disjoint; background compaction merges level
+/// which outgrows its limit into the next one.
+/// @note not a part of public interface
+namespace jbkv::lsm {
+
+class Segment;
+
+/// Changes applied to tree atomically
+class Batch {
+ public:
+  void Put(std::string key, std::string value) {
+    changes_.emplace_back(std::move(key), std::move(value));
+  }
+
+  void Remove(std::string key) {
+    changes_.emplace_back(std::move(key), std::nullopt);
+  }
+
+  bool Empty() const {
+    return changes_.empty();
+  }
+
+ private:
+  friend class Tree;
+
+  /// nullopt value is removal
+  std::vector<std::pair<std::string, std::optional<std::string>>> changes_;
+};
+
+class Tree : NonCopyableNonMovable {
+ public:
+  /// @return false to stop scan
+  using Visitor =
+      std::function<bool(std::string_view key, std::string_view value)>;
+
+  static constexpr size_t kLevels = 7;
+
+ public:
+  /// Opens tree stored in directory, creating directory if needed, and
+  /// replays logs of changes which were not written to segments
+  /// @throw std::runtime_error if files of tree are corrupted
+  Tree(const std::filesystem::path& directory, const LsmOptions& options);
+
+  /// Stops background work, changes which are not written to segments stay
+  /// in log
+  ~Tree();
+
+  std::optional<std::string> Get(std::string_view key) const;
+
+  /// Visits keys starting with prefix in ascending order
+  void Scan(std::string_view prefix, const Visitor& visitor) const;
+
+  /// Runs fn with exclusive access among writers and applies changes it
+  /// adds to batch, so fn may read tree to decide on changes
+  /// With sync option, changes become visible to readers once log is synced,
+  /// while reads of fn see changes of earlier writers which are still being
+  /// synced
+  /// @return result of fn
+  /// @throw std::runtime_error if background work failed
+  template <typename Fn>
+  auto Write(Fn&& fn) {
+    std::unique_lock lock(write_mutex_);
+    const WriterScope scope(*this);
+    Batch batch;
+    if constexpr (std::is_void_v<std::invoke_result_t<Fn&, Batch&>>) {
+      fn(batch);
+      Apply(batch, lock);
+    } else {
+      auto result = fn(batch);
+      Apply(batch, lock);
+      return result;
+    }
+  }
+
+  /// Writes in-memory table to segment and waits until background work is
+  /// done
+  void Flush();
+
+  /// @return number of segments per level
+  std::vector<size_t> Levels() const;
+
+ private:
+  struct Memtable {
+    std::map<std::string, std::optional<std::string>, std::less<>> entries;
+    size_t bytes = 0;
+    /// logs holding changes of table
+    std::vector<uint64_t> logs;
+  };
+
+  /// Segments of every level, immutable once published
+  struct Version {
+    std::vector<std::vector<std::shared_ptr<const Segment>>> levels;
+  };
+
+  struct Compaction;
+
+  /// Change of batch which is logged, but not yet synced and published
+  struct Pending {
+    std::optional<std::string> value;
+    /// of batch which made change
+    uint64_t sequence = 0;
+  };
+
+  /// Marks calling thread as writer of tree, so its reads see pending
+  /// changes
+  class WriterScope : NonCopyableNonMovable {
+   public:
+    explicit WriterScope(const Tree& tree);
+    ~WriterScope();
+
+   private:
+    const Tree* const previous_;
+  };
+
+ private:
+  /// Logs and applies batch
+  /// With sync option, log is synced after write lock is released, so that
+  /// one sync covers batches of writers which follow, and batches are
+  /// published in the order they were logged
+  void Apply(Batch& batch, std::unique_lock<std::mutex>& lock);
+  /// Syncs log up to batch of sequence and moves its changes from pending
+  /// ones to memtable
+  void Publish(Batch& batch, uint64_t sequence, io::LogFile& log);
+  /// @return true if calling thread writes to tree
+  bool IsWriter() const;
+
+  /// Moves memtable to background flush and switches to new log, waits
+  /// while previous memtable is being flushed
+  void Rotate(std::unique_lock<std::shared_mutex>& lock);
+  std::shared_ptr<io::LogFile> CreateLog(uint64_t number) const;
+  static void Insert(Memtable& memtable, std::string&& key,
+                     std::optional<std::string>&& value);
+
+  void Recover();
+  /// Applies batches of log until the end of log or first torn batch
+  static void Replay(const std::filesystem::path& path, Memtable& memtable);
+  void WriteManifest(const Version& version, uint64_t log_number) const;
+
+  void RunBackground();
+  void FlushImmutable(const std::shared_ptr<const Memtable>& memtable);
+  std::optional<Compaction> PickCompaction(const Version& version);
+  void Compact(const Compaction& compaction);
+
+  std::filesystem::path FilePath(uint64_t number, const char* suffix) const;
+
+ private:
+  const std::filesystem::path directory_;
+  const LsmOptions options_;
+  std::atomic<uint64_t> next_file_ = 1;
+
+  /// serializes writers
+  std::mutex write_mutex_;
+
+  /// guards state below, memtable_ and log_ are replaced under both locks,
+  /// so writers read them under write lock only
+  mutable std::shared_mutex mutex_;
+  std::condition_variable_any changed_;
+  std::shared_ptr<Memtable> memtable_;
+  std::shared_ptr<const Memtable> immutable_;
+  std::shared_ptr<const Version> version_;
+  std::shared_ptr<io::LogFile> log_;
+  /// changes visible to writers only, newer than memtable
+  std::map<std::string, Pending, std::less<>> pending_;
+  /// sequences of last batch logged, synced and published; memtable is
+  /// rotated only when every logged batch is published
+  uint64_t logged_ = 0;
+  uint64_t synced_ = 0;
+  uint64_t published_ = 0;
+  /// first log which is not written to segments
+  uint64_t log_number_ = 0;
+  bool idle_ = false;
+  bool stop_ = false;
+  std::exception_ptr error_;
+
+  /// largest key compacted last per level, used by background thread only
+  std::vector<std::string> compact_pointers_;
+  std::thread background_;
+};
+}  // namespace jbkv::lsm
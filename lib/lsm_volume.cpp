@@ -0,0 +1,324 @@
+#include "lsm_volume.h"
+#include "lsm_tree.h"
+#include "volume_format.h"
+#include "volume_node_impl.h"
+
+namespace {
+using namespace jbkv;
+
+constexpr auto kRootName = "/";
+constexpr uint64_t kRootId = 1;
+
+/// Records of node are keyed by big-endian id of node, so records of every
+/// node are adjacent, followed by kind of record and name of child or key
+enum class RecordKind : char { Child = 'c', Data = 'd' };
+
+std::string EncodeId(uint64_t id) {
+  std::string result(sizeof(id), '\0');
+  for (size_t i = sizeof(id); i-- > 0; id >>= 8) {
+    result[i] = static_cast<char>(id & 0xFF);
+  }
+
+  return result;
+}
+
+uint64_t DecodeId(std::string_view bytes) {
+  if (bytes.size() < sizeof(uint64_t)) {
+    throw std::runtime_error("Data corrupted");
+  }
+
+  uint64_t id = 0;
+  for (size_t i = 0; i < sizeof(id); ++i) {
+    id = id << 8 | static_cast<uint8_t>(bytes[i]);
+  }
+
+  return id;
+}
+
+std::string RecordPrefix(uint64_t id, RecordKind kind) {
+  auto result = EncodeId(id);
+  result.push_back(static_cast<char>(kind));
+  return result;
+}
+
+std::string RecordKey(uint64_t id, RecordKind kind, std::string_view name) {
+  auto result = RecordPrefix(id, kind);
+  result.append(name);
+  return result;
+}
+
+/// Id 0 is never assigned to node, its record keeps next free id
+const std::string kNextIdKey = EncodeId(0) + "next";
+
+/// Appends bytes to string
+class StringWriter {
+ public:
+  explicit StringWriter(std::string& out)
+      : out_(out) {
+  }
+
+  void Write(const void* data, uint64_t size) {
+    out_.append(static_cast<const char*>(data), static_cast<size_t>(size));
+  }
+
+ private:
+  std::string& out_;
+};
+
+std::string EncodeValue(const Value& value) {
+  std::string result;
+  StringWriter out(result);
+  format::CompactWriter compact_out(out);
+  format::Serialize(value, compact_out);
+  return result;
+}
+
+Value DecodeValue(std::string_view bytes) {
+  const auto* data = reinterpret_cast<const uint8_t*>(bytes.data());
+  format::MemoryReader in(data, data + bytes.size());
+  format::CompactReader compact_in(in);
+  std::optional<Value> value;
+  format::Deserialize(value, compact_in);
+  return std::move(*value);
+}
+
+/// Node with its record in parent
+struct NodeLink {
+  /// zero for root
+  uint64_t parent = 0;
+  VolumeNode::Name name;
+  uint64_t id = kRootId;
+};
+
+/// Tree shared by nodes of volume
+struct LsmVolume : NonCopyableNonMovable {
+  LsmVolume(const std::filesystem::path& directory, const LsmOptions& options)
+      : tree(directory, options) {
+    const auto stored = tree.Get(kNextIdKey);
+    next_id = stored ? DecodeId(*stored) : kRootId + 1;
+  }
+
+  /// @return false if node or its ancestor is unlinked: unlink removes
+  /// records of subtree, record of node in parent included
+  /// @note called by writers of tree, so result holds while they write
+  bool Linked(const NodeLink& link) const {
+    if (link.parent == 0) {
+      return true;
+    }
+
+    const auto stored =
+        tree.Get(RecordKey(link.parent, RecordKind::Child, link.name));
+    return stored && DecodeId(*stored) == link.id;
+  }
+
+  lsm::Tree tree;
+  /// changed by writers of tree only
+  uint64_t next_id = 0;
+};
+
+using VolumePtr = std::shared_ptr<LsmVolume>;
+
+class LsmNodeData final : public NodeData {
+ public:
+  LsmNodeData(VolumePtr volume, NodeLink link)
+      : volume_(std::move(volume)),
+        link_(std::move(link)) {
+  }
+
+  std::optional<Value> Read(const Key& key) const override {
+    const auto stored = volume_->tree.Get(Record(key));
+    if (!stored) {
+      return std::nullopt;
+    }
+
+    return DecodeValue(*stored);
+  }
+
+  /// Write to data of unlinked node is dropped, as its records would be
+  /// unreachable
+  void Write(const Key& key, Value&& value) override {
+    auto record = Record(key);
+    auto encoded = EncodeValue(value);
+    auto& volume = *volume_;
+    volume.tree.Write([this, &volume, &record, &encoded](lsm::Batch& batch) {
+      if (volume.Linked(link_)) {
+        batch.Put(std::move(record), std::move(encoded));
+      }
+    });
+  }
+
+  bool Update(const Key& key, Value&& value) override {
+    auto record = Record(key);
+    auto encoded = EncodeValue(value);
+    auto& tree = volume_->tree;
+    return tree.Write([&tree, &record, &encoded](lsm::Batch& batch) {
+      if (!tree.Get(record)) {
+        return false;
+      }
+
+      batch.Put(std::move(record), std::move(encoded));
+      return true;
+    });
+  }
+
+  bool Remove(const Key& key) override {
+    auto record = Record(key);
+    auto& tree = volume_->tree;
+    return tree.Write([&tree, &record](lsm::Batch& batch) {
+      if (!tree.Get(record)) {
+        return false;
+      }
+
+      batch.Remove(std::move(record));
+      return true;
+    });
+  }
+
+  KeyValueList Enumerate() const override {
+    const auto prefix = RecordPrefix(link_.id, RecordKind::Data);
+    KeyValueList result;
+    volume_->tree.Scan(prefix, [&prefix, &result](std::string_view key,
+                                                  std::string_view value) {
+      result.emplace_back(key.substr(prefix.size()), DecodeValue(value));
+      return true;
+    });
+    return result;
+  }
+
+ private:
+  std::string Record(const Key& key) const {
+    return RecordKey(link_.id, RecordKind::Data, key);
+  }
+
+ private:
+  const VolumePtr volume_;
+  const NodeLink link_;
+};
+
+/// Node of volume stored in log-structured merge tree
+/// Node keeps no state besides its id and record in parent, every operation
+/// reads or changes records of tree
+class LsmVolumeNode final : public VolumeNode {
+ public:
+  LsmVolumeNode(VolumePtr volume, NodeLink link)
+      : link_(std::move(link)),
+        volume_(std::move(volume)) {
+  }
+
+  const Name& GetName() const override {
+    return link_.name;
+  }
+
+  /// @return invalid node if this node is unlinked, so no ids are taken by
+  /// unreachable children
+  VolumeNode::Ptr Create(const Name& name) override {
+    auto record = RecordKey(link_.id, RecordKind::Child, name);
+    auto& volume = *volume_;
+    if (const auto stored = volume.tree.Get(record)) {
+      return MakeNode(DecodeId(*stored), name);
+    }
+
+    const auto id =
+        volume.tree.Write([this, &volume, &record](lsm::Batch& batch) {
+          /// child may be created by another writer since lookup above
+          if (const auto stored = volume.tree.Get(record)) {
+            return DecodeId(*stored);
+          }
+
+          if (!volume.Linked(link_)) {
+            return uint64_t(0);
+          }
+
+          const auto id = volume.next_id++;
+          batch.Put(std::move(record), EncodeId(id));
+          batch.Put(kNextIdKey, EncodeId(volume.next_id));
+          return id;
+        });
+    if (id == 0) {
+      return NullVolumeNode::Instance();
+    }
+
+    return MakeNode(id, name);
+  }
+
+  VolumeNode::Ptr Find(const Name& name) const override {
+    const auto stored =
+        volume_->tree.Get(RecordKey(link_.id, RecordKind::Child, name));
+    if (!stored) {
+      return NullVolumeNode::Instance();
+    }
+
+    return MakeNode(DecodeId(*stored), name);
+  }
+
+  bool Unlink(const Name& name) override {
+    auto record = RecordKey(link_.id, RecordKind::Child, name);
+    auto& tree = volume_->tree;
+    return tree.Write([&tree, &record](lsm::Batch& batch) {
+      const auto stored = tree.Get(record);
+      if (!stored) {
+        return false;
+      }
+
+      /// records of unlinked subtree are removed, so it takes no space once
+      /// removals are compacted
+      std::vector<uint64_t> pending = {DecodeId(*stored)};
+      while (!pending.empty()) {
+        const auto id = pending.back();
+        pending.pop_back();
+        const auto child_prefix = RecordPrefix(id, RecordKind::Child);
+        tree.Scan(EncodeId(id), [&](std::string_view key,
+                                    std::string_view value) {
+          if (key.starts_with(child_prefix)) {
+            pending.push_back(DecodeId(value));
+          }
+
+          batch.Remove(std::string(key));
+          return true;
+        });
+      }
+
+      batch.Remove(std::move(record));
+      return true;
+    });
+  }
+
+  NodeData::Ptr Open() const override {
+    return std::make_shared<LsmNodeData>(volume_, link_);
+  }
+
+  VolumeNode::List Enumerate() const override {
+    const auto prefix = RecordPrefix(link_.id, RecordKind::Child);
+    VolumeNode::List result;
+    volume_->tree.Scan(prefix, [this, &prefix, &result](
+                                   std::string_view key,
+                                   std::string_view value) {
+      result.push_back(
+          MakeNode(DecodeId(value), Name(key.substr(prefix.size()))));
+      return true;
+    });
+    return result;
+  }
+
+  bool IsValid() const override {
+    return true;
+  }
+
+ private:
+  VolumeNode::Ptr MakeNode(uint64_t id, const Name& name) const {
+    return std::make_shared<LsmVolumeNode>(volume_,
+                                           NodeLink{link_.id, name, id});
+  }
+
+ private:
+  const NodeLink link_;
+  const VolumePtr volume_;
+};
+}  // namespace
+
+VolumeNode::Ptr jbkv::OpenLsmVolume(const std::filesystem::path& directory,
+                                    const LsmOptions& options) {
+  auto volume = std::make_shared<LsmVolume>(directory, options);
+  return std::make_shared<LsmVolumeNode>(std::move(volume),
+                                         NodeLink{0, kRootName, kRootId});
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include "volume_node.h"
+
+namespace jbkv {
+
+struct LsmOptions {
+  /// size of in-memory table written to segment when full
+  size_t memtable_size = 8 << 20;
+  /// number of segments of level 0 which triggers their compaction
+  size_t level0_segments = 4;
+  /// total size of segments of level 1
+  uint64_t level1_size = 64 << 20;
+  /// growth of size limit from level to level
+  uint64_t level_ratio = 10;
+  /// size of segment written by compaction
+  uint64_t segment_size = 8 << 20;
+  /// every change is synced to storage before call making it returns and
+  /// before other threads see it, concurrent changes share syncs; otherwise
+  /// changes survive crash of process but not of system
+  bool sync = true;
+};
+
+/// Opens persistent volume stored in directory as log-structured merge tree,
+/// creating it if directory is empty
+/// Volume may be larger than memory: nodes and data entries are records of
+/// sorted files keyed by id of node and name of child or key, and only
+/// recent changes are kept in memory. Nodes are mounted by MountStorage,
+/// saved by Save and so on like nodes of any other volume.
+/// Unlink removes records of whole subtree, so nodes of subtree obtained
+/// before Unlink read as empty afterwards, their writes are dropped and
+/// their Create returns invalid node.
+/// Volume is closed when last of its nodes is released.
+/// @return non-null volume ptr
+/// @throw std::runtime_error if files of volume are corrupted
+/// @note directory must not be opened by several volumes at once
+VolumeNode::Ptr OpenLsmVolume(const std::filesystem::path& directory,
+                              const LsmOptions& options = {});
+
+}  // namespace jbkv
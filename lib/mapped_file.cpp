@@ -0,0 +1,101 @@
+#include "mapped_file.h"
+#include <stdexcept>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace jbkv;
+
+#if defined(_WIN32)
+
+MappedFile::MappedFile(const std::filesystem::path& path) {
+  file_ = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                      OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file_ == INVALID_HANDLE_VALUE) {
+    file_ = nullptr;
+    throw std::runtime_error("Cannot open file for reading: " + path.string());
+  }
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file_, &size)) {
+    CloseHandle(file_);
+    throw std::runtime_error("Cannot get file size: " + path.string());
+  }
+
+  size_ = static_cast<size_t>(size.QuadPart);
+  if (size_ == 0) {
+    return;
+  }
+
+  mapping_ = CreateFileMappingW(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (!mapping_) {
+    CloseHandle(file_);
+    throw std::runtime_error("Cannot map file: " + path.string());
+  }
+
+  data_ = static_cast<uint8_t*>(
+      MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+  if (!data_) {
+    CloseHandle(mapping_);
+    CloseHandle(file_);
+    throw std::runtime_error("Cannot map file: " + path.string());
+  }
+}
+
+MappedFile::~MappedFile() {
+  if (data_) {
+    UnmapViewOfFile(data_);
+  }
+
+  if (mapping_) {
+    CloseHandle(mapping_);
+  }
+
+  if (file_) {
+    CloseHandle(file_);
+  }
+}
+
+#else
+
+MappedFile::MappedFile(const std::filesystem::path& path) {
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("Cannot open file for reading: " + path.string());
+  }
+
+  struct stat info = {};
+  if (::fstat(fd, &info) != 0) {
+    ::close(fd);
+    throw std::runtime_error("Cannot get file size: " + path.string());
+  }
+
+  size_ = static_cast<size_t>(info.st_size);
+  if (size_ != 0) {
+    void* data = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+      ::close(fd);
+      throw std::runtime_error("Cannot map file: " + path.string());
+    }
+
+    data_ = static_cast<uint8_t*>(data);
+  }
+
+  /// mapping stays valid after descriptor is closed
+  ::close(fd);
+}
+
+MappedFile::~MappedFile() {
+  if (data_) {
+    ::munmap(data_, size_);
+  }
+}
+
+#endif
@@ -0,0 +1,39 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include "noncopyable.h"
+
+namespace jbkv {
+
+/// Read-only memory mapping of whole file
+class MappedFile : NonCopyableNonMovable {
+ public:
+  using Ptr = std::shared_ptr<const MappedFile>;
+
+ public:
+  /// @throw std::runtime_error if file cannot be mapped
+  explicit MappedFile(const std::filesystem::path& path);
+  ~MappedFile();
+
+  static Ptr Open(const std::filesystem::path& path) {
+    return std::make_shared<const MappedFile>(path);
+  }
+
+  const uint8_t* Data() const {
+    return data_;
+  }
+
+  size_t Size() const {
+    return size_;
+  }
+
+ private:
+  uint8_t* data_ = nullptr;
+  size_t size_ = 0;
+#if defined(_WIN32)
+  void* file_ = nullptr;
+  void* mapping_ = nullptr;
+#endif
+};
+}  // namespace jbkv
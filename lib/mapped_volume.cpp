@@ -0,0 +1,114 @@
+#include "volume_io.h"
+#include "volume_node_impl.h"
+#include "volume_snapshot.h"
+#include <mutex>
+
+namespace {
+using namespace jbkv;
+
+constexpr auto kRootName = "/";
+
+/// Node of mapped snapshot decoding its children and data on first access
+/// After decoding behaves as regular in-memory node
+class MappedVolumeNode final : public VolumeNode {
+ public:
+  MappedVolumeNode(VolumeSnapshot::Ptr snapshot, uint64_t record,
+                   const Name& name)
+      : name_(name),
+        record_(record),
+        snapshot_(std::move(snapshot)) {
+  }
+
+  const Name& GetName() const override {
+    return name_;
+  }
+
+  VolumeNode::Ptr Create(const Name& name) override {
+    Materialize();
+    std::lock_guard lock(mutex_);
+    auto& child = children_[name];
+    if (!child) {
+      child = std::make_shared<VolumeNodeImpl>(name);
+    }
+
+    return child;
+  }
+
+  VolumeNode::Ptr Find(const Name& name) const override {
+    Materialize();
+    std::shared_lock lock(mutex_);
+    auto it = children_.find(name);
+    if (it == children_.end()) {
+      return NullVolumeNode::Instance();
+    }
+
+    return it->second;
+  }
+
+  bool Unlink(const Name& name) override {
+    Materialize();
+    std::lock_guard lock(mutex_);
+    return children_.erase(name) == 1u;
+  }
+
+  NodeData::Ptr Open() const override {
+    Materialize();
+    return data_;
+  }
+
+  VolumeNode::List Enumerate() const override {
+    Materialize();
+    std::shared_lock lock(mutex_);
+    VolumeNode::List result;
+    result.reserve(children_.size());
+    for (const auto& [_, child] : children_) {
+      result.push_back(child);
+    }
+
+    return result;
+  }
+
+  bool IsValid() const override {
+    return true;
+  }
+
+ private:
+  void Materialize() const {
+    std::call_once(materialized_, [this]() {
+      auto data = std::make_shared<VolumeNodeData>();
+      snapshot_->Decode(
+          record_,
+          [this](std::string&& name, uint64_t child_record) {
+            auto child = std::make_shared<MappedVolumeNode>(
+                snapshot_, child_record, name);
+            children_.emplace(std::move(name), std::move(child));
+          },
+          [&data](std::string&& key, Value&& value) {
+            data->Write(key, std::move(value));
+          });
+
+      data_ = std::move(data);
+      /// mapping is released as soon as all nodes are decoded
+      snapshot_.reset();
+    });
+  }
+
+ private:
+  const Name name_;
+  const uint64_t record_;
+
+  mutable std::once_flag materialized_;
+  mutable VolumeSnapshot::Ptr snapshot_;
+  mutable NodeData::Ptr data_;
+
+  mutable std::shared_mutex mutex_;
+  mutable std::unordered_map<Name, VolumeNode::Ptr> children_;
+};
+}  // namespace
+
+VolumeNode::Ptr jbkv::OpenVolume(const std::filesystem::path& path) {
+  auto file = MappedFile::Open(path);
+  auto snapshot = std::make_shared<const VolumeSnapshot>(std::move(file));
+  return std::make_shared<MappedVolumeNode>(
+      std::move(snapshot), VolumeSnapshot::kRootRecord, kRootName);
+}
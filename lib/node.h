@@ -47,6 +47,27 @@ class Node : NonCopyableNonMovable {
 
   /// Returns false if node not exist, otherwise true
   virtual bool IsValid() const = 0;
+
+  /// Read-only node throws on Create and on Unlink of existing child
+  virtual bool IsReadOnly() const {
+    return false;
+  }
+
+  /// Asynchronous Find
+  /// Task waiting for contended lock is suspended and resumed on executor,
+  /// so it does not block thread of coroutine. Node which does not support
+  /// it runs blocking call on executor.
+  /// @note node must outlive task
+  virtual Task<Ptr> AsyncFind(Name name, Executor& executor) const {
+    co_await ScheduleOn(executor);
+    co_return Find(name);
+  }
+
+  /// helpers
+ public:
+  Task<Ptr> AsyncFind(Name name) const {
+    return AsyncFind(std::move(name), DefaultExecutor());
+  }
 };
 
 template <typename Parent>
@@ -1,6 +1,9 @@
 #pragma once
 #include <memory>
 #include <optional>
+#include <type_traits>
+#include <variant>
+#include "async.h"
 #include "noncopyable.h"
 #include "value.h"
 
@@ -36,6 +39,56 @@ class NodeData : NonCopyableNonMovable {
   /// List data entries (key=value)
   virtual KeyValueList Enumerate() const = 0;
 
+  /// Read-only data throws on Write and on Update or Remove of existing key
+  /// Storage writes shadow keys of read-only layers in the top layer instead
+  /// of changing them.
+  virtual bool IsReadOnly() const {
+    return false;
+  }
+
+  /// Reads scalar value by key
+  /// Data keeping scalars in sequence-locked slots reads them without locks,
+  /// by default value is read by Read
+  /// @return false if key does not exist or its value is not scalar
+  virtual bool ReadScalar(const Key& key, Value::Data& value) const {
+    const auto result = Read(key);
+    bool scalar = false;
+    if (result) {
+      result->Accept([&value, &scalar](const auto& data) {
+        using Data = std::decay_t<decltype(data)>;
+        if constexpr (std::is_arithmetic_v<Data>) {
+          value.emplace<Data>(data);
+          scalar = true;
+        }
+      });
+    }
+
+    return scalar;
+  }
+
+  /// Asynchronous Read, Write and Update
+  /// Task waiting for contended lock is suspended and resumed on executor,
+  /// so it does not block thread of coroutine. Data which does not support
+  /// it runs blocking call on executor.
+  /// @note data must outlive task
+  /// @{
+  virtual Task<std::optional<Value>> AsyncRead(Key key,
+                                               Executor& executor) const {
+    co_await ScheduleOn(executor);
+    co_return Read(key);
+  }
+
+  virtual Task<> AsyncWrite(Key key, Value value, Executor& executor) {
+    co_await ScheduleOn(executor);
+    Write(key, std::move(value));
+  }
+
+  virtual Task<bool> AsyncUpdate(Key key, Value value, Executor& executor) {
+    co_await ScheduleOn(executor);
+    co_return Update(key, std::move(value));
+  }
+  /// @}
+
   /// helpers
  public:
   template <typename T>
@@ -50,17 +103,43 @@ class NodeData : NonCopyableNonMovable {
 
   template <typename T>
   std::optional<T> Read(const Key& key) {
-    const auto value = Read(key);
-    if (!value) {
-      return std::nullopt;
-    }
+    if constexpr (std::is_arithmetic_v<T>) {
+      Value::Data value;
+      if (!ReadScalar(key, value)) {
+        return std::nullopt;
+      }
+
+      const auto* mb_data = std::get_if<T>(&value);
+      if (!mb_data) {
+        return std::nullopt;
+      }
+
+      return *mb_data;
+    } else {
+      const auto value = Read(key);
+      if (!value) {
+        return std::nullopt;
+      }
+
+      const auto* mb_data = value->Try<T>();
+      if (!mb_data) {
+        return std::nullopt;
+      }
 
-    const auto* mb_data = value->Try<T>();
-    if (!mb_data) {
-      return std::nullopt;
+      return *mb_data;
     }
+  }
+
+  Task<std::optional<Value>> AsyncRead(Key key) const {
+    return AsyncRead(std::move(key), DefaultExecutor());
+  }
+
+  Task<> AsyncWrite(Key key, Value value) {
+    return AsyncWrite(std::move(key), std::move(value), DefaultExecutor());
+  }
 
-    return *mb_data;
+  Task<bool> AsyncUpdate(Key key, Value value) {
+    return AsyncUpdate(std::move(key), std::move(value), DefaultExecutor());
   }
 };
 }  // namespace jbkv
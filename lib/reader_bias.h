@@ -0,0 +1,186 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+
+/// Reader bias of shared mutexes, enabled by JBKV_READER_BIASED_LOCKS
+/// @note not a part of public interface
+namespace jbkv {
+
+#if defined(JBKV_READER_BIASED_LOCKS)
+
+/// Lets readers take shared mutex without writing to state of mutex, so
+/// readers of different threads do not contend for its cache line (BRAVO)
+/// Reader publishes mutex in slot of process-wide table chosen by hash of
+/// mutex and thread, every slot takes its own cache line, so readers write
+/// to the same line only when their slots collide. Writer holding
+/// underlying mutex revokes bias and waits until no slot holds mutex. Bias
+/// is restored by readers only after period proportional to time of
+/// revocation, so mutexes which are written often are taken by underlying
+/// lock alone.
+class ReaderBias {
+ public:
+  /// @return true if shared lock is taken by bias
+  bool TryLockShared() {
+    if (!enabled_.load(std::memory_order_relaxed)) {
+      return false;
+    }
+
+    auto& slot = Slot();
+    const void* expected = nullptr;
+    if (!slot.compare_exchange_strong(expected, this)) {
+      return false;
+    }
+
+    /// pairs with TryRevoke: either writer sees slot or reader sees
+    /// revocation
+    if (enabled_.load()) {
+      return true;
+    }
+
+    slot.store(nullptr);
+    return false;
+  }
+
+  /// Releases shared lock taken by bias
+  /// Shared locks are interchangeable, so slot of colliding thread may be
+  /// released instead of underlying lock
+  /// @return false if shared lock is to be released by underlying lock
+  bool UnlockShared() {
+    const void* expected = this;
+    return Slot().compare_exchange_strong(expected, nullptr);
+  }
+
+  /// Revokes bias without waiting for readers which took lock by it
+  /// @return false while such readers remain: bias stays revoked and call
+  /// is repeated once Draining readers release their slots
+  /// @note called by writer holding underlying lock
+  bool TryRevoke() {
+    if (!draining_.load(std::memory_order_relaxed)) {
+      if (!enabled_.load(std::memory_order_relaxed)) {
+        return true;
+      }
+
+      draining_.store(true);
+      enabled_.store(false);
+      revoke_start_ = Now();
+    }
+
+    for (auto& slot : slots_) {
+      if (slot.mutex.load() == this) {
+        return false;
+      }
+    }
+
+    draining_.store(false, std::memory_order_relaxed);
+    const auto now = Now();
+    inhibit_until_.store(now + (now - revoke_start_) * kInhibitFactor,
+                         std::memory_order_relaxed);
+    return true;
+  }
+
+  /// Revokes bias and waits until readers which took lock by it release it
+  /// @param wait false makes it return right away if there are such readers
+  /// @return false if readers hold lock by bias and wait is false
+  /// @note called by writer holding underlying lock
+  bool Revoke(bool wait = true) {
+    while (!TryRevoke()) {
+      if (!wait) {
+        /// next writer has to wait for the same readers
+        draining_.store(false, std::memory_order_relaxed);
+        enabled_.store(true, std::memory_order_relaxed);
+        return false;
+      }
+
+      std::this_thread::yield();
+    }
+
+    return true;
+  }
+
+  /// @return true while writer waits for readers which took lock by bias,
+  /// checked by reader after it releases slot
+  /// @note slot is released before, so that either reader sees writer
+  /// draining or writer sees slot released
+  bool Draining() const {
+    return draining_.load();
+  }
+
+  /// Restores bias once inhibition period is over
+  /// @note called by reader holding underlying shared lock
+  void Restore() {
+    if (!enabled_.load(std::memory_order_relaxed) &&
+        Now() >= inhibit_until_.load(std::memory_order_relaxed)) {
+      enabled_.store(true, std::memory_order_release);
+    }
+  }
+
+ private:
+  static constexpr size_t kSlotBits = 10;
+  static constexpr int64_t kInhibitFactor = 9;
+
+  static int64_t Now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  struct alignas(64) PaddedSlot {
+    std::atomic<const void*> mutex;
+  };
+
+  std::atomic<const void*>& Slot() const {
+    /// address of thread local variable identifies thread
+    static thread_local char thread;
+    const auto key = (reinterpret_cast<uintptr_t>(this) ^
+                      reinterpret_cast<uintptr_t>(&thread)) *
+                     UINT64_C(0x9E3779B97F4A7C15);
+    return slots_[static_cast<uint64_t>(key) >> (64 - kSlotBits)].mutex;
+  }
+
+ private:
+  /// new mutex is not biased until it is read
+  std::atomic<bool> enabled_ = false;
+  /// set while revoking writer waits for slots to be released
+  std::atomic<bool> draining_ = false;
+  std::atomic<int64_t> inhibit_until_ = 0;
+  /// of revocation in progress, used by writer holding underlying lock
+  int64_t revoke_start_ = 0;
+
+  inline static PaddedSlot slots_[1 << kSlotBits];
+};
+
+#else
+
+/// Reader bias disabled at build time
+class ReaderBias {
+ public:
+  bool TryLockShared() {
+    return false;
+  }
+
+  bool UnlockShared() {
+    return false;
+  }
+
+  bool TryRevoke() {
+    return true;
+  }
+
+  bool Revoke(bool = true) {
+    return true;
+  }
+
+  bool Draining() const {
+    return false;
+  }
+
+  void Restore() {
+  }
+};
+
+#endif
+
+}  // namespace jbkv
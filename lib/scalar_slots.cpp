@@ -0,0 +1,174 @@
+#include "scalar_slots.h"
+#include <new>
+#include <vector>
+
+using namespace jbkv;
+
+namespace {
+/// tables are at most half full and at most quarter full when rebuilt, or
+/// half full with slots reserved at once
+constexpr size_t kMinCapacity = 8;
+}  // namespace
+
+ScalarSlots::~ScalarSlots() {
+  /// readers hold node, so none reads slots of destroyed one
+  auto* table = table_.load(std::memory_order_relaxed);
+  if (!table) {
+    return;
+  }
+
+  for (size_t i = 0; i <= table->mask; ++i) {
+    const auto* slot = table->slots[i].load(std::memory_order_relaxed);
+    if (slot && !slot->pooled) {
+      delete slot;
+    }
+  }
+
+  delete table;
+}
+
+void ScalarSlots::Store(const std::string& key, const Value* value) {
+  uint32_t index = kEmpty;
+  uint64_t bits = 0;
+  if (value) {
+    value->Accept([&index, &bits](const auto& data) {
+      using Data = std::decay_t<decltype(data)>;
+      if constexpr (std::is_arithmetic_v<Data>) {
+        index = static_cast<uint32_t>(Value::Data(data).index());
+        std::memcpy(&bits, &data, sizeof(data));
+      }
+    });
+  }
+
+  if (index == kEmpty && !table_.load(std::memory_order_relaxed)) {
+    return;
+  }
+
+  const auto hash = std::hash<std::string>{}(key);
+  auto* slot = Find(key, hash);
+  if (!slot) {
+    if (index == kEmpty) {
+      return;
+    }
+
+    slot = Add(key, hash);
+  }
+
+  slot->Store(index, bits);
+}
+
+void ScalarSlots::Reserve(size_t keys) {
+  const auto* table = table_.load(std::memory_order_relaxed);
+  if (keys == 0) {
+    return;
+  }
+
+  if (!table || (table->used + keys) * 2 > table->mask + 1) {
+    Rebuild(keys);
+  }
+
+  pools_.push_back(std::make_unique<Pool>(keys));
+}
+
+size_t ScalarSlots::Footprint() const {
+  const auto* table = table_.load(std::memory_order_relaxed);
+  if (!table) {
+    return 0;
+  }
+
+  size_t footprint = sizeof(Table) + (table->mask + 1) * sizeof(Slot*);
+  for (size_t i = 0; i <= table->mask; ++i) {
+    if (const auto* slot = table->slots[i].load(std::memory_order_relaxed)) {
+      footprint += sizeof(Slot) + slot->key.capacity();
+    }
+  }
+
+  return footprint;
+}
+
+ScalarSlots::Slot* ScalarSlots::Find(const std::string& key,
+                                     size_t hash) const {
+  const auto* table = table_.load(std::memory_order_relaxed);
+  if (!table) {
+    return nullptr;
+  }
+
+  for (size_t i = hash & table->mask;; i = (i + 1) & table->mask) {
+    auto* slot = table->slots[i].load(std::memory_order_relaxed);
+    if (!slot || (slot->hash == hash && slot->key == key)) {
+      return slot;
+    }
+  }
+}
+
+ScalarSlots::Slot* ScalarSlots::Add(const std::string& key, size_t hash) {
+  auto* table = table_.load(std::memory_order_relaxed);
+  if (!table || (table->used + 1) * 2 > table->mask + 1) {
+    table = &Rebuild(1);
+  }
+
+  Slot* slot = nullptr;
+  if (!pools_.empty() && pools_.back()->used < pools_.back()->capacity) {
+    auto& pool = *pools_.back();
+    slot = new (&pool.slots[pool.used]) Slot(key, hash);
+    slot->pooled = true;
+    ++pool.used;
+  } else {
+    slot = new Slot(key, hash);
+  }
+
+  Insert(*table, slot);
+  ++table->used;
+  return slot;
+}
+
+ScalarSlots::Table& ScalarSlots::Rebuild(size_t added) {
+  auto* old = table_.load(std::memory_order_relaxed);
+  std::vector<Slot*> live;
+  std::vector<Slot*> dropped;
+  if (old) {
+    for (size_t i = 0; i <= old->mask; ++i) {
+      if (auto* slot = old->slots[i].load(std::memory_order_relaxed)) {
+        if (slot->index.load(std::memory_order_relaxed) != kEmpty) {
+          live.push_back(slot);
+        } else if (!slot->pooled) {
+          dropped.push_back(slot);
+        }
+      }
+    }
+  }
+
+  size_t capacity = kMinCapacity;
+  while ((live.size() + 1) * 4 > capacity ||
+         (live.size() + added) * 2 > capacity) {
+    capacity *= 2;
+  }
+
+  auto* table = new Table(capacity);
+  for (auto* slot : live) {
+    Insert(*table, slot);
+  }
+
+  table->used = live.size();
+  table_.store(table, std::memory_order_release);
+  if (old) {
+    RetireAfterEpoch([old, dropped = std::move(dropped)] {
+      for (auto* slot : dropped) {
+        delete slot;
+      }
+
+      delete old;
+    });
+  }
+
+  return *table;
+}
+
+void ScalarSlots::Insert(Table& table, Slot* slot) {
+  size_t i = slot->hash & table.mask;
+  while (table.slots[i].load(std::memory_order_relaxed)) {
+    i = (i + 1) & table.mask;
+  }
+
+  table.slots[i].store(slot, std::memory_order_release);
+}
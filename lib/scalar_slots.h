@@ -0,0 +1,192 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <variant>
+#include <vector>
+#include "epoch.h"
+#include "noncopyable.h"
+#include "value.h"
+
+/// Scalar values of entries readable without locks
+/// @note not a part of public interface
+namespace jbkv {
+
+/// Scalar values of node entries kept in sequence-locked slots, so readers
+/// take no locks and make no stores to shared memory, and retry if value
+/// changes while they read it
+/// Slots are changed only by single writer, i.e. under exclusive lock of
+/// node, and are allocated with the first scalar value, or at once for
+/// keys stored after Reserve. Removed key keeps its slot marked empty until
+/// lookup table is rebuilt on growth, which drops empty slots. Replaced
+/// table and dropped slots are freed once readers pinned to epoch when they
+/// were replaced are gone, slots allocated at once are freed with slots.
+class ScalarSlots : NonCopyableNonMovable {
+ public:
+  ScalarSlots() = default;
+  ~ScalarSlots();
+
+  /// Reads scalar value of key
+  /// @return false if key has no value or its value is not scalar
+  bool Read(const std::string& key, Value::Data& value) const {
+    if (!table_.load(std::memory_order_relaxed)) {
+      return false;
+    }
+
+    EpochGuard guard;
+    const auto* table = table_.load(std::memory_order_acquire);
+
+    const auto hash = std::hash<std::string>{}(key);
+    for (size_t i = hash & table->mask;; i = (i + 1) & table->mask) {
+      const auto* slot = table->slots[i].load(std::memory_order_acquire);
+      if (!slot) {
+        return false;
+      }
+
+      if (slot->hash == hash && slot->key == key) {
+        return slot->Load(value);
+      }
+    }
+  }
+
+  /// Stores value of key, nullptr or value which is not scalar empties slot
+  /// @note called by single writer
+  void Store(const std::string& key, const Value* value);
+
+  /// Sizes table and allocates slots at once, so that as many new keys are
+  /// stored without rebuilding table and allocating slots one by one
+  /// @note called by single writer
+  void Reserve(size_t keys);
+
+  /// @return memory taken by slots
+  /// @note called by writer or under shared lock of node
+  size_t Footprint() const;
+
+ private:
+  static constexpr uint32_t kEmpty = std::variant_size_v<Value::Data>;
+
+  struct Slot : NonCopyableNonMovable {
+    Slot(const std::string& key, size_t hash)
+        : key(key),
+          hash(hash) {
+    }
+
+    bool Load(Value::Data& value) const {
+      uint32_t index = kEmpty;
+      uint64_t bits = 0;
+      for (;;) {
+        const auto before = sequence.load(std::memory_order_acquire);
+        if (before & 1) {
+          /// writer may be preempted in the middle of store
+          std::this_thread::yield();
+          continue;
+        }
+
+        index = this->index.load(std::memory_order_relaxed);
+        bits = this->bits.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (sequence.load(std::memory_order_relaxed) == before) {
+          break;
+        }
+      }
+
+      return Decode(index, bits, value);
+    }
+
+    void Store(uint32_t index, uint64_t bits) {
+      const auto before = sequence.load(std::memory_order_relaxed);
+      sequence.store(before + 1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+      this->index.store(index, std::memory_order_relaxed);
+      this->bits.store(bits, std::memory_order_relaxed);
+      sequence.store(before + 2, std::memory_order_release);
+    }
+
+    const std::string key;
+    const size_t hash;
+    /// allocated by Reserve, freed with pool
+    bool pooled = false;
+    /// odd while value is being stored
+    std::atomic<uint32_t> sequence = 0;
+    /// alternative of Value::Data, kEmpty if there is no scalar value
+    std::atomic<uint32_t> index = kEmpty;
+    std::atomic<uint64_t> bits = 0;
+  };
+
+  struct Table {
+    explicit Table(size_t capacity)
+        : mask(capacity - 1),
+          slots(std::make_unique<std::atomic<Slot*>[]>(capacity)) {
+    }
+
+    const size_t mask;
+    std::unique_ptr<std::atomic<Slot*>[]> slots;
+    /// slots in table including empty ones, changed by writer
+    size_t used = 0;
+  };
+
+  /// Slots allocated at once by Reserve
+  struct Pool : NonCopyableNonMovable {
+    explicit Pool(size_t capacity)
+        : slots(std::allocator<Slot>().allocate(capacity)),
+          capacity(capacity) {
+    }
+
+    ~Pool() {
+      for (size_t i = 0; i < used; ++i) {
+        slots[i].~Slot();
+      }
+
+      std::allocator<Slot>().deallocate(slots, capacity);
+    }
+
+    Slot* const slots;
+    const size_t capacity;
+    size_t used = 0;
+  };
+
+  /// Builds value from alternative and its bits
+  /// @return false if index is kEmpty
+  template <size_t Index = 0>
+  static bool Decode(uint32_t index, uint64_t bits, Value::Data& value) {
+    if constexpr (Index == kEmpty) {
+      return false;
+    } else {
+      using Scalar = std::variant_alternative_t<Index, Value::Data>;
+      if constexpr (std::is_arithmetic_v<Scalar>) {
+        if (index == Index) {
+          Scalar scalar;
+          std::memcpy(&scalar, &bits, sizeof(scalar));
+          value.emplace<Index>(scalar);
+          return true;
+        }
+      }
+
+      return Decode<Index + 1>(index, bits, value);
+    }
+  }
+
+  /// @return slot of key or nullptr
+  Slot* Find(const std::string& key, size_t hash) const;
+
+  /// Adds slot for key rebuilding table if needed
+  Slot* Add(const std::string& key, size_t hash);
+
+  /// Replaces table by one holding only non-empty slots of current one and
+  /// room for added ones, and retires the rest
+  Table& Rebuild(size_t added);
+
+  static void Insert(Table& table, Slot* slot);
+
+ private:
+  /// nullptr until the first scalar value
+  std::atomic<Table*> table_ = nullptr;
+  std::vector<std::unique_ptr<Pool>> pools_;
+};
+
+}  // namespace jbkv
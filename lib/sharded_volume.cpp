@@ -0,0 +1,532 @@
+#include "sharded_volume.h"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include "volume_node_impl.h"
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+using namespace jbkv;
+
+constexpr auto kRootName = "/";
+constexpr uint64_t kRootId = 1;
+/// checks of waiting thread before it sleeps
+constexpr int kSpins = 64;
+
+/// Location of node: its id and shard owning it
+struct NodeRef {
+  uint64_t id = 0;
+  size_t shard = 0;
+};
+
+struct NodeState {
+  std::unordered_map<NodeData::Key, Value> entries;
+  std::unordered_map<VolumeNode::Name, NodeRef> children;
+};
+
+/// Nodes owned by shard, touched by its thread only
+using Nodes = std::unordered_map<uint64_t, NodeState>;
+
+/// Call passed to shard, lives on stack of calling thread until done
+struct Message {
+  std::atomic<Message*> next = nullptr;
+  void* context = nullptr;
+  void (*run)(void* context, Nodes& nodes) = nullptr;
+  std::atomic<bool> done = false;
+};
+
+/// Intrusive multi-producer single-consumer queue
+/// Producers link message by single exchange, consumer takes messages in
+/// order of their exchanges
+class MessageQueue : NonCopyableNonMovable {
+ public:
+  MessageQueue()
+      : head_(&stub_),
+        tail_(&stub_) {
+  }
+
+  void Push(Message& message) {
+    message.next.store(nullptr, std::memory_order_relaxed);
+    auto* previous = head_.exchange(&message, std::memory_order_acq_rel);
+    previous->next.store(&message, std::memory_order_release);
+  }
+
+  /// @return nullptr if queue is empty or next message is being linked
+  /// @note called by consumer only
+  Message* Pop() {
+    auto* tail = tail_;
+    auto* next = tail->next.load(std::memory_order_acquire);
+    if (tail == &stub_) {
+      if (!next) {
+        return nullptr;
+      }
+
+      tail_ = next;
+      tail = next;
+      next = next->next.load(std::memory_order_acquire);
+    }
+
+    if (next) {
+      tail_ = next;
+      return tail;
+    }
+
+    if (tail != head_.load(std::memory_order_acquire)) {
+      return nullptr;
+    }
+
+    /// stub keeps queue non-empty, so the last message can be taken
+    Push(stub_);
+    next = tail->next.load(std::memory_order_acquire);
+    if (next) {
+      tail_ = next;
+      return tail;
+    }
+
+    return nullptr;
+  }
+
+ private:
+  Message stub_;
+  std::atomic<Message*> head_;
+  /// used by consumer only
+  Message* tail_;
+};
+
+class Shard : NonCopyableNonMovable {
+ public:
+  /// @param core core to bind thread to, nullopt leaves thread unbound
+  explicit Shard(std::optional<size_t> core) {
+    thread_ = std::thread([this]() {
+      Run();
+    });
+
+#if defined(__linux__)
+    if (core) {
+      cpu_set_t cpus;
+      CPU_ZERO(&cpus);
+      CPU_SET(*core, &cpus);
+      /// binding is an optimization, shard works unbound as well
+      pthread_setaffinity_np(thread_.native_handle(), sizeof(cpus), &cpus);
+    }
+#endif
+  }
+
+  /// Runs fn with nodes of shard on thread of shard and waits for it
+  /// @return result of fn
+  template <typename Fn>
+  auto Call(Fn&& fn) {
+    using Result = std::invoke_result_t<Fn&, Nodes&>;
+    std::conditional_t<std::is_void_v<Result>, bool, std::optional<Result>>
+        result{};
+    std::exception_ptr error;
+    auto task = [&fn, &result, &error](Nodes& nodes) {
+      try {
+        if constexpr (std::is_void_v<Result>) {
+          fn(nodes);
+        } else {
+          result.emplace(fn(nodes));
+        }
+      } catch (...) {
+        error = std::current_exception();
+      }
+    };
+
+    Message message;
+    message.context = &task;
+    message.run = [](void* context, Nodes& nodes) {
+      (*static_cast<decltype(task)*>(context))(nodes);
+    };
+
+    Send(message);
+    if (error) {
+      std::rethrow_exception(error);
+    }
+
+    if constexpr (!std::is_void_v<Result>) {
+      return std::move(*result);
+    }
+  }
+
+  /// Stops thread of shard
+  ~Shard() {
+    Call([this](Nodes&) {
+      stop_ = true;
+    });
+    thread_.join();
+  }
+
+ private:
+  /// Queues message and waits until shard runs it
+  /// Waiter sleeps on counter of shard rather than on message, so shard
+  /// does not touch message once it is done and message may leave scope
+  void Send(Message& message) {
+    queue_.Push(message);
+    if (pending_.fetch_add(1, std::memory_order_release) == 0) {
+      pending_.notify_one();
+    }
+
+    for (int i = 0; i < kSpins; ++i) {
+      if (message.done.load(std::memory_order_acquire)) {
+        return;
+      }
+    }
+
+    for (;;) {
+      const auto completed = completed_.load();
+      if (message.done.load()) {
+        return;
+      }
+
+      completed_.wait(completed);
+    }
+  }
+
+  void Run() {
+    while (!stop_) {
+      auto pending = pending_.load(std::memory_order_acquire);
+      for (int i = 0; i < kSpins && pending == 0; ++i) {
+        pending = pending_.load(std::memory_order_acquire);
+      }
+
+      if (pending == 0) {
+        pending_.wait(0, std::memory_order_acquire);
+        continue;
+      }
+
+      /// runs every queued message in one go
+      uint64_t ran = 0;
+      while (ran < pending) {
+        auto* message = queue_.Pop();
+        if (!message) {
+          /// producer has not linked its message yet
+          std::this_thread::yield();
+          continue;
+        }
+
+        message->run(message->context, nodes_);
+        /// the last access to message
+        message->done.store(true);
+        ++ran;
+      }
+
+      pending_.fetch_sub(ran, std::memory_order_relaxed);
+      completed_.fetch_add(1);
+      completed_.notify_all();
+    }
+  }
+
+ private:
+  MessageQueue queue_;
+  /// number of pushed messages not run yet
+  std::atomic<uint64_t> pending_ = 0;
+  /// advanced after every batch of messages, wakes waiting senders
+  std::atomic<uint32_t> completed_ = 0;
+
+  /// used by thread of shard only
+  Nodes nodes_;
+  bool stop_ = false;
+  std::thread thread_;
+};
+
+/// Shards shared by nodes of volume
+struct ShardedVolume : NonCopyableNonMovable {
+  explicit ShardedVolume(const ShardOptions& options) {
+    const size_t cores = std::max(1u, std::thread::hardware_concurrency());
+    const size_t count = options.shards ? options.shards : cores;
+    shards.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+      shards.push_back(std::make_unique<Shard>(
+          options.pin_threads ? std::optional(i % cores) : std::nullopt));
+    }
+  }
+
+  size_t ShardOf(const std::string& path) const {
+    return std::hash<std::string>{}(path) % shards.size();
+  }
+
+  std::vector<std::unique_ptr<Shard>> shards;
+  std::atomic<uint64_t> next_id = kRootId + 1;
+};
+
+using VolumePtr = std::shared_ptr<ShardedVolume>;
+
+class ShardedNodeData final : public NodeData {
+ public:
+  ShardedNodeData(VolumePtr volume, NodeRef ref)
+      : volume_(std::move(volume)),
+        ref_(ref) {
+  }
+
+  std::optional<Value> Read(const Key& key) const override {
+    return Owner().Call([this, &key](Nodes& nodes) -> std::optional<Value> {
+      const auto* entries = Entries(nodes);
+      if (!entries) {
+        return std::nullopt;
+      }
+
+      const auto it = entries->find(key);
+      if (it == entries->end()) {
+        return std::nullopt;
+      }
+
+      return it->second;
+    });
+  }
+
+  void Write(const Key& key, Value&& value) override {
+    Owner().Call([this, &key, &value](Nodes& nodes) {
+      if (auto* entries = Entries(nodes)) {
+        entries->insert_or_assign(key, std::move(value));
+      }
+    });
+  }
+
+  bool Update(const Key& key, Value&& value) override {
+    return Owner().Call([this, &key, &value](Nodes& nodes) {
+      auto* entries = Entries(nodes);
+      if (!entries) {
+        return false;
+      }
+
+      const auto it = entries->find(key);
+      if (it == entries->end()) {
+        return false;
+      }
+
+      it->second = std::move(value);
+      return true;
+    });
+  }
+
+  bool Remove(const Key& key) override {
+    return Owner().Call([this, &key](Nodes& nodes) {
+      auto* entries = Entries(nodes);
+      return entries && entries->erase(key) == 1u;
+    });
+  }
+
+  KeyValueList Enumerate() const override {
+    return Owner().Call([this](Nodes& nodes) {
+      KeyValueList result;
+      if (const auto* entries = Entries(nodes)) {
+        result.reserve(entries->size());
+        for (const auto& [key, value] : *entries) {
+          result.push_back({key, value});
+        }
+      }
+
+      return result;
+    });
+  }
+
+ private:
+  Shard& Owner() const {
+    return *volume_->shards[ref_.shard];
+  }
+
+  /// @return nullptr if node is unlinked
+  std::unordered_map<Key, Value>* Entries(Nodes& nodes) const {
+    const auto it = nodes.find(ref_.id);
+    return it != nodes.end() ? &it->second.entries : nullptr;
+  }
+
+ private:
+  const VolumePtr volume_;
+  const NodeRef ref_;
+};
+
+class ShardedVolumeNode final : public VolumeNode {
+ public:
+  ShardedVolumeNode(VolumePtr volume, NodeRef ref, std::string path,
+                    const Name& name)
+      : name_(name),
+        path_(std::move(path)),
+        ref_(ref),
+        volume_(std::move(volume)) {
+  }
+
+  const Name& GetName() const override {
+    return name_;
+  }
+
+  VolumeNode::Ptr Create(const Name& name) override {
+    if (auto child = FindChild(name)) {
+      return MakeNode(*child, name);
+    }
+
+    /// state of child is created before it is linked, so it is never found
+    /// without state
+    auto path = ChildPath(name);
+    const NodeRef created = {volume_->next_id.fetch_add(1),
+                             volume_->ShardOf(path)};
+    volume_->shards[created.shard]->Call([&created](Nodes& nodes) {
+      nodes.try_emplace(created.id);
+    });
+
+    const auto linked = Owner().Call([this, &name, &created](Nodes& nodes) {
+      const auto it = nodes.find(ref_.id);
+      if (it == nodes.end()) {
+        return NodeRef{};
+      }
+
+      return it->second.children.try_emplace(name, created).first->second;
+    });
+
+    if (linked.id != created.id) {
+      /// child is created by another thread meanwhile or this node is
+      /// unlinked, created child is unreachable
+      Drop(created);
+    }
+
+    return MakeNode(linked.id ? linked : created, name, std::move(path));
+  }
+
+  VolumeNode::Ptr Find(const Name& name) const override {
+    const auto child = FindChild(name);
+    if (!child) {
+      return NullVolumeNode::Instance();
+    }
+
+    return MakeNode(*child, name);
+  }
+
+  bool Unlink(const Name& name) override {
+    const auto child = Owner().Call([this, &name](Nodes& nodes) {
+      std::optional<NodeRef> result;
+      const auto it = nodes.find(ref_.id);
+      if (it == nodes.end()) {
+        return result;
+      }
+
+      auto& children = it->second.children;
+      if (const auto child = children.find(name); child != children.end()) {
+        result = child->second;
+        children.erase(child);
+      }
+
+      return result;
+    });
+
+    if (!child) {
+      return false;
+    }
+
+    Drop(*child);
+    return true;
+  }
+
+  NodeData::Ptr Open() const override {
+    return std::make_shared<ShardedNodeData>(volume_, ref_);
+  }
+
+  VolumeNode::List Enumerate() const override {
+    const auto children = Owner().Call([this](Nodes& nodes) {
+      std::vector<std::pair<Name, NodeRef>> result;
+      const auto it = nodes.find(ref_.id);
+      if (it != nodes.end()) {
+        result.assign(it->second.children.begin(),
+                      it->second.children.end());
+      }
+
+      return result;
+    });
+
+    VolumeNode::List result;
+    result.reserve(children.size());
+    for (const auto& [name, child] : children) {
+      result.push_back(MakeNode(child, name));
+    }
+
+    return result;
+  }
+
+  bool IsValid() const override {
+    return true;
+  }
+
+ private:
+  Shard& Owner() const {
+    return *volume_->shards[ref_.shard];
+  }
+
+  std::optional<NodeRef> FindChild(const Name& name) const {
+    return Owner().Call([this, &name](Nodes& nodes) {
+      std::optional<NodeRef> result;
+      const auto it = nodes.find(ref_.id);
+      if (it == nodes.end()) {
+        return result;
+      }
+
+      const auto& children = it->second.children;
+      if (const auto child = children.find(name); child != children.end()) {
+        result = child->second;
+      }
+
+      return result;
+    });
+  }
+
+  /// Removes states of subtree from their shards
+  void Drop(NodeRef root) const {
+    std::vector<NodeRef> pending = {root};
+    while (!pending.empty()) {
+      const auto ref = pending.back();
+      pending.pop_back();
+      volume_->shards[ref.shard]->Call([&ref, &pending](Nodes& nodes) {
+        const auto it = nodes.find(ref.id);
+        if (it == nodes.end()) {
+          return;
+        }
+
+        for (const auto& [_, child] : it->second.children) {
+          pending.push_back(child);
+        }
+
+        nodes.erase(it);
+      });
+    }
+  }
+
+  std::string ChildPath(const Name& name) const {
+    return path_ + "/" + name;
+  }
+
+  VolumeNode::Ptr MakeNode(NodeRef ref, const Name& name) const {
+    return MakeNode(ref, name, ChildPath(name));
+  }
+
+  VolumeNode::Ptr MakeNode(NodeRef ref, const Name& name,
+                           std::string path) const {
+    return std::make_shared<ShardedVolumeNode>(volume_, ref, std::move(path),
+                                               name);
+  }
+
+ private:
+  const Name name_;
+  /// names from root joined by '/', empty for root
+  const std::string path_;
+  const NodeRef ref_;
+  const VolumePtr volume_;
+};
+}  // namespace
+
+VolumeNode::Ptr jbkv::CreateShardedVolume(const ShardOptions& options) {
+  auto volume = std::make_shared<ShardedVolume>(options);
+  const NodeRef root = {kRootId, volume->ShardOf({})};
+  volume->shards[root.shard]->Call([&root](Nodes& nodes) {
+    nodes.try_emplace(root.id);
+  });
+
+  return std::make_shared<ShardedVolumeNode>(std::move(volume), root,
+                                             std::string(), kRootName);
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <cstddef>
+#include "volume_node.h"
+
+namespace jbkv {
+
+struct ShardOptions {
+  /// number of shards, zero means hardware concurrency
+  size_t shards = 0;
+  /// every shard thread is bound to its own core where platform allows it
+  bool pin_threads = true;
+};
+
+/// Creates empty volume partitioned across shards, every shard is owned by
+/// single thread
+/// Node is placed to shard by hash of its path, and its data and list of
+/// its children are touched only by thread of that shard, so they take no
+/// locks and are not shared between cores. Calls of nodes are passed to
+/// shard through lock-free queue, shard runs all queued calls at once, and
+/// calling thread waits for result. Node handles keep id of node: Unlink
+/// removes whole subtree, so nodes of subtree obtained before Unlink read
+/// as empty and ignore changes afterwards.
+/// Volume is stopped when last of its nodes is released.
+/// @return non-null volume ptr
+VolumeNode::Ptr CreateShardedVolume(const ShardOptions& options = {});
+
+}  // namespace jbkv
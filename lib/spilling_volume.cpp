@@ -0,0 +1,439 @@
+#include "spilling_volume.h"
+#include <algorithm>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include "epoch.h"
+#include "volume_io.h"
+#include "volume_node_impl.h"
+
+namespace {
+using namespace jbkv;
+
+constexpr auto kRootName = "/";
+
+/// node with its data, tracker and hash table node of parent
+constexpr size_t kNodeFootprint = sizeof(VolumeNodeImpl) +
+                                  sizeof(VolumeNodeData) +
+                                  sizeof(ChangeTracker) + 4 * sizeof(void*);
+
+/// Shared by volume and its subtrees
+struct SpillState {
+  /// advanced by every check, subtree remembers it on access
+  std::atomic<uint64_t> clock = 1;
+
+  std::mutex mutex;
+  std::condition_variable wake;
+  bool reloaded = false;
+  bool stop = false;
+};
+
+/// @return estimated memory taken by subtree
+size_t Footprint(const VolumeNode& node) {
+  const auto data = std::static_pointer_cast<VolumeNodeData>(node.Open());
+  size_t result = kNodeFootprint + node.GetName().size() + data->Footprint();
+  for (const auto& child : node.Enumerate()) {
+    result += Footprint(*child);
+  }
+
+  return result;
+}
+
+/// @return true if data and children of node are referenced only by node
+/// @note list returned by Enumerate holds the second reference of child
+bool Unreferenced(const VolumeNode& node) {
+  if (node.Open().use_count() != 2) {
+    return false;
+  }
+
+  for (const auto& child : node.Enumerate()) {
+    if (child.use_count() != 2 || !Unreferenced(*child)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/// Child of spilling volume root, holds its subtree while it is resident
+/// and forwards calls to it
+/// Calls reach resident subtree by raw pointer under EpochGuard, so they
+/// write no shared cache line. Spill unpublishes pointer and waits for
+/// calls pinned before, so calls it races with are either finished and
+/// their results are seen as references, or reload subtree.
+class SpilledSubtree final : public VolumeNode {
+ public:
+  SpilledSubtree(const Name& name, std::filesystem::path path,
+                 std::shared_ptr<SpillState> state)
+      : name_(name),
+        path_(std::move(path)),
+        state_(std::move(state)),
+        owner_(std::make_shared<VolumeNodeImpl>(name)),
+        resident_(owner_.get()) {
+  }
+
+  ~SpilledSubtree() override {
+    std::error_code error;
+    std::filesystem::remove(path_, error);
+  }
+
+  const Name& GetName() const override {
+    return name_;
+  }
+
+  VolumeNode::Ptr Create(const Name& name) override {
+    return WithResident([&name](VolumeNodeImpl& node) {
+      return node.Create(name);
+    });
+  }
+
+  VolumeNode::Ptr Find(const Name& name) const override {
+    return WithResident([&name](const VolumeNodeImpl& node) {
+      return node.Find(name);
+    });
+  }
+
+  bool Unlink(const Name& name) override {
+    return WithResident([&name](VolumeNodeImpl& node) {
+      return node.Unlink(name);
+    });
+  }
+
+  NodeData::Ptr Open() const override {
+    return WithResident([](const VolumeNodeImpl& node) {
+      return node.Open();
+    });
+  }
+
+  VolumeNode::List Enumerate() const override {
+    return WithResident([](const VolumeNodeImpl& node) {
+      return node.Enumerate();
+    });
+  }
+
+  bool IsValid() const override {
+    return true;
+  }
+
+  uint64_t LastAccess() const {
+    return last_access_.load(std::memory_order_relaxed);
+  }
+
+  /// @return estimated memory of subtree, zero if it is spilled
+  size_t Footprint() {
+    std::lock_guard lock(mutex_);
+    const auto& node = owner_;
+    if (!node) {
+      return 0;
+    }
+
+    /// subtree is measured again only if it has changed since last time
+    const auto& tracker = node->Tracker();
+    if (!footprint_ || tracker->Subtree() > measured_) {
+      measured_ = tracker->Advance();
+      footprint_ = ::Footprint(*node);
+    }
+
+    return footprint_;
+  }
+
+  /// Saves subtree unless file holds it already and drops it from memory
+  /// @return false if subtree is spilled or referenced
+  bool Spill() {
+    std::lock_guard lock(mutex_);
+    if (!owner_) {
+      return false;
+    }
+
+    /// calls which reached subtree before it is unpublished finish, and
+    /// their results hold references
+    resident_.store(nullptr, std::memory_order_relaxed);
+    SynchronizeEpoch();
+    if (owner_.use_count() != 1 || !Unreferenced(*owner_)) {
+      resident_.store(owner_.get(), std::memory_order_release);
+      return false;
+    }
+
+    auto node = std::move(owner_);
+
+    if (!saved_ || node->Tracker()->Subtree() > saved_generation_) {
+      /// file is scratch copy, so it is neither synced nor replaced
+      /// atomically, and is not used after failed save
+      saved_ = false;
+      try {
+        std::ofstream out(path_, std::ios_base::binary | std::ios_base::trunc);
+        Save(node, out);
+        out.close();
+        if (!out) {
+          throw std::runtime_error("Cannot write file: " + path_.string());
+        }
+      } catch (...) {
+        owner_ = std::move(node);
+        resident_.store(owner_.get(), std::memory_order_release);
+        throw;
+      }
+
+      saved_ = true;
+    }
+
+    footprint_ = 0;
+    return true;
+  }
+
+ private:
+  /// Calls fn with resident subtree, reloading it if needed
+  template <typename Fn>
+  std::invoke_result_t<Fn&, VolumeNodeImpl&> WithResident(Fn&& fn) const {
+    const auto clock = state_->clock.load(std::memory_order_relaxed);
+    if (last_access_.load(std::memory_order_relaxed) != clock) {
+      last_access_.store(clock, std::memory_order_relaxed);
+    }
+
+    {
+      EpochGuard guard;
+      if (auto* node = resident_.load(std::memory_order_acquire)) {
+        return fn(*node);
+      }
+    }
+
+    /// reference keeps reloaded subtree from being spilled during the call
+    return fn(*Reload());
+  }
+
+  std::shared_ptr<VolumeNodeImpl> Reload() const {
+    std::shared_ptr<VolumeNodeImpl> node;
+    {
+      std::lock_guard lock(mutex_);
+      if (owner_) {
+        return owner_;
+      }
+
+      node = std::make_shared<VolumeNodeImpl>(name_);
+      std::ifstream in(path_, std::ios_base::binary);
+      if (!in) {
+        throw std::runtime_error("Cannot open file: " + path_.string());
+      }
+
+      Load(node, in);
+      /// changes made after reload are stamped with later generations
+      saved_generation_ = node->Tracker()->Advance();
+      owner_ = node;
+      resident_.store(node.get(), std::memory_order_release);
+    }
+
+    {
+      std::lock_guard lock(state_->mutex);
+      state_->reloaded = true;
+    }
+
+    state_->wake.notify_one();
+    return node;
+  }
+
+ private:
+  const Name name_;
+  const std::filesystem::path path_;
+  const std::shared_ptr<SpillState> state_;
+  mutable std::atomic<uint64_t> last_access_ = 0;
+
+  /// guards spilling, reloading and state below
+  mutable std::mutex mutex_;
+  /// owns subtree while it is resident
+  mutable std::shared_ptr<VolumeNodeImpl> owner_;
+  /// published owner, read without locks
+  mutable std::atomic<VolumeNodeImpl*> resident_;
+  /// file holds subtree as of saved generation
+  bool saved_ = false;
+  mutable uint64_t saved_generation_ = 0;
+  size_t footprint_ = 0;
+  uint64_t measured_ = 0;
+};
+
+class SpillingVolumeNode final : public VolumeNode {
+ public:
+  explicit SpillingVolumeNode(const SpillOptions& options)
+      : options_(options),
+        state_(std::make_shared<SpillState>()),
+        data_(std::make_shared<VolumeNodeData>()) {
+    std::filesystem::create_directories(options_.directory);
+    checker_ = std::thread([this]() {
+      RunChecks();
+    });
+  }
+
+  ~SpillingVolumeNode() override {
+    {
+      std::lock_guard lock(state_->mutex);
+      state_->stop = true;
+    }
+
+    state_->wake.notify_one();
+    checker_.join();
+  }
+
+  const Name& GetName() const override {
+    return name_;
+  }
+
+  VolumeNode::Ptr Create(const Name& name) override {
+    {
+      std::shared_lock lock(mutex_);
+      if (auto it = subtrees_.find(name); it != subtrees_.end()) {
+        return it->second;
+      }
+    }
+
+    std::lock_guard lock(mutex_);
+    auto& subtree = subtrees_[name];
+    if (!subtree) {
+      auto path = options_.directory / (std::to_string(next_file_++) + ".bin");
+      subtree = std::make_shared<SpilledSubtree>(name, std::move(path), state_);
+    }
+
+    return subtree;
+  }
+
+  VolumeNode::Ptr Find(const Name& name) const override {
+    std::shared_lock lock(mutex_);
+    auto it = subtrees_.find(name);
+    if (it == subtrees_.end()) {
+      return NullVolumeNode::Instance();
+    }
+
+    return it->second;
+  }
+
+  bool Unlink(const Name& name) override {
+    std::lock_guard lock(mutex_);
+    return subtrees_.erase(name) == 1u;
+  }
+
+  NodeData::Ptr Open() const override {
+    return data_;
+  }
+
+  VolumeNode::List Enumerate() const override {
+    std::shared_lock lock(mutex_);
+    VolumeNode::List result;
+    result.reserve(subtrees_.size());
+    for (const auto& [_, subtree] : subtrees_) {
+      result.push_back(subtree);
+    }
+
+    return result;
+  }
+
+  bool IsValid() const override {
+    return true;
+  }
+
+  size_t SpillCold() {
+    std::lock_guard check_lock(check_mutex_);
+    /// subtrees accessed from now on are more recent than the rest
+    state_->clock.fetch_add(1, std::memory_order_relaxed);
+
+    std::vector<std::shared_ptr<SpilledSubtree>> subtrees;
+    {
+      std::shared_lock lock(mutex_);
+      subtrees.reserve(subtrees_.size());
+      for (const auto& [_, subtree] : subtrees_) {
+        subtrees.push_back(subtree);
+      }
+    }
+
+    struct Candidate {
+      uint64_t access = 0;
+      size_t footprint = 0;
+      SpilledSubtree* subtree = nullptr;
+    };
+
+    std::vector<Candidate> resident;
+    uint64_t total = 0;
+    for (const auto& subtree : subtrees) {
+      const auto footprint = subtree->Footprint();
+      if (footprint > 0) {
+        total += footprint;
+        resident.push_back({subtree->LastAccess(), footprint, subtree.get()});
+      }
+    }
+
+    std::sort(resident.begin(), resident.end(),
+              [](const Candidate& lhs, const Candidate& rhs) {
+                return lhs.access < rhs.access;
+              });
+
+    size_t spilled = 0;
+    for (const auto& candidate : resident) {
+      if (total <= options_.memory_budget) {
+        break;
+      }
+
+      if (candidate.subtree->Spill()) {
+        total -= candidate.footprint;
+        ++spilled;
+      }
+    }
+
+    return spilled;
+  }
+
+ private:
+  void RunChecks() {
+    std::unique_lock lock(state_->mutex);
+    auto ready = [this]() {
+      return state_->stop || state_->reloaded;
+    };
+
+    for (;;) {
+      if (options_.interval.count() > 0) {
+        state_->wake.wait_for(lock, options_.interval, ready);
+      } else {
+        state_->wake.wait(lock, ready);
+      }
+
+      if (state_->stop) {
+        return;
+      }
+
+      state_->reloaded = false;
+      lock.unlock();
+      try {
+        SpillCold();
+      } catch (const std::exception&) {
+        /// subtree which failed to save stays resident until next check
+      }
+
+      lock.lock();
+    }
+  }
+
+ private:
+  const Name name_ = kRootName;
+  const SpillOptions options_;
+  const std::shared_ptr<SpillState> state_;
+  const NodeData::Ptr data_;
+
+  mutable std::shared_mutex mutex_;
+  std::unordered_map<Name, std::shared_ptr<SpilledSubtree>> subtrees_;
+  uint64_t next_file_ = 0;
+
+  /// serializes checks
+  std::mutex check_mutex_;
+  std::thread checker_;
+};
+}  // namespace
+
+VolumeNode::Ptr jbkv::CreateSpillingVolume(const SpillOptions& options) {
+  return std::make_shared<SpillingVolumeNode>(options);
+}
+
+size_t jbkv::SpillCold(const VolumeNode::Ptr& root) {
+  auto* volume = dynamic_cast<SpillingVolumeNode*>(root.get());
+  if (!volume) {
+    throw std::runtime_error("Volume does not spill subtrees");
+  }
+
+  return volume->SpillCold();
+}
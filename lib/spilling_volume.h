@@ -0,0 +1,48 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include "volume_node.h"
+
+namespace jbkv {
+
+struct SpillOptions {
+  /// directory of files of spilled subtrees, created if needed
+  /// @note directory must not be shared by several volumes
+  std::filesystem::path directory;
+  /// estimated memory of resident subtrees above which the least recently
+  /// accessed ones are spilled
+  uint64_t memory_budget = 1 << 30;
+  /// period of background check of resident subtrees, zero disables
+  /// periodic checks, so subtrees are spilled after reloads and by
+  /// SpillCold only
+  std::chrono::milliseconds interval{1000};
+};
+
+/// Creates empty volume which keeps subtrees in memory while they fit
+/// budget
+/// Every child of root with its subtree is a unit of spilling: cold subtree
+/// is saved to file of directory and dropped from memory, and is loaded
+/// back on first access through child node. Subtree is not spilled while
+/// any of its nodes or data is referenced outside of volume, so node
+/// obtained from subtree stays valid and keeps subtree resident. Access
+/// through child whose subtree is resident loads its pointer under epoch
+/// pinned by calling thread and writes no cache line shared with other
+/// threads.
+/// Saving whole volume loads every spilled subtree. Files are removed when
+/// subtrees are unlinked or volume is released.
+/// @return non-null volume ptr
+/// @throw std::runtime_error if directory cannot be created
+VolumeNode::Ptr CreateSpillingVolume(const SpillOptions& options);
+
+/// Spills least recently accessed subtrees until estimated memory of
+/// resident ones fits budget
+/// Volume calls it in background, explicit call spills subtrees right away
+/// and reports errors of saving, which background checks retry later
+/// @return number of spilled subtrees
+/// @throw std::runtime_error if volume is not created by
+/// CreateSpillingVolume
+size_t SpillCold(const VolumeNode::Ptr& root);
+
+}  // namespace jbkv
@@ -1,8 +1,14 @@
 #include "storage_node.h"
-#include <list>
+#include "async_mutex.h"
+#include "epoch.h"
+#include "volume_node_impl.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <queue>
 #include <shared_mutex>
 #include <unordered_map>
-#include <unordered_set>
 #include <cassert>
 
 namespace {
@@ -22,7 +28,68 @@ class NullStorageNode final : public InvalidNode<StorageNode> {
   }
 };
 
-class StorageNodeData final : public NodeData {
+/// K-way merge of per-layer lists sorted by key
+/// Calls visitor once per distinct key with items of all layers having this
+/// key, ordered from bottom layer to top one. Visitor is allowed to move items
+/// out of the group.
+template <typename T, typename KeyOf, typename Visitor>
+void MergeSortedLayers(std::vector<std::vector<T>>& layers, KeyOf&& key_of,
+                       Visitor&& visitor) {
+  using Cursor = std::pair<size_t, size_t>;  // layer, position
+  auto greater = [&layers, &key_of](const Cursor& lhs, const Cursor& rhs) {
+    const auto order = key_of(layers[lhs.first][lhs.second])
+                           .compare(key_of(layers[rhs.first][rhs.second]));
+    if (order != 0) {
+      return order > 0;
+    }
+
+    return lhs.first > rhs.first;
+  };
+
+  std::vector<Cursor> storage;
+  storage.reserve(layers.size());
+  std::priority_queue<Cursor, std::vector<Cursor>, decltype(greater)> heap(
+      greater, std::move(storage));
+  for (size_t i = 0; i < layers.size(); ++i) {
+    if (!layers[i].empty()) {
+      heap.push({i, 0});
+    }
+  }
+
+  std::vector<T*> group;
+  std::vector<Cursor> advanced;
+  group.reserve(layers.size());
+  advanced.reserve(layers.size());
+  while (!heap.empty()) {
+    const auto [first_layer, first_pos] = heap.top();
+    const auto& key = key_of(layers[first_layer][first_pos]);
+    while (!heap.empty()) {
+      const auto [layer, pos] = heap.top();
+      if (key_of(layers[layer][pos]) != key) {
+        break;
+      }
+
+      heap.pop();
+      group.push_back(&layers[layer][pos]);
+      advanced.push_back({layer, pos + 1});
+    }
+
+    visitor(group);
+    for (const auto& cursor : advanced) {
+      if (cursor.second < layers[cursor.first].size()) {
+        heap.push(cursor);
+      }
+    }
+
+    group.clear();
+    advanced.clear();
+  }
+}
+
+/// Data of storage node
+/// Keys of read-only layers are never changed: writing them shadows them in
+/// the top layer, removing them throws
+class StorageNodeData final : public NodeData, public TransactionalData {
  public:
   explicit StorageNodeData(NodeData::List&& layers)
       : layers_(std::move(layers)) {
@@ -42,150 +109,527 @@ class StorageNodeData final : public NodeData {
     return std::nullopt;
   }
 
+  Task<std::optional<Value>> AsyncRead(Key key,
+                                       Executor& executor) const override {
+    for (auto it = layers_.rbegin(); it != layers_.rend(); ++it) {
+      auto value = co_await (*it)->AsyncRead(key, executor);
+      if (value) {
+        co_return value;
+      }
+    }
+
+    co_return std::nullopt;
+  }
+
   void Write(const Key& key, Value&& value) override {
     if (!Update(key, std::move(value))) {
       TopLayer().Write(key, std::move(value));
     }
   }
 
+  Task<> AsyncWrite(Key key, Value value, Executor& executor) override {
+    const bool updated = co_await AsyncUpdate(key, value, executor);
+    if (!updated) {
+      co_await TopLayer().AsyncWrite(std::move(key), std::move(value),
+                                     executor);
+    }
+  }
+
   bool Update(const Key& key, Value&& value) override {
     for (auto it = layers_.rbegin(); it != layers_.rend(); ++it) {
       const auto& layer = *it;
-      if (layer->Update(key, std::move(value))) {
+      if (!layer->IsReadOnly() && layer->Update(key, std::move(value))) {
         return true;
       }
     }
 
-    return false;
+    if (!IsInherited(key)) {
+      return false;
+    }
+
+    TopLayer().Write(key, std::move(value));
+    return true;
   }
 
+  Task<bool> AsyncUpdate(Key key, Value value, Executor& executor) override {
+    /// values share their strings and blobs, copies are cheap
+    for (auto it = layers_.rbegin(); it != layers_.rend(); ++it) {
+      if ((*it)->IsReadOnly()) {
+        continue;
+      }
+
+      const bool updated = co_await (*it)->AsyncUpdate(key, value, executor);
+      if (updated) {
+        co_return true;
+      }
+    }
+
+    if (!IsInherited(key)) {
+      co_return false;
+    }
+
+    co_await TopLayer().AsyncWrite(std::move(key), std::move(value), executor);
+    co_return true;
+  }
+
+  /// @throw std::runtime_error if key exists in read-only layer
   bool Remove(const Key& key) override {
+    ThrowIfInherited(key);
     bool result = false;
     for (auto it = layers_.rbegin(); it != layers_.rend(); ++it) {
       const auto& layer = *it;
-      result = layer->Remove(key) || result;
+      result = (!layer->IsReadOnly() && layer->Remove(key)) || result;
     }
 
     return result;
   }
 
+  /// @note result is sorted by key
   KeyValueList Enumerate() const override {
+    std::vector<KeyValueList> layer_kvs;
+    layer_kvs.reserve(layers_.size());
+    size_t total_size = 0;
+    for (const auto& layer : layers_) {
+      auto kv_list = layer->Enumerate();
+      std::sort(kv_list.begin(), kv_list.end(),
+                [](const auto& lhs, const auto& rhs) {
+                  return lhs.first < rhs.first;
+                });
+      total_size += kv_list.size();
+      layer_kvs.push_back(std::move(kv_list));
+    }
+
+    if (layer_kvs.size() == 1) {
+      return std::move(layer_kvs.front());
+    }
+
     KeyValueList result;
-    std::unordered_set<NodeData::Key> used;
+    result.reserve(total_size);
+    auto key_of = [](const auto& kv) -> const Key& {
+      return kv.first;
+    };
+
+    /// top layer shadows the bottom ones
+    MergeSortedLayers(layer_kvs, key_of, [&result](auto& group) {
+      result.push_back(std::move(*group.back()));
+    });
+    return result;
+  }
+
+  /// Transactions
+  /// Read-only layers never change, so they are read without versions
+  /// @{
+  std::optional<Value> ReadVersioned(const Key& key,
+                                     Versions& versions) override {
     for (auto it = layers_.rbegin(); it != layers_.rend(); ++it) {
-      const auto& layer = *it;
-      for (auto&& [key, value] : layer->Enumerate()) {
-        if (!used.contains(key)) {
-          used.insert(key);
-          result.push_back({std::move(key), std::move(value)});
+      auto value = (*it)->IsReadOnly()
+                       ? (*it)->Read(key)
+                       : AsTransactional(**it).ReadVersioned(key, versions);
+      if (value) {
+        return value;
+      }
+    }
+
+    return std::nullopt;
+  }
+
+  void CollectWritten(std::vector<VolumeNodeData*>& written) override {
+    for (const auto& layer : layers_) {
+      if (!layer->IsReadOnly()) {
+        AsTransactional(*layer).CollectWritten(written);
+      }
+    }
+  }
+
+  void CheckLocked(const Key& key,
+                   const std::optional<Value>& value) const override {
+    if (!value) {
+      ThrowIfInherited(key);
+    }
+  }
+
+  void ApplyLocked(const Key& key, std::optional<Value>&& value,
+                   Tickets& tickets) override {
+    if (!value) {
+      for (auto it = layers_.rbegin(); it != layers_.rend(); ++it) {
+        if (!(*it)->IsReadOnly()) {
+          AsTransactional(**it).ApplyLocked(key, std::nullopt, tickets);
         }
       }
+    } else if (!UpdateLocked(key, std::move(*value), tickets)) {
+      AsTransactional(TopLayer()).ApplyLocked(key, std::move(value), tickets);
     }
+  }
 
-    return result;
+  bool UpdateLocked(const Key& key, Value&& value, Tickets& tickets) override {
+    for (auto it = layers_.rbegin(); it != layers_.rend(); ++it) {
+      if (!(*it)->IsReadOnly() &&
+          AsTransactional(**it).UpdateLocked(key, std::move(value), tickets)) {
+        return true;
+      }
+    }
+
+    if (!IsInherited(key)) {
+      return false;
+    }
+
+    AsTransactional(TopLayer()).ApplyLocked(key, std::move(value), tickets);
+    return true;
   }
+  /// @}
 
  private:
   NodeData& TopLayer() const {
     return *layers_.back();
   }
 
+  /// @return true if key exists in read-only layer
+  bool IsInherited(const Key& key) const {
+    for (const auto& layer : layers_) {
+      if (layer->IsReadOnly() && layer->Read(key)) {
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  void ThrowIfInherited(const Key& key) const {
+    if (IsInherited(key)) {
+      throw std::runtime_error("Key of read-only layer cannot be removed");
+    }
+  }
+
  private:
   const NodeData::List layers_;
 };
 
+class StorageNodeMetadata;
+
 struct MountPoint : NonCopyableNonMovable {
  public:
   using StrongPtr = std::shared_ptr<MountPoint>;
-  using WeakPtr = std::weak_ptr<MountPoint>;
 
-  explicit MountPoint(VolumeNode::Ptr n)
-      : node(std::move(n)) {
+  MountPoint(VolumeNode::Ptr n, std::weak_ptr<StorageNodeMetadata> o)
+      : node(std::move(n)),
+        owner(std::move(o)) {
   }
 
+  /// unregisters itself from owner
+  ~MountPoint();
+
   VolumeNode::Ptr node;
+  std::weak_ptr<StorageNodeMetadata> owner;
 };
 
-class StorageNodeMetadata : NonCopyableNonMovable {
+/// Tracks mounts by path
+/// Metadata entry is registered in the tree lazily on the first mount by its
+/// path and is reclaimed automatically when neither mounts nor storage nodes
+/// refer to it: parents hold children weakly, children hold parents strongly
+/// Detached metadata caches registered metadata of its path until the
+/// registered subtree of its anchor, the nearest ancestor registered when it
+/// was created, is attached to or unlinked from, so in unmounted subtrees
+/// resolving is O(1) instead of a lookup per detached ancestor, and changes
+/// elsewhere in the tree do not invalidate the cache.
+class StorageNodeMetadata :
+    NonCopyableNonMovable,
+    public std::enable_shared_from_this<StorageNodeMetadata> {
  public:
   using Ptr = std::shared_ptr<StorageNodeMetadata>;
+  using WeakPtr = std::weak_ptr<StorageNodeMetadata>;
   using List = std::vector<Ptr>;
 
+  enum class State : uint8_t {
+    /// knows its path, but is not registered in parent
+    Detached,
+    /// registered in parent and visible for lookups
+    Attached,
+    /// was removed from parent by unlink
+    Orphaned
+  };
+
  public:
-  explicit StorageNodeMetadata(const StorageNode::Name& name)
-      : name_(name) {
+  StorageNodeMetadata(Ptr parent, const StorageNode::Name& name, State state)
+      : parent_(std::move(parent)),
+        anchor_(!parent_ ? this
+                : parent_->state_.load(std::memory_order_acquire) !=
+                        State::Detached
+                    ? parent_.get()
+                    : parent_->anchor_),
+        name_(name),
+        state_(state),
+        mounts_(new MountList) {
+  }
+
+  ~StorageNodeMetadata() {
+    delete mounts_.load(std::memory_order_relaxed);
+    delete resolved_.load(std::memory_order_relaxed);
+    if (parent_ && state_.load(std::memory_order_acquire) == State::Attached) {
+      parent_->ReleaseChild(name_);
+    }
   }
 
  public:
-  template <typename... Args>
-  static StorageNodeMetadata::Ptr Create(Args&&... args) {
-    return std::make_shared<StorageNodeMetadata>(std::forward<Args>(args)...);
+  static StorageNodeMetadata::Ptr CreateRoot() {
+    return std::make_shared<StorageNodeMetadata>(nullptr, kRootName,
+                                                 State::Attached);
+  }
+
+  static StorageNodeMetadata::Ptr CreateDetached(
+      Ptr parent, const StorageNode::Name& name) {
+    return std::make_shared<StorageNodeMetadata>(std::move(parent), name,
+                                                 State::Detached);
   }
 
   const StorageNode::Name& Name() const {
     return name_;
   }
 
-  StorageNodeMetadata::Ptr GetAddChild(const StorageNode::Name& name) {
-    std::shared_lock rlock(mutex_);
+  /// @return registered metadata by the same path or nullptr if there is none
+  /// @note never modifies tree
+  StorageNodeMetadata::Ptr Resolve() {
+    if (state_.load(std::memory_order_acquire) != State::Detached) {
+      return shared_from_this();
+    }
+
+    const auto changes = anchor_->changes_.load(std::memory_order_acquire);
+    StorageNodeMetadata::Ptr resolved;
+    if (TryResolved(changes, resolved)) {
+      return resolved;
+    }
+
+    auto parent = parent_->Resolve();
+    resolved = parent ? parent->FindChild(name_) : nullptr;
+    CacheResolved(changes, resolved);
+    return resolved;
+  }
+
+  /// Registers path of metadata in the tree
+  /// @return registered metadata by the same path, non-null
+  StorageNodeMetadata::Ptr Attach() {
+    if (state_.load(std::memory_order_acquire) != State::Detached) {
+      return shared_from_this();
+    }
+
+    return parent_->Attach()->GetAddChild(name_, shared_from_this());
+  }
+
+  StorageNodeMetadata::Ptr FindChild(const StorageNode::Name& name) const {
+    std::shared_lock lock(mutex_);
     auto it = children_.find(name);
-    if (it != children_.end()) {
-      return it->second;
+    if (it == children_.end()) {
+      return nullptr;
     }
-    rlock.unlock();
 
-    std::lock_guard wlock(mutex_);
-    auto& child = children_[name];
-    if (!child) {
-      child = StorageNodeMetadata::Create(name);
+    return it->second.lock();
+  }
+
+  /// Asynchronous Resolve and FindChild
+  /// @note metadata must outlive task
+  /// @{
+  Task<StorageNodeMetadata::Ptr> AsyncResolve(Executor& executor) {
+    if (state_.load(std::memory_order_acquire) != State::Detached) {
+      co_return shared_from_this();
     }
 
-    return child;
+    const auto changes = anchor_->changes_.load(std::memory_order_acquire);
+    StorageNodeMetadata::Ptr resolved;
+    if (TryResolved(changes, resolved)) {
+      co_return resolved;
+    }
+
+    auto parent = co_await parent_->AsyncResolve(executor);
+    if (parent) {
+      resolved = co_await parent->AsyncFindChild(name_, executor);
+    }
+
+    CacheResolved(changes, resolved);
+    co_return resolved;
+  }
+
+  Task<StorageNodeMetadata::Ptr> AsyncFindChild(StorageNode::Name name,
+                                                Executor& executor) const {
+    const auto lock = co_await mutex_.LockSharedAsync(executor);
+    auto it = children_.find(name);
+    if (it == children_.end()) {
+      co_return nullptr;
+    }
+
+    co_return it->second.lock();
   }
+  /// @}
 
   void RemoveChild(const StorageNode::Name& name) {
     std::lock_guard lock(mutex_);
-    children_.erase(name);
+    auto it = children_.find(name);
+    if (it == children_.end()) {
+      return;
+    }
+
+    if (auto child = it->second.lock()) {
+      child->state_.store(State::Orphaned, std::memory_order_release);
+    }
+
+    children_.erase(it);
+    Changed();
   }
 
   MountPoint::StrongPtr AddMountPoint(VolumeNode::Ptr&& node) {
-    std::lock_guard lock(mutex_);
-    CleanUpExpired();
-    auto mount = std::make_shared<MountPoint>(std::move(node));
-    mounts_.insert(mounts_.end(), mount);
+    auto mount = std::make_shared<MountPoint>(node, weak_from_this());
+    const MountEntry entry = {mount.get(), std::move(node)};
+    Publish([&entry](const MountList& current, MountList& next) {
+      next.reserve(current.size() + 1);
+      next = current;
+      next.push_back(entry);
+    });
+
     return mount;
   }
 
-  void ListMountPoints(VolumeNode::List& mounts) const {
-    std::shared_lock lock(mutex_);
-    for (const auto& mount_ref : mounts_) {
-      auto mount = mount_ref.lock();
-      if (mount) {
-        mounts.push_back(mount->node);
+  /// Called by mount point on its destruction
+  void RemoveMountPoint(const MountPoint* mount) {
+    Publish([mount](const MountList& current, MountList& next) {
+      next.reserve(current.size());
+      for (const auto& entry : current) {
+        if (entry.mount != mount) {
+          next.push_back(entry);
+        }
       }
+    });
+  }
+
+  /// Takes no lock and writes no shared cache line of metadata: immutable
+  /// list of mounts is read by raw pointer under EpochGuard
+  void ListMountPoints(VolumeNode::List& mounts) const {
+    EpochGuard guard;
+    for (const auto& entry : *mounts_.load(std::memory_order_acquire)) {
+      mounts.push_back(entry.node);
     }
   }
 
  private:
-  void CleanUpExpired() {
-    auto it = mounts_.begin();
-    while (it != mounts_.end()) {
-      auto locked = it->lock();
-      auto prev_it = it++;
-      if (!locked) {
-        mounts_.erase(prev_it);
-      }
+  struct MountEntry {
+    const MountPoint* mount;
+    VolumeNode::Ptr node;
+  };
+
+  using MountList = std::vector<MountEntry>;
+
+  /// @param candidate detached metadata to register if path is vacant
+  StorageNodeMetadata::Ptr GetAddChild(const StorageNode::Name& name,
+                                       const Ptr& candidate) {
+    if (auto child = FindChild(name)) {
+      return child;
     }
+
+    std::lock_guard lock(mutex_);
+    auto& child_ref = children_[name];
+    if (auto child = child_ref.lock()) {
+      return child;
+    }
+
+    auto child = candidate->parent_.get() == this
+                     ? candidate
+                     : CreateDetached(shared_from_this(), name);
+    child->state_.store(State::Attached, std::memory_order_release);
+    child_ref = child;
+    Changed();
+    return child;
+  }
+
+  /// Called by child on its destruction
+  void ReleaseChild(const StorageNode::Name& name) {
+    std::lock_guard lock(mutex_);
+    auto it = children_.find(name);
+    if (it != children_.end() && it->second.expired()) {
+      children_.erase(it);
+    }
+  }
+
+  /// Counts change of children in registered subtrees of metadata and its
+  /// ancestors, which are anchors of detached metadata below it
+  /// @note called under lock of children
+  void Changed() {
+    for (auto* meta = this; meta; meta = meta->parent_.get()) {
+      meta->changes_.fetch_add(1, std::memory_order_release);
+    }
+  }
+
+  /// Takes no lock: immutable cached entry is read by raw pointer under
+  /// EpochGuard
+  /// @param changes count of changes of anchor read before resolving
+  /// @return false if cache is older than changes
+  bool TryResolved(uint64_t changes, StorageNodeMetadata::Ptr& resolved) {
+    EpochGuard guard;
+    const auto* cached = resolved_.load(std::memory_order_acquire);
+    if (!cached || cached->changes != changes) {
+      return false;
+    }
+
+    /// expired metadata is released by parent as well
+    resolved = cached->metadata.lock();
+    return true;
+  }
+
+  /// Replaces cached entry, the last of concurrent resolvers wins
+  void CacheResolved(uint64_t changes,
+                     const StorageNodeMetadata::Ptr& resolved) {
+    const auto* previous = resolved_.exchange(new Resolved{changes, resolved},
+                                              std::memory_order_acq_rel);
+    if (previous) {
+      RetireAfterEpoch([previous] { delete previous; });
+    }
+  }
+
+  /// Copy-on-write update of mounts, replaced list is freed once readers
+  /// pinned before are done with it
+  template <typename Modifier>
+  void Publish(Modifier&& modify) {
+    const MountList* current = nullptr;
+    {
+      std::lock_guard lock(mounts_mutex_);
+      current = mounts_.load(std::memory_order_relaxed);
+      auto next = std::make_unique<MountList>();
+      modify(*current, *next);
+      mounts_.store(next.release(), std::memory_order_release);
+    }
+
+    /// nodes of list may unmount others when released, so not under lock
+    RetireAfterEpoch([current] { delete current; });
   }
 
  private:
+  const StorageNodeMetadata::Ptr parent_;
+  /// nearest ancestor registered when metadata was created, root for root;
+  /// outlives metadata, as children hold parents strongly
+  StorageNodeMetadata* const anchor_;
   const StorageNode::Name name_;
-
-  mutable std::shared_mutex mutex_;
-  std::unordered_map<StorageNode::Name, StorageNodeMetadata::Ptr> children_;
-  std::list<MountPoint::WeakPtr> mounts_;
+  std::atomic<State> state_;
+  /// count of attaches and unlinks of metadata in registered subtree
+  std::atomic<uint64_t> changes_ = 0;
+
+  /// registered metadata of detached one, valid while count of changes of
+  /// anchor is equal to changes
+  struct Resolved {
+    uint64_t changes;
+    StorageNodeMetadata::WeakPtr metadata;
+  };
+
+  std::atomic<const Resolved*> resolved_ = nullptr;
+
+  mutable AsyncSharedMutex mutex_;
+  std::unordered_map<StorageNode::Name, StorageNodeMetadata::WeakPtr> children_;
+  /// serializes writers of mounts
+  std::mutex mounts_mutex_;
+  std::atomic<const MountList*> mounts_;
 };
 
+MountPoint::~MountPoint() {
+  if (auto meta = owner.lock()) {
+    meta->RemoveMountPoint(this);
+  }
+}
+
 class StorageNodeImpl final : public StorageNode {
  public:
   explicit StorageNodeImpl(const StorageNodeMetadata::Ptr& meta,
@@ -205,8 +649,9 @@ class StorageNodeImpl final : public StorageNode {
 
     auto layers = layers_;
     layers.push_back(node);
-    auto mount = meta_->AddMountPoint(std::move(node));
-    return std::make_shared<StorageNodeImpl>(meta_, std::move(layers),
+    auto meta = meta_->Attach();
+    auto mount = meta->AddMountPoint(std::move(node));
+    return std::make_shared<StorageNodeImpl>(std::move(meta), std::move(layers),
                                              std::move(mount));
   }
 
@@ -224,7 +669,7 @@ class StorageNodeImpl final : public StorageNode {
 
     auto layer = TopLayer().Create(name);
     VolumeNode::List child_layers = {std::move(layer)};
-    auto child_meta = meta_->GetAddChild(name);
+    auto child_meta = StorageNodeMetadata::CreateDetached(meta_, name);
     /// do not search for mount points, we've already done this on Find
     return std::make_shared<StorageNodeImpl>(std::move(child_meta),
                                              std::move(child_layers));
@@ -239,46 +684,95 @@ class StorageNodeImpl final : public StorageNode {
         child_layers.push_back(std::move(child));
       }
     }
-    auto child_meta = meta_->GetAddChild(name);
-    child_meta->ListMountPoints(child_layers);
-    if (child_layers.empty()) {
-      meta_->RemoveChild(name);
-      return NullStorageNode::Instance();
+
+    auto meta = meta_->Resolve();
+    auto child_meta = meta ? meta->FindChild(name) : nullptr;
+    return MakeChild(name, std::move(child_layers), meta,
+                     std::move(child_meta));
+  }
+
+  Task<StorageNode::Ptr> AsyncFind(Name name,
+                                   Executor& executor) const override {
+    VolumeNode::List child_layers;
+    child_layers.reserve(layers_.size());
+    for (const auto& layer : layers_) {
+      auto child = co_await layer->AsyncFind(name, executor);
+      if (child->IsValid()) {
+        child_layers.push_back(std::move(child));
+      }
     }
 
-    return std::make_shared<StorageNodeImpl>(std::move(child_meta),
-                                             std::move(child_layers));
+    auto meta = co_await meta_->AsyncResolve(executor);
+    StorageNodeMetadata::Ptr child_meta;
+    if (meta) {
+      child_meta = co_await meta->AsyncFindChild(name, executor);
+    }
+
+    co_return MakeChild(name, std::move(child_layers), meta,
+                        std::move(child_meta));
   }
 
+  /// @throw std::runtime_error if child exists in read-only layer
   bool Unlink(const Name& name) override {
+    for (const auto& layer : layers_) {
+      if (layer->IsReadOnly() && layer->Find(name)->IsValid()) {
+        throw std::runtime_error("Child of read-only layer cannot be unlinked");
+      }
+    }
+
     bool result = false;
     for (const auto& layer : layers_) {
-      result = layer->Unlink(name) || result;
+      result = (!layer->IsReadOnly() && layer->Unlink(name)) || result;
+    }
+
+    if (auto meta = meta_->Resolve()) {
+      meta->RemoveChild(name);
     }
 
-    meta_->RemoveChild(name);
     return result;
   }
 
+  /// @note result is sorted by name
   StorageNode::List Enumerate() const override {
-    std::unordered_map<Name, VolumeNode::List> name_groups;
+    std::vector<VolumeNode::List> layer_children;
+    layer_children.reserve(layers_.size());
+    size_t total_size = 0;
     for (const auto& layer : layers_) {
-      for (auto&& child : layer->Enumerate()) {
-        const auto& name = child->GetName();
-        name_groups[name].push_back(std::move(child));
-      }
+      auto children = layer->Enumerate();
+      std::sort(children.begin(), children.end(),
+                [](const auto& lhs, const auto& rhs) {
+                  return lhs->GetName() < rhs->GetName();
+                });
+      total_size += children.size();
+      layer_children.push_back(std::move(children));
     }
 
     StorageNode::List result;
-    result.reserve(name_groups.size());
-    for (auto&& [name, layers] : name_groups) {
-      auto meta = meta_->GetAddChild(name);
-      meta->ListMountPoints(layers);
-      auto child =
-          std::make_shared<StorageNodeImpl>(std::move(meta), std::move(layers));
-      result.push_back(std::move(child));
-    }
+    result.reserve(total_size);
+    auto name_of = [](const auto& child) -> const Name& {
+      return child->GetName();
+    };
+
+    auto meta = meta_->Resolve();
+    auto parent_meta = meta ? meta : meta_;
+    MergeSortedLayers(layer_children, name_of, [&](auto& group) {
+      VolumeNode::List layers;
+      layers.reserve(group.size());
+      for (auto* child : group) {
+        layers.push_back(std::move(*child));
+      }
+
+      const auto& name = layers.front()->GetName();
+      auto child_meta = meta ? meta->FindChild(name) : nullptr;
+      if (child_meta) {
+        child_meta->ListMountPoints(layers);
+      } else {
+        child_meta = StorageNodeMetadata::CreateDetached(parent_meta, name);
+      }
 
+      result.push_back(std::make_shared<StorageNodeImpl>(std::move(child_meta),
+                                                         std::move(layers)));
+    });
     return result;
   }
 
@@ -301,6 +795,28 @@ class StorageNodeImpl final : public StorageNode {
     return *layers_.back();
   }
 
+  /// @param meta resolved metadata of this node or nullptr
+  /// @param child_meta registered metadata of child or nullptr
+  StorageNode::Ptr MakeChild(const Name& name, VolumeNode::List&& child_layers,
+                             const StorageNodeMetadata::Ptr& meta,
+                             StorageNodeMetadata::Ptr&& child_meta) const {
+    if (child_meta) {
+      child_meta->ListMountPoints(child_layers);
+    }
+
+    if (child_layers.empty()) {
+      return NullStorageNode::Instance();
+    }
+
+    if (!child_meta) {
+      child_meta =
+          StorageNodeMetadata::CreateDetached(meta ? meta : meta_, name);
+    }
+
+    return std::make_shared<StorageNodeImpl>(std::move(child_meta),
+                                             std::move(child_layers));
+  }
+
  private:
   const StorageNodeMetadata::Ptr meta_;
   const VolumeNode::List layers_;
@@ -313,7 +829,7 @@ StorageNode::Ptr jbkv::MountStorage(VolumeNode::Ptr node) {
 }
 
 StorageNode::Ptr jbkv::MountStorage(VolumeNode::List nodes) {
-  auto meta = StorageNodeMetadata::Create(kRootName);
+  auto meta = StorageNodeMetadata::CreateRoot();
   StorageNode::Ptr root = std::make_shared<StorageNodeImpl>(std::move(meta));
   return root->Mount(std::move(nodes));
 }
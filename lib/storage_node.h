@@ -1,6 +1,7 @@
 #pragma once
 #include "volume_node.h"
 #include "noncopyable.h"
+#include "thread_pool.h"
 #include <string>
 #include <vector>
 #include <memory>
@@ -47,4 +48,14 @@ class StorageNode : public Node<StorageNode> {
 /// @note mount effect is for life-time of returned node
 StorageNode::Ptr MountStorage(VolumeNode::Ptr node);
 StorageNode::Ptr MountStorage(VolumeNode::List nodes);
+
+/// Merges all layers of storage subtree into single volume
+/// Layer precedence follows StorageNodeData rules and mounted subtrees are
+/// included, so reading result is equal to reading storage at the moment
+/// of call. Subtrees are merged in parallel on given pool.
+/// @return non-null volume ptr, independent of storage layers
+/// @{
+VolumeNode::Ptr Flatten(const StorageNode::Ptr& root);
+VolumeNode::Ptr Flatten(const StorageNode::Ptr& root, ThreadPool& pool);
+/// @}
 }  // namespace jbkv
@@ -0,0 +1,108 @@
+#include "thread_pool.h"
+#include <algorithm>
+#include <utility>
+
+using namespace jbkv;
+
+ThreadPool::ThreadPool(size_t threads) {
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  workers_.reserve(threads);
+  for (size_t i = 0; i < threads; ++i) {
+    workers_.emplace_back([this]() {
+      Run();
+    });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard lock(mutex_);
+    stopped_ = true;
+  }
+
+  wakeup_.notify_all();
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+}
+
+void ThreadPool::Submit(Task task) {
+  {
+    std::lock_guard lock(mutex_);
+    tasks_.push_back(std::move(task));
+  }
+
+  wakeup_.notify_one();
+}
+
+void ThreadPool::Run() {
+  while (true) {
+    Task task;
+    {
+      std::unique_lock lock(mutex_);
+      wakeup_.wait(lock, [this]() {
+        return stopped_ || !tasks_.empty();
+      });
+
+      if (tasks_.empty()) {
+        return;
+      }
+
+      task = std::move(tasks_.front());
+      tasks_.pop_front();
+    }
+
+    task();
+  }
+}
+
+TaskGroup::~TaskGroup() {
+  std::unique_lock lock(mutex_);
+  done_.wait(lock, [this]() {
+    return pending_ == 0;
+  });
+}
+
+void TaskGroup::Submit(ThreadPool::Task task) {
+  {
+    std::lock_guard lock(mutex_);
+    ++pending_;
+  }
+
+  pool_.Submit([this, task = std::move(task)]() {
+    std::exception_ptr error;
+    try {
+      task();
+    } catch (...) {
+      error = std::current_exception();
+    }
+
+    std::lock_guard lock(mutex_);
+    if (error && !error_) {
+      error_ = std::move(error);
+    }
+
+    if (--pending_ == 0) {
+      done_.notify_all();
+    }
+  });
+}
+
+void TaskGroup::Wait() {
+  std::unique_lock lock(mutex_);
+  done_.wait(lock, [this]() {
+    return pending_ == 0;
+  });
+
+  if (error_) {
+    std::rethrow_exception(std::exchange(error_, nullptr));
+  }
+}
+
+size_t TaskGroup::Pending() const {
+  std::lock_guard lock(mutex_);
+  return pending_;
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "noncopyable.h"
+
+namespace jbkv {
+
+/// Fixed-size pool of worker threads executing tasks in FIFO order
+class ThreadPool : NonCopyableNonMovable {
+ public:
+  using Task = std::function<void()>;
+
+ public:
+  /// @param threads number of workers, zero means hardware concurrency
+  explicit ThreadPool(size_t threads = 0);
+
+  /// Completes queued tasks and joins workers
+  ~ThreadPool();
+
+  void Submit(Task task);
+
+  size_t Size() const {
+    return workers_.size();
+  }
+
+ private:
+  void Run();
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable wakeup_;
+  std::deque<Task> tasks_;
+  bool stopped_ = false;
+  std::vector<std::thread> workers_;
+};
+
+/// Tracks completion of tasks submitted to pool
+/// Tasks are allowed to submit more tasks into the same group
+class TaskGroup : NonCopyableNonMovable {
+ public:
+  explicit TaskGroup(ThreadPool& pool)
+      : pool_(pool) {
+  }
+
+  /// Waits for submitted tasks, swallowing their errors
+  ~TaskGroup();
+
+  void Submit(ThreadPool::Task task);
+
+  /// Waits for all submitted tasks
+  /// @note rethrows first exception thrown by tasks
+  /// @note must not be called from pool worker
+  void Wait();
+
+  /// @return number of submitted but not yet completed tasks
+  size_t Pending() const;
+
+  ThreadPool& Pool() const {
+    return pool_;
+  }
+
+ private:
+  ThreadPool& pool_;
+  mutable std::mutex mutex_;
+  std::condition_variable done_;
+  size_t pending_ = 0;
+  std::exception_ptr error_;
+};
+
+}  // namespace jbkv
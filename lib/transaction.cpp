@@ -0,0 +1,132 @@
+#include "transaction.h"
+#include <algorithm>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <vector>
+#include "volume_node_impl.h"
+
+using namespace jbkv;
+
+TransactionalData& jbkv::AsTransactional(NodeData& data) {
+  auto* transactional = dynamic_cast<TransactionalData*>(&data);
+  if (!transactional) {
+    throw std::runtime_error("node data does not support transactions");
+  }
+
+  return *transactional;
+}
+
+Transaction::Transaction() = default;
+
+Transaction::~Transaction() = default;
+
+std::optional<Value> Transaction::Read(const NodeData::Ptr& data,
+                                       const NodeData::Key& key) {
+  auto& touched = Touch(data);
+  if (auto it = touched.writes.find(key); it != touched.writes.end()) {
+    return it->second;
+  }
+
+  return touched.transactional.ReadVersioned(key, reads_);
+}
+
+void Transaction::Write(const NodeData::Ptr& data, const NodeData::Key& key,
+                        Value&& value) {
+  Touch(data).writes.insert_or_assign(key, std::move(value));
+}
+
+void Transaction::Remove(const NodeData::Ptr& data,
+                         const NodeData::Key& key) {
+  Touch(data).writes.insert_or_assign(key, std::nullopt);
+}
+
+bool Transaction::Commit() {
+  /// nodes in address order, locked exclusively if they are written
+  std::vector<VolumeNodeData*> written;
+  for (const auto& [_, touched] : touched_) {
+    if (!touched.writes.empty()) {
+      touched.transactional.CollectWritten(written);
+    }
+  }
+
+  std::vector<std::pair<VolumeNodeData*, bool>> nodes;
+  nodes.reserve(reads_.size() + written.size());
+  for (const auto& [node, _] : reads_) {
+    nodes.emplace_back(node, false);
+  }
+
+  for (auto* node : written) {
+    nodes.emplace_back(node, true);
+  }
+
+  /// written entry of node goes first and is kept
+  std::sort(nodes.begin(), nodes.end(), [](const auto& lhs, const auto& rhs) {
+    if (lhs.first != rhs.first) {
+      return std::less<>{}(lhs.first, rhs.first);
+    }
+
+    return lhs.second > rhs.second;
+  });
+  nodes.erase(std::unique(nodes.begin(), nodes.end(),
+                          [](const auto& lhs, const auto& rhs) {
+                            return lhs.first == rhs.first;
+                          }),
+              nodes.end());
+
+  TransactionalData::Tickets tickets;
+  bool committed = true;
+  {
+    std::vector<std::unique_lock<AsyncSharedMutex>> exclusive_locks;
+    std::vector<std::shared_lock<AsyncSharedMutex>> shared_locks;
+    for (const auto& [node, exclusive] : nodes) {
+      if (exclusive) {
+        exclusive_locks.emplace_back(node->Mutex());
+      } else {
+        shared_locks.emplace_back(node->Mutex());
+      }
+    }
+
+    for (const auto& [node, version] : reads_) {
+      if (node->Version() != version) {
+        committed = false;
+        break;
+      }
+    }
+
+    if (committed) {
+      for (const auto& [_, touched] : touched_) {
+        for (const auto& [key, value] : touched.writes) {
+          touched.transactional.CheckLocked(key, value);
+        }
+      }
+
+      for (auto& [_, touched] : touched_) {
+        for (auto& [key, value] : touched.writes) {
+          touched.transactional.ApplyLocked(key, std::move(value), tickets);
+        }
+      }
+    }
+  }
+
+  /// waiting for durability may block on file sync
+  for (const auto& ticket : tickets) {
+    ticket.Commit();
+  }
+
+  reads_.clear();
+  touched_.clear();
+  return committed;
+}
+
+Transaction::Touched& Transaction::Touch(const NodeData::Ptr& data) {
+  auto it = touched_.find(data.get());
+  if (it == touched_.end()) {
+    it = touched_
+             .emplace(data.get(), Touched{data, AsTransactional(*data), {}})
+             .first;
+  }
+
+  return it->second;
+}
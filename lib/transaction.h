@@ -0,0 +1,118 @@
+#pragma once
+#include <functional>
+#include <map>
+#include <optional>
+#include <thread>
+#include "node_data.h"
+#include "noncopyable.h"
+
+namespace jbkv {
+
+class TransactionalData;
+class VolumeNodeData;
+
+/// Transaction over data of several nodes with optimistic concurrency
+/// control
+/// Reads go to data right away and record versions of nodes whose entries
+/// decide their results, writes are buffered and are seen by later reads
+/// of the same data by transaction. Commit locks nodes touched by
+/// transaction in address order, checks that versions of nodes read by
+/// transaction did not change and applies writes as data would, e.g. write
+/// to storage node data updates the top layer holding key. Every change of
+/// node, made by transaction or not, changes its version, so operations
+/// outside of transactions take no more locks than before.
+/// Typical use:
+/// @code
+/// RunTransaction([&](Transaction& transaction) {
+///   const auto amount = transaction.Read<int64_t>(from, "amount");
+///   transaction.Write(from, "amount", *amount - 10);
+///   transaction.Write(to, "amount", *transaction.Read<int64_t>(to, "amount")
+///                                       + 10);
+/// });
+/// @endcode
+/// @note supported are node data of volumes created by CreateVolume or
+/// VolumeBuilder and of storage nodes mounting only such volumes and
+/// read-only ones, e.g. frozen, others throw std::runtime_error. Commit
+/// removing key of read-only layer throws and applies nothing.
+/// @note transaction is not thread-safe
+class Transaction : NonCopyableNonMovable {
+ public:
+  Transaction();
+  ~Transaction();
+
+  /// Reads value by key as seen by transaction
+  /// @return nullopt if key does not exist or is removed by transaction
+  std::optional<Value> Read(const NodeData::Ptr& data,
+                            const NodeData::Key& key);
+
+  /// Writes value by key on commit
+  void Write(const NodeData::Ptr& data, const NodeData::Key& key,
+             Value&& value);
+
+  /// Removes value by key on commit
+  void Remove(const NodeData::Ptr& data, const NodeData::Key& key);
+
+  /// Applies writes atomically if nodes read by transaction did not change
+  /// since they were read
+  /// @return false on conflict, then nothing is applied and transaction is
+  /// to be run again
+  /// @note transaction is empty afterwards
+  bool Commit();
+
+  /// helpers
+ public:
+  template <typename T>
+  std::optional<T> Read(const NodeData::Ptr& data, const NodeData::Key& key) {
+    const auto value = Read(data, key);
+    if (!value) {
+      return std::nullopt;
+    }
+
+    const auto* mb_data = value->Try<T>();
+    if (!mb_data) {
+      return std::nullopt;
+    }
+
+    return *mb_data;
+  }
+
+  template <typename T>
+  void Write(const NodeData::Ptr& data, const NodeData::Key& key,
+             const T& value) {
+    Write(data, key, Value(value));
+  }
+
+ private:
+  /// Data touched by transaction, kept alive until commit
+  struct Touched {
+    NodeData::Ptr data;
+    TransactionalData& transactional;
+    /// buffered changes by key, nullopt removes key
+    std::map<NodeData::Key, std::optional<Value>, std::less<>> writes;
+  };
+
+  Touched& Touch(const NodeData::Ptr& data);
+
+ private:
+  /// versions of nodes when transaction read them first
+  std::map<VolumeNodeData*, uint64_t> reads_;
+  std::map<const NodeData*, Touched> touched_;
+};
+
+/// Runs function with new transaction until its commit succeeds
+/// @note function is called again on conflict, so it should have no
+/// effects outside of transaction
+template <typename Function>
+void RunTransaction(Function&& function) {
+  for (;;) {
+    Transaction transaction;
+    function(transaction);
+    if (transaction.Commit()) {
+      return;
+    }
+
+    std::this_thread::yield();
+  }
+}
+
+}  // namespace jbkv
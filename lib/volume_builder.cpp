@@ -0,0 +1,79 @@
+#include "volume_builder.h"
+#include <algorithm>
+#include "volume_node_impl.h"
+
+using namespace jbkv;
+
+namespace {
+constexpr auto kRootName = "/";
+}  // namespace
+
+VolumeBuilder::VolumeBuilder()
+    : root_(std::make_shared<VolumeNodeImpl>(kRootName)),
+      nodes_({root_.get()}) {
+}
+
+VolumeBuilder::~VolumeBuilder() = default;
+
+void VolumeBuilder::Add(const VolumeNode::Path& path, NodeData::Key key,
+                        Value&& value) {
+  Locate(path);
+  run_.emplace_back(std::move(key), std::move(value));
+}
+
+void VolumeBuilder::Add(const VolumeNode::Path& path,
+                        NodeData::KeyValueList&& entries) {
+  auto& node = Locate(path);
+  Flush();
+  node.Data().Insert(std::move(entries));
+}
+
+void VolumeBuilder::AddNode(const VolumeNode::Path& path) {
+  Locate(path);
+}
+
+void VolumeBuilder::Reserve(const VolumeNode::Path& path, size_t children,
+                            size_t entries) {
+  auto& node = Locate(path);
+  node.Reserve(children);
+  node.Data().Reserve(entries);
+}
+
+VolumeNode::Ptr VolumeBuilder::Build() {
+  Flush();
+  root_->FillScalars();
+  auto result = std::move(root_);
+  root_ = std::make_shared<VolumeNodeImpl>(kRootName);
+  path_.clear();
+  nodes_ = {root_.get()};
+  return result;
+}
+
+VolumeNodeImpl& VolumeBuilder::Locate(const VolumeNode::Path& path) {
+  size_t common = 0;
+  const auto limit = std::min(path.size(), path_.size());
+  while (common < limit && path[common] == path_[common]) {
+    ++common;
+  }
+
+  if (common == path.size() && common == path_.size()) {
+    return *nodes_.back();
+  }
+
+  Flush();
+  path_.resize(common);
+  nodes_.resize(common + 1);
+  for (size_t i = common; i < path.size(); ++i) {
+    path_.push_back(path[i]);
+    nodes_.push_back(&nodes_.back()->BuildChild(path[i]));
+  }
+
+  return *nodes_.back();
+}
+
+void VolumeBuilder::Flush() {
+  if (!run_.empty()) {
+    nodes_.back()->Data().Insert(std::move(run_));
+    run_.clear();
+  }
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include "noncopyable.h"
+#include "volume_node.h"
+
+namespace jbkv {
+
+class VolumeNodeImpl;
+
+/// Builds volume from stream of entries in bulk
+/// Volume is built by single owner before it is published, so nodes are
+/// filled without locking and without stamping their ancestors on every
+/// write, and scalar slots of every node are filled once by Build. Entries
+/// may come in any order; runs of entries of the same node, as in sorted
+/// export, skip lookup of path and are inserted at once, so table of
+/// entries of node is sized once. Later entry of the same key replaces
+/// earlier one.
+/// Typical use:
+/// @code
+/// VolumeBuilder builder;
+/// for (auto&& [path, key, value] : entries) {
+///   builder.Add(path, std::move(key), std::move(value));
+/// }
+///
+/// auto volume = builder.Build();
+/// @endcode
+/// @note builder is not thread-safe
+class VolumeBuilder : NonCopyableNonMovable {
+ public:
+  VolumeBuilder();
+  ~VolumeBuilder();
+
+  /// Adds entry to node at path from root, creating nodes on the path
+  void Add(const VolumeNode::Path& path, NodeData::Key key, Value&& value);
+
+  /// Adds entries to node at path, table of entries of node is sized once
+  /// if node has none yet
+  void Add(const VolumeNode::Path& path, NodeData::KeyValueList&& entries);
+
+  /// Creates node at path, e.g. node without entries
+  void AddNode(const VolumeNode::Path& path);
+
+  /// Sizes tables of node at path, creating it if needed, for expected
+  /// number of its children and entries, e.g. known from header of export
+  void Reserve(const VolumeNode::Path& path, size_t children, size_t entries);
+
+  /// Publishes built nodes as volume, builder starts new volume afterwards
+  /// @return non-null volume ptr, which tracks changes as one created by
+  /// CreateVolume
+  VolumeNode::Ptr Build();
+
+  /// helpers
+ public:
+  template <typename T>
+  void Add(const VolumeNode::Path& path, NodeData::Key key, const T& value) {
+    Add(path, std::move(key), Value(value));
+  }
+
+ private:
+  /// @return node at path, created if needed
+  /// Run of entries of previous node is inserted if path differs
+  VolumeNodeImpl& Locate(const VolumeNode::Path& path);
+
+  /// Inserts run of entries into node of previous path at once
+  void Flush();
+
+ private:
+  std::shared_ptr<VolumeNodeImpl> root_;
+  /// previous path and its nodes from root, so runs of the same path take
+  /// no lookups
+  VolumeNode::Path path_;
+  std::vector<VolumeNodeImpl*> nodes_;
+  /// entries of node of previous path, not inserted yet
+  NodeData::KeyValueList run_;
+};
+
+}  // namespace jbkv
@@ -0,0 +1,1117 @@
+#pragma once
+#include <concepts>
+#include <cstdint>
+#include <cstring>
+#include <ios>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "crc32c.h"
+#include "noncopyable.h"
+#include "value.h"
+
+/// Building blocks of volume file format shared by loaders and savers
+namespace jbkv::format {
+
+enum class FormatMarker : uint8_t {
+  Double = 0,
+  String = 1,
+  Blob = 2,
+  Bool = 3,
+  Char = 4,
+  UChar = 5,
+  UInt16 = 6,
+  Int16 = 7,
+  UInt32 = 8,
+  Int32 = 9,
+  UInt64 = 10,
+  Int64 = 11,
+  Float = 12
+};
+
+/// Version 1: header and node records in BFS order
+/// Version 4: header, node records prefixed by ids of node and its first
+/// child, index of records, dictionary and trailer. Records end with
+/// CRC-32C of whole record, ids, counts, sizes and integer values are
+/// LEB128 varints, names and keys repeated in file are coded by ids of
+/// per-file dictionary
+/// Versions 2 and 3 were never released and are not read
+constexpr uint8_t kFormatVersion = 4;
+constexpr uint8_t kLegacyFormatVersion = 1;
+constexpr std::string_view kMagic = "jbkv";
+
+/// Delta files carry changes of volume made after some generation
+/// Version 2: header and delta records closed by end marker, records end
+/// with CRC-32C of whole record
+/// Version 1 was never released and is not read
+constexpr uint8_t kDeltaFormatVersion = 2;
+constexpr std::string_view kDeltaMagic = "jbkd";
+
+/// Write-ahead log: header and framed change records
+/// Version 2: record is framed by size of payload and CRC-32C of payload
+/// Version 1 was never released and is not read
+constexpr uint8_t kLogFormatVersion = 2;
+constexpr std::string_view kLogMagic = "jbkl";
+
+/// Compressed file wraps any of files above: header with id of codec and
+/// maximum size of block, blocks and empty block closing the file
+/// Version 1: block is prefixed by its sizes before and after compression
+/// and CRC-32C of stored bytes, block which codec did not shrink is stored
+/// as is
+constexpr uint8_t kCompressedFormatVersion = 1;
+constexpr std::string_view kCompressedMagic = "jbkz";
+
+/// Files of volume opened by OpenLsmVolume
+/// Segment: header, blocks of sorted entries each followed by CRC-32C of
+/// block, index of blocks, bloom filter of keys and SegmentFooter
+/// Manifest: header, segments of every level and CRC-32C of them
+/// Batch log: header and batches of changes framed as records of
+/// write-ahead log
+/// @{
+constexpr uint8_t kSegmentFormatVersion = 1;
+constexpr std::string_view kSegmentMagic = "jbks";
+constexpr uint8_t kManifestFormatVersion = 1;
+constexpr std::string_view kManifestMagic = "jbkm";
+constexpr uint8_t kBatchLogFormatVersion = 1;
+constexpr std::string_view kBatchLogMagic = "jbkb";
+/// @}
+
+struct BlockHeader {
+  uint32_t raw_size = 0;
+  uint32_t stored_size = 0;
+  uint32_t crc = 0;
+};
+
+/// Location of node record in file, stored in index by record id
+struct IndexEntry {
+  uint64_t offset = 0;
+  uint64_t size = 0;
+};
+
+/// Closes file with index: offset of index and number of records in it
+struct Trailer {
+  uint64_t index_offset = 0;
+  uint64_t record_count = 0;
+};
+
+/// Closes segment file: offsets of index and filter, CRC-32C of both
+struct SegmentFooter {
+  uint64_t index_offset = 0;
+  uint64_t filter_offset = 0;
+  uint32_t crc = 0;
+  uint32_t reserved = 0;
+};
+
+static_assert(sizeof(IndexEntry) == 16 && sizeof(Trailer) == 16);
+static_assert(sizeof(SegmentFooter) == 24);
+static_assert(sizeof(BlockHeader) == 12);
+
+inline std::streamsize ConvertSize(uint64_t size) {
+  if constexpr (sizeof(std::streamsize) < sizeof(size)) {
+    const uint64_t native_max = std::numeric_limits<std::streamsize>::max();
+    if (size > native_max) {
+      throw std::runtime_error("Size is too big");
+    }
+  }
+
+  return static_cast<std::streamsize>(size);
+}
+
+/// Reads from contiguous memory, e.g. mapped file
+/// Streams and files are written and read through io::BufferedWriter and
+/// io::BufferedReader
+class MemoryReader {
+ public:
+  MemoryReader(const uint8_t* begin, const uint8_t* end)
+      : pos_(begin),
+        end_(end) {
+  }
+
+  void Read(void* data, uint64_t size) {
+    std::memcpy(data, Skip(size), static_cast<size_t>(size));
+  }
+
+  /// @return pointer to skipped bytes
+  const uint8_t* Skip(uint64_t size) {
+    if (size > static_cast<uint64_t>(end_ - pos_)) {
+      throw std::runtime_error("Data truncated");
+    }
+
+    const auto* result = pos_;
+    pos_ += size;
+    return result;
+  }
+
+  const uint8_t* Position() const {
+    return pos_;
+  }
+
+  uint64_t Remaining() const {
+    return static_cast<uint64_t>(end_ - pos_);
+  }
+
+  /// Checksum of bytes read after StartCrc, computed at once by Crc
+  /// @{
+  void StartCrc() {
+    crc_start_ = pos_;
+  }
+
+  uint32_t Crc() const {
+    return Crc32c(0, crc_start_, static_cast<size_t>(pos_ - crc_start_));
+  }
+
+  void StopCrc() {
+  }
+  /// @}
+
+ private:
+  const uint8_t* pos_;
+  const uint8_t* end_;
+  const uint8_t* crc_start_ = nullptr;
+};
+
+/// Whether stream checksums its bytes itself, once per contiguous block
+/// instead of once per written or read field
+template <typename Stream>
+constexpr bool kChecksumsBlocks = requires(Stream& stream) {
+  stream.StartCrc();
+  stream.StopCrc();
+  { stream.Crc() } -> std::same_as<uint32_t>;
+};
+
+/// Computes CRC-32C of bytes passing through to underlying writer
+/// Writers which checksum their blocks compute it instead
+template <typename Writer>
+class CrcWriter : NonCopyableNonMovable {
+ public:
+  explicit CrcWriter(Writer& out)
+      : out_(out) {
+    if constexpr (kChecksumsBlocks<Writer>) {
+      out_.StartCrc();
+    }
+  }
+
+  ~CrcWriter() {
+    if constexpr (kChecksumsBlocks<Writer>) {
+      out_.StopCrc();
+    }
+  }
+
+  void Write(const void* data, uint64_t size) {
+    if constexpr (!kChecksumsBlocks<Writer>) {
+      crc_ = Crc32c(crc_, data, static_cast<size_t>(size));
+    }
+
+    out_.Write(data, size);
+  }
+
+  /// @note must be called before anything else is written to underlying
+  /// writer
+  uint32_t Crc() const {
+    if constexpr (kChecksumsBlocks<Writer>) {
+      return out_.Crc();
+    } else {
+      return crc_;
+    }
+  }
+
+ private:
+  Writer& out_;
+  uint32_t crc_ = 0;
+};
+
+/// Computes CRC-32C of bytes read from underlying reader
+/// Readers which checksum their blocks compute it instead
+template <typename Reader>
+class CrcReader : NonCopyableNonMovable {
+ public:
+  explicit CrcReader(Reader& in)
+      : in_(in) {
+    if constexpr (kChecksumsBlocks<Reader>) {
+      in_.StartCrc();
+    }
+  }
+
+  ~CrcReader() {
+    if constexpr (kChecksumsBlocks<Reader>) {
+      in_.StopCrc();
+    }
+  }
+
+  void Read(void* data, uint64_t size) {
+    in_.Read(data, size);
+    if constexpr (!kChecksumsBlocks<Reader>) {
+      crc_ = Crc32c(crc_, data, static_cast<size_t>(size));
+    }
+  }
+
+  /// @note must be called before anything else is read from underlying
+  /// reader
+  uint32_t Crc() const {
+    if constexpr (kChecksumsBlocks<Reader>) {
+      return in_.Crc();
+    } else {
+      return crc_;
+    }
+  }
+
+ private:
+  Reader& in_;
+  uint32_t crc_ = 0;
+};
+
+/// Reads CRC-32C stored after data read by crc reader and verifies it
+template <typename Reader>
+void CheckCrc(const CrcReader<Reader>& crc_in, Reader& in) {
+  const auto crc = crc_in.Crc();
+  uint32_t stored_crc = 0;
+  in.Read(&stored_crc, sizeof(stored_crc));
+  if (stored_crc != crc) {
+    throw std::runtime_error("Data corrupted");
+  }
+}
+
+template <typename T, typename Writer>
+void Serialize(const T& value, Writer& out) {
+  static_assert(std::is_trivially_copyable_v<T>);
+  out.Write(&value, sizeof(value));
+}
+
+template <typename Writer>
+void Serialize(const std::string& value, Writer& out) {
+  const uint64_t size = value.size();
+  out.Write(&size, sizeof(size));
+  out.Write(value.data(), size);
+}
+
+template <typename Writer>
+void Serialize(const Value::String& value, Writer& out) {
+  Serialize(value.Ref(), out);
+}
+
+template <typename Writer>
+void Serialize(const Value::Blob& value, Writer& out) {
+  const uint64_t size = value.Ref().size();
+  out.Write(&size, sizeof(size));
+  out.Write(value.Ref().data(), size);
+}
+
+template <typename Writer>
+void Serialize(const Value& value, Writer& out) {
+  value.Accept([&out](const auto& data) {
+    using Type = std::remove_cvref_t<decltype(data)>;
+    if constexpr (std::is_same_v<Type, bool>) {
+      Serialize(FormatMarker::Bool, out);
+    } else if constexpr (std::is_same_v<Type, char>) {
+      Serialize(FormatMarker::Char, out);
+    } else if constexpr (std::is_same_v<Type, unsigned char>) {
+      Serialize(FormatMarker::UChar, out);
+    } else if constexpr (std::is_same_v<Type, uint16_t>) {
+      Serialize(FormatMarker::UInt16, out);
+    } else if constexpr (std::is_same_v<Type, int16_t>) {
+      Serialize(FormatMarker::Int16, out);
+    } else if constexpr (std::is_same_v<Type, uint32_t>) {
+      Serialize(FormatMarker::UInt32, out);
+    } else if constexpr (std::is_same_v<Type, int32_t>) {
+      Serialize(FormatMarker::Int32, out);
+    } else if constexpr (std::is_same_v<Type, uint64_t>) {
+      Serialize(FormatMarker::UInt64, out);
+    } else if constexpr (std::is_same_v<Type, int64_t>) {
+      Serialize(FormatMarker::Int64, out);
+    } else if constexpr (std::is_same_v<Type, float>) {
+      Serialize(FormatMarker::Float, out);
+    } else if constexpr (std::is_same_v<Type, double>) {
+      Serialize(FormatMarker::Double, out);
+    } else if constexpr (std::is_same_v<Type, Value::String>) {
+      Serialize(FormatMarker::String, out);
+    } else if constexpr (std::is_same_v<Type, Value::Blob>) {
+      Serialize(FormatMarker::Blob, out);
+    } else {
+      static_assert(sizeof(Type) != sizeof(Type), "unknown type");
+    }
+
+    Serialize(data, out);
+  });
+}
+
+template <typename Writer>
+void SerializeHeader(Writer& out, std::string_view magic = kMagic,
+                     uint8_t version = kFormatVersion) {
+  out.Write(magic.data(), magic.size());
+  Serialize(version, out);
+}
+
+template <typename T, typename Reader>
+void Deserialize(T& value, Reader& in) {
+  static_assert(std::is_trivially_copyable_v<T>);
+  in.Read(&value, sizeof(value));
+}
+
+template <typename Reader>
+void Deserialize(std::string& value, Reader& in) {
+  uint64_t size = 0;
+  in.Read(&size, sizeof(size));
+
+  const auto native_size = ConvertSize(size);
+  value.resize(static_cast<size_t>(native_size));
+  in.Read(value.data(), size);
+}
+
+template <typename Reader>
+void Deserialize(Value::String& value, Reader& in) {
+  Deserialize(value.Ref(), in);
+}
+
+template <typename Reader>
+void Deserialize(Value::Blob& value, Reader& in) {
+  uint64_t size = 0;
+  in.Read(&size, sizeof(size));
+
+  const auto native_size = ConvertSize(size);
+  value.Ref().resize(static_cast<size_t>(native_size));
+  in.Read(value.Ref().data(), size);
+}
+
+template <typename Reader>
+void Deserialize(std::optional<Value>& value, Reader& in) {
+  FormatMarker marker;
+  Deserialize(marker, in);
+  auto read = [&value, &in](auto data) {
+    Deserialize(data, in);
+    value.emplace(std::move(data));
+  };
+
+  switch (marker) {
+    case FormatMarker::Bool:
+      return read(bool{});
+    case FormatMarker::Char:
+      return read(char{});
+    case FormatMarker::UChar:
+      return read(static_cast<unsigned char>(0));
+    case FormatMarker::UInt16:
+      return read(uint16_t{});
+    case FormatMarker::Int16:
+      return read(int16_t{});
+    case FormatMarker::UInt32:
+      return read(uint32_t{});
+    case FormatMarker::Int32:
+      return read(int32_t{});
+    case FormatMarker::UInt64:
+      return read(uint64_t{});
+    case FormatMarker::Int64:
+      return read(int64_t{});
+    case FormatMarker::Float:
+      return read(float{});
+    case FormatMarker::Double:
+      return read(double{});
+    case FormatMarker::String:
+      return read(Value::String{});
+    case FormatMarker::Blob:
+      return read(Value::Blob{});
+  };
+
+  throw std::runtime_error("Bad value marker: " +
+                           std::to_string(static_cast<int>(marker)));
+}
+
+/// Header is read in two steps, so kind of file is detected by its magic
+/// @{
+template <typename Reader>
+std::string DeserializeMagic(Reader& in) {
+  std::string magic(kMagic.size(), '\0');
+  in.Read(magic.data(), magic.size());
+  return magic;
+}
+
+/// @param min_version oldest version which is still read
+/// @return version of format
+template <typename Reader>
+uint8_t DeserializeVersion(Reader& in, uint8_t max_version,
+                           uint8_t min_version = 0) {
+  uint8_t version = 0;
+  Deserialize(version, in);
+  if (version > max_version) {
+    throw std::runtime_error("File version is too new. Update program!");
+  }
+
+  if (version < min_version) {
+    throw std::runtime_error("Unsupported file version: " +
+                             std::to_string(version));
+  }
+
+  return version;
+}
+
+/// @return kLegacyFormatVersion or kFormatVersion
+template <typename Reader>
+uint8_t DeserializeVolumeVersion(Reader& in) {
+  const auto version = DeserializeVersion(in, kFormatVersion);
+  if (version != kLegacyFormatVersion && version != kFormatVersion) {
+    throw std::runtime_error("Unsupported file version: " +
+                             std::to_string(version));
+  }
+
+  return version;
+}
+/// @}
+
+/// @return version of format
+template <typename Reader>
+uint8_t DeserializeHeader(Reader& in) {
+  const auto magic = DeserializeMagic(in);
+  if (magic != kMagic) {
+    throw std::runtime_error("Bad file format, magic mismatch: " + magic);
+  }
+
+  return DeserializeVolumeVersion(in);
+}
+
+/// Skips value without decoding it
+template <typename Reader>
+void SkipValue(Reader& in) {
+  FormatMarker marker;
+  Deserialize(marker, in);
+  switch (marker) {
+    case FormatMarker::Bool:
+      in.Skip(sizeof(bool));
+      return;
+    case FormatMarker::Char:
+    case FormatMarker::UChar:
+      in.Skip(sizeof(char));
+      return;
+    case FormatMarker::UInt16:
+    case FormatMarker::Int16:
+      in.Skip(sizeof(uint16_t));
+      return;
+    case FormatMarker::UInt32:
+    case FormatMarker::Int32:
+      in.Skip(sizeof(uint32_t));
+      return;
+    case FormatMarker::UInt64:
+    case FormatMarker::Int64:
+      in.Skip(sizeof(uint64_t));
+      return;
+    case FormatMarker::Float:
+      in.Skip(sizeof(float));
+      return;
+    case FormatMarker::Double:
+      in.Skip(sizeof(double));
+      return;
+    case FormatMarker::String:
+    case FormatMarker::Blob: {
+      uint64_t size = 0;
+      Deserialize(size, in);
+      in.Skip(size);
+      return;
+    }
+  };
+
+  throw std::runtime_error("Bad value marker: " +
+                           std::to_string(static_cast<int>(marker)));
+}
+
+/// Skips node record body
+/// @tparam Count type of children and key-value counters
+/// @return number of children of node
+template <typename Count, typename Reader>
+Count SkipNode(Reader& in) {
+  Count children_count = 0;
+  Deserialize(children_count, in);
+  for (Count i = 0; i < children_count; ++i) {
+    uint64_t size = 0;
+    Deserialize(size, in);
+    in.Skip(size);
+  }
+
+  Count kv_size = 0;
+  Deserialize(kv_size, in);
+  for (Count i = 0; i < kv_size; ++i) {
+    uint64_t size = 0;
+    Deserialize(size, in);
+    in.Skip(size);
+    SkipValue(in);
+  }
+
+  in.Skip(sizeof(uint8_t));
+  return children_count;
+}
+
+/// Byte-wise XOR of payloads used by legacy format
+/// @{
+inline void CheckSum(const void* data, size_t size, uint8_t& checksum) {
+  // XOR is folded by machine words, byte-wise result is the same
+  const auto* bytes = static_cast<const uint8_t*>(data);
+  uint64_t folded = 0;
+  for (; size >= sizeof(folded); size -= sizeof(folded)) {
+    uint64_t word;
+    std::memcpy(&word, bytes, sizeof(word));
+    folded ^= word;
+    bytes += sizeof(word);
+  }
+
+  for (; size > 0; --size) {
+    folded ^= *bytes++;
+  }
+
+  folded ^= folded >> 32;
+  folded ^= folded >> 16;
+  folded ^= folded >> 8;
+  checksum ^= static_cast<uint8_t>(folded);
+}
+
+template <typename T>
+void CheckSum(const T& value, uint8_t& checksum) {
+  static_assert(std::is_trivially_copyable_v<T>);
+  CheckSum(&value, sizeof(value), checksum);
+}
+
+template <typename T>
+void CheckSum(const Referenced<T>& value, uint8_t& checksum) {
+  CheckSum(value.Ref().data(), value.Ref().size(), checksum);
+}
+
+inline void CheckSum(const std::string& value, uint8_t& checksum) {
+  CheckSum(value.data(), value.size(), checksum);
+}
+
+inline void CheckSum(const Value& value, uint8_t& checksum) {
+  value.Accept([&checksum](const auto& data) {
+    CheckSum(data, checksum);
+  });
+}
+/// @}
+
+/// Reads node record body: children names and key-value pairs
+/// @tparam Count type of children and key-value counters
+/// @param on_child called with name of every child
+/// @param on_value called with every key and value
+template <typename Count, typename Reader, typename OnChild, typename OnValue>
+void DeserializeNodeBody(Reader& in, OnChild&& on_child, OnValue&& on_value) {
+  Count children_count = 0;
+  Deserialize(children_count, in);
+  for (Count i = 0; i < children_count; ++i) {
+    std::string name;
+    Deserialize(name, in);
+    on_child(std::move(name));
+  }
+
+  Count kv_size = 0;
+  Deserialize(kv_size, in);
+  for (Count i = 0; i < kv_size; ++i) {
+    std::string key;
+    std::optional<Value> value;
+    Deserialize(key, in);
+    Deserialize(value, in);
+    on_value(std::move(key), std::move(*value));
+  }
+}
+
+/// Reads node record body followed by XOR checksum of legacy format
+/// @param checksum checksum of preceding record fields
+template <typename Count, typename Reader, typename OnChild, typename OnValue>
+void DeserializeNode(Reader& in, uint8_t checksum, OnChild&& on_child,
+                     OnValue&& on_value) {
+  DeserializeNodeBody<Count>(
+      in,
+      [&checksum, &on_child](std::string&& name) {
+        CheckSum(name, checksum);
+        on_child(std::move(name));
+      },
+      [&checksum, &on_value](std::string&& key, Value&& value) {
+        CheckSum(key, checksum);
+        CheckSum(value, checksum);
+        on_value(std::move(key), std::move(value));
+      });
+
+  uint8_t stored_checksum = 0;
+  Deserialize(stored_checksum, in);
+  if (checksum != stored_checksum) {
+    throw std::runtime_error("Data corrupted");
+  }
+}
+
+/// Reads names of children from node record body without verification
+template <typename Count, typename Reader, typename OnChild>
+void DeserializeChildren(Reader& in, OnChild&& on_child) {
+  Count children_count = 0;
+  Deserialize(children_count, in);
+  for (Count i = 0; i < children_count; ++i) {
+    std::string name;
+    Deserialize(name, in);
+    on_child(std::move(name));
+  }
+}
+
+/// Header of indexed node record
+struct RecordHeader {
+  uint64_t id = 0;
+  /// children records have sequential ids starting from this one
+  uint64_t first_child = 0;
+};
+
+/// Compact encoding of format version kFormatVersion
+/// @{
+
+/// Unsigned LEB128: 7 bits per byte, least significant first, high bit of
+/// byte is set if more bytes follow
+template <typename Writer>
+void SerializeVarint(uint64_t value, Writer& out) {
+  uint8_t bytes[10];
+  size_t size = 0;
+  for (; value >= 0x80; value >>= 7) {
+    bytes[size++] = static_cast<uint8_t>(value | 0x80);
+  }
+
+  bytes[size++] = static_cast<uint8_t>(value);
+  out.Write(bytes, size);
+}
+
+template <typename Reader>
+uint64_t DeserializeVarint(Reader& in) {
+  uint64_t value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    uint8_t byte = 0;
+    in.Read(&byte, sizeof(byte));
+    value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0) {
+      if (shift == 63 && byte > 1) {
+        break;
+      }
+
+      return value;
+    }
+  }
+
+  throw std::runtime_error("Data corrupted");
+}
+
+/// Writes integers, sizes of strings and blobs inside values as varints
+template <typename Writer>
+class CompactWriter {
+ public:
+  explicit CompactWriter(Writer& out)
+      : out_(out) {
+  }
+
+  void Write(const void* data, uint64_t size) {
+    out_.Write(data, size);
+  }
+
+ private:
+  Writer& out_;
+};
+
+/// Reads integers, sizes of strings and blobs inside values as varints
+template <typename Reader>
+class CompactReader {
+ public:
+  explicit CompactReader(Reader& in)
+      : in_(in) {
+  }
+
+  void Read(void* data, uint64_t size) {
+    in_.Read(data, size);
+  }
+
+ private:
+  Reader& in_;
+};
+
+/// Integers wider than byte are varints, signed ones are zigzag-coded, so
+/// small magnitudes of either sign take single byte
+template <typename T>
+constexpr bool kIsVarint = std::is_integral_v<T> && sizeof(T) > 1;
+
+template <typename T, typename Writer>
+  requires kIsVarint<T>
+void Serialize(const T& value, CompactWriter<Writer>& out) {
+  if constexpr (std::is_signed_v<T>) {
+    const auto wide = static_cast<int64_t>(value);
+    SerializeVarint(static_cast<uint64_t>(wide) << 1 ^
+                        static_cast<uint64_t>(wide >> 63),
+                    out);
+  } else {
+    SerializeVarint(value, out);
+  }
+}
+
+template <typename T, typename Reader>
+  requires kIsVarint<T>
+void Deserialize(T& value, CompactReader<Reader>& in) {
+  const auto coded = DeserializeVarint(in);
+  if constexpr (std::is_signed_v<T>) {
+    const auto wide = static_cast<int64_t>(coded >> 1 ^ (0 - (coded & 1)));
+    if (wide < std::numeric_limits<T>::min() ||
+        wide > std::numeric_limits<T>::max()) {
+      throw std::runtime_error("Data corrupted");
+    }
+
+    value = static_cast<T>(wide);
+  } else {
+    if (coded > std::numeric_limits<T>::max()) {
+      throw std::runtime_error("Data corrupted");
+    }
+
+    value = static_cast<T>(coded);
+  }
+}
+
+template <typename Writer>
+void Serialize(const std::string& value, CompactWriter<Writer>& out) {
+  SerializeVarint(value.size(), out);
+  out.Write(value.data(), value.size());
+}
+
+template <typename Writer>
+void Serialize(const Value::Blob& value, CompactWriter<Writer>& out) {
+  SerializeVarint(value.Ref().size(), out);
+  out.Write(value.Ref().data(), value.Ref().size());
+}
+
+template <typename Reader>
+void Deserialize(std::string& value, CompactReader<Reader>& in) {
+  const auto size = DeserializeVarint(in);
+  value.resize(static_cast<size_t>(ConvertSize(size)));
+  in.Read(value.data(), size);
+}
+
+template <typename Reader>
+void Deserialize(Value::Blob& value, CompactReader<Reader>& in) {
+  const auto size = DeserializeVarint(in);
+  value.Ref().resize(static_cast<size_t>(ConvertSize(size)));
+  in.Read(value.Ref().data(), size);
+}
+
+template <typename Writer>
+void SerializeCompactRecordHeader(const RecordHeader& header, Writer& out) {
+  SerializeVarint(header.id, out);
+  SerializeVarint(header.first_child, out);
+}
+
+template <typename Reader>
+void DeserializeCompactRecordHeader(RecordHeader& header, Reader& in) {
+  header.id = DeserializeVarint(in);
+  header.first_child = DeserializeVarint(in);
+}
+
+/// Names and keys are written as tokens: varint of payload shifted left by
+/// two bits and kind of token in lower bits
+enum class TokenKind : uint8_t {
+  /// payload is size of string which follows
+  Literal = 0,
+  /// payload is id of dictionary entry
+  Reference = 1,
+  /// payload is size of string which follows and becomes next entry
+  Definition = 2
+};
+
+/// Writes every string as literal, used when records are not written in
+/// order, so references could precede definitions
+struct LiteralEncoder {
+  template <typename Writer>
+  void Serialize(const std::string& value, Writer& out) {
+    SerializeVarint(value.size() << 2 |
+                        static_cast<uint64_t>(TokenKind::Literal),
+                    out);
+    out.Write(value.data(), value.size());
+  }
+};
+
+/// Builds dictionary of file from strings repeated in it
+/// String is defined on its second occurrence and referenced afterwards;
+/// long strings are never defined, and size of dictionary is bounded
+class DictionaryEncoder {
+ public:
+  static constexpr size_t kMaxEntrySize = 64;
+  static constexpr size_t kMaxEntries = 1 << 16;
+  /// strings seen once are forgotten when there are too many of them
+  static constexpr size_t kMaxCandidates = 1 << 16;
+
+ public:
+  template <typename Writer>
+  void Serialize(const std::string& value, Writer& out) {
+    auto kind = TokenKind::Literal;
+    if (value.size() <= kMaxEntrySize) {
+      if (const auto it = ids_.find(value); it != ids_.end()) {
+        SerializeVarint(it->second << 2 |
+                            static_cast<uint64_t>(TokenKind::Reference),
+                        out);
+        return;
+      }
+
+      if (entries_.size() < kMaxEntries && seen_.erase(value) != 0) {
+        kind = TokenKind::Definition;
+        const auto it = ids_.emplace(value, entries_.size()).first;
+        entries_.push_back(&it->first);
+      } else if (seen_.size() < kMaxCandidates) {
+        seen_.insert(value);
+      } else {
+        seen_.clear();
+      }
+    }
+
+    SerializeVarint(value.size() << 2 | static_cast<uint64_t>(kind), out);
+    out.Write(value.data(), value.size());
+  }
+
+  /// Entries in order of ids
+  const std::vector<const std::string*>& Entries() const {
+    return entries_;
+  }
+
+ private:
+  std::unordered_map<std::string, uint64_t> ids_;
+  std::vector<const std::string*> entries_;
+  std::unordered_set<std::string> seen_;
+};
+
+/// Resolves tokens of names and keys
+/// Sequential reader builds dictionary from definitions as they come,
+/// random access reader adds whole dictionary of file upfront
+class DictionaryDecoder {
+ public:
+  void Add(std::string entry) {
+    entries_.push_back(std::move(entry));
+  }
+
+  /// Reads token in sequential order, definitions are added to dictionary
+  template <typename Reader>
+  void Deserialize(std::string& value, Reader& in) {
+    if (DeserializeToken(value, in) == TokenKind::Definition) {
+      Add(value);
+    }
+  }
+
+  /// Reads token of any record, dictionary is expected to be complete
+  template <typename Reader>
+  void Decode(std::string& value, Reader& in) const {
+    DeserializeToken(value, in);
+  }
+
+ private:
+  template <typename Reader>
+  TokenKind DeserializeToken(std::string& value, Reader& in) const {
+    const auto tag = DeserializeVarint(in);
+    const auto kind = static_cast<TokenKind>(tag & 3);
+    const auto payload = tag >> 2;
+    switch (kind) {
+      case TokenKind::Reference:
+        if (payload >= entries_.size()) {
+          break;
+        }
+
+        /// short strings are stored inline, so copy does not allocate
+        value = entries_[payload];
+        return kind;
+      case TokenKind::Literal:
+      case TokenKind::Definition:
+        value.resize(static_cast<size_t>(ConvertSize(payload)));
+        in.Read(value.data(), payload);
+        return kind;
+    }
+
+    throw std::runtime_error("Data corrupted");
+  }
+
+ private:
+  std::vector<std::string> entries_;
+};
+
+/// Dictionary of file: varint number of entries, entries as varint sizes
+/// and bytes, CRC-32C of preceding bytes
+template <typename Writer>
+void SerializeDictionary(const std::vector<const std::string*>& entries,
+                         Writer& out) {
+  CrcWriter crc_out(out);
+  CompactWriter compact_out(crc_out);
+  SerializeVarint(entries.size(), compact_out);
+  for (const auto* entry : entries) {
+    Serialize(*entry, compact_out);
+  }
+
+  Serialize(crc_out.Crc(), out);
+}
+
+template <typename Reader>
+void DeserializeDictionary(DictionaryDecoder& dictionary, Reader& in) {
+  CrcReader crc_in(in);
+  CompactReader compact_in(crc_in);
+  const auto count = DeserializeVarint(compact_in);
+  for (uint64_t i = 0; i < count; ++i) {
+    std::string entry;
+    Deserialize(entry, compact_in);
+    dictionary.Add(std::move(entry));
+  }
+
+  CheckCrc(crc_in, in);
+}
+
+/// Reads compact node record body
+/// @param read_string reads token of name or key into string
+/// @param on_child called with name of every child
+/// @param on_value called with every key and value
+template <typename Reader, typename ReadString, typename OnChild,
+          typename OnValue>
+void DeserializeCompactNodeBody(Reader& in, ReadString&& read_string,
+                                OnChild&& on_child, OnValue&& on_value) {
+  const auto children_count = DeserializeVarint(in);
+  for (uint64_t i = 0; i < children_count; ++i) {
+    std::string name;
+    read_string(name, in);
+    on_child(std::move(name));
+  }
+
+  CompactReader compact_in(in);
+  const auto kv_size = DeserializeVarint(in);
+  for (uint64_t i = 0; i < kv_size; ++i) {
+    std::string key;
+    std::optional<Value> value;
+    read_string(key, in);
+    Deserialize(value, compact_in);
+    on_value(std::move(key), std::move(*value));
+  }
+}
+
+/// Reads names of children from compact node record body
+template <typename Reader, typename ReadString, typename OnChild>
+void DeserializeCompactChildren(Reader& in, ReadString&& read_string,
+                                OnChild&& on_child) {
+  const auto children_count = DeserializeVarint(in);
+  for (uint64_t i = 0; i < children_count; ++i) {
+    std::string name;
+    read_string(name, in);
+    on_child(std::move(name));
+  }
+}
+/// @}
+
+/// Changes of single node
+struct DeltaRecord {
+  /// names of nodes from root to changed node
+  std::vector<std::string> path;
+  std::vector<std::string> unlinked;
+  std::vector<std::string> removed;
+  std::vector<std::pair<std::string, Value>> written;
+};
+
+/// Record is prefixed by marker distinguishing it from end of delta
+template <typename Writer>
+void SerializeDeltaRecord(const DeltaRecord& record, Writer& out) {
+  Serialize(true, out);
+  CrcWriter crc_out(out);
+  auto serialize_names = [&crc_out](const auto& names) {
+    Serialize(static_cast<uint64_t>(names.size()), crc_out);
+    for (const auto& name : names) {
+      Serialize(name, crc_out);
+    }
+  };
+
+  serialize_names(record.path);
+  serialize_names(record.unlinked);
+  serialize_names(record.removed);
+  Serialize(static_cast<uint64_t>(record.written.size()), crc_out);
+  for (const auto& [key, value] : record.written) {
+    Serialize(key, crc_out);
+    Serialize(value, crc_out);
+  }
+
+  Serialize(crc_out.Crc(), out);
+}
+
+template <typename Writer>
+void SerializeDeltaEnd(Writer& out) {
+  Serialize(false, out);
+}
+
+/// @return false at the end of delta
+template <typename Reader>
+bool DeserializeDeltaRecord(DeltaRecord& record, Reader& in) {
+  bool has_record = false;
+  Deserialize(has_record, in);
+  if (!has_record) {
+    return false;
+  }
+
+  CrcReader crc_in(in);
+  auto deserialize_names = [&crc_in](auto& names) {
+    uint64_t count = 0;
+    Deserialize(count, crc_in);
+    names.clear();
+    for (uint64_t i = 0; i < count; ++i) {
+      Deserialize(names.emplace_back(), crc_in);
+    }
+  };
+
+  deserialize_names(record.path);
+  deserialize_names(record.unlinked);
+  deserialize_names(record.removed);
+
+  uint64_t count = 0;
+  Deserialize(count, crc_in);
+  record.written.clear();
+  for (uint64_t i = 0; i < count; ++i) {
+    std::string key;
+    std::optional<Value> value;
+    Deserialize(key, crc_in);
+    Deserialize(value, crc_in);
+    record.written.emplace_back(std::move(key), std::move(*value));
+  }
+
+  CheckCrc(crc_in, in);
+  return true;
+}
+
+/// Change of volume recorded in write-ahead log
+struct LogRecord {
+  uint8_t kind = 0;
+  /// names of nodes from root to changed node
+  std::vector<std::string> path;
+  /// name of child or key
+  std::string name;
+  std::optional<Value> value;
+};
+
+/// Serializes payload of log record
+template <typename Writer>
+void SerializeLogRecord(uint8_t kind, const std::vector<std::string>& path,
+                        const std::string& name, const Value* value,
+                        Writer& out) {
+  Serialize(kind, out);
+  Serialize(static_cast<uint64_t>(path.size()), out);
+  for (const auto& node : path) {
+    Serialize(node, out);
+  }
+
+  Serialize(name, out);
+  Serialize(value != nullptr, out);
+  if (value) {
+    Serialize(*value, out);
+  }
+}
+
+template <typename Reader>
+void DeserializeLogRecord(LogRecord& record, Reader& in) {
+  Deserialize(record.kind, in);
+  uint64_t count = 0;
+  Deserialize(count, in);
+  record.path.clear();
+  for (uint64_t i = 0; i < count; ++i) {
+    Deserialize(record.path.emplace_back(), in);
+  }
+
+  Deserialize(record.name, in);
+  bool has_value = false;
+  Deserialize(has_value, in);
+  record.value.reset();
+  if (has_value) {
+    Deserialize(record.value, in);
+  }
+}
+
+}  // namespace jbkv::format
@@ -1,359 +1,455 @@
 #include "volume_io.h"
-#include <fstream>
+#include "async_file.h"
+#include "buffered_io.h"
+#include "compressed_io.h"
+#include "volume_format.h"
+#include "volume_node_impl.h"
+#include "volume_snapshot.h"
+#include <atomic>
 #include <deque>
-#include <limits>
-#include <type_traits>
+#include <future>
+#include <mutex>
+#include <unordered_map>
 
 namespace {
 using namespace jbkv;
-
-enum class FormatMarker : uint8_t {
-  Double = 0,
-  String = 1,
-  Blob = 2,
-  Bool = 3,
-  Char = 4,
-  UChar = 5,
-  UInt16 = 6,
-  Int16 = 7,
-  UInt32 = 8,
-  Int32 = 9,
-  UInt64 = 10,
-  Int64 = 11,
-  Float = 12
-};
-
-constexpr uint8_t kFormatVersion = 1;
-constexpr std::string_view kMagic = "jbkv";
-
-void Check(std::ios& stream) {
-  if (!stream.good()) {
-    throw std::runtime_error("Bad stream");
+using namespace jbkv::format;
+using io::BufferedReader;
+using io::BufferedWriter;
+
+/// Serializes record of node
+/// @param allocate reserves given number of sequential ids for children and
+/// returns first of them
+/// @param strings encoder of names and keys
+/// @return children of node in order of their ids
+template <typename Writer, typename Allocate, typename Strings>
+VolumeNode::List SerializeRecord(VolumeNode::List children,
+                                 const NodeData::KeyValueList& kv_list,
+                                 uint64_t id, Allocate&& allocate,
+                                 Strings& strings, Writer& out) {
+  const RecordHeader header = {id, allocate(children.size())};
+  CrcWriter crc_out(out);
+  CompactWriter compact_out(crc_out);
+  SerializeCompactRecordHeader(header, compact_out);
+
+  SerializeVarint(children.size(), compact_out);
+  for (const auto& child : children) {
+    strings.Serialize(child->GetName(), compact_out);
   }
-}
 
-std::streamsize ConvertSize(uint64_t size) {
-  if constexpr (sizeof(std::streamsize) < sizeof(size)) {
-    const uint64_t native_max = std::numeric_limits<std::streamsize>::max();
-    if (size > native_max) {
-      throw std::runtime_error("Size is too big");
-    }
+  SerializeVarint(kv_list.size(), compact_out);
+  for (const auto& [key, value] : kv_list) {
+    strings.Serialize(key, compact_out);
+    Serialize(value, compact_out);
   }
 
-  return static_cast<std::streamsize>(size);
+  Serialize(crc_out.Crc(), out);
+  return children;
 }
 
-void SerializeHeader(std::ostream& out) {
-  Check(out.write(kMagic.data(), kMagic.size()));
-  Check(out.write(reinterpret_cast<const char*>(&kFormatVersion),
-                  sizeof(kFormatVersion)));
-}
-
-template <typename T>
-void Serialize(const T& value, std::ostream& out) {
-  static_assert(std::is_trivial_v<T>);
-  Check(out.write(reinterpret_cast<const char*>(&value), sizeof(value)));
-}
-
-template <>
-void Serialize(const std::string& value, std::ostream& out) {
-  uint64_t size = value.size();
-  Check(out.write(reinterpret_cast<const char*>(&size), sizeof(size)));
-  Check(out.write(value.data(), ConvertSize(size)));
-}
+template <typename Writer>
+void SerializeIndex(const std::vector<IndexEntry>& index,
+                    const std::vector<const std::string*>& dictionary,
+                    Writer& out) {
+  const Trailer trailer = {out.Offset(), index.size()};
+  for (const auto& entry : index) {
+    Serialize(entry, out);
+  }
 
-template <>
-void Serialize(const Value::String& value, std::ostream& out) {
-  Serialize(value.Ref(), out);
+  SerializeDictionary(dictionary, out);
+  Serialize(trailer, out);
 }
 
-template <>
-void Serialize(const Value::Blob& value, std::ostream& out) {
-  uint64_t size = value.Ref().size();
-  Check(out.write(reinterpret_cast<const char*>(&size), sizeof(size)));
-  Check(out.write(reinterpret_cast<const char*>(&value.Ref()[0]),
-                  ConvertSize(size)));
-}
+class VolumeSaver {
+ public:
+  /// @param snapshot epoch of point-in-time snapshot of tracked volume to
+  /// save, zero to save current state of nodes
+  explicit VolumeSaver(io::Sink& sink, uint64_t snapshot = 0)
+      : out_(sink),
+        snapshot_(snapshot) {
+    SerializeHeader(out_);
+  }
 
-template <>
-void Serialize(const Value& value, std::ostream& out) {
-  value.Accept([&out](const auto& data) {
-    using Type = std::remove_cvref_t<decltype(data)>;
-    if constexpr (std::is_same_v<Type, bool>) {
-      Serialize(FormatMarker::Bool, out);
-    } else if constexpr (std::is_same_v<Type, char>) {
-      Serialize(FormatMarker::Char, out);
-    } else if constexpr (std::is_same_v<Type, unsigned char>) {
-      Serialize(FormatMarker::UChar, out);
-    } else if constexpr (std::is_same_v<Type, uint16_t>) {
-      Serialize(FormatMarker::UInt16, out);
-    } else if constexpr (std::is_same_v<Type, int16_t>) {
-      Serialize(FormatMarker::Int16, out);
-    } else if constexpr (std::is_same_v<Type, uint32_t>) {
-      Serialize(FormatMarker::UInt32, out);
-    } else if constexpr (std::is_same_v<Type, int32_t>) {
-      Serialize(FormatMarker::Int32, out);
-    } else if constexpr (std::is_same_v<Type, uint64_t>) {
-      Serialize(FormatMarker::UInt64, out);
-    } else if constexpr (std::is_same_v<Type, int64_t>) {
-      Serialize(FormatMarker::Int64, out);
-    } else if constexpr (std::is_same_v<Type, float>) {
-      Serialize(FormatMarker::Float, out);
-    } else if constexpr (std::is_same_v<Type, double>) {
-      Serialize(FormatMarker::Double, out);
-    } else if constexpr (std::is_same_v<Type, Value::String>) {
-      Serialize(FormatMarker::String, out);
-    } else if constexpr (std::is_same_v<Type, Value::Blob>) {
-      Serialize(FormatMarker::Blob, out);
+ public:
+  /// Nodes are visited in BFS order, so children of node get sequential ids
+  void OnNode(VolumeNode& node, auto& descendants) {
+    if (snapshot_) {
+      /// nodes of tracked volume are always VolumeNodeImpl
+      auto& impl = static_cast<VolumeNodeImpl&>(node);
+      OnRecord(impl.SnapshotChildren(snapshot_), impl.SnapshotData(snapshot_),
+               descendants);
     } else {
-      static_assert(sizeof(Type) != sizeof(Type), "unknown type");
+      OnRecord(node.Enumerate(), node.Open()->Enumerate(), descendants);
     }
+  }
 
-    Serialize(data, out);
-  });
-}
-
-void DeserializeHeader(std::string& magic, uint8_t& version, std::istream& in) {
-  magic.resize(kMagic.size());
-  Check(in.read(&magic[0], ConvertSize(magic.size())));
-  Check(in.read(reinterpret_cast<char*>(&version), sizeof(version)));
-}
+  void Finish() {
+    SerializeIndex(index_, dictionary_.Entries(), out_);
+    out_.Flush();
+  }
 
-template <typename T>
-void Deserialize(T& value, std::istream& in) {
-  static_assert(std::is_trivial_v<T>);
-  Check(in.read(reinterpret_cast<char*>(&value), sizeof(value)));
-}
+ private:
+  void OnRecord(VolumeNode::List children,
+                const NodeData::KeyValueList& kv_list, auto& descendants) {
+    const auto offset = out_.Offset();
+    children = SerializeRecord(
+        std::move(children), kv_list, index_.size(),
+        [this](uint64_t count) {
+          const auto first = next_id_;
+          next_id_ += count;
+          return first;
+        },
+        dictionary_, out_);
+
+    index_.push_back({offset, out_.Offset() - offset});
+    std::move(children.begin(), children.end(),
+              std::back_inserter(descendants));
+  }
 
-template <>
-void Deserialize(std::string& value, std::istream& in) {
-  uint64_t size = 0;
-  Check(in.read(reinterpret_cast<char*>(&size), sizeof(size)));
+ private:
+  BufferedWriter out_;
+  const uint64_t snapshot_;
+  std::vector<IndexEntry> index_;
+  DictionaryEncoder dictionary_;
+  uint64_t next_id_ = 1;
+};
 
-  const auto native_size = ConvertSize(size);
-  value.resize(static_cast<size_t>(native_size));
-  Check(in.read(&value[0], native_size));
-}
+/// Serializes subtrees concurrently into task-local buffers which are
+/// appended to file as they fill up
+/// Children ids are reserved from shared counter, so records are written in
+/// arbitrary order, but parent record always precedes its children: subtree
+/// is offloaded to pool only after buffer with its parent is flushed
+/// Since records are not ordered, names and keys are not coded by
+/// dictionary
+class ParallelSaver {
+ public:
+  ParallelSaver(io::Sink& sink, ThreadPool& pool)
+      : out_(sink),
+        group_(pool),
+        /// keep pool busy, but do not flood its queue with tiny subtrees
+        max_pending_(pool.Size() * 4) {
+    SerializeHeader(out_);
+  }
 
-template <>
-void Deserialize(Value::String& value, std::istream& in) {
-  Deserialize(value.Ref(), in);
-}
+  void Run(const VolumeNode::Ptr& root) {
+    Save(root, 0);
+    group_.Wait();
+    SerializeIndex(index_, {}, out_);
+    out_.Flush();
+  }
 
-template <>
-void Deserialize(Value::Blob& value, std::istream& in) {
-  uint64_t size = 0;
-  Check(in.read(reinterpret_cast<char*>(&size), sizeof(size)));
+ private:
+  static constexpr uint64_t kFlushSize = 4 << 20;
 
-  const auto native_size = ConvertSize(size);
-  value.Ref().resize(static_cast<size_t>(native_size));
-  Check(in.read(reinterpret_cast<char*>(&value.Ref()[0]), native_size));
-}
+  struct Chunk {
+    io::MemoryWriter out;
+    /// ids and local locations of records in buffer
+    std::vector<std::pair<uint64_t, IndexEntry>> records;
+  };
 
-template <>
-
-void Deserialize(std::optional<Value>& value, std::istream& in) {
-  FormatMarker marker;
-  Deserialize(marker, in);
-  switch (marker) {
-    case FormatMarker::Bool: {
-      bool data = {};
-      Deserialize(data, in);
-      value.emplace(data);
-      break;
-    }
-    case FormatMarker::Char: {
-      char data = {};
-      Deserialize(data, in);
-      value.emplace(data);
-      break;
-    }
-    case FormatMarker::UChar: {
-      unsigned char data = {};
-      Deserialize(data, in);
-      value.emplace(data);
-      break;
-    }
-    case FormatMarker::UInt16: {
-      uint16_t data = {};
-      Deserialize(data, in);
-      value.emplace(data);
-      break;
-    }
-    case FormatMarker::Int16: {
-      int16_t data = {};
-      Deserialize(data, in);
-      value.emplace(data);
-      break;
-    }
-    case FormatMarker::UInt32: {
-      uint32_t data = {};
-      Deserialize(data, in);
-      value.emplace(data);
-      break;
-    }
-    case FormatMarker::Int32: {
-      int32_t data = {};
-      Deserialize(data, in);
-      value.emplace(data);
-      break;
+  /// Saves subtree depth-first, offloading subtrees into pool while it has
+  /// free capacity
+  void Save(VolumeNode::Ptr root, uint64_t root_id) {
+    Chunk chunk;
+    LiteralEncoder strings;
+    std::vector<std::pair<VolumeNode::Ptr, uint64_t>> stack;
+    std::vector<std::pair<VolumeNode::Ptr, uint64_t>> offloaded;
+    stack.emplace_back(std::move(root), root_id);
+    while (!stack.empty()) {
+      auto [node, id] = std::move(stack.back());
+      stack.pop_back();
+
+      uint64_t first_child = 0;
+      const auto offset = chunk.out.Offset();
+      auto children = SerializeRecord(
+          node->Enumerate(), node->Open()->Enumerate(), id,
+          [this, &first_child](uint64_t count) {
+            first_child = next_id_.fetch_add(count);
+            return first_child;
+          },
+          strings, chunk.out);
+      chunk.records.emplace_back(
+          id, IndexEntry{offset, chunk.out.Offset() - offset});
+
+      for (auto& child : children) {
+        if (group_.Pending() < max_pending_) {
+          offloaded.emplace_back(std::move(child), first_child++);
+        } else {
+          stack.emplace_back(std::move(child), first_child++);
+        }
+      }
+
+      if (!offloaded.empty() || chunk.out.Offset() >= kFlushSize) {
+        Flush(chunk);
+      }
+
+      for (auto&& [child, child_id] : std::move(offloaded)) {
+        group_.Submit([this, child = std::move(child), child_id]() mutable {
+          Save(std::move(child), child_id);
+        });
+      }
+
+      offloaded.clear();
     }
-    case FormatMarker::UInt64: {
-      uint64_t data = {};
-      Deserialize(data, in);
-      value.emplace(data);
-      break;
-    }
-    case FormatMarker::Int64: {
-      int64_t data = {};
-      Deserialize(data, in);
-      value.emplace(data);
-      break;
-    }
-    case FormatMarker::Float: {
-      float data = {};
-      Deserialize(data, in);
-      value.emplace(data);
-      break;
-    }
-    case FormatMarker::Double: {
-      double data = {};
-      Deserialize(data, in);
-      value.emplace(data);
-      break;
-    }
-    case FormatMarker::String: {
-      Value::String data;
-      Deserialize(data, in);
-      value.emplace(std::move(data));
-      break;
+
+    Flush(chunk);
+  }
+
+  void Flush(Chunk& chunk) {
+    const auto data = chunk.out.Data();
+    if (data.size == 0) {
+      return;
     }
-    case FormatMarker::Blob: {
-      Value::Blob data;
-      Deserialize(data, in);
-      value.emplace(std::move(data));
-      break;
+
+    std::lock_guard lock(mutex_);
+    const auto base = out_.Offset();
+    out_.Write(data.data, data.size);
+    for (auto& [id, entry] : chunk.records) {
+      if (id >= index_.size()) {
+        index_.resize(id + 1);
+      }
+
+      index_[id] = {base + entry.offset, entry.size};
     }
-  };
-}
 
-template <typename T>
-void CheckSum(const T& value, uint8_t& checksum) {
-  static_assert(std::is_trivial_v<T>);
-  for (size_t i = 0; i < sizeof(value); ++i) {
-    checksum ^= *(reinterpret_cast<const uint8_t*>(&value) + i);
+    chunk.out.Clear();
+    chunk.records.clear();
   }
-}
 
-template <typename T>
-void CheckSum(const Referenced<T>& value, uint8_t& checksum) {
-  for (const auto c : value.Ref()) {
-    checksum ^= c;
+ private:
+  std::mutex mutex_;
+  BufferedWriter out_;
+  std::vector<IndexEntry> index_;
+  std::atomic<uint64_t> next_id_ = 1;
+  TaskGroup group_;
+  const size_t max_pending_;
+};
+
+/// Loads records in BFS order
+class LegacyVolumeLoader {
+ public:
+  explicit LegacyVolumeLoader(BufferedReader& in)
+      : in_(in) {
   }
-}
 
-template <>
-void CheckSum(const std::string& value, uint8_t& checksum) {
-  for (const auto c : value) {
-    checksum ^= c;
+  void OnNode(VolumeNode& node, auto& descendants) {
+    auto data = node.Open();
+    DeserializeNode<size_t>(
+        in_, 0,
+        [&node, &descendants](std::string&& name) {
+          descendants.push_back(node.Create(name));
+        },
+        [&data](std::string&& key, Value&& value) {
+          data->Write(key, std::move(value));
+        });
   }
-}
 
-template <>
-void CheckSum(const Value& value, uint8_t& checksum) {
-  value.Accept([&checksum](const auto& data) {
-    CheckSum(data, checksum);
-  });
+ private:
+  BufferedReader& in_;
+};
+
+/// Loads records in any order as long as parents precede children
+/// Index is not needed for sequential load and is skipped
+void LoadIndexed(const VolumeNode::Ptr& root, BufferedReader& in) {
+  DictionaryDecoder dictionary;
+  std::unordered_map<uint64_t, VolumeNode::Ptr> pending{{0, root}};
+  while (!pending.empty()) {
+    CrcReader crc_in(in);
+    RecordHeader header;
+    DeserializeCompactRecordHeader(header, crc_in);
+
+    auto it = pending.find(header.id);
+    if (it == pending.end()) {
+      throw std::runtime_error("Data corrupted");
+    }
+
+    auto node = std::move(it->second);
+    pending.erase(it);
+
+    auto data = node->Open();
+    auto child_id = header.first_child;
+    auto on_child = [&node, &pending, &child_id](std::string&& name) {
+      pending.emplace(child_id++, node->Create(name));
+    };
+    auto on_value = [&data](std::string&& key, Value&& value) {
+      data->Write(key, std::move(value));
+    };
+
+    DeserializeCompactNodeBody(
+        crc_in,
+        [&dictionary](std::string& value, auto& string_in) {
+          dictionary.Deserialize(value, string_in);
+        },
+        on_child, on_value);
+    CheckCrc(crc_in, in);
+  }
 }
 
-class VolumeSaver {
+/// Decodes subtrees of snapshot concurrently into detached nodes built
+/// without locking, and publishes them into root when all are decoded
+class ParallelLoader {
  public:
-  explicit VolumeSaver(std::ostream& stream)
-      : stream_(stream) {
-    SerializeHeader(stream_);
+  ParallelLoader(const VolumeSnapshot& snapshot, ThreadPool& pool)
+      : snapshot_(snapshot),
+        group_(pool),
+        /// keep pool busy, but do not flood its queue with tiny subtrees
+        max_pending_(pool.Size() * 4) {
   }
 
- public:
-  void OnNode(const VolumeNode& node, auto& descendants) {
-    auto children = node.Enumerate();
-    uint8_t checksum = 0;
-    Serialize(children.size(), stream_);
-    for (auto&& child : std::move(children)) {
-      const auto& name = child->GetName();
-      Serialize(name, stream_);
-      CheckSum(name, checksum);
-      descendants.push_back(std::move(child));
+  void Run(const VolumeNode::Ptr& root) {
+    auto* target = dynamic_cast<VolumeNodeImpl*>(root.get());
+    auto tracker = target ? target->Tracker() : nullptr;
+    auto data = root->Open();
+    std::vector<std::shared_ptr<VolumeNodeImpl>> subtrees;
+    snapshot_.Decode(
+        VolumeSnapshot::kRootRecord,
+        [this, &tracker, &subtrees](std::string&& name, uint64_t record) {
+          auto subtree = std::make_shared<VolumeNodeImpl>(name, tracker);
+          group_.Submit([this, subtree, record]() {
+            Build(subtree, record);
+          });
+          subtrees.push_back(std::move(subtree));
+        },
+        [&data](std::string&& key, Value&& value) {
+          data->Write(key, std::move(value));
+        });
+
+    group_.Wait();
+    /// adopted subtrees bypass journal, so journaled volume gets them
+    /// through journaled operations
+    const bool adopt = target && !tracker->HasJournal();
+    for (auto&& subtree : std::move(subtrees)) {
+      if (!adopt || !target->Adopt(subtree)) {
+        Merge(subtree, root->Create(subtree->GetName()));
+      }
     }
+  }
 
-    const auto data = node.Open();
-    const auto kv_list = data->Enumerate();
-    Serialize(kv_list.size(), stream_);
-    for (const auto& [key, value] : kv_list) {
-      Serialize(key, stream_);
-      Serialize(value, stream_);
+ private:
+  /// Decodes subtree depth-first, offloading subtrees into pool while it has
+  /// free capacity
+  void Build(std::shared_ptr<VolumeNodeImpl> root, uint64_t root_record) {
+    std::vector<std::pair<std::shared_ptr<VolumeNodeImpl>, uint64_t>> stack;
+    stack.emplace_back(std::move(root), root_record);
+    while (!stack.empty()) {
+      auto [node, record] = std::move(stack.back());
+      stack.pop_back();
+
+      snapshot_.Decode(
+          record,
+          [this, &node, &stack](std::string&& name, uint64_t child_record) {
+            auto child = node->AddChild(name);
+            if (group_.Pending() < max_pending_) {
+              group_.Submit([this, child = std::move(child), child_record]() {
+                Build(child, child_record);
+              });
+            } else {
+              stack.emplace_back(std::move(child), child_record);
+            }
+          },
+          [&node](std::string&& key, Value&& value) {
+            node->Data().Insert(std::move(key), std::move(value));
+          });
+      node->Data().FillScalars();
+    }
+  }
 
-      CheckSum(key, checksum);
-      CheckSum(value, checksum);
+  /// Copies subtree into existing node through its interface
+  static void Merge(const VolumeNode::Ptr& from, const VolumeNode::Ptr& to) {
+    auto data = to->Open();
+    for (auto&& [key, value] : from->Open()->Enumerate()) {
+      data->Write(key, std::move(value));
     }
 
-    Serialize(checksum, stream_);
+    for (const auto& child : from->Enumerate()) {
+      Merge(child, to->Create(child->GetName()));
+    }
   }
 
  private:
-  std::ostream& stream_;
+  const VolumeSnapshot& snapshot_;
+  TaskGroup group_;
+  const size_t max_pending_;
 };
 
-class VolumeLoader {
- public:
-  explicit VolumeLoader(std::istream& stream)
-      : stream_(stream) {
-    std::string magic;
-    uint8_t version = 0;
-    DeserializeHeader(magic, version, stream_);
-    if (magic != kMagic) {
-      throw std::runtime_error("Bad file format, magic mismatch: " + magic);
+/// Tracked root of volume
+/// @throw std::runtime_error if volume does not track changes
+VolumeNodeImpl& Tracked(const VolumeNode::Ptr& root) {
+  if (!root) {
+    throw std::runtime_error("Root is nullptr");
+  }
+
+  auto* tracked = dynamic_cast<VolumeNodeImpl*>(root.get());
+  if (!tracked) {
+    throw std::runtime_error("Volume does not track changes");
+  }
+
+  return *tracked;
+}
+
+/// Saves records of changed nodes depth-first, so record of parent precedes
+/// records of its children
+uint64_t SaveDelta(VolumeNodeImpl& root, io::Sink& sink, uint64_t since) {
+  const auto generation = root.Tracker()->Advance();
+  BufferedWriter out(sink);
+  SerializeHeader(out, kDeltaMagic, kDeltaFormatVersion);
+
+  DeltaRecord record;
+  std::vector<std::pair<VolumeNodeImpl*, size_t>> stack{{&root, 0}};
+  std::vector<std::shared_ptr<VolumeNodeImpl>> children;
+  /// keeps visited nodes alive while they are on stack
+  std::vector<std::shared_ptr<VolumeNodeImpl>> visited;
+  while (!stack.empty()) {
+    auto [node, depth] = stack.back();
+    stack.pop_back();
+
+    record.path.resize(depth);
+    if (depth > 0) {
+      record.path.back() = node->GetName();
+    }
+
+    record.unlinked.clear();
+    record.removed.clear();
+    record.written.clear();
+    children.clear();
+    if (node->ChangesSince(since, record.unlinked, record.removed,
+                           record.written, children)) {
+      SerializeDeltaRecord(record, out);
     }
 
-    if (version > kFormatVersion) {
-      throw std::runtime_error("File version is too new. Update program!");
+    for (auto& child : children) {
+      stack.emplace_back(child.get(), depth + 1);
+      visited.push_back(std::move(child));
     }
   }
 
-  void OnNode(VolumeNode& node, auto& descendants) {
-    uint8_t checksum = 0;
-    size_t children_count = 0;
-    Deserialize(children_count, stream_);
-    for (size_t i = 0; i < children_count; ++i) {
-      VolumeNode::Name name;
-      Deserialize(name, stream_);
-      CheckSum(name, checksum);
-      auto child = node.Create(name);
-      descendants.push_back(std::move(child));
+  SerializeDeltaEnd(out);
+  out.Flush();
+  return generation;
+}
+
+void ApplyDelta(const VolumeNode::Ptr& root, BufferedReader& in) {
+  DeltaRecord record;
+  while (DeserializeDeltaRecord(record, in)) {
+    auto node = root;
+    for (const auto& name : record.path) {
+      node = node->Create(name);
     }
 
-    auto data = node.Open();
-    size_t kv_size = 0;
-    Deserialize(kv_size, stream_);
-    for (size_t i = 0; i < kv_size; ++i) {
-      NodeData::Key key;
-      std::optional<Value> value;
-      Deserialize(key, stream_);
-      Deserialize(value, stream_);
-      CheckSum(key, checksum);
-      CheckSum(*value, checksum);
-      data->Write(key, std::move(*value));
+    for (const auto& name : record.unlinked) {
+      node->Unlink(name);
     }
 
-    uint8_t stream_checksum = 0;
-    Deserialize(stream_checksum, stream_);
-    if (checksum != stream_checksum) {
-      throw std::runtime_error("Data corrupted");
+    auto data = node->Open();
+    for (const auto& key : record.removed) {
+      data->Remove(key);
     }
-  }
 
- private:
-  std::istream& stream_;
-};
+    for (auto&& [key, value] : record.written) {
+      data->Write(key, std::move(value));
+    }
+  }
+}
 
 template <typename Visitor>
 void Traverse(const VolumeNode::Ptr& root, Visitor&& visitor) {
@@ -365,42 +461,222 @@ void Traverse(const VolumeNode::Ptr& root, Visitor&& visitor) {
   }
 }
 
+void Save(const VolumeNode::Ptr& root, io::Sink& sink) {
+  if (!root) {
+    throw std::runtime_error("Unable to save: root is nullptr");
+  }
+
+  VolumeSaver saver(sink);
+  Traverse(root, saver);
+  saver.Finish();
+}
+
+void Save(const VolumeNode::Ptr& root, io::Sink& sink, ThreadPool& pool) {
+  if (!root) {
+    throw std::runtime_error("Unable to save: root is nullptr");
+  }
+
+  ParallelSaver(sink, pool).Run(root);
+}
+
+void Load(const VolumeNode::Ptr& root, io::Source& source) {
+  if (!root) {
+    throw std::runtime_error("Unable to load: root is nullptr");
+  }
+
+  BufferedReader in(source);
+  const auto magic = DeserializeMagic(in);
+  if (magic == kCompressedMagic) {
+    io::DecompressingSource<BufferedReader> decompressed(in);
+    Load(root, decompressed);
+    return;
+  }
+
+  if (magic == kDeltaMagic) {
+    DeserializeVersion(in, kDeltaFormatVersion, kDeltaFormatVersion);
+    ApplyDelta(root, in);
+    return;
+  }
+
+  if (magic != kMagic) {
+    throw std::runtime_error("Bad file format, magic mismatch: " + magic);
+  }
+
+  if (DeserializeVolumeVersion(in) == kFormatVersion) {
+    LoadIndexed(root, in);
+  } else {
+    Traverse(root, LegacyVolumeLoader(in));
+  }
+}
+
 }  // namespace
 
 void jbkv::Save(const VolumeNode::Ptr& root,
                 const std::filesystem::path& path) {
-  std::ofstream stream(path, std::ios_base::binary);
-  if (!stream.is_open()) {
-    throw std::runtime_error("Cannot open file for writing: " + path.string());
-  }
-
-  Save(root, stream);
+  Save(root, path, FileOptions{});
 }
 
 void jbkv::Load(const VolumeNode::Ptr& root,
                 const std::filesystem::path& path) {
-  std::ifstream stream(path, std::ios_base::binary);
-  if (!stream.is_open()) {
-    throw std::runtime_error("Cannot open file for reading: " + path.string());
-  }
+  Load(root, path, FileOptions{});
+}
 
-  Load(root, stream);
+void jbkv::Save(const VolumeNode::Ptr& root, const std::filesystem::path& path,
+                const FileOptions& options) {
+  io::AsyncFileOptions file_options;
+  file_options.direct = options.direct;
+  io::AsyncFileSink sink(path, file_options);
+  ::Save(root, sink);
+  sink.Commit();
+}
+
+void jbkv::Load(const VolumeNode::Ptr& root, const std::filesystem::path& path,
+                const FileOptions& options) {
+  io::AsyncFileOptions file_options;
+  file_options.direct = options.direct;
+  io::AsyncFileSource source(path, file_options);
+  ::Load(root, source);
 }
 
 void jbkv::Save(const VolumeNode::Ptr& root, std::ostream& stream) {
+  io::StreamSink sink(stream);
+  ::Save(root, sink);
+}
+
+void jbkv::Save(const VolumeNode::Ptr& root, const std::filesystem::path& path,
+                ThreadPool& pool) {
+  io::AsyncFileSink sink(path);
+  ::Save(root, sink, pool);
+  sink.Commit();
+}
+
+void jbkv::Save(const VolumeNode::Ptr& root, std::ostream& stream,
+                ThreadPool& pool) {
+  io::StreamSink sink(stream);
+  ::Save(root, sink, pool);
+}
+
+void jbkv::Save(const VolumeNode::Ptr& root, std::ostream& stream,
+                const Codec& codec) {
+  io::StreamSink sink(stream);
+  io::CompressingSink compressed(sink, codec);
+  ::Save(root, compressed);
+  compressed.Finish();
+}
+
+void jbkv::Save(const VolumeNode::Ptr& root, const std::filesystem::path& path,
+                const Codec& codec) {
+  io::AsyncFileSink sink(path);
+  io::CompressingSink compressed(sink, codec);
+  ::Save(root, compressed);
+  compressed.Finish();
+  sink.Commit();
+}
+
+void jbkv::Load(const VolumeNode::Ptr& root, std::istream& stream) {
+  io::StreamSource source(stream);
+  ::Load(root, source);
+}
+
+void jbkv::Load(const VolumeNode::Ptr& root, const std::filesystem::path& path,
+                ThreadPool& pool) {
   if (!root) {
-    throw std::runtime_error("Unable to save: root is nullptr");
+    throw std::runtime_error("Unable to load: root is nullptr");
   }
 
-  VolumeSaver saver(stream);
-  Traverse(root, saver);
+  const VolumeSnapshot snapshot(MappedFile::Open(path));
+  ParallelLoader(snapshot, pool).Run(root);
 }
 
-void jbkv::Load(const VolumeNode::Ptr& root, std::istream& stream) {
+std::future<void> jbkv::CheckpointAsync(const VolumeNode::Ptr& root,
+                                        const std::filesystem::path& path) {
+  auto tracker = Tracked(root).Tracker();
+  const auto epoch = tracker->BeginSnapshot();
+  try {
+    return std::async(std::launch::async, [root, path, tracker, epoch]() {
+      struct SnapshotGuard {
+        ~SnapshotGuard() {
+          tracker->EndSnapshot();
+        }
+
+        const ChangeTracker::Ptr& tracker;
+      } guard{tracker};
+
+      io::AsyncFileSink sink(path);
+      VolumeSaver saver(sink, epoch);
+      Traverse(root, saver);
+      saver.Finish();
+      sink.Commit();
+    });
+  } catch (...) {
+    tracker->EndSnapshot();
+    throw;
+  }
+}
+
+Task<> jbkv::AsyncSave(VolumeNode::Ptr root, std::filesystem::path path,
+                       Executor& executor) {
+  co_await Offload([&root, &path]() { Save(root, path); }, executor);
+}
+
+uint64_t jbkv::AdvanceGeneration(const VolumeNode::Ptr& root) {
+  return Tracked(root).Tracker()->Advance();
+}
+
+uint64_t jbkv::SaveDelta(const VolumeNode::Ptr& root,
+                         const std::filesystem::path& path,
+                         uint64_t since_generation) {
+  auto& tracked = Tracked(root);
+  io::AsyncFileSink sink(path);
+  const auto generation = ::SaveDelta(tracked, sink, since_generation);
+  sink.Commit();
+  return generation;
+}
+
+uint64_t jbkv::SaveDelta(const VolumeNode::Ptr& root, std::ostream& stream,
+                         uint64_t since_generation) {
+  auto& tracked = Tracked(root);
+  io::StreamSink sink(stream);
+  return ::SaveDelta(tracked, sink, since_generation);
+}
+
+void jbkv::LoadSubtree(const VolumeNode::Ptr& root,
+                       const std::filesystem::path& path,
+                       const VolumeNode::Path& node_path) {
   if (!root) {
     throw std::runtime_error("Unable to load: root is nullptr");
   }
 
-  VolumeLoader loader(stream);
-  Traverse(root, loader);
+  const VolumeSnapshot snapshot(MappedFile::Open(path));
+  auto record = VolumeSnapshot::kRootRecord;
+  for (const auto& name : node_path) {
+    std::optional<uint64_t> child_record;
+    snapshot.DecodeChildren(record, [&](std::string&& child, uint64_t id) {
+      if (child == name) {
+        child_record = id;
+      }
+    });
+
+    if (!child_record) {
+      throw std::runtime_error("Node is not found: " + name);
+    }
+
+    record = *child_record;
+  }
+
+  std::deque<std::pair<uint64_t, VolumeNode::Ptr>> nodes{{record, root}};
+  while (!nodes.empty()) {
+    auto [id, node] = std::move(nodes.front());
+    nodes.pop_front();
+
+    auto data = node->Open();
+    snapshot.Decode(
+        id,
+        [&node, &nodes](std::string&& name, uint64_t child_id) {
+          nodes.emplace_back(child_id, node->Create(name));
+        },
+        [&data](std::string&& key, Value&& value) {
+          data->Write(key, std::move(value));
+        });
+  }
 }
@@ -1,11 +1,21 @@
 #pragma once
 #include <filesystem>
+#include <future>
 #include <iostream>
+#include "async.h"
+#include "codec.h"
+#include "thread_pool.h"
 #include "volume_node.h"
 
 namespace jbkv {
 
 /// Serialization/deserialization
+/// Load accepts both full snapshots and deltas saved by SaveDelta, delta is
+/// applied on top of contents of root
+/// Functions saving to path write file next to it and rename it over path
+/// after its contents are synced to storage, so path holds either previous
+/// or new complete file. Files are written and read through several large
+/// buffers in flight, by io_uring on Linux where kernel provides it.
 /// @{
 void Save(const VolumeNode::Ptr& root, std::ostream& stream);
 void Load(const VolumeNode::Ptr& root, std::istream& stream);
@@ -14,4 +24,108 @@ void Save(const VolumeNode::Ptr& root, const std::filesystem::path& path);
 void Load(const VolumeNode::Ptr& root, const std::filesystem::path& path);
 /// @}
 
+/// Options of file overloads of Save and Load
+struct FileOptions {
+  /// bypasses page cache (O_DIRECT) where file system supports it, so that
+  /// snapshot does not evict cached data; ignored where it is not supported
+  bool direct = false;
+};
+
+/// Saves and loads file as overloads above do, with given options
+/// @{
+void Save(const VolumeNode::Ptr& root, const std::filesystem::path& path,
+          const FileOptions& options);
+void Load(const VolumeNode::Ptr& root, const std::filesystem::path& path,
+          const FileOptions& options);
+/// @}
+
+/// Compresses saved volume by blocks with codec, e.g. *LzCodec()
+/// Every Load function detects compressed files by their header; functions
+/// reading files through memory mapping decompress whole file into memory
+/// @{
+void Save(const VolumeNode::Ptr& root, std::ostream& stream,
+          const Codec& codec);
+void Save(const VolumeNode::Ptr& root, const std::filesystem::path& path,
+          const Codec& codec);
+/// @}
+
+/// Serializes subtrees concurrently on pool
+/// Records are written in order of completion, so file differs from one
+/// written by sequential Save, but loads to the same contents
+/// @{
+void Save(const VolumeNode::Ptr& root, std::ostream& stream, ThreadPool& pool);
+void Save(const VolumeNode::Ptr& root, const std::filesystem::path& path,
+          ThreadPool& pool);
+/// @}
+
+/// Decodes subtrees of saved volume concurrently on pool
+/// Subtrees are built detached without locking and are attached to root
+/// after all of them are decoded; children which already exist in root are
+/// merged into
+void Load(const VolumeNode::Ptr& root, const std::filesystem::path& path,
+          ThreadPool& pool);
+
+/// Incremental snapshots
+/// Volumes created by CreateVolume stamp every change of data and children
+/// with current generation of volume. Delta contains changes made after
+/// given generation and is applied to base snapshot by Load. Deltas are
+/// applied in the order they were saved.
+/// Typical use:
+/// @code
+/// auto generation = AdvanceGeneration(volume);
+/// Save(volume, "base.bin");
+/// ...
+/// generation = SaveDelta(volume, "delta1.bin", generation);
+/// @endcode
+/// @{
+
+/// Starts new generation of changes
+/// @return generation to pass to SaveDelta to save changes made after call
+/// @throw std::runtime_error if volume does not track changes
+uint64_t AdvanceGeneration(const VolumeNode::Ptr& root);
+
+/// Saves changes made after given generation
+/// Removals made before it are not tracked anymore
+/// @return generation to pass to next SaveDelta call
+/// @throw std::runtime_error if volume does not track changes
+uint64_t SaveDelta(const VolumeNode::Ptr& root,
+                   const std::filesystem::path& path,
+                   uint64_t since_generation);
+uint64_t SaveDelta(const VolumeNode::Ptr& root, std::ostream& stream,
+                   uint64_t since_generation);
+/// @}
+
+/// Saves point-in-time view of volume on background thread
+/// View is captured at the call: every node copies its entries and children
+/// before their first change made after the call, so writers proceed while
+/// volume is serialized, and locks are held only while state of single node
+/// is copied. File replaces path atomically as with Save.
+/// @return future which is ready when file is saved or holds exception
+/// @throw std::runtime_error if volume does not track changes or another
+/// checkpoint of volume is in progress
+/// @note as with any future returned by std::async, its destruction waits
+/// for checkpoint to complete
+std::future<void> CheckpointAsync(const VolumeNode::Ptr& root,
+                                  const std::filesystem::path& path);
+
+/// Saves volume to path as Save does, on threads dedicated to blocking
+/// calls, and resumes awaiting coroutine on executor when file is saved
+Task<> AsyncSave(VolumeNode::Ptr root, std::filesystem::path path,
+                 Executor& executor = DefaultExecutor());
+
+/// Loads subtree of saved volume into root
+/// Saved subtree is located through index of file, so only records on the
+/// path and records of subtree are read
+/// @param node_path names of nodes from saved root to subtree root
+/// @throw std::runtime_error if subtree is not found
+void LoadSubtree(const VolumeNode::Ptr& root, const std::filesystem::path& path,
+                 const VolumeNode::Path& node_path);
+
+/// Opens saved volume without loading it
+/// File is memory-mapped and every node decodes its children and data on
+/// first access, after which it behaves as regular in-memory node
+/// @return non-null volume ptr
+/// @note file must not be modified while volume nodes are not decoded
+VolumeNode::Ptr OpenVolume(const std::filesystem::path& path);
+
 }  // namespace jbkv
@@ -8,4 +8,13 @@ class VolumeNode : public Node<VolumeNode> {};
 /// Creates empty volume
 /// @return non-null volume ptr
 VolumeNode::Ptr CreateVolume();
+
+/// Creates immutable read-optimized copy of volume subtree
+/// Nodes and data are packed into sorted arrays and read without locks
+/// @return non-null volume ptr
+/// @note operations which would change frozen volume throw, while no-op ones
+/// (Update, Remove or Unlink of absent entry) return false. Frozen volume is
+/// read-only, so mounted as a lower layer of storage its entries are
+/// shadowed by writes to upper layers, and removal of them throws
+VolumeNode::Ptr Freeze(const VolumeNode::Ptr& root);
 }  // namespace jbkv
@@ -0,0 +1,984 @@
+#pragma once
+#include "async_mutex.h"
+#include "atomic_shared_ptr.h"
+#include "scalar_slots.h"
+#include "volume_node.h"
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/// In-memory volume implementation shared by volume engines
+/// @note not a part of public interface
+namespace jbkv {
+
+class NullVolumeNode final : public InvalidNode<VolumeNode> {
+ public:
+  static VolumeNode::Ptr Instance() {
+    return std::make_shared<NullVolumeNode>();
+  }
+};
+
+enum class ChangeKind : uint8_t {
+  Create = 0,
+  Unlink = 1,
+  Write = 2,
+  Update = 3,
+  Remove = 4
+};
+
+/// Change of tracked volume
+struct Change {
+  ChangeKind kind;
+  /// names of nodes from root to changed node
+  const std::vector<std::string>& path;
+  /// name of child or key
+  const std::string& name;
+  /// value of write or update
+  const Value* value = nullptr;
+};
+
+/// Receiver of changes of tracked volume, e.g. write-ahead log
+class ChangeJournal : NonCopyableNonMovable {
+ public:
+  using Ptr = std::shared_ptr<ChangeJournal>;
+
+ public:
+  virtual ~ChangeJournal() = default;
+
+  /// Records change
+  /// @note called under lock guarding changed state, so changes of the same
+  /// state are recorded in order they are made, while changes of different
+  /// nodes are appended concurrently
+  /// @return ticket of change to wait for
+  virtual uint64_t Append(const Change& change) = 0;
+
+  /// Waits until change is durable
+  /// @note called without node locks
+  virtual void Commit(uint64_t ticket) = 0;
+};
+
+/// Journaled change waiting for commit
+class JournalTicket {
+ public:
+  JournalTicket() = default;
+
+  JournalTicket(ChangeJournal::Ptr journal, uint64_t ticket)
+      : journal_(std::move(journal)),
+        ticket_(ticket) {
+  }
+
+  void Commit() const {
+    if (journal_) {
+      journal_->Commit(ticket_);
+    }
+  }
+
+  /// @return true if there is no change to wait for
+  bool Empty() const {
+    return !journal_;
+  }
+
+ private:
+  ChangeJournal::Ptr journal_;
+  uint64_t ticket_ = 0;
+};
+
+/// State shared by all nodes of tracked volume
+struct VolumeState {
+  std::atomic<uint64_t> clock = 1;
+  /// set while journal is attached, keeps unjournaled writes free of
+  /// shared pointer loads
+  std::atomic<bool> journaled = false;
+  AtomicSharedPtr<ChangeJournal> journal;
+  /// orders unlinks of subtrees with appends of their changes: appends take
+  /// it shared, so writers of different nodes do not wait for each other,
+  /// and only marking unlinked subtree takes it exclusively
+  AsyncSharedMutex journal_mutex;
+  /// epoch of point-in-time snapshot in progress, zero if there is none
+  std::atomic<uint64_t> snapshot = 0;
+};
+
+/// Generations of changes of volume node and its subtree
+/// Generation is a volume-wide counter advanced by snapshots; every change
+/// is stamped with current generation, and stamp is propagated to ancestors,
+/// so unchanged subtrees are skipped without visiting them
+class ChangeTracker : NonCopyableNonMovable {
+ public:
+  using Ptr = std::shared_ptr<ChangeTracker>;
+
+ public:
+  /// Tracker of volume root
+  ChangeTracker()
+      : state_(std::make_shared<VolumeState>()),
+        created_(Stamp()) {
+  }
+
+  ChangeTracker(Ptr parent, const VolumeNode::Name& name)
+      : parent_(std::move(parent)),
+        name_(name),
+        state_(parent_->state_),
+        created_(Stamp()) {
+  }
+
+  /// Stamps change of node
+  /// @return generation of change
+  /// @note must be called under lock protecting changed state, so snapshot
+  /// advancing generation either sees change or gets it with new generation
+  uint64_t Stamp() {
+    auto& clock = state_->clock;
+    for (;;) {
+      const auto generation = clock.load();
+      for (auto* tracker = this; tracker; tracker = tracker->parent_.get()) {
+        auto current = tracker->subtree_.load();
+        while (current < generation &&
+               !tracker->subtree_.compare_exchange_weak(current, generation)) {
+        }
+      }
+
+      if (clock.load() == generation) {
+        return generation;
+      }
+    }
+  }
+
+  /// Passes change to journal attached to volume
+  /// Changes of unlinked subtrees are not journaled, they are not reachable
+  /// from root
+  /// @note must be called under lock protecting changed state
+  JournalTicket Journal(ChangeKind kind, const std::string& name,
+                        const Value* value = nullptr) const {
+    if (!state_->journaled.load(std::memory_order_relaxed)) {
+      return {};
+    }
+
+    auto journal = state_->journal.Load();
+    if (!journal) {
+      return {};
+    }
+
+    std::vector<std::string> path;
+    for (auto* tracker = this; tracker->parent_;
+         tracker = tracker->parent_.get()) {
+      path.push_back(tracker->name_);
+    }
+
+    std::reverse(path.begin(), path.end());
+
+    /// unlink of ancestor is appended after this change or sees it skipped;
+    /// changes of the same node are ordered by its lock, so journal assigns
+    /// their tickets in order
+    std::shared_lock lock(state_->journal_mutex);
+    for (auto* tracker = this; tracker->parent_;
+         tracker = tracker->parent_.get()) {
+      if (tracker->detached_) {
+        return {};
+      }
+    }
+
+    const auto ticket = journal->Append({kind, path, name, value});
+    return {std::move(journal), ticket};
+  }
+
+  bool HasJournal() const {
+    return state_->journaled.load();
+  }
+
+  /// Attaches journal to volume, nullptr detaches it
+  void SetJournal(ChangeJournal::Ptr journal) {
+    state_->journaled = journal != nullptr;
+    state_->journal.Store(std::move(journal));
+  }
+
+  /// Marks node as unlinked from its parent
+  /// @note must be called before unlink is journaled
+  void Detach() {
+    std::lock_guard lock(state_->journal_mutex);
+    detached_ = true;
+  }
+
+  /// Starts new generation
+  /// @return last generation of changes made before the call
+  uint64_t Advance() {
+    return state_->clock.fetch_add(1);
+  }
+
+  /// Starts point-in-time snapshot of volume: from now on nodes preserve
+  /// their state before its first change
+  /// @return epoch of snapshot
+  /// @throw std::runtime_error if another snapshot is in progress
+  uint64_t BeginSnapshot() {
+    const auto epoch = Advance();
+    uint64_t none = 0;
+    if (!state_->snapshot.compare_exchange_strong(none, epoch)) {
+      throw std::runtime_error("Another checkpoint is in progress");
+    }
+
+    return epoch;
+  }
+
+  void EndSnapshot() {
+    state_->snapshot = 0;
+  }
+
+  /// @return epoch of snapshot in progress, zero if there is none
+  uint64_t Snapshot() const {
+    return state_->snapshot.load();
+  }
+
+  /// @return generation of node creation
+  uint64_t Created() const {
+    return created_;
+  }
+
+  /// @return latest generation of changes in subtree
+  uint64_t Subtree() const {
+    return subtree_.load();
+  }
+
+ private:
+  /// parent tracker is kept alive by unlinked subtrees, stamping it is
+  /// harmless
+  const Ptr parent_;
+  const VolumeNode::Name name_;
+  const std::shared_ptr<VolumeState> state_;
+  std::atomic<uint64_t> subtree_ = 0;
+  /// written under exclusive journal mutex of volume, read under shared one
+  bool detached_ = false;
+  const uint64_t created_;
+};
+
+/// Entries of node preserved for point-in-time snapshot in progress
+/// Entry is copied before its first change made after snapshot began and
+/// before snapshot reached node, preserved entries replace changed ones when
+/// snapshot reaches node
+/// @note all calls must be made under exclusive lock protecting entries
+template <typename Key, typename T>
+class SnapshotSlot {
+ public:
+  using Entries = std::unordered_map<Key, T>;
+
+ public:
+  /// @param epoch epoch of snapshot in progress, zero if there is none
+  void BeforeChange(uint64_t epoch, const Entries& entries, const Key& key) {
+    if (epoch != epoch_) {
+      epoch_ = epoch;
+      taken_ = false;
+      preserved_ = {};
+      index_.reset();
+    }
+
+    if (epoch == 0 || taken_) {
+      return;
+    }
+
+    if (!IsPreserved(key)) {
+      const auto it = entries.find(key);
+      preserved_.emplace_back(key, it != entries.end()
+                                       ? std::optional<T>(it->second)
+                                       : std::nullopt);
+      if (index_) {
+        index_->insert(key);
+      } else if (preserved_.size() > kMaxScan) {
+        index_ = std::make_unique<std::unordered_set<Key>>();
+        for (const auto& [preserved, _] : preserved_) {
+          index_->insert(preserved);
+        }
+      }
+    }
+  }
+
+  /// Visits entries as they were at the beginning of snapshot, later
+  /// changes are not preserved
+  template <typename Visitor>
+  void Take(uint64_t epoch, const Entries& entries, Visitor&& visitor) {
+    Preserved preserved;
+    if (epoch == epoch_) {
+      preserved.swap(preserved_);
+    }
+
+    preserved_ = {};
+    index_.reset();
+    epoch_ = epoch;
+    taken_ = true;
+    if (preserved.empty()) {
+      for (const auto& [key, value] : entries) {
+        visitor(key, value);
+      }
+
+      return;
+    }
+
+    std::unordered_set<Key> changed;
+    for (const auto& [key, value] : preserved) {
+      changed.insert(key);
+      if (value) {
+        visitor(key, *value);
+      }
+    }
+
+    for (const auto& [key, value] : entries) {
+      if (!changed.contains(key)) {
+        visitor(key, value);
+      }
+    }
+  }
+
+ private:
+  /// original entries of changed keys, nullopt if key did not exist
+  using Preserved = std::vector<std::pair<Key, std::optional<T>>>;
+
+  /// few changed keys are found by scan, more of them are indexed
+  static constexpr size_t kMaxScan = 8;
+
+ private:
+  bool IsPreserved(const Key& key) const {
+    if (index_) {
+      return index_->contains(key);
+    }
+
+    return std::any_of(preserved_.begin(), preserved_.end(),
+                       [&key](const auto& entry) { return entry.first == key; });
+  }
+
+ private:
+  uint64_t epoch_ = 0;
+  /// snapshot with epoch_ has already visited entries
+  bool taken_ = false;
+  Preserved preserved_;
+  std::unique_ptr<std::unordered_set<Key>> index_;
+};
+
+class VolumeNodeData;
+
+/// Node data taking part in transactions, see Transaction
+/// Entries are held by node data of volumes, so commit locks them and
+/// validates their versions
+class TransactionalData {
+ public:
+  /// versions of node data when transaction read them first
+  using Versions = std::map<VolumeNodeData*, uint64_t>;
+  using Tickets = std::vector<JournalTicket>;
+
+ public:
+  virtual ~TransactionalData() = default;
+
+  /// Reads value, recording versions of node data which decide it
+  virtual std::optional<Value> ReadVersioned(const NodeData::Key& key,
+                                             Versions& versions) = 0;
+
+  /// Adds node data which ApplyLocked may change
+  virtual void CollectWritten(std::vector<VolumeNodeData*>& written) = 0;
+
+  /// Throws if ApplyLocked would reject change, so commit fails before it
+  /// applies anything
+  /// @note called while node data collected by CollectWritten are locked
+  virtual void CheckLocked(const NodeData::Key&,
+                           const std::optional<Value>&) const {
+  }
+
+  /// Writes value as Write does, or removes key as Remove does if value is
+  /// nullopt
+  /// @note called while node data collected by CollectWritten are locked
+  virtual void ApplyLocked(const NodeData::Key& key,
+                           std::optional<Value>&& value, Tickets& tickets) = 0;
+
+  /// Updates value as Update does
+  /// @note called while node data collected by CollectWritten are locked
+  virtual bool UpdateLocked(const NodeData::Key& key, Value&& value,
+                            Tickets& tickets) = 0;
+};
+
+/// @return data as TransactionalData
+/// @throw std::runtime_error if data does not support transactions
+TransactionalData& AsTransactional(NodeData& data);
+
+class VolumeNodeData final : public NodeData, public TransactionalData {
+ public:
+  /// @param tracker tracker of owning node, nullptr disables tracking
+  explicit VolumeNodeData(ChangeTracker::Ptr tracker = nullptr)
+      : tracker_(std::move(tracker)) {
+  }
+
+  std::optional<Value> Read(const Key& key) const override {
+    std::shared_lock lock(mutex_);
+    const auto it = data_.find(key);
+    if (it == data_.end()) {
+      return std::nullopt;
+    }
+
+    return it->second.value;
+  }
+
+  bool ReadScalar(const Key& key, Value::Data& value) const override {
+    return scalars_.Read(key, value);
+  }
+
+  void Write(const Key& key, Value&& value) override {
+    JournalTicket ticket;
+    {
+      std::lock_guard lock(mutex_);
+      ticket = WriteLocked(key, std::move(value));
+    }
+
+    ticket.Commit();
+  }
+
+  Task<std::optional<Value>> AsyncRead(Key key,
+                                       Executor& executor) const override {
+    const auto lock = co_await mutex_.LockSharedAsync(executor);
+    const auto it = data_.find(key);
+    if (it == data_.end()) {
+      co_return std::nullopt;
+    }
+
+    co_return it->second.value;
+  }
+
+  Task<> AsyncWrite(Key key, Value value, Executor& executor) override {
+    JournalTicket ticket;
+    {
+      const auto lock = co_await mutex_.LockAsync(executor);
+      ticket = WriteLocked(key, std::move(value));
+    }
+
+    /// waiting for durability may block on file sync
+    if (!ticket.Empty()) {
+      co_await Offload([&ticket]() { ticket.Commit(); }, executor);
+    }
+  }
+
+  bool Update(const Key& key, Value&& value) override {
+    JournalTicket ticket;
+    {
+      std::lock_guard lock(mutex_);
+      if (!UpdateLocked(key, std::move(value), ticket)) {
+        return false;
+      }
+    }
+
+    ticket.Commit();
+    return true;
+  }
+
+  Task<bool> AsyncUpdate(Key key, Value value, Executor& executor) override {
+    JournalTicket ticket;
+    {
+      const auto lock = co_await mutex_.LockAsync(executor);
+      if (!UpdateLocked(key, std::move(value), ticket)) {
+        co_return false;
+      }
+    }
+
+    if (!ticket.Empty()) {
+      co_await Offload([&ticket]() { ticket.Commit(); }, executor);
+    }
+
+    co_return true;
+  }
+
+  bool Remove(const Key& key) override {
+    JournalTicket ticket;
+    {
+      std::lock_guard lock(mutex_);
+      if (!RemoveLocked(key, ticket)) {
+        return false;
+      }
+    }
+
+    ticket.Commit();
+    return true;
+  }
+
+  KeyValueList Enumerate() const override {
+    std::shared_lock lock(mutex_);
+    KeyValueList result;
+    result.reserve(data_.size());
+    for (const auto& [key, entry] : data_) {
+      result.push_back({key, entry.value});
+    }
+
+    return result;
+  }
+
+  /// @return contents at the beginning of snapshot in progress
+  KeyValueList Snapshot(uint64_t epoch) {
+    std::lock_guard lock(mutex_);
+    KeyValueList result;
+    result.reserve(data_.size());
+    snapshot_.Take(epoch, data_, [&result](const Key& key, const Entry& entry) {
+      result.push_back({key, entry.value});
+    });
+
+    return result;
+  }
+
+  /// @return estimated memory taken by entries and their scalar slots
+  size_t Footprint() const {
+    std::shared_lock lock(mutex_);
+    size_t result = data_.size() * kEntryFootprint + scalars_.Footprint();
+    for (const auto& [key, entry] : data_) {
+      result += key.size();
+      entry.value.Accept([&result](const auto& data) {
+        if constexpr (requires { data.Ref().size(); }) {
+          result += data.Ref().size();
+        }
+      });
+    }
+
+    return result;
+  }
+
+  /// Bulk construction without synchronization
+  /// Scalar values of inserted entries are readable without locks only
+  /// after FillScalars, which sizes table of slots once for all of them
+  /// @note allowed only until node is published to other threads
+  /// @{
+  void Reserve(size_t entries) {
+    data_.reserve(entries);
+  }
+
+  void Insert(Key&& key, Value&& value) {
+    const auto generation = tracker_ ? tracker_->Created() : 0;
+    data_.insert_or_assign(std::move(key), Entry{std::move(value), generation});
+    generation_ = std::max(generation_, generation);
+  }
+
+  /// Table of entries is sized once if node has no entries yet
+  void Insert(KeyValueList&& entries) {
+    if (data_.empty() && entries.size() > data_.bucket_count()) {
+      data_.reserve(entries.size());
+    }
+
+    for (auto& [key, value] : entries) {
+      Insert(std::move(key), std::move(value));
+    }
+  }
+
+  void FillScalars() {
+    size_t scalars = 0;
+    for (const auto& [key, entry] : data_) {
+      entry.value.Accept([&scalars](const auto& data) {
+        if constexpr (std::is_arithmetic_v<std::decay_t<decltype(data)>>) {
+          ++scalars;
+        }
+      });
+    }
+
+    scalars_.Reserve(scalars);
+    for (const auto& [key, entry] : data_) {
+      scalars_.Store(key, &entry.value);
+    }
+  }
+  /// @}
+
+  /// Transactions
+  /// @{
+  std::optional<Value> ReadVersioned(const Key& key,
+                                     Versions& versions) override {
+    std::shared_lock lock(mutex_);
+    versions.try_emplace(this, version_);
+    const auto it = data_.find(key);
+    if (it == data_.end()) {
+      return std::nullopt;
+    }
+
+    return it->second.value;
+  }
+
+  void CollectWritten(std::vector<VolumeNodeData*>& written) override {
+    written.push_back(this);
+  }
+
+  void ApplyLocked(const Key& key, std::optional<Value>&& value,
+                   Tickets& tickets) override {
+    JournalTicket ticket;
+    if (value) {
+      ticket = WriteLocked(key, std::move(*value));
+    } else {
+      RemoveLocked(key, ticket);
+    }
+
+    if (!ticket.Empty()) {
+      tickets.push_back(std::move(ticket));
+    }
+  }
+
+  bool UpdateLocked(const Key& key, Value&& value, Tickets& tickets) override {
+    JournalTicket ticket;
+    if (!UpdateLocked(key, std::move(value), ticket)) {
+      return false;
+    }
+
+    if (!ticket.Empty()) {
+      tickets.push_back(std::move(ticket));
+    }
+
+    return true;
+  }
+
+  AsyncSharedMutex& Mutex() {
+    return mutex_;
+  }
+
+  /// @return version changed by every change of entries
+  /// @note called under lock
+  uint64_t Version() const {
+    return version_;
+  }
+  /// @}
+
+  /// Collects changes made after given generation and forgets removals made
+  /// before it
+  /// @return true if there are changes
+  bool ChangesSince(uint64_t since, KeyValueList& written,
+                    std::vector<Key>& removed) {
+    std::lock_guard lock(mutex_);
+    if (generation_ <= since) {
+      removed_.clear();
+      return false;
+    }
+
+    for (const auto& [key, entry] : data_) {
+      if (entry.generation > since) {
+        written.push_back({key, entry.value});
+      }
+    }
+
+    std::erase_if(removed_, [since, &removed](const auto& item) {
+      if (item.second > since) {
+        removed.push_back(item.first);
+        return false;
+      }
+
+      return true;
+    });
+
+    return !written.empty() || !removed.empty();
+  }
+
+ private:
+  struct Entry {
+    Value value;
+    /// generation of last write
+    uint64_t generation = 0;
+  };
+
+  using Entries = std::unordered_map<Key, Entry>;
+
+  /// hash table node holding entry and its bucket pointer
+  static constexpr size_t kEntryFootprint =
+      sizeof(Entries::value_type) + 2 * sizeof(void*);
+
+  JournalTicket WriteLocked(const Key& key, Value&& value) {
+    ++version_;
+    Preserve(key);
+    const auto generation = Stamp();
+    auto ticket = Journal(ChangeKind::Write, key, &value);
+    scalars_.Store(key, &value);
+    data_.insert_or_assign(key, Entry{std::move(value), generation});
+    if (!removed_.empty()) {
+      removed_.erase(key);
+    }
+
+    return ticket;
+  }
+
+  bool UpdateLocked(const Key& key, Value&& value, JournalTicket& ticket) {
+    auto it = data_.find(key);
+    if (it == data_.end()) {
+      return false;
+    }
+
+    ++version_;
+    Preserve(key);
+    const auto generation = Stamp();
+    ticket = Journal(ChangeKind::Update, key, &value);
+    scalars_.Store(key, &value);
+    it->second = {std::move(value), generation};
+    return true;
+  }
+
+  bool RemoveLocked(const Key& key, JournalTicket& ticket) {
+    auto it = data_.find(key);
+    if (it == data_.end()) {
+      return false;
+    }
+
+    ++version_;
+    Preserve(key);
+    scalars_.Store(key, nullptr);
+    data_.erase(it);
+    const auto generation = Stamp();
+    ticket = Journal(ChangeKind::Remove, key);
+    if (tracker_) {
+      removed_.insert_or_assign(key, generation);
+    }
+
+    return true;
+  }
+
+  uint64_t Stamp() {
+    if (!tracker_) {
+      return 0;
+    }
+
+    generation_ = tracker_->Stamp();
+    return generation_;
+  }
+
+  void Preserve(const Key& key) {
+    if (tracker_) {
+      snapshot_.BeforeChange(tracker_->Snapshot(), data_, key);
+    }
+  }
+
+  JournalTicket Journal(ChangeKind kind, const Key& key,
+                        const Value* value = nullptr) const {
+    return tracker_ ? tracker_->Journal(kind, key, value) : JournalTicket{};
+  }
+
+ private:
+  const ChangeTracker::Ptr tracker_;
+  mutable AsyncSharedMutex mutex_;
+  Entries data_;
+  /// copies of scalar values of data_, changed under exclusive lock
+  ScalarSlots scalars_;
+  /// tracked removals and latest generation of changes
+  std::unordered_map<Key, uint64_t> removed_;
+  uint64_t generation_ = 0;
+  SnapshotSlot<Key, Entry> snapshot_;
+  /// validated by transactions
+  uint64_t version_ = 0;
+};
+
+class VolumeNodeImpl final : public VolumeNode {
+ public:
+  /// @param parent tracker of parent node, nullptr for root of volume
+  explicit VolumeNodeImpl(const Name& name, ChangeTracker::Ptr parent = nullptr)
+      : name_(name),
+        tracker_(parent
+                     ? std::make_shared<ChangeTracker>(std::move(parent), name)
+                     : std::make_shared<ChangeTracker>()),
+        data_(std::make_shared<VolumeNodeData>(tracker_)) {
+  }
+
+  const Name& GetName() const override {
+    return name_;
+  }
+
+  VolumeNode::Ptr Create(const Name& name) override {
+    VolumeNode::Ptr result;
+    JournalTicket ticket;
+    {
+      std::lock_guard lock(mutex_);
+      if (auto it = children_.find(name); it != children_.end()) {
+        return it->second;
+      }
+
+      Preserve(name);
+      auto& child = children_[name];
+      child.reset(new VolumeNodeImpl(name, tracker_));
+      ticket = tracker_->Journal(ChangeKind::Create, name);
+      result = child;
+    }
+
+    ticket.Commit();
+    return result;
+  }
+
+  VolumeNode::Ptr Find(const Name& name) const override {
+    std::shared_lock lock(mutex_);
+    auto it = children_.find(name);
+    if (it == children_.end()) {
+      return NullVolumeNode::Instance();
+    }
+
+    return it->second;
+  }
+
+  Task<VolumeNode::Ptr> AsyncFind(Name name,
+                                  Executor& executor) const override {
+    const auto lock = co_await mutex_.LockSharedAsync(executor);
+    auto it = children_.find(name);
+    if (it == children_.end()) {
+      co_return NullVolumeNode::Instance();
+    }
+
+    co_return it->second;
+  }
+
+  bool Unlink(const Name& name) override {
+    JournalTicket ticket;
+    {
+      std::lock_guard lock(mutex_);
+      auto it = children_.find(name);
+      if (it == children_.end()) {
+        return false;
+      }
+
+      std::static_pointer_cast<VolumeNodeImpl>(it->second)->tracker_->Detach();
+      Preserve(name);
+      children_.erase(it);
+      /// kept even if child is created again: its old subtree is dropped
+      unlinked_.insert_or_assign(name, tracker_->Stamp());
+      ticket = tracker_->Journal(ChangeKind::Unlink, name);
+    }
+
+    ticket.Commit();
+    return true;
+  }
+
+  NodeData::Ptr Open() const override {
+    return data_;
+  }
+
+  VolumeNode::List Enumerate() const override {
+    std::shared_lock lock(mutex_);
+    VolumeNode::List result;
+    result.reserve(children_.size());
+    for (const auto& [_, child] : children_) {
+      result.push_back(child);
+    }
+
+    return result;
+  }
+
+  bool IsValid() const override {
+    return true;
+  }
+
+  /// Bulk construction without synchronization
+  /// @note allowed only until node is published to other threads
+  /// @{
+  VolumeNodeData& Data() {
+    return *data_;
+  }
+
+  void Reserve(size_t children) {
+    children_.reserve(children);
+  }
+
+  std::shared_ptr<VolumeNodeImpl> AddChild(const Name& name) {
+    auto child = std::make_shared<VolumeNodeImpl>(name, tracker_);
+    children_.insert_or_assign(name, child);
+    return child;
+  }
+
+  /// @return existing child, or child added if there is none
+  VolumeNodeImpl& BuildChild(const Name& name) {
+    auto& child = children_[name];
+    if (!child) {
+      child = std::make_shared<VolumeNodeImpl>(name, tracker_);
+    }
+
+    return static_cast<VolumeNodeImpl&>(*child);
+  }
+
+  /// Fills scalar slots of data of every node of subtree built by BuildChild
+  void FillScalars() {
+    std::vector<VolumeNodeImpl*> pending = {this};
+    while (!pending.empty()) {
+      auto* node = pending.back();
+      pending.pop_back();
+      node->data_->FillScalars();
+      for (const auto& [name, child] : node->children_) {
+        pending.push_back(static_cast<VolumeNodeImpl*>(child.get()));
+      }
+    }
+  }
+  /// @}
+
+  const ChangeTracker::Ptr& Tracker() const {
+    return tracker_;
+  }
+
+  /// Collects changes of node made after given generation and forgets
+  /// unlinks made before it
+  /// @param children receives children with changes in their subtrees
+  /// @return true if node itself is changed
+  bool ChangesSince(uint64_t since, std::vector<Name>& unlinked,
+                    std::vector<NodeData::Key>& removed,
+                    NodeData::KeyValueList& written,
+                    std::vector<std::shared_ptr<VolumeNodeImpl>>& children) {
+    {
+      std::lock_guard lock(mutex_);
+      std::erase_if(unlinked_, [since, &unlinked](const auto& item) {
+        if (item.second > since) {
+          unlinked.push_back(item.first);
+          return false;
+        }
+
+        return true;
+      });
+
+      for (const auto& [_, child] : children_) {
+        auto impl = std::static_pointer_cast<VolumeNodeImpl>(child);
+        if (impl->tracker_->Subtree() > since) {
+          children.push_back(std::move(impl));
+        }
+      }
+    }
+
+    const auto data_changed = data_->ChangesSince(since, written, removed);
+    return tracker_->Created() > since || !unlinked.empty() || data_changed;
+  }
+
+  /// Attaches detached subtree, unless child with the same name exists
+  /// @return true if subtree is attached
+  /// @note subtree must be built with Tracker() of this node as parent
+  /// @note subtree is not journaled, so volume must have no journal
+  bool Adopt(std::shared_ptr<VolumeNodeImpl> child) {
+    const auto name = child->GetName();
+    std::lock_guard lock(mutex_);
+    if (children_.contains(name)) {
+      return false;
+    }
+
+    Preserve(name);
+    children_.emplace(name, std::move(child));
+    return true;
+  }
+
+  /// @return children at the beginning of snapshot in progress
+  VolumeNode::List SnapshotChildren(uint64_t epoch) {
+    std::lock_guard lock(mutex_);
+    VolumeNode::List result;
+    result.reserve(children_.size());
+    snapshot_.Take(epoch, children_, [&result](const Name&, const auto& child) {
+      result.push_back(child);
+    });
+
+    return result;
+  }
+
+  /// @return contents at the beginning of snapshot in progress
+  NodeData::KeyValueList SnapshotData(uint64_t epoch) {
+    return data_->Snapshot(epoch);
+  }
+
+ private:
+  void Preserve(const Name& name) {
+    snapshot_.BeforeChange(tracker_->Snapshot(), children_, name);
+  }
+
+ private:
+  const Name name_;
+  const ChangeTracker::Ptr tracker_;
+  const std::shared_ptr<VolumeNodeData> data_;
+
+  mutable AsyncSharedMutex mutex_;
+  /// children are always VolumeNodeImpl
+  std::unordered_map<Name, Node::Ptr> children_;
+  /// generations of tracked unlinks
+  std::unordered_map<Name, uint64_t> unlinked_;
+  SnapshotSlot<Name, Node::Ptr> snapshot_;
+};
+
+}  // namespace jbkv
@@ -0,0 +1,134 @@
+#include "volume_snapshot.h"
+#include "compressed_io.h"
+
+using namespace jbkv;
+using namespace jbkv::format;
+
+namespace {
+constexpr auto kCorrupted = "Data corrupted";
+}  // namespace
+
+VolumeSnapshot::VolumeSnapshot(MappedFile::Ptr file)
+    : file_(std::move(file)),
+      data_(file_->Data()),
+      size_(file_->Size()) {
+  MemoryReader in(data_, data_ + size_);
+  if (size_ >= kCompressedMagic.size() &&
+      DeserializeMagic(in) == kCompressedMagic) {
+    Decompress(in);
+  }
+
+  in = MemoryReader(data_, data_ + size_);
+
+  version_ = DeserializeHeader(in);
+  if (IsLegacy()) {
+    LocateLegacyRecords(in);
+  } else {
+    LocateIndexedRecords();
+  }
+}
+
+void VolumeSnapshot::Decompress(MemoryReader& in) {
+  io::DecompressingSource<MemoryReader> source(in);
+  constexpr uint64_t kChunkSize = 1 << 20;
+  uint64_t count = 0;
+  do {
+    const auto offset = decompressed_.size();
+    decompressed_.resize(offset + kChunkSize);
+    count = source.Read(decompressed_.data() + offset, kChunkSize);
+  } while (count == kChunkSize);
+
+  decompressed_.resize(decompressed_.size() - kChunkSize + count);
+  data_ = decompressed_.data();
+  size_ = decompressed_.size();
+}
+
+MemoryReader VolumeSnapshot::Seek(uint64_t record) const {
+  if (record >= record_count_) {
+    throw std::runtime_error(kCorrupted);
+  }
+
+  const auto* begin = data_;
+  const auto* end = begin + size_;
+  if (IsLegacy()) {
+    return MemoryReader(begin + legacy_records_[record].offset, end);
+  }
+
+  IndexEntry entry;
+  std::memcpy(&entry, index_ + record * sizeof(IndexEntry), sizeof(entry));
+  if (entry.offset > size_ || entry.size > size_ - entry.offset) {
+    throw std::runtime_error(kCorrupted);
+  }
+
+  return MemoryReader(begin + entry.offset, begin + entry.offset + entry.size);
+}
+
+void VolumeSnapshot::CheckRecordCrc(const MemoryReader& in) {
+  uint32_t stored_crc = 0;
+  if (in.Remaining() < sizeof(stored_crc)) {
+    throw std::runtime_error(kCorrupted);
+  }
+
+  const auto size = static_cast<size_t>(in.Remaining() - sizeof(stored_crc));
+  std::memcpy(&stored_crc, in.Position() + size, sizeof(stored_crc));
+  if (Crc32c(0, in.Position(), size) != stored_crc) {
+    throw std::runtime_error(kCorrupted);
+  }
+}
+
+uint64_t VolumeSnapshot::ReadRecordHeader(uint64_t record,
+                                          MemoryReader& in) const {
+  if (IsLegacy()) {
+    return legacy_records_[record].first_child;
+  }
+
+  RecordHeader header;
+  DeserializeCompactRecordHeader(header, in);
+
+  if (header.id != record) {
+    throw std::runtime_error(kCorrupted);
+  }
+
+  return header.first_child;
+}
+
+/// Records are stored in BFS order, so children of every node follow
+/// children of its predecessors
+void VolumeSnapshot::LocateLegacyRecords(MemoryReader& in) {
+  const auto* begin = data_;
+  uint64_t next_child = 1;
+  while (legacy_records_.size() < next_child) {
+    LegacyRecord record;
+    record.offset = static_cast<uint64_t>(in.Position() - begin);
+    record.first_child = next_child;
+    next_child += SkipNode<size_t>(in);
+    legacy_records_.push_back(record);
+  }
+
+  record_count_ = legacy_records_.size();
+}
+
+void VolumeSnapshot::LocateIndexedRecords() {
+  const auto* begin = data_;
+  const auto size = size_;
+  if (size < sizeof(Trailer)) {
+    throw std::runtime_error("Data truncated");
+  }
+
+  Trailer trailer;
+  MemoryReader(begin + size - sizeof(Trailer), begin + size)
+      .Read(&trailer, sizeof(trailer));
+
+  const auto index_end = size - sizeof(Trailer);
+  if (trailer.index_offset > index_end ||
+      trailer.record_count >
+          (index_end - trailer.index_offset) / sizeof(IndexEntry)) {
+    throw std::runtime_error(kCorrupted);
+  }
+
+  record_count_ = trailer.record_count;
+  index_ = begin + trailer.index_offset;
+  MemoryReader in(index_ + record_count_ * sizeof(IndexEntry),
+                  begin + index_end);
+  DeserializeDictionary(dictionary_, in);
+}
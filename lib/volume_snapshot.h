@@ -0,0 +1,112 @@
+#pragma once
+#include "mapped_file.h"
+#include "volume_format.h"
+#include <vector>
+
+namespace jbkv {
+
+/// Random access to node records of saved volume
+/// Records of indexed format are located through index right in mapping, so
+/// opening takes constant time. Records of legacy format are located by
+/// single pass skipping their payloads. Compressed file is decompressed into
+/// memory.
+/// @note not a part of public interface
+class VolumeSnapshot : NonCopyableNonMovable {
+ public:
+  using Ptr = std::shared_ptr<const VolumeSnapshot>;
+  static constexpr uint64_t kRootRecord = 0;
+
+ public:
+  explicit VolumeSnapshot(MappedFile::Ptr file);
+
+  uint64_t RecordCount() const {
+    return record_count_;
+  }
+
+  /// Decodes and verifies record
+  /// @param on_child called with name of child and id of its record
+  /// @param on_value called with every key and value
+  template <typename OnChild, typename OnValue>
+  void Decode(uint64_t record, OnChild&& on_child, OnValue&& on_value) const {
+    auto in = Seek(record);
+    if (!IsLegacy()) {
+      CheckRecordCrc(in);
+    }
+
+    auto child_record = ReadRecordHeader(record, in);
+    auto on_name = [&on_child, &child_record](std::string&& name) {
+      on_child(std::move(name), child_record++);
+    };
+
+    if (IsLegacy()) {
+      format::DeserializeNode<size_t>(in, 0, on_name, on_value);
+    } else {
+      format::DeserializeCompactNodeBody(in, ReadString(), on_name, on_value);
+    }
+  }
+
+  /// Decodes names of children without verification of record
+  /// @param on_child called with name of child and id of its record
+  template <typename OnChild>
+  void DecodeChildren(uint64_t record, OnChild&& on_child) const {
+    auto in = Seek(record);
+    auto child_record = ReadRecordHeader(record, in);
+    auto on_name = [&on_child, &child_record](std::string&& name) {
+      on_child(std::move(name), child_record++);
+    };
+
+    if (IsLegacy()) {
+      format::DeserializeChildren<size_t>(in, on_name);
+    } else {
+      format::DeserializeCompactChildren(in, ReadString(), on_name);
+    }
+  }
+
+ private:
+  bool IsLegacy() const {
+    return version_ == format::kLegacyFormatVersion;
+  }
+
+  /// @return reader of names and keys of compact format
+  auto ReadString() const {
+    return [this](std::string& value, format::MemoryReader& in) {
+      dictionary_.Decode(value, in);
+    };
+  }
+
+  /// Verifies CRC stored at the end of record by single pass over record
+  static void CheckRecordCrc(const format::MemoryReader& in);
+
+  /// @return reader positioned at the beginning of record
+  format::MemoryReader Seek(uint64_t record) const;
+
+  /// @return id of first child record
+  uint64_t ReadRecordHeader(uint64_t record, format::MemoryReader& in) const;
+
+  /// Decodes whole compressed file into memory
+  void Decompress(format::MemoryReader& in);
+
+  void LocateLegacyRecords(format::MemoryReader& in);
+  void LocateIndexedRecords();
+
+ private:
+  struct LegacyRecord {
+    uint64_t offset = 0;
+    uint64_t first_child = 0;
+  };
+
+  const MappedFile::Ptr file_;
+  /// compressed file only
+  std::vector<uint8_t> decompressed_;
+  /// contents of file, decompressed if needed
+  const uint8_t* data_ = nullptr;
+  uint64_t size_ = 0;
+  uint8_t version_ = 0;
+  uint64_t record_count_ = 0;
+  /// legacy format only
+  std::vector<LegacyRecord> legacy_records_;
+  /// indexed format only, points into mapping
+  const uint8_t* index_ = nullptr;
+  format::DictionaryDecoder dictionary_;
+};
+}  // namespace jbkv
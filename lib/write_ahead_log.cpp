@@ -0,0 +1,287 @@
+#include "write_ahead_log.h"
+#include <cerrno>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include "buffered_io.h"
+#include "log_file.h"
+#include "mapped_file.h"
+#include "volume_format.h"
+#include "volume_io.h"
+#include "volume_node_impl.h"
+
+using namespace jbkv;
+using namespace jbkv::format;
+using jbkv::io::AppendFramed;
+using jbkv::io::LogFile;
+using jbkv::io::SyncFile;
+
+namespace {
+
+std::filesystem::path Sibling(const std::filesystem::path& path,
+                              const char* suffix) {
+  auto result = path;
+  result += suffix;
+  return result;
+}
+
+void WriteHeader(LogFile& file) {
+  io::MemoryWriter header;
+  SerializeHeader(header, kLogMagic, kLogFormatVersion);
+  file.Write(header.Data());
+}
+
+void Apply(const VolumeNode::Ptr& root, LogRecord&& record) {
+  auto node = root;
+  for (const auto& name : record.path) {
+    node = node->Create(name);
+  }
+
+  switch (static_cast<ChangeKind>(record.kind)) {
+    case ChangeKind::Create:
+      node->Create(record.name);
+      return;
+    case ChangeKind::Unlink:
+      node->Unlink(record.name);
+      return;
+    case ChangeKind::Write:
+      if (record.value) {
+        node->Open()->Write(record.name, std::move(*record.value));
+        return;
+      }
+      break;
+    case ChangeKind::Update:
+      if (record.value) {
+        node->Open()->Update(record.name, std::move(*record.value));
+        return;
+      }
+      break;
+    case ChangeKind::Remove:
+      node->Open()->Remove(record.name);
+      return;
+  }
+
+  throw std::runtime_error("Bad log record");
+}
+
+/// Applies records of log to root until the end of log or first torn record
+/// @param records receives valid records framed in current format
+void Replay(const VolumeNode::Ptr& root, const std::filesystem::path& path,
+            io::MemoryWriter& records) {
+  const MappedFile file(path);
+  MemoryReader in(file.Data(), file.Data() + file.Size());
+  if (file.Size() == 0) {
+    return;
+  }
+
+  if (DeserializeMagic(in) != kLogMagic) {
+    throw std::runtime_error("Bad log format: " + path.string());
+  }
+
+  DeserializeVersion(in, kLogFormatVersion, kLogFormatVersion);
+  LogRecord record;
+  for (;;) {
+    uint64_t size = 0;
+    if (in.Remaining() < sizeof(size)) {
+      break;
+    }
+
+    Deserialize(size, in);
+    uint32_t stored_crc = 0;
+    if (size > in.Remaining() ||
+        in.Remaining() - size < sizeof(stored_crc)) {
+      break;
+    }
+
+    const auto* payload = in.Skip(size);
+    Deserialize(stored_crc, in);
+    if (Crc32c(0, payload, static_cast<size_t>(size)) != stored_crc) {
+      break;
+    }
+
+    MemoryReader record_in(payload, payload + size);
+    DeserializeLogRecord(record, record_in);
+    Apply(root, std::move(record));
+    AppendFramed({payload, size}, records);
+  }
+}
+
+}  // namespace
+
+/// Appends changes to log file with group commit
+class WriteAheadLog::Journal final : public ChangeJournal {
+ public:
+  explicit Journal(const std::filesystem::path& path)
+      : file_(std::make_unique<LogFile>(path)) {
+  }
+
+  uint64_t Append(const Change& change) override {
+    io::MemoryWriter payload;
+    SerializeLogRecord(static_cast<uint8_t>(change.kind), change.path,
+                       change.name, change.value, payload);
+
+    std::lock_guard lock(mutex_);
+    AppendFramed(payload.Data(), pending_);
+    return ++appended_;
+  }
+
+  void Commit(uint64_t ticket) override {
+    std::unique_lock lock(mutex_);
+    while (durable_ < ticket) {
+      if (error_) {
+        std::rethrow_exception(error_);
+      }
+
+      if (flushing_) {
+        flushed_.wait(lock);
+        continue;
+      }
+
+      Flush(lock);
+    }
+  }
+
+  /// Makes appended records durable and switches to new log file
+  /// Current log is renamed to rotated path, or appended to it if rotated log
+  /// is left by failed checkpoint
+  void Rotate(const std::filesystem::path& path,
+              const std::filesystem::path& rotated) {
+    std::unique_lock lock(mutex_);
+    flushed_.wait(lock, [this]() { return !flushing_; });
+    if (error_) {
+      std::rethrow_exception(error_);
+    }
+
+    Flush(lock);
+    file_.reset();
+    if (std::filesystem::exists(rotated)) {
+      const MappedFile current(path);
+      MemoryReader in(current.Data(), current.Data() + current.Size());
+      DeserializeMagic(in);
+      DeserializeVersion(in, kLogFormatVersion);
+      const auto* records = in.Position();
+      const auto* end = current.Data() + current.Size();
+      LogFile file(rotated);
+      file.Write({records, static_cast<uint64_t>(end - records)});
+      file.Sync();
+      std::filesystem::remove(path);
+    } else {
+      std::filesystem::rename(path, rotated);
+    }
+
+    file_ = std::make_unique<LogFile>(path);
+    WriteHeader(*file_);
+    file_->Sync();
+  }
+
+ private:
+  /// Writes pending records by single write and sync
+  /// Other writers keep appending while lock is released
+  void Flush(std::unique_lock<std::mutex>& lock) {
+    flushing_ = true;
+    std::swap(pending_, batch_);
+    const auto last = appended_;
+    lock.unlock();
+
+    std::exception_ptr error;
+    try {
+      file_->Write(batch_.Data());
+      file_->Sync();
+    } catch (...) {
+      error = std::current_exception();
+    }
+
+    batch_.Clear();
+    lock.lock();
+    flushing_ = false;
+    if (error) {
+      error_ = error;
+    } else {
+      durable_ = last;
+    }
+
+    flushed_.notify_all();
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable flushed_;
+  std::unique_ptr<LogFile> file_;
+  io::MemoryWriter pending_;
+  /// records being flushed, accessed only by flushing writer
+  io::MemoryWriter batch_;
+  uint64_t appended_ = 0;
+  uint64_t durable_ = 0;
+  bool flushing_ = false;
+  std::exception_ptr error_;
+};
+
+WriteAheadLog::WriteAheadLog(const VolumeNode::Ptr& root,
+                             const std::filesystem::path& path)
+    : root_(root),
+      path_(path) {
+  auto* tracked = dynamic_cast<VolumeNodeImpl*>(root_.get());
+  if (!tracked) {
+    throw std::runtime_error("Volume does not track changes");
+  }
+
+  if (tracked->Tracker()->HasJournal()) {
+    throw std::runtime_error("Volume already has log");
+  }
+
+  /// rotated log is left by crash during checkpoint, its records precede
+  /// records of current log
+  const auto rotated = Sibling(path_, ".old");
+  const bool has_rotated = std::filesystem::exists(rotated);
+  const bool has_current = std::filesystem::exists(path_);
+  io::MemoryWriter records;
+  if (has_rotated) {
+    Replay(root_, rotated, records);
+  }
+
+  if (has_current) {
+    Replay(root_, path_, records);
+  }
+
+  /// valid records are rewritten in current format, so torn tail is not
+  /// followed by new records
+  if (has_rotated || has_current) {
+    const auto merged = Sibling(path_, ".tmp");
+    std::filesystem::remove(merged);
+    {
+      LogFile file(merged);
+      WriteHeader(file);
+      file.Write(records.Data());
+      file.Sync();
+    }
+
+    std::filesystem::rename(merged, path_);
+    SyncFile(path_);
+    std::filesystem::remove(rotated);
+  } else {
+    LogFile file(path_);
+    WriteHeader(file);
+    file.Sync();
+  }
+
+  journal_ = std::make_shared<Journal>(path_);
+  tracked->Tracker()->SetJournal(journal_);
+}
+
+WriteAheadLog::~WriteAheadLog() {
+  static_cast<VolumeNodeImpl*>(root_.get())->Tracker()->SetJournal(nullptr);
+}
+
+void WriteAheadLog::Checkpoint(const std::filesystem::path& snapshot) {
+  const auto rotated = Sibling(path_, ".old");
+  journal_->Rotate(path_, rotated);
+
+  /// every change logged before rotation is in snapshot, changes made
+  /// during saving are in both snapshot and new log, replaying them again
+  /// is harmless. Save replaces snapshot only after it is synced
+  Save(root_, snapshot);
+  std::filesystem::remove(rotated);
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <filesystem>
+#include <memory>
+#include "noncopyable.h"
+#include "volume_node.h"
+
+namespace jbkv {
+
+/// Write-ahead log of volume changes
+/// Changes of data and children of volume are appended to log and are
+/// durable when call making them returns. Concurrent writers share flushes:
+/// writer which finds no flush in progress writes records appended by all
+/// writers so far and syncs them by single fsync.
+/// Typical use:
+/// @code
+/// auto volume = CreateVolume();
+/// if (std::filesystem::exists("volume.bin")) {
+///   Load(volume, "volume.bin");
+/// }
+///
+/// WriteAheadLog log(volume, "volume.log");
+/// ...
+/// log.Checkpoint("volume.bin");
+/// @endcode
+class WriteAheadLog : NonCopyableNonMovable {
+ public:
+  /// Replays log into root and attaches log to volume
+  /// Torn record at the end of log, left by crash, is dropped
+  /// @throw std::runtime_error if volume does not track changes, i.e. was not
+  /// created by CreateVolume, or log cannot be opened
+  WriteAheadLog(const VolumeNode::Ptr& root, const std::filesystem::path& path);
+
+  /// Detaches log from volume
+  ~WriteAheadLog();
+
+  /// Saves snapshot of volume and truncates log
+  /// Snapshot is written to temporary file which is renamed over previous
+  /// snapshot, so crash at any point leaves snapshot and log consistent
+  void Checkpoint(const std::filesystem::path& snapshot);
+
+ private:
+  class Journal;
+
+  const VolumeNode::Ptr root_;
+  const std::filesystem::path path_;
+  std::shared_ptr<Journal> journal_;
+};
+
+}  // namespace jbkv
@@ -0,0 +1,702 @@
+#include "lib/async_mutex.h"
+#include "lib/jbkv.h"
+#include "lib/volume_node_impl.h"
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <shared_mutex>
+#include <sstream>
+#include <thread>
+
+using namespace jbkv;
+
+namespace {
+
+/// @return average time of single iteration in nanoseconds
+template <typename Func>
+double Measure(size_t iterations, Func&& func) {
+  const auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < iterations; ++i) {
+    func(i);
+  }
+
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+  return std::chrono::duration<double, std::nano>(elapsed).count() /
+         static_cast<double>(iterations);
+}
+
+void Report(const std::string& name, double ns_per_op) {
+  std::cout << "[ BENCH    ] " << name << ": " << ns_per_op << " ns/op"
+            << std::endl;
+}
+
+/// @return elapsed time of single call in seconds
+template <typename Func>
+double MeasureOnce(Func&& func) {
+  const auto start = std::chrono::steady_clock::now();
+  func();
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+  return std::chrono::duration<double>(elapsed).count();
+}
+
+void ReportThroughput(const std::string& name, uint64_t bytes,
+                      double seconds) {
+  std::cout << "[ BENCH    ] " << name << ": "
+            << static_cast<double>(bytes) / (1 << 20) / seconds << " MiB/s"
+            << std::endl;
+}
+
+/// Size of volume for I/O benchmarks, JBKV_BENCH_VOLUME_MB overrides it
+uint64_t VolumeBytes() {
+  const char* mb = std::getenv("JBKV_BENCH_VOLUME_MB");
+  return (mb ? std::strtoull(mb, nullptr, 10) : 1024) << 20;
+}
+
+VolumeNode::Ptr MakeVolume(size_t children, size_t keys) {
+  auto v = CreateVolume();
+  for (size_t i = 0; i < children; ++i) {
+    auto d = v->Create("child" + std::to_string(i))->Open();
+    for (size_t j = 0; j < keys; ++j) {
+      d->Write("key" + std::to_string(j), static_cast<uint64_t>(j));
+    }
+  }
+
+  return v;
+}
+}  // namespace
+
+TEST(FrozenVolume, ReadVersusMutable) {
+  const size_t children = 1000;
+  const size_t keys = 20;
+  const size_t iterations = 1000000;
+
+  auto mutable_volume = MakeVolume(children, keys);
+  auto frozen_volume = Freeze(mutable_volume);
+
+  std::vector<std::string> names;
+  std::vector<std::string> key_names;
+  for (size_t i = 0; i < children; ++i) {
+    names.push_back("child" + std::to_string(i));
+  }
+
+  for (size_t j = 0; j < keys; ++j) {
+    key_names.push_back("key" + std::to_string(j));
+  }
+
+  for (const auto& [name, volume] :
+       {std::pair{"mutable", mutable_volume},
+        std::pair{"frozen", frozen_volume}}) {
+    uint64_t sum = 0;
+    const auto ns = Measure(iterations, [&](size_t i) {
+      auto d = volume->Find(names[i % children])->Open();
+      sum += *d->Read<uint64_t>(key_names[i % keys]);
+    });
+
+    Report(std::string(name) + " find+read", ns);
+    EXPECT_GT(sum, 0u);
+  }
+}
+
+TEST(VolumeNode, SaveLoadThroughput) {
+  const size_t keys = 64;
+  const size_t value_size = 1024;
+  const auto total = VolumeBytes();
+  const size_t children = std::max<uint64_t>(total / (keys * value_size), 1);
+
+  auto volume = CreateVolume();
+  const Value::String value{std::string(value_size, 'x')};
+  for (size_t i = 0; i < children; ++i) {
+    auto d = volume->Create("child" + std::to_string(i))->Open();
+    for (size_t j = 0; j < keys; ++j) {
+      d->Write("key" + std::to_string(j), value);
+    }
+  }
+
+  const std::filesystem::path path = "bench_volume.bin";
+  const std::filesystem::path raw_path = "bench_raw.bin";
+  const auto save = MeasureOnce([&] { Save(volume, path); });
+  const auto bytes = std::filesystem::file_size(path);
+  ReportThroughput("save", bytes, save);
+
+  ThreadPool pool;
+  const auto parallel_save = MeasureOnce([&] { Save(volume, path, pool); });
+  ReportThroughput("parallel save", std::filesystem::file_size(path),
+                   parallel_save);
+
+  auto loaded = CreateVolume();
+  const auto load = MeasureOnce([&] { Load(loaded, path); });
+  ReportThroughput("load", bytes, load);
+  EXPECT_EQ(loaded->Enumerate().size(), children);
+
+  auto parallel_loaded = CreateVolume();
+  const auto parallel_load =
+      MeasureOnce([&] { Load(parallel_loaded, path, pool); });
+  ReportThroughput("parallel load", bytes, parallel_load);
+  EXPECT_EQ(parallel_loaded->Enumerate().size(), children);
+
+  // Raw bandwidth: the same number of bytes by large sequential writes/reads
+  std::vector<char> block(1 << 20, 'x');
+  const auto raw_write = MeasureOnce([&] {
+    std::ofstream out(raw_path, std::ios_base::binary);
+    for (uint64_t written = 0; written < bytes; written += block.size()) {
+      out.write(block.data(), static_cast<std::streamsize>(block.size()));
+    }
+  });
+  ReportThroughput("raw write", bytes, raw_write);
+
+  const auto raw_read = MeasureOnce([&] {
+    std::ifstream in(raw_path, std::ios_base::binary);
+    while (in.read(block.data(), static_cast<std::streamsize>(block.size()))) {
+    }
+  });
+  ReportThroughput("raw read", bytes, raw_read);
+
+  std::filesystem::remove(path);
+  std::filesystem::remove(raw_path);
+}
+
+TEST(VolumeNode, SaveDeltaVersusSave) {
+  const size_t children = 10000;
+  auto volume = MakeVolume(children, 20);
+  auto generation = AdvanceGeneration(volume);
+
+  // 1% of nodes change between snapshots
+  for (size_t i = 0; i < children; i += 100) {
+    volume->Find("child" + std::to_string(i))->Open()->Write("key0", true);
+  }
+
+  std::stringstream full;
+  std::stringstream delta;
+  Report("save", MeasureOnce([&] { Save(volume, full); }) * 1e9);
+  Report("save delta",
+         MeasureOnce([&] { SaveDelta(volume, delta, generation); }) * 1e9);
+  std::cout << "[ BENCH    ] size: " << full.str().size() << " bytes, delta "
+            << delta.str().size() << " bytes" << std::endl;
+}
+
+TEST(VolumeNode, CompressedSaveLoad) {
+  auto compare = [](const std::string& corpus, const VolumeNode::Ptr& volume) {
+    const std::filesystem::path raw_path = "bench_plain.bin";
+    const std::filesystem::path path = "bench_compressed.bin";
+    const auto raw_save = MeasureOnce([&] { Save(volume, raw_path); });
+    const auto save = MeasureOnce([&] { Save(volume, path, *LzCodec()); });
+    const auto raw_bytes = std::filesystem::file_size(raw_path);
+    const auto bytes = std::filesystem::file_size(path);
+
+    auto raw_loaded = CreateVolume();
+    const auto raw_load = MeasureOnce([&] { Load(raw_loaded, raw_path); });
+    auto loaded = CreateVolume();
+    const auto load = MeasureOnce([&] { Load(loaded, path); });
+    EXPECT_EQ(loaded->Enumerate().size(), volume->Enumerate().size());
+
+    std::cout << "[ BENCH    ] " << corpus << " ratio: "
+              << static_cast<double>(raw_bytes) / static_cast<double>(bytes)
+              << " (" << raw_bytes << " -> " << bytes << " bytes)"
+              << std::endl;
+    // throughput in bytes of uncompressed file for both
+    ReportThroughput(corpus + " save", raw_bytes, raw_save);
+    ReportThroughput(corpus + " compressed save", raw_bytes, save);
+    ReportThroughput(corpus + " load", raw_bytes, raw_load);
+    ReportThroughput(corpus + " compressed load", raw_bytes, load);
+    std::filesystem::remove(raw_path);
+    std::filesystem::remove(path);
+  };
+
+  compare("small values", MakeVolume(10000, 20));
+
+  // Records of repetitive strings, as typical for configuration and catalogs
+  const size_t keys = 16;
+  const size_t children =
+      std::max<uint64_t>(VolumeBytes() / (keys * 128), 1);
+  const char* regions[] = {"eu-west-1", "eu-central-1", "us-east-2"};
+  auto volume = CreateVolume();
+  for (size_t i = 0; i < children; ++i) {
+    auto d = volume->Create("user" + std::to_string(i))->Open();
+    for (size_t j = 0; j < keys; ++j) {
+      d->Write("attribute" + std::to_string(j),
+               Value::String{"id=" + std::to_string(i * keys + j) +
+                             ";status=active;region=" + regions[(i + j) % 3] +
+                             ";owner=user" + std::to_string(i) +
+                             "@example.com;plan=standard"});
+    }
+  }
+
+  compare("strings", volume);
+}
+
+TEST(VolumeNode, WriteDuringCheckpoint) {
+  const size_t children = 100000;
+  const size_t writes = 200000;
+  auto volume = MakeVolume(children, 10);
+  std::vector<VolumeNode::Ptr> nodes = volume->Enumerate();
+
+  auto write = [&](const std::string& name) {
+    Report(name, Measure(writes, [&](size_t i) {
+      nodes[i % nodes.size()]->Open()->Write("key0", static_cast<uint64_t>(i));
+    }));
+  };
+
+  write("write");
+
+  std::thread saver([&] { Save(volume, "bench_checkpoint.bin"); });
+  write("write during save");
+  saver.join();
+
+  auto done = CheckpointAsync(volume, "bench_checkpoint.bin");
+  write("write during checkpoint");
+  done.get();
+  std::filesystem::remove("bench_checkpoint.bin");
+}
+
+TEST(WriteAheadLog, WriteLatency) {
+  const size_t writes = 4096;
+  for (const size_t threads : {1, 8, 64}) {
+    std::filesystem::remove("bench.log");
+    auto volume = CreateVolume();
+    WriteAheadLog log(volume, "bench.log");
+
+    std::vector<std::thread> writers;
+    std::atomic<uint64_t> total_ns = 0;
+    for (size_t i = 0; i < threads; ++i) {
+      writers.emplace_back([&, i]() {
+        auto d = volume->Create("writer" + std::to_string(i))->Open();
+        const auto ns = Measure(writes / threads, [&d](size_t j) {
+          d->Write("key" + std::to_string(j), static_cast<uint64_t>(j));
+        });
+        total_ns += static_cast<uint64_t>(ns);
+      });
+    }
+
+    for (auto& writer : writers) {
+      writer.join();
+    }
+
+    Report("log write, " + std::to_string(threads) + " threads",
+           static_cast<double>(total_ns) / static_cast<double>(threads));
+  }
+
+  std::filesystem::remove("bench.log");
+}
+
+/// journal without I/O isolates cost of journaling from sync
+TEST(ChangeTracker, JournalLatency) {
+  class CountingJournal final : public ChangeJournal {
+   public:
+    uint64_t Append(const Change&) override {
+      return ++appended_;
+    }
+
+    void Commit(uint64_t) override {
+    }
+
+   private:
+    std::atomic<uint64_t> appended_ = 0;
+  };
+
+  const size_t writes = 1 << 18;
+  for (const size_t threads : {1, 8, 64}) {
+    auto volume = CreateVolume();
+    std::static_pointer_cast<VolumeNodeImpl>(volume)->Tracker()->SetJournal(
+        std::make_shared<CountingJournal>());
+
+    std::vector<std::thread> writers;
+    std::atomic<uint64_t> total_ns = 0;
+    for (size_t i = 0; i < threads; ++i) {
+      writers.emplace_back([&, i]() {
+        auto d = volume->Create("writer" + std::to_string(i))->Open();
+        const auto ns = Measure(writes / threads, [&d](size_t j) {
+          d->Write("key" + std::to_string(j & 1023), static_cast<uint64_t>(j));
+        });
+        total_ns += static_cast<uint64_t>(ns);
+      });
+    }
+
+    for (auto& writer : writers) {
+      writer.join();
+    }
+
+    Report("journaled write, " + std::to_string(threads) + " threads",
+           static_cast<double>(total_ns) / static_cast<double>(threads));
+  }
+}
+
+TEST(LsmVolume, VersusInMemory) {
+  const size_t children = 1000;
+  const size_t keys = 100;
+  const size_t reads = 200000;
+  std::filesystem::remove_all("bench_lsm");
+
+  LsmOptions options;
+  options.sync = false;
+  auto lsm = OpenLsmVolume("bench_lsm", options);
+  auto memory = CreateVolume();
+  for (auto& volume : {memory, lsm}) {
+    for (size_t i = 0; i < children; ++i) {
+      auto d = volume->Create(std::to_string(i))->Open();
+      for (size_t j = 0; j < keys; ++j) {
+        d->Write("key" + std::to_string(j), static_cast<uint64_t>(i + j));
+      }
+    }
+  }
+
+  for (const auto& [name, volume] :
+       {std::pair{"memory", memory}, std::pair{"lsm", lsm}}) {
+    std::vector<std::string> names;
+    for (size_t i = 0; i < children; ++i) {
+      names.push_back(std::to_string(i));
+    }
+
+    Report(std::string(name) + " write", Measure(reads, [&](size_t i) {
+      volume->Find(names[i % children])
+          ->Open()
+          ->Write("key" + std::to_string(i % keys), static_cast<uint64_t>(i));
+    }));
+    Report(std::string(name) + " find+read", Measure(reads, [&](size_t i) {
+      volume->Find(names[i * 7919 % children])
+          ->Open()
+          ->Read("key" + std::to_string(i % keys));
+    }));
+    Report(std::string(name) + " enumerate node",
+           Measure(children, [&](size_t i) {
+             volume->Find(names[i])->Open()->Enumerate();
+           }));
+  }
+
+  lsm.reset();
+  std::filesystem::remove_all("bench_lsm");
+}
+
+TEST(SpillingVolume, ResidentVersusSpilled) {
+  const size_t children = 1000;
+  const size_t keys = 100;
+  const size_t reads = 200000;
+  std::filesystem::remove_all("bench_spill");
+
+  SpillOptions options;
+  options.directory = "bench_spill";
+  options.interval = std::chrono::milliseconds(0);
+  auto spilling = CreateSpillingVolume(options);
+  auto memory = CreateVolume();
+  std::vector<std::string> names;
+  for (size_t i = 0; i < children; ++i) {
+    names.push_back(std::to_string(i));
+  }
+
+  for (const auto& volume : {memory, spilling}) {
+    for (const auto& name : names) {
+      auto d = volume->Create(name)->Open();
+      for (size_t j = 0; j < keys; ++j) {
+        d->Write("key" + std::to_string(j), static_cast<uint64_t>(j));
+      }
+    }
+  }
+
+  for (const auto& [name, volume] :
+       {std::pair{"memory", memory}, std::pair{"resident", spilling}}) {
+    Report(std::string(name) + " find+read", Measure(reads, [&](size_t i) {
+      volume->Find(names[i * 7919 % children])
+          ->Open()
+          ->Read("key" + std::to_string(i % keys));
+    }));
+  }
+
+  /// spilled subtree is loaded on access and spilled by next check
+  options.memory_budget = 0;
+  auto cold = CreateSpillingVolume(options);
+  for (const auto& name : names) {
+    auto d = cold->Create(name)->Open();
+    for (size_t j = 0; j < keys; ++j) {
+      d->Write("key" + std::to_string(j), static_cast<uint64_t>(j));
+    }
+  }
+
+  Report("spill subtree", MeasureOnce([&] { SpillCold(cold); }) * 1e9 /
+                              static_cast<double>(children));
+  Report("reload subtree+read", Measure(children, [&](size_t i) {
+    cold->Find(names[i])->Open()->Read("key0");
+  }));
+
+  cold.reset();
+  spilling.reset();
+  std::filesystem::remove_all("bench_spill");
+}
+
+TEST(VolumeBuilder, VersusCreateWrite) {
+  const size_t parents = 20;
+  const size_t children = 100;
+  const size_t keys = 100;
+  std::vector<VolumeNode::Path> paths;
+  for (size_t i = 0; i < parents; ++i) {
+    for (size_t j = 0; j < children; ++j) {
+      paths.push_back({"parent" + std::to_string(i),
+                       "child" + std::to_string(j)});
+    }
+  }
+
+  std::vector<std::string> names;
+  for (size_t k = 0; k < keys; ++k) {
+    names.push_back("key" + std::to_string(k));
+  }
+
+  /// entry i is key i % keys of node i / keys, shuffled order visits every
+  /// entry once with nodes interleaved
+  const size_t entries = paths.size() * keys;
+  auto entry = [&](size_t i, bool shuffled) {
+    const auto index = shuffled ? i * 7919 % entries : i;
+    return std::pair{&paths[index / keys], &names[index % keys]};
+  };
+
+  for (const bool shuffled : {false, true}) {
+    const std::string order = shuffled ? "shuffled" : "sorted";
+    auto volume = CreateVolume();
+    Report("create+write " + order, Measure(entries, [&](size_t i) {
+      const auto [path, key] = entry(i, shuffled);
+      auto node = volume;
+      for (const auto& name : *path) {
+        node = node->Create(name);
+      }
+
+      node->Open()->Write(*key, static_cast<uint64_t>(i));
+    }));
+
+    VolumeBuilder builder;
+    VolumeNode::Ptr built;
+    const auto seconds = MeasureOnce([&] {
+      for (size_t i = 0; i < entries; ++i) {
+        const auto [path, key] = entry(i, shuffled);
+        builder.Add(*path, *key, static_cast<uint64_t>(i));
+      }
+
+      built = builder.Build();
+    });
+    Report("builder " + order, seconds * 1e9 / static_cast<double>(entries));
+    ASSERT_EQ(built->Enumerate().size(), parents);
+  }
+
+  /// sorted export added as list of entries per node
+  VolumeBuilder builder;
+  VolumeNode::Ptr built;
+  const auto seconds = MeasureOnce([&] {
+    for (size_t node = 0; node < paths.size(); ++node) {
+      NodeData::KeyValueList list;
+      list.reserve(keys);
+      for (size_t k = 0; k < keys; ++k) {
+        const auto i = node * keys + k;
+        list.emplace_back(names[k], Value(static_cast<uint64_t>(i)));
+      }
+
+      builder.Add(paths[node], std::move(list));
+    }
+
+    built = builder.Build();
+  });
+  Report("builder sorted by node",
+         seconds * 1e9 / static_cast<double>(entries));
+  ASSERT_EQ(built->Enumerate().size(), parents);
+}
+
+TEST(Async, ReadVersusBlocking) {
+  const size_t keys = 100;
+  const size_t reads = 500000;
+  auto d = MakeVolume(1, keys)->Find("child0")->Open();
+  std::vector<std::string> names;
+  for (size_t j = 0; j < keys; ++j) {
+    names.push_back("key" + std::to_string(j));
+  }
+
+  Report("blocking read", Measure(reads, [&](size_t i) {
+    d->Read(names[i % keys]);
+  }));
+
+  /// uncontended lock is taken without suspension, so the difference is
+  /// cost of coroutine frame
+  ThreadPool pool(1);
+  PoolExecutor executor(pool);
+  const auto seconds = MeasureOnce([&] {
+    SyncWait([](NodeData& data, const std::vector<std::string>& names,
+                Executor& executor) -> Task<> {
+      for (size_t i = 0; i < reads; ++i) {
+        co_await data.AsyncRead(names[i % keys], executor);
+      }
+    }(*d, names, executor));
+  });
+  Report("async read", seconds * 1e9 / static_cast<double>(reads));
+}
+
+TEST(ShardedVolume, ScalingVersusVolume) {
+  const size_t nodes = 64;
+  const size_t ops = 100000;
+  const size_t max_threads =
+      std::max<size_t>(std::thread::hardware_concurrency(), 1);
+
+  /// every thread writes and reads nodes of all shards
+  const auto run = [&](VolumeNode::Ptr v, size_t concurrency) {
+    std::vector<NodeData::Ptr> data;
+    for (size_t i = 0; i < nodes; ++i) {
+      data.push_back(v->Create("node" + std::to_string(i))->Open());
+    }
+
+    const auto seconds = MeasureOnce([&] {
+      std::vector<std::thread> threads;
+      for (size_t t = 0; t < concurrency; ++t) {
+        threads.emplace_back([&data, t, concurrency]() {
+          for (size_t i = t; i < ops; i += concurrency) {
+            auto& d = *data[i % data.size()];
+            if (i % 4) {
+              d.Read("key");
+            } else {
+              d.Write("key", static_cast<uint64_t>(i));
+            }
+          }
+        });
+      }
+
+      for (auto& thread : threads) {
+        thread.join();
+      }
+    });
+
+    return static_cast<double>(ops) / seconds;
+  };
+
+  for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+    ShardOptions options;
+    options.shards = threads;
+    const auto sharded = run(CreateShardedVolume(options), threads);
+    const auto locked = run(CreateVolume(), threads);
+    std::cout << "[ BENCH    ] " << threads << " threads: sharded " << sharded
+              << " ops/s, volume " << locked << " ops/s" << std::endl;
+  }
+}
+
+TEST(VolumeNodeData, ScalarReadVersusRead) {
+  const size_t keys = 100;
+  const size_t reads = 1000000;
+  auto d = MakeVolume(1, keys)->Find("child0")->Open();
+  std::vector<std::string> names;
+  for (size_t j = 0; j < keys; ++j) {
+    names.push_back("key" + std::to_string(j));
+  }
+
+  Report("read value", Measure(reads, [&](size_t i) {
+    d->Read(names[i % keys]);
+  }));
+  Report("read uint64_t", Measure(reads, [&](size_t i) {
+    d->Read<uint64_t>(names[i % keys]);
+  }));
+
+  /// readers contend with writer of other key of the same node
+  std::atomic<bool> done = false;
+  std::thread writer([&d, &done]() {
+    for (uint64_t i = 0; !done; ++i) {
+      d->Write("written", i);
+    }
+  });
+  Report("read value while writing", Measure(reads, [&](size_t i) {
+    d->Read(names[i % keys]);
+  }));
+  Report("read uint64_t while writing", Measure(reads, [&](size_t i) {
+    d->Read<uint64_t>(names[i % keys]);
+  }));
+  done = true;
+  writer.join();
+}
+
+TEST(AsyncSharedMutex, ReadContention) {
+  const size_t ops = 2000000;
+  const size_t max_threads =
+      std::max<size_t>(std::thread::hardware_concurrency(), 1);
+#if defined(JBKV_READER_BIASED_LOCKS)
+  std::cout << "[ BENCH    ] node locks are reader-biased" << std::endl;
+#endif
+
+  /// every thread reads under shared lock and every 1000th op writes, as
+  /// readers of VolumeNodeData in stresstest do
+  const auto run = [&](auto& mutex, size_t concurrency) {
+    uint64_t shared = 0;
+    /// keeps reads from being optimized away
+    std::atomic<uint64_t> checksum = 0;
+    const auto seconds = MeasureOnce([&] {
+      std::vector<std::thread> threads;
+      for (size_t t = 0; t < concurrency; ++t) {
+        threads.emplace_back([&mutex, &shared, &checksum, t, concurrency]() {
+          uint64_t sum = 0;
+          for (size_t i = t; i < ops; i += concurrency) {
+            if (i % 1000 == 0) {
+              std::lock_guard lock(mutex);
+              ++shared;
+            } else {
+              std::shared_lock lock(mutex);
+              sum += shared;
+            }
+          }
+
+          checksum += sum;
+        });
+      }
+
+      for (auto& thread : threads) {
+        thread.join();
+      }
+    });
+
+    return static_cast<double>(ops) / seconds;
+  };
+
+  for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+    std::shared_mutex standard;
+    AsyncSharedMutex node;
+    const auto standard_ops = run(standard, threads);
+    const auto node_ops = run(node, threads);
+    std::cout << "[ BENCH    ] " << threads << " threads: std::shared_mutex "
+              << standard_ops << " ops/s, node lock " << node_ops << " ops/s"
+              << std::endl;
+  }
+
+  /// reads of node data
+  auto v = MakeVolume(1, 100);
+  for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+    const auto seconds = MeasureOnce([&] {
+      std::vector<std::thread> workers;
+      for (size_t t = 0; t < threads; ++t) {
+        workers.emplace_back([&v, t, threads]() {
+          auto d = v->Find("child0")->Open();
+          for (size_t i = t; i < ops; i += threads) {
+            d->Read("key" + std::to_string(i % 100));
+          }
+        });
+      }
+
+      for (auto& worker : workers) {
+        worker.join();
+      }
+    });
+    std::cout << "[ BENCH    ] " << threads << " threads: node data reads "
+              << static_cast<double>(ops) / seconds << " ops/s" << std::endl;
+  }
+}
+
+TEST(Transaction, CommitVersusWrites) {
+  const size_t iterations = 200000;
+  auto v = MakeVolume(2, 100);
+  auto d1 = v->Find("child0")->Open();
+  auto d2 = v->Find("child1")->Open();
+
+  Report("two writes", Measure(iterations, [&](size_t i) {
+    d1->Write("key1", static_cast<uint64_t>(i));
+    d2->Write("key2", static_cast<uint64_t>(i));
+  }));
+  Report("transaction of two reads and two writes",
+         Measure(iterations, [&](size_t i) {
+           RunTransaction([&](Transaction& transaction) {
+             transaction.Read(d1, "key1");
+             transaction.Read(d2, "key2");
+             transaction.Write(d1, "key1", static_cast<uint64_t>(i));
+             transaction.Write(d2, "key2", static_cast<uint64_t>(i));
+           });
+         }));
+}
@@ -1,5 +1,16 @@
+#include "lib/async_file.h"
+#include "lib/lsm_tree.h"
+#include "lib/volume_node_impl.h"
 #include "lib/jbkv.h"
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <condition_variable>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <mutex>
+#include <random>
+#include <sstream>
 
 using namespace jbkv;
 
@@ -90,4 +101,870 @@ TEST(Volume, SaveUnexistingThrows) {
   EXPECT_THROW(Save(v, "some/unexsiting/path"), std::exception);
 }
 
-/// todo checksum test
+TEST(Volume, OpenSaved) {
+  auto v1 = CreateVolume();
+  v1->Open()->Write("root", "value");
+  v1->Create("c1")->Create("c11")->Open()->Write("name", 11);
+  v1->Create("c2")->Open()->Write("blob", Value::Blob{1, 2, 3});
+  v1->Create("c3");
+  Save(v1, "open.bin");
+
+  auto v2 = OpenVolume("open.bin");
+  EXPECT_EQ(v2->GetName(), v1->GetName());
+  EXPECT_EQ(v2->Open()->Read<Value::String>("root"), "value");
+  EXPECT_EQ(v2->Find("c1")->Find("c11")->Open()->Read<int>("name"), 11);
+  EXPECT_EQ(v2->Find("c2")->Open()->Read<Value::Blob>("blob"),
+            (Value::Blob{1, 2, 3}));
+  EXPECT_EQ(v2->Enumerate().size(), size_t(3));
+  EXPECT_FALSE(v2->Find("c4")->IsValid());
+}
+
+TEST(Volume, OpenSavedIsMutable) {
+  auto v1 = CreateVolume();
+  v1->Create("c1")->Open()->Write("name", 1);
+  Save(v1, "open_mutable.bin");
+
+  auto v2 = OpenVolume("open_mutable.bin");
+  v2->Find("c1")->Open()->Write("name", 2);
+  v2->Find("c1")->Create("c11")->Open()->Write("name", 11);
+  v2->Create("c2");
+  EXPECT_TRUE(v2->Unlink("c2"));
+
+  EXPECT_EQ(v2->Find("c1")->Open()->Read<int>("name"), 2);
+  EXPECT_EQ(v2->Find("c1")->Find("c11")->Open()->Read<int>("name"), 11);
+  EXPECT_FALSE(v2->Find("c2")->IsValid());
+
+  Save(v2, "open_mutable.bin");
+  auto v3 = CreateVolume();
+  Load(v3, "open_mutable.bin");
+  EXPECT_EQ(v3->Find("c1")->Find("c11")->Open()->Read<int>("name"), 11);
+}
+
+TEST(Volume, OpenUnexistingThrows) {
+  EXPECT_THROW(OpenVolume("some/unexsiting/path"), std::exception);
+}
+
+TEST(Volume, LoadSubtree) {
+  auto v1 = CreateVolume();
+  v1->Create("a")->Create("b")->Open()->Write("name", "b");
+  v1->Find("a")->Find("b")->Create("c")->Open()->Write("name", "c");
+  v1->Find("a")->Create("d")->Open()->Write("name", "d");
+  Save(v1, "subtree.bin");
+
+  auto v2 = CreateVolume();
+  LoadSubtree(v2, "subtree.bin", {"a", "b"});
+  EXPECT_EQ(v2->Open()->Read<Value::String>("name"), "b");
+  EXPECT_EQ(v2->Find("c")->Open()->Read<Value::String>("name"), "c");
+  EXPECT_EQ(v2->Enumerate().size(), size_t(1));
+
+  auto v3 = CreateVolume();
+  LoadSubtree(v3, "subtree.bin", {});
+  EXPECT_TRUE(v3->Find("a")->Find("d")->IsValid());
+
+  EXPECT_THROW(LoadSubtree(CreateVolume(), "subtree.bin", {"a", "x"}),
+               std::exception);
+}
+
+TEST(Volume, SaveParallelOpens) {
+  auto v1 = CreateVolume();
+  for (int i = 0; i < 20; ++i) {
+    auto child = v1->Create(std::to_string(i));
+    child->Create("leaf")->Open()->Write("name", i);
+  }
+
+  ThreadPool pool(4);
+  Save(v1, "parallel.bin", pool);
+
+  auto v2 = OpenVolume("parallel.bin");
+  EXPECT_EQ(v2->Enumerate().size(), size_t(20));
+  EXPECT_EQ(v2->Find("7")->Find("leaf")->Open()->Read<int>("name"), 7);
+
+  auto v3 = CreateVolume();
+  LoadSubtree(v3, "parallel.bin", {"13"});
+  EXPECT_EQ(v3->Find("leaf")->Open()->Read<int>("name"), 13);
+}
+
+TEST(Volume, LoadParallel) {
+  auto v1 = CreateVolume();
+  v1->Open()->Write("root", true);
+  for (int i = 0; i < 20; ++i) {
+    auto child = v1->Create(std::to_string(i));
+    for (int j = 0; j < 5; ++j) {
+      child->Create(std::to_string(j))->Open()->Write("name", i * 10 + j);
+    }
+  }
+
+  Save(v1, "parallel_load.bin");
+
+  ThreadPool pool(4);
+  auto v2 = CreateVolume();
+  v2->Create("3")->Create("extra");
+  Load(v2, "parallel_load.bin", pool);
+
+  EXPECT_EQ(v2->Open()->Read<bool>("root"), true);
+  EXPECT_EQ(v2->Enumerate().size(), size_t(20));
+  EXPECT_EQ(v2->Find("7")->Enumerate().size(), size_t(5));
+  EXPECT_EQ(v2->Find("7")->Find("4")->Open()->Read<int>("name"), 74);
+  EXPECT_EQ(v2->Find("3")->Enumerate().size(), size_t(6));
+  EXPECT_EQ(v2->Find("3")->Find("1")->Open()->Read<int>("name"), 31);
+
+  v2->Find("7")->Create("new")->Open()->Write("name", 1);
+  EXPECT_EQ(v2->Find("7")->Find("new")->Open()->Read<int>("name"), 1);
+}
+
+TEST(Volume, SaveCompressedOpens) {
+  auto v1 = CreateVolume();
+  v1->Open()->Write("root", true);
+  for (int i = 0; i < 20; ++i) {
+    auto child = v1->Create(std::to_string(i));
+    for (int j = 0; j < 5; ++j) {
+      child->Create(std::to_string(j))->Open()->Write("name", i * 10 + j);
+    }
+  }
+
+  Save(v1, "plain.bin");
+  Save(v1, "compressed.bin", *LzCodec());
+  EXPECT_LT(std::filesystem::file_size("compressed.bin"),
+            std::filesystem::file_size("plain.bin"));
+
+  auto v2 = CreateVolume();
+  Load(v2, "compressed.bin");
+  EXPECT_EQ(v2->Find("7")->Find("4")->Open()->Read<int>("name"), 74);
+
+  auto v3 = OpenVolume("compressed.bin");
+  EXPECT_EQ(v3->Open()->Read<bool>("root"), true);
+  EXPECT_EQ(v3->Find("3")->Find("1")->Open()->Read<int>("name"), 31);
+
+  auto v4 = CreateVolume();
+  LoadSubtree(v4, "compressed.bin", {"13"});
+  EXPECT_EQ(v4->Find("2")->Open()->Read<int>("name"), 132);
+
+  ThreadPool pool(4);
+  auto v5 = CreateVolume();
+  Load(v5, "compressed.bin", pool);
+  EXPECT_EQ(v5->Enumerate().size(), size_t(20));
+  EXPECT_EQ(v5->Find("19")->Find("0")->Open()->Read<int>("name"), 190);
+}
+
+TEST(Volume, CheckpointAsyncSavesPointInTimeView) {
+  auto v1 = CreateVolume();
+  for (int i = 0; i < 100; ++i) {
+    v1->Create(std::to_string(i))->Open()->Write("value", 0);
+  }
+
+  auto many = v1->Create("many")->Open();
+  for (int i = 0; i < 20; ++i) {
+    many->Write("old" + std::to_string(i), i);
+  }
+
+  auto done = CheckpointAsync(v1, "checkpoint_async.bin");
+  for (int i = 0; i < 100; ++i) {
+    v1->Find(std::to_string(i))->Open()->Write("value", 1);
+  }
+
+  for (int i = 0; i < 20; ++i) {
+    many->Write("old" + std::to_string(i), -i);
+    many->Write("new" + std::to_string(i), i);
+    many->Remove("old" + std::to_string(i));
+  }
+
+  v1->Unlink("5");
+  v1->Create("new")->Open()->Write("value", 1);
+  v1->Find("7")->Open()->Remove("value");
+  done.get();
+
+  auto v2 = CreateVolume();
+  Load(v2, "checkpoint_async.bin");
+  EXPECT_EQ(v2->Enumerate().size(), size_t(101));
+  EXPECT_FALSE(v2->Find("new")->IsValid());
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(v2->Find(std::to_string(i))->Open()->Read<int>("value"), 0);
+  }
+
+  const auto loaded = v2->Find("many")->Open();
+  EXPECT_EQ(loaded->Enumerate().size(), size_t(20));
+  for (int i = 0; i < 20; ++i) {
+    EXPECT_EQ(loaded->Read<int>("old" + std::to_string(i)), i);
+  }
+
+  /// the next checkpoint sees changes
+  CheckpointAsync(v1, "checkpoint_async.bin").get();
+  auto v3 = OpenVolume("checkpoint_async.bin");
+  EXPECT_FALSE(v3->Find("5")->IsValid());
+  EXPECT_EQ(v3->Find("new")->Open()->Read<int>("value"), 1);
+  EXPECT_FALSE(v3->Find("7")->Open()->Read<int>("value"));
+}
+
+TEST(Volume, CheckpointAsyncUntrackedThrows) {
+  Save(CreateVolume(), "checkpoint_untracked.bin");
+  EXPECT_THROW(CheckpointAsync(OpenVolume("checkpoint_untracked.bin"),
+                               "checkpoint_untracked.bin"),
+               std::exception);
+}
+
+/// @return true if a temporary file of sink writing to path is left
+bool HasTemporary(const std::string& path) {
+  for (const auto& entry : std::filesystem::directory_iterator(".")) {
+    const auto name = entry.path().filename().string();
+    if (name.starts_with(path + ".") && name.ends_with(".tmp")) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+TEST(Volume, FailedSaveKeepsPreviousFile) {
+  auto v1 = CreateVolume();
+  v1->Create("a")->Open()->Write("name", 1);
+  Save(v1, "failed_save.bin");
+
+  EXPECT_THROW(Save(nullptr, "failed_save.bin"), std::exception);
+  EXPECT_FALSE(HasTemporary("failed_save.bin"));
+
+  auto v2 = CreateVolume();
+  Load(v2, "failed_save.bin");
+  EXPECT_EQ(v2->Find("a")->Open()->Read<int>("name"), 1);
+}
+
+TEST(AsyncFile, RoundTripsThroughBackends) {
+  const size_t buffer_size = 4096;
+  std::vector<uint8_t> bytes(buffer_size * 5 + 123);
+  for (size_t i = 0; i < bytes.size(); ++i) {
+    bytes[i] = static_cast<uint8_t>(i * 7 + i / 251);
+  }
+
+  for (const bool io_uring : {true, false}) {
+    for (const bool direct : {false, true}) {
+      for (const size_t size :
+           {size_t(0), size_t(1), buffer_size, bytes.size()}) {
+        const io::AsyncFileOptions options{buffer_size, 2, direct, io_uring};
+        {
+          io::AsyncFileSink sink("async_file.bin", options);
+          // Parts straddle buffers
+          for (size_t pos = 0; pos < size; pos += 1000) {
+            const auto count = std::min<size_t>(1000, size - pos);
+            sink.Write({{bytes.data() + pos, count}});
+          }
+
+          sink.Commit();
+        }
+
+        ASSERT_EQ(std::filesystem::file_size("async_file.bin"), size);
+        io::AsyncFileSource source("async_file.bin", options);
+        std::vector<uint8_t> read(bytes.size());
+        uint64_t total = 0;
+        while (const auto count = source.Read(read.data() + total, 777)) {
+          total += count;
+        }
+
+        ASSERT_EQ(total, size) << source.Backend();
+        EXPECT_TRUE(std::equal(bytes.begin(), bytes.begin() + size,
+                               read.begin()))
+            << source.Backend() << (direct ? ", direct" : "");
+      }
+    }
+  }
+}
+
+TEST(AsyncFile, SavesAndLoadsDirect) {
+  auto v1 = CreateVolume();
+  v1->Open()->Write("root", "value");
+  const Value::Blob blob(std::vector<uint8_t>(10000, 7));
+  v1->Create("c1")->Open()->Write("blob", blob);
+  FileOptions options;
+  options.direct = true;
+  Save(v1, "async_direct.bin", options);
+
+  auto v2 = CreateVolume();
+  Load(v2, "async_direct.bin", options);
+  EXPECT_EQ(v2->Open()->Read<Value::String>("root"), "value");
+  EXPECT_EQ(v2->Find("c1")->Open()->Read<Value::Blob>("blob"), blob);
+  EXPECT_FALSE(HasTemporary("async_direct.bin"));
+}
+
+TEST(AsyncFile, UncommittedFileIsRemoved) {
+  {
+    io::AsyncFileSink sink("async_uncommitted.bin");
+    sink.Write({{"abc", 3}});
+  }
+
+  EXPECT_FALSE(std::filesystem::exists("async_uncommitted.bin"));
+  EXPECT_FALSE(HasTemporary("async_uncommitted.bin"));
+}
+
+TEST(AsyncFile, ConcurrentSinksDoNotInterleave) {
+  {
+    std::ofstream user("async_concurrent.bin.tmp");
+    user << "user";
+  }
+
+  const std::string first(100000, 'a');
+  const std::string second(100000, 'b');
+  {
+    io::AsyncFileSink lhs("async_concurrent.bin");
+    io::AsyncFileSink rhs("async_concurrent.bin");
+    for (size_t pos = 0; pos < first.size(); pos += 1000) {
+      lhs.Write({{first.data() + pos, 1000}});
+      rhs.Write({{second.data() + pos, 1000}});
+    }
+
+    lhs.Commit();
+    rhs.Commit();
+  }
+
+  std::ifstream stream("async_concurrent.bin");
+  std::stringstream contents;
+  contents << stream.rdbuf();
+  EXPECT_EQ(contents.str(), second);
+
+  std::ifstream user("async_concurrent.bin.tmp");
+  std::string word;
+  user >> word;
+  EXPECT_EQ(word, "user");
+  user.close();
+  std::filesystem::remove("async_concurrent.bin.tmp");
+  EXPECT_FALSE(HasTemporary("async_concurrent.bin"));
+}
+
+TEST(WriteAheadLog, ReplaysChanges) {
+  std::filesystem::remove("replay.log");
+  {
+    auto v = CreateVolume();
+    WriteAheadLog log(v, "replay.log");
+    v->Open()->Write("root", 1);
+    v->Create("a")->Create("b")->Open()->Write("name", Value::String{"b"});
+    v->Find("a")->Open()->Write("removed", true);
+    v->Find("a")->Open()->Remove("removed");
+    v->Open()->Update("root", 2);
+    v->Create("c")->Open()->Write("name", 3);
+    v->Unlink("c");
+
+    auto detached = v->Create("d");
+    v->Unlink("d");
+    detached->Open()->Write("lost", true);
+  }
+
+  auto v = CreateVolume();
+  WriteAheadLog log(v, "replay.log");
+  EXPECT_EQ(v->Open()->Read<int>("root"), 2);
+  EXPECT_EQ(v->Find("a")->Find("b")->Open()->Read<Value::String>("name"),
+            "b");
+  EXPECT_FALSE(v->Find("a")->Open()->Read("removed"));
+  EXPECT_FALSE(v->Find("c")->IsValid());
+  EXPECT_FALSE(v->Find("d")->IsValid());
+  EXPECT_THROW(WriteAheadLog(v, "other.log"), std::exception);
+}
+
+TEST(WriteAheadLog, ReplaysParallelLoad) {
+  std::filesystem::remove("replay_load.log");
+  auto saved = CreateVolume();
+  saved->Open()->Write("root", 1);
+  saved->Create("a")->Create("b")->Open()->Write("k", 7);
+  Save(saved, "replay_load.bin");
+  {
+    auto v = CreateVolume();
+    WriteAheadLog log(v, "replay_load.log");
+    ThreadPool pool(2);
+    Load(v, "replay_load.bin", pool);
+    EXPECT_EQ(v->Find("a")->Find("b")->Open()->Read<int>("k"), 7);
+  }
+
+  auto v = CreateVolume();
+  WriteAheadLog log(v, "replay_load.log");
+  EXPECT_EQ(v->Open()->Read<int>("root"), 1);
+  EXPECT_EQ(v->Find("a")->Find("b")->Open()->Read<int>("k"), 7);
+}
+
+TEST(WriteAheadLog, DropsTornRecord) {
+  std::filesystem::remove("torn.log");
+  {
+    auto v = CreateVolume();
+    WriteAheadLog log(v, "torn.log");
+    v->Open()->Write("first", 1);
+    v->Open()->Write("second", 2);
+  }
+
+  std::filesystem::resize_file("torn.log",
+                               std::filesystem::file_size("torn.log") - 3);
+  {
+    auto v = CreateVolume();
+    WriteAheadLog log(v, "torn.log");
+    EXPECT_EQ(v->Open()->Read<int>("first"), 1);
+    EXPECT_FALSE(v->Open()->Read("second"));
+    v->Open()->Write("third", 3);
+  }
+
+  auto v = CreateVolume();
+  WriteAheadLog log(v, "torn.log");
+  EXPECT_EQ(v->Open()->Read<int>("first"), 1);
+  EXPECT_EQ(v->Open()->Read<int>("third"), 3);
+}
+
+TEST(WriteAheadLog, CheckpointTruncatesLog) {
+  std::filesystem::remove("checkpoint.log");
+  {
+    auto v = CreateVolume();
+    WriteAheadLog log(v, "checkpoint.log");
+    for (int i = 0; i < 100; ++i) {
+      v->Create(std::to_string(i))->Open()->Write("name", i);
+    }
+
+    const auto size = std::filesystem::file_size("checkpoint.log");
+    log.Checkpoint("checkpoint.bin");
+    EXPECT_LT(std::filesystem::file_size("checkpoint.log"), size);
+    v->Find("5")->Open()->Write("after", true);
+  }
+
+  auto v = CreateVolume();
+  Load(v, "checkpoint.bin");
+  WriteAheadLog log(v, "checkpoint.log");
+  EXPECT_EQ(v->Enumerate().size(), size_t(100));
+  EXPECT_EQ(v->Find("7")->Open()->Read<int>("name"), 7);
+  EXPECT_EQ(v->Find("5")->Open()->Read<bool>("after"), true);
+}
+
+TEST(WriteAheadLog, UntrackedVolumeThrows) {
+  EXPECT_THROW(WriteAheadLog(Freeze(CreateVolume()), "untracked.log"),
+               std::exception);
+}
+
+LsmOptions SmallLsmOptions() {
+  LsmOptions options;
+  options.memtable_size = 4 << 10;
+  options.level0_segments = 2;
+  options.level1_size = 16 << 10;
+  options.level_ratio = 2;
+  options.segment_size = 8 << 10;
+  options.sync = false;
+  return options;
+}
+
+TEST(LsmTree, FlushesAndCompacts) {
+  std::filesystem::remove_all("lsm_tree");
+  auto key = [](int i) {
+    auto result = std::to_string(i);
+    result.insert(0, 5 - result.size(), '0');
+    return result;
+  };
+
+  {
+    lsm::Tree tree("lsm_tree", SmallLsmOptions());
+    for (int i = 0; i < 3000; ++i) {
+      tree.Write([&](lsm::Batch& batch) {
+        batch.Put(key(i), std::string(20, 'a' + i % 26));
+        if (i % 3 == 0) {
+          batch.Remove(key(i / 2));
+        }
+      });
+    }
+
+    tree.Flush();
+    const auto levels = tree.Levels();
+    EXPECT_LT(levels[0], size_t(2));
+    EXPECT_GT(levels[1] + levels[2] + levels[3], size_t(1));
+  }
+
+  lsm::Tree tree("lsm_tree", SmallLsmOptions());
+  EXPECT_EQ(tree.Get(key(2999)), std::string(20, 'a' + 2999 % 26));
+  EXPECT_FALSE(tree.Get(key(499)));
+  EXPECT_EQ(tree.Get(key(1999)), std::string(20, 'a' + 1999 % 26));
+
+  std::vector<std::string> keys;
+  tree.Scan("029", [&keys](std::string_view key, std::string_view) {
+    keys.emplace_back(key);
+    return true;
+  });
+  EXPECT_TRUE(std::is_sorted(keys.begin(), keys.end()));
+  EXPECT_EQ(keys.size(), size_t(100));
+}
+
+TEST(LsmVolume, PersistsAcrossReopen) {
+  std::filesystem::remove_all("lsm_volume");
+  {
+    auto v = OpenLsmVolume("lsm_volume", SmallLsmOptions());
+    v->Open()->Write("root", 1);
+    for (int i = 0; i < 300; ++i) {
+      auto node = v->Create(std::to_string(i));
+      node->Open()->Write("name", Value::String{std::to_string(i)});
+      node->Create("child")->Open()->Write("num", i);
+    }
+
+    v->Open()->Update("root", 2);
+    v->Find("7")->Open()->Remove("name");
+    EXPECT_FALSE(v->Find("7")->Open()->Update("name", 1));
+    EXPECT_TRUE(v->Unlink("8"));
+    EXPECT_FALSE(v->Unlink("8"));
+  }
+
+  auto v = OpenLsmVolume("lsm_volume", SmallLsmOptions());
+  EXPECT_EQ(v->Open()->Read<int>("root"), 2);
+  EXPECT_EQ(v->Enumerate().size(), size_t(299));
+  EXPECT_EQ(v->Find("42")->Open()->Read<Value::String>("name"), "42");
+  EXPECT_EQ(v->Find("42")->Find("child")->Open()->Read<int>("num"), 42);
+  EXPECT_FALSE(v->Find("7")->Open()->Read("name"));
+  EXPECT_FALSE(v->Find("8")->IsValid());
+
+  v->Create("8")->Open()->Write("again", true);
+  EXPECT_EQ(v->Find("8")->Open()->Enumerate().size(), size_t(1));
+  EXPECT_FALSE(v->Find("8")->Find("child")->IsValid());
+}
+
+TEST(LsmVolume, UnlinkRemovesSubtree) {
+  std::filesystem::remove_all("lsm_unlink");
+  auto v = OpenLsmVolume("lsm_unlink", SmallLsmOptions());
+  auto a = v->Create("a");
+  auto b = a->Create("b");
+  b->Open()->Write("num", 1);
+  a->Open()->Write("num", 2);
+  v->Create("c")->Open()->Write("num", 3);
+
+  EXPECT_TRUE(v->Unlink("a"));
+  EXPECT_FALSE(v->Find("a")->IsValid());
+  EXPECT_FALSE(b->Open()->Read("num"));
+  EXPECT_TRUE(a->Enumerate().empty());
+  EXPECT_EQ(v->Find("c")->Open()->Read<int>("num"), 3);
+}
+
+TEST(LsmVolume, StaleNodesOfUnlinkedSubtreeWriteNothing) {
+  std::filesystem::remove_all("lsm_stale");
+  {
+    auto v = OpenLsmVolume("lsm_stale", SmallLsmOptions());
+    auto a = v->Create("a");
+    auto b = a->Create("b");
+    auto data = b->Open();
+    v->Create("c")->Open()->Write("num", 3);
+    EXPECT_TRUE(v->Unlink("a"));
+
+    data->Write("num", 1);
+    a->Open()->Write("num", 2);
+    EXPECT_FALSE(a->Create("d")->IsValid());
+    EXPECT_FALSE(b->Create("e")->IsValid());
+    EXPECT_FALSE(data->Update("num", 4));
+    EXPECT_FALSE(data->Read("num"));
+
+    /// a node linked again under the same name is not stale
+    v->Create("a")->Open()->Write("num", 5);
+    EXPECT_EQ(v->Find("a")->Open()->Read<int>("num"), 5);
+    EXPECT_TRUE(v->Unlink("a"));
+  }
+
+  /// only next id, record of c in root and data of c are left
+  lsm::Tree tree("lsm_stale", SmallLsmOptions());
+  size_t records = 0;
+  tree.Scan("", [&records](std::string_view, std::string_view) {
+    ++records;
+    return true;
+  });
+  EXPECT_EQ(records, size_t(3));
+}
+
+TEST(LsmVolume, MountsAsStorage) {
+  std::filesystem::remove_all("lsm_storage");
+  auto lower = Freeze(CreateVolume());
+  {
+    auto s = MountStorage({lower, OpenLsmVolume("lsm_storage")});
+    s->Create("state")->Open()->Write("count", 10);
+  }
+
+  auto s = MountStorage({lower, OpenLsmVolume("lsm_storage")});
+  EXPECT_EQ(s->Find("state")->Open()->Read<int>("count"), 10);
+  s->Find("state")->Open()->Update("count", 11);
+  EXPECT_EQ(s->Find("state")->Open()->Read<int>("count"), 11);
+}
+
+TEST(SpillingVolume, SpillsAndReloadsColdSubtrees) {
+  std::filesystem::remove_all("spill");
+  SpillOptions options;
+  options.directory = "spill";
+  options.memory_budget = 64 << 10;
+  options.interval = std::chrono::milliseconds(0);
+  auto v = CreateSpillingVolume(options);
+  const std::string payload(100, 'x');
+  for (int i = 0; i < 20; ++i) {
+    auto node = v->Create(std::to_string(i))->Create("child");
+    for (int j = 0; j < 100; ++j) {
+      node->Open()->Write(std::to_string(j),
+                          Value::String{std::string(payload)});
+    }
+  }
+
+  EXPECT_GT(SpillCold(v), size_t(10));
+  EXPECT_FALSE(std::filesystem::is_empty("spill"));
+  EXPECT_EQ(SpillCold(v), size_t(0));
+
+  v->Find("3")->Find("child")->Open()->Write("changed", 1);
+  for (int i = 0; i < 20; ++i) {
+    auto data = v->Find(std::to_string(i))->Find("child")->Open();
+    EXPECT_EQ(data->Read<Value::String>("99"), payload);
+  }
+
+  SpillCold(v);
+  EXPECT_EQ(v->Find("3")->Find("child")->Open()->Read<int>("changed"), 1);
+
+  EXPECT_TRUE(v->Unlink("0"));
+  EXPECT_EQ(v->Enumerate().size(), size_t(19));
+  v.reset();
+  EXPECT_TRUE(std::filesystem::is_empty("spill"));
+}
+
+TEST(SpillingVolume, KeepsReferencedSubtreeAndSaves) {
+  std::filesystem::remove_all("spill_save");
+  SpillOptions options;
+  options.directory = "spill_save";
+  options.memory_budget = 0;
+  auto v = CreateSpillingVolume(options);
+  v->Open()->Write("root", 1);
+  v->Create("a")->Create("b")->Open()->Write("num", 2);
+  EXPECT_EQ(SpillCold(v), size_t(1));
+
+  /// node held outside of volume keeps its subtree resident
+  auto pinned = v->Find("a")->Find("b");
+  EXPECT_EQ(SpillCold(v), size_t(0));
+  pinned->Open()->Write("pinned", true);
+  pinned.reset();
+  EXPECT_EQ(SpillCold(v), size_t(1));
+  EXPECT_EQ(v->Find("a")->Find("b")->Open()->Read<bool>("pinned"), true);
+
+  Save(v, "spill_save.bin");
+  auto loaded = CreateVolume();
+  Load(loaded, "spill_save.bin");
+  EXPECT_EQ(loaded->Open()->Read<int>("root"), 1);
+  EXPECT_EQ(loaded->Find("a")->Find("b")->Open()->Read<int>("num"), 2);
+}
+
+TEST(ShardedVolume, SavesLoadsAndMounts) {
+  ShardOptions options;
+  options.shards = 4;
+  auto v = CreateShardedVolume(options);
+  for (int i = 0; i < 20; ++i) {
+    auto child = v->Create(std::to_string(i));
+    for (int j = 0; j < 5; ++j) {
+      child->Create(std::to_string(j))->Open()->Write("name", i * 10 + j);
+    }
+  }
+
+  std::stringstream stream;
+  Save(v, stream);
+  auto v2 = CreateShardedVolume(options);
+  Load(v2, stream);
+  EXPECT_EQ(v2->Enumerate().size(), size_t(20));
+  EXPECT_EQ(v2->Find("7")->Find("4")->Open()->Read<int>("name"), 74);
+
+  auto top = CreateVolume();
+  top->Create("7")->Open()->Write("top", true);
+  auto s = MountStorage({v2, top});
+  EXPECT_EQ(s->Find("7")->Find("4")->Open()->Read<int>("name"), 74);
+  EXPECT_EQ(s->Find("7")->Open()->Read<bool>("top"), true);
+}
+
+TEST(VolumeBuilder, BuildsUnsortedEntries) {
+  std::vector<std::pair<VolumeNode::Path, int>> entries;
+  for (int i = 0; i < 10; ++i) {
+    for (int j = 0; j < 10; ++j) {
+      entries.push_back({{std::to_string(i), std::to_string(j)}, i * 10 + j});
+    }
+  }
+
+  std::shuffle(entries.begin(), entries.end(), std::mt19937(42));
+  VolumeBuilder builder;
+  for (const auto& [path, value] : entries) {
+    builder.Add(path, "name", value);
+    builder.Add({path.front()}, std::to_string(value % 10), value);
+  }
+
+  builder.AddNode({"empty", "leaf"});
+  auto v = builder.Build();
+  EXPECT_EQ(v->Enumerate().size(), size_t(11));
+  EXPECT_EQ(v->Find("7")->Enumerate().size(), size_t(10));
+  EXPECT_EQ(v->Find("7")->Find("4")->Open()->Read<int>("name"), 74);
+  EXPECT_EQ(v->Find("7")->Open()->Enumerate().size(), size_t(10));
+  EXPECT_EQ(v->Find("3")->Open()->Read<int>("5"), 35);
+  EXPECT_TRUE(v->Find("empty")->Find("leaf")->IsValid());
+
+  /// built volume is regular tracked volume
+  const auto generation = AdvanceGeneration(v);
+  v->Find("7")->Create("new")->Open()->Write("name", 1);
+  std::stringstream delta;
+  SaveDelta(v, delta, generation);
+  auto v2 = CreateVolume();
+  Load(v2, delta);
+  EXPECT_EQ(v2->Enumerate().size(), size_t(1));
+  EXPECT_EQ(v2->Find("7")->Find("new")->Open()->Read<int>("name"), 1);
+
+  /// builder starts over after build
+  builder.Add({"other"}, "key", 1);
+  auto v3 = builder.Build();
+  EXPECT_EQ(v3->Enumerate().size(), size_t(1));
+  EXPECT_EQ(v->Enumerate().size(), size_t(11));
+}
+
+namespace {
+
+/// Journal blocking changes until released, so writer holds node lock
+class BlockingJournal final : public ChangeJournal {
+ public:
+  uint64_t Append(const Change&) override {
+    std::unique_lock lock(mutex_);
+    entered_ = true;
+    changed_.notify_all();
+    changed_.wait(lock, [this]() { return released_; });
+    return 0;
+  }
+
+  void Commit(uint64_t) override {
+  }
+
+  void WaitEntered() {
+    std::unique_lock lock(mutex_);
+    changed_.wait(lock, [this]() { return entered_; });
+  }
+
+  void Release() {
+    std::lock_guard lock(mutex_);
+    released_ = true;
+    changed_.notify_all();
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable changed_;
+  bool entered_ = false;
+  bool released_ = false;
+};
+}  // namespace
+
+TEST(Async, ContendedReadDoesNotBlockExecutor) {
+  auto v = CreateVolume();
+  auto d = v->Open();
+  d->Write("num", 1);
+  auto journal = std::make_shared<BlockingJournal>();
+  std::static_pointer_cast<VolumeNodeImpl>(v)->Tracker()->SetJournal(journal);
+  auto writer = std::async(std::launch::async, [&d]() {
+    d->Write("num", 2);
+  });
+  journal->WaitEntered();
+
+  ThreadPool pool(1);
+  PoolExecutor executor(pool);
+  auto reader = std::async(std::launch::async, [&d, &executor]() {
+    return SyncWait([](NodeData& data, Executor& executor)
+                        -> Task<std::optional<Value>> {
+      co_await ScheduleOn(executor);
+      co_return co_await data.AsyncRead("num", executor);
+    }(*d, executor));
+  });
+
+  /// the only thread of executor keeps running while read waits for lock
+  for (int i = 0; i < 10; ++i) {
+    std::promise<void> ran;
+    pool.Submit([&ran]() { ran.set_value(); });
+    ran.get_future().get();
+  }
+
+  EXPECT_EQ(reader.wait_for(std::chrono::milliseconds(10)),
+            std::future_status::timeout);
+  journal->Release();
+  writer.get();
+  EXPECT_EQ(*reader.get()->Try<int32_t>(), 2);
+}
+
+TEST(Async, ContendedStorageOpsDoNotBlockExecutor) {
+  auto v = CreateVolume();
+  v->Open()->Write("num", 1);
+  auto s = MountStorage({v});
+  auto tracker = std::static_pointer_cast<VolumeNodeImpl>(v)->Tracker();
+  ThreadPool pool(1);
+  PoolExecutor executor(pool);
+  auto expect_executor_runs = [&pool]() {
+    for (int i = 0; i < 10; ++i) {
+      std::promise<void> ran;
+      pool.Submit([&ran]() { ran.set_value(); });
+      ran.get_future().get();
+    }
+  };
+
+  /// write of storage data waits for lock of layer data
+  auto journal = std::make_shared<BlockingJournal>();
+  tracker->SetJournal(journal);
+  auto writer = std::async(std::launch::async, [&v]() {
+    v->Open()->Write("num", 2);
+  });
+  journal->WaitEntered();
+
+  auto async_writer = std::async(std::launch::async, [&s, &executor]() {
+    SyncWait([](NodeData& data, Executor& executor) -> Task<> {
+      co_await ScheduleOn(executor);
+      co_await data.AsyncWrite("num", Value(Value::Data(3)), executor);
+    }(*s->Open(), executor));
+  });
+
+  expect_executor_runs();
+  EXPECT_EQ(async_writer.wait_for(std::chrono::milliseconds(10)),
+            std::future_status::timeout);
+  journal->Release();
+  writer.get();
+  async_writer.get();
+  EXPECT_EQ(v->Open()->Read<int32_t>("num"), 3);
+
+  /// find in storage node waits for lock of layer node
+  journal = std::make_shared<BlockingJournal>();
+  tracker->SetJournal(journal);
+  auto creator = std::async(std::launch::async, [&v]() {
+    v->Create("child");
+  });
+  journal->WaitEntered();
+
+  auto finder = std::async(std::launch::async, [&s, &executor]() {
+    return SyncWait([](StorageNode& node, Executor& executor)
+                        -> Task<StorageNode::Ptr> {
+      co_await ScheduleOn(executor);
+      co_return co_await node.AsyncFind("child", executor);
+    }(*s, executor));
+  });
+
+  expect_executor_runs();
+  EXPECT_EQ(finder.wait_for(std::chrono::milliseconds(10)),
+            std::future_status::timeout);
+  journal->Release();
+  creator.get();
+  EXPECT_TRUE(finder.get()->IsValid());
+  tracker->SetJournal(nullptr);
+}
+
+TEST(Async, SavesVolume) {
+  auto v = CreateVolume();
+  v->Create("c1")->Open()->Write("num", 1);
+  SyncWait(AsyncSave(v, "async_save.bin"));
+
+  auto v2 = CreateVolume();
+  Load(v2, "async_save.bin");
+  EXPECT_EQ(v2->Find("c1")->Open()->Read<int>("num"), 1);
+  EXPECT_THROW(SyncWait(AsyncSave(nullptr, "async_save.bin")),
+               std::exception);
+  std::filesystem::remove("async_save.bin");
+}
+
+TEST(Volume, CorruptedDataThrows) {
+  auto v1 = CreateVolume();
+  v1->Create("a")->Open()->Write("name", Value::String{"0123456789"});
+  Save(v1, "corrupted.bin");
+
+  std::string bytes;
+  {
+    std::ifstream in("corrupted.bin", std::ios_base::binary);
+    bytes.assign(std::istreambuf_iterator<char>(in), {});
+  }
+
+  const auto pos = bytes.find("0123456789");
+  ASSERT_NE(pos, std::string::npos);
+  bytes[pos + 5] ^= 0x10;
+  {
+    std::ofstream out("corrupted.bin", std::ios_base::binary);
+    out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+  }
+
+  EXPECT_THROW(Load(CreateVolume(), "corrupted.bin"), std::exception);
+  auto v2 = OpenVolume("corrupted.bin");
+  EXPECT_THROW(v2->Find("a")->Open(), std::exception);
+}
@@ -1,5 +1,11 @@
+#include "lib/async_mutex.h"
 #include "lib/jbkv.h"
 #include <gtest/gtest.h>
+#include <atomic>
+#include <cmath>
+#include <filesystem>
+#include <mutex>
+#include <shared_mutex>
 #include <thread>
 
 using namespace jbkv;
@@ -34,6 +40,198 @@ TEST(VolumeNodeData, ReadWriteConcurrently) {
   EXPECT_TRUE(v->Open()->Enumerate().empty());
 }
 
+TEST(AsyncSharedMutex, ReadersExcludeWriters) {
+  const size_t concurrency = 8;
+  const size_t iterations = 20000;
+
+  AsyncSharedMutex mutex;
+  /// writers keep both counters equal while they hold lock
+  size_t first = 0;
+  size_t second = 0;
+  std::vector<std::thread> threads;
+  threads.reserve(concurrency);
+  for (size_t i = 0; i < concurrency; ++i) {
+    threads.emplace_back([&, i]() {
+      for (size_t j = 0; j < iterations; ++j) {
+        if ((i + j) % 16 == 0) {
+          std::lock_guard lock(mutex);
+          ++first;
+          ++second;
+        } else if (j % 64 == 0 && mutex.try_lock()) {
+          ++first;
+          ++second;
+          mutex.unlock();
+        } else {
+          std::shared_lock lock(mutex);
+          EXPECT_EQ(first, second);
+        }
+      }
+    });
+  }
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  EXPECT_EQ(first, second);
+  EXPECT_GE(first, concurrency * iterations / 16);
+}
+
+TEST(VolumeNodeData, ScalarReadsAreNotTorn) {
+  const size_t readers = 8;
+  const uint64_t iterations = 200000;
+
+  auto d = CreateVolume()->Open();
+  d->Write("gauge", uint64_t(0));
+  std::atomic<bool> done = false;
+  std::vector<std::thread> threads;
+  threads.reserve(readers + 1);
+  /// even values are written as uint64_t and odd ones as double, torn read
+  /// would pair type with bits of other one and yield odd or huge number
+  threads.emplace_back([&d, &done]() {
+    for (uint64_t i = 1; i < iterations; ++i) {
+      if (i % 2) {
+        d->Write("gauge", static_cast<double>(i));
+      } else {
+        d->Write("gauge", i);
+      }
+
+      d->Write("key" + std::to_string(i % 1000), i);
+    }
+
+    done = true;
+  });
+
+  for (size_t i = 0; i < readers; ++i) {
+    threads.emplace_back([&d, &done, iterations]() {
+      while (!done) {
+        if (const auto value = d->Read<uint64_t>("gauge")) {
+          EXPECT_LT(*value, iterations);
+          EXPECT_EQ(*value % 2, uint64_t(0));
+        }
+
+        if (const auto value = d->Read<double>("gauge")) {
+          EXPECT_EQ(std::fmod(*value, 2.0), 1.0);
+        }
+
+        d->Read<uint64_t>("key999");
+      }
+    });
+  }
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  EXPECT_EQ(d->Read<uint64_t>("key999"), iterations - 1);
+}
+
+TEST(Transaction, TransfersKeepTotal) {
+  const size_t accounts = 8;
+  const size_t concurrency = 8;
+  const size_t iterations = 2000;
+  const int64_t initial = 1000;
+
+  /// odd accounts are reached through storage node over their volume
+  std::vector<NodeData::Ptr> data;
+  for (size_t i = 0; i < accounts; ++i) {
+    auto v = CreateVolume();
+    v->Open()->Write("amount", initial);
+    data.push_back(i % 2 ? MountStorage({CreateVolume(), v})->Open()
+                         : v->Open());
+  }
+
+  std::vector<std::thread> threads;
+  threads.reserve(concurrency);
+  for (size_t i = 0; i < concurrency; ++i) {
+    threads.emplace_back([&data, i]() {
+      for (size_t j = 0; j < iterations; ++j) {
+        const auto& from = data[(i + j) % accounts];
+        const auto& to = data[(i * 3 + j * 7 + 1) % accounts];
+        if (j % 4 == 0) {
+          int64_t total = 0;
+          RunTransaction([&](Transaction& transaction) {
+            total = 0;
+            for (const auto& account : data) {
+              total += *transaction.Read<int64_t>(account, "amount");
+            }
+          });
+          EXPECT_EQ(total, initial * static_cast<int64_t>(accounts));
+        } else if (from != to) {
+          RunTransaction([&](Transaction& transaction) {
+            const auto amount = *transaction.Read<int64_t>(from, "amount");
+            transaction.Write(from, "amount", amount - 1);
+            transaction.Write(to, "amount",
+                              *transaction.Read<int64_t>(to, "amount") + 1);
+          });
+        }
+
+        /// changes outside of transactions make them retry
+        from->Write("other", j);
+      }
+    });
+  }
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  int64_t total = 0;
+  for (const auto& account : data) {
+    total += *account->Read<int64_t>("amount");
+  }
+
+  EXPECT_EQ(total, initial * static_cast<int64_t>(accounts));
+}
+
+TEST(VolumeNodeData, AsyncAndBlockingConcurrently) {
+  const size_t concurrency = 16;
+  const size_t iterations = 2000;
+
+  ThreadPool pool(4);
+  PoolExecutor executor(pool);
+  auto v = CreateVolume();
+  v->Create("child");
+  auto d = v->Open();
+  auto run = [&](size_t i) -> Task<> {
+    co_await ScheduleOn(executor);
+    const auto key = "async" + std::to_string(i);
+    for (size_t j = 0; j < iterations; ++j) {
+      co_await d->AsyncWrite(key, Value(Value::Data(j)), executor);
+      const auto value = co_await d->AsyncRead(key, executor);
+      EXPECT_EQ(*value->Try<size_t>(), j);
+      const auto child = co_await v->AsyncFind("child", executor);
+      EXPECT_TRUE(child->IsValid());
+    }
+  };
+
+  std::vector<std::thread> threads;
+  threads.reserve(concurrency * 2);
+  for (size_t i = 0; i < concurrency; ++i) {
+    threads.emplace_back([&run, i]() {
+      SyncWait(run(i));
+    });
+    threads.emplace_back([&d, &v, i]() {
+      const auto key = "sync" + std::to_string(i);
+      for (size_t j = 0; j < iterations; ++j) {
+        d->Write(key, j);
+        EXPECT_EQ(d->Read<size_t>(key), j);
+        d->Enumerate();
+        v->Create("child" + std::to_string(j % 5));
+      }
+    });
+  }
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  EXPECT_EQ(d->Enumerate().size(), concurrency * 2);
+  for (const auto& [_, value] : d->Enumerate()) {
+    EXPECT_EQ(*value.Try<size_t>(), iterations - 1);
+  }
+}
+
 TEST(VolumeNodeHierarchy, ModifiesConcurrently) {
   const size_t concurrency = 50;
   const size_t iterations = 1000;
@@ -65,6 +263,44 @@ TEST(VolumeNodeHierarchy, ModifiesConcurrently) {
   EXPECT_TRUE(v->Enumerate().empty());
 }
 
+TEST(ShardedVolume, ModifiesConcurrently) {
+  const size_t concurrency = 16;
+  const size_t iterations = 2000;
+
+  ShardOptions options;
+  options.shards = 4;
+  auto v = CreateShardedVolume(options);
+  std::vector<std::thread> threads;
+  threads.reserve(concurrency);
+  for (size_t i = 0; i < concurrency; ++i) {
+    threads.emplace_back([&v, i]() {
+      auto own = v->Create("own" + std::to_string(i))->Open();
+      for (size_t j = 0; j < iterations; ++j) {
+        const auto name = std::to_string(j % 5);
+        own->Write(name, j);
+        EXPECT_EQ(own->Read<size_t>(name), j);
+
+        v->Create(name)->Create(name)->Open()->Write("num", j);
+        auto node = v->Find(name);
+        if (node->IsValid()) {
+          node->Open()->Read("num");
+          node->Enumerate();
+          node->Unlink(name);
+        }
+
+        v->Unlink(name);
+      }
+    });
+  }
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  EXPECT_EQ(v->Enumerate().size(), concurrency);
+  EXPECT_EQ(v->Find("own0")->Open()->Read<size_t>("4"), iterations - 1);
+}
+
 TEST(StorageNodeData, ReadWriteConcurrently) {
   const size_t concurrency = 50;
   const size_t iterations = 1000;
@@ -169,3 +405,300 @@ TEST(StorageNodeHierarchy, MountsConcurrently) {
 
   EXPECT_TRUE(s->Enumerate().empty());
 }
+
+TEST(StorageNodeHierarchy, ProbesAndMountsConcurrently) {
+  const size_t concurrency = 30;
+  const size_t iterations = 1000;
+
+  auto v = CreateVolume();
+  v->Create("a")->Create("b");
+  auto s = MountStorage(v);
+  std::vector<std::thread> threads;
+  threads.reserve(concurrency);
+  for (size_t i = 0; i < concurrency; ++i) {
+    threads.emplace_back([i, &s]() {
+      for (size_t j = 0; j < iterations; ++j) {
+        const auto name = std::to_string(j % 7);
+        auto a = s->Find("a");
+        a->Find(name);
+        a->Find("b")->Find(name);
+        if (i % 3 == 0) {
+          auto m = a->Find("b")->Mount(CreateVolume());
+          m->Create(name);
+          a->Find("b")->Find(name);
+          s->Enumerate();
+        }
+      }
+    });
+  }
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  EXPECT_EQ(s->Enumerate().size(), size_t(1));
+  EXPECT_TRUE(s->Find("a")->Find("b")->Enumerate().empty());
+}
+
+TEST(WriteAheadLog, WritesConcurrently) {
+  const size_t concurrency = 16;
+  const size_t iterations = 200;
+
+  std::filesystem::remove("stress.log");
+  {
+    auto v = CreateVolume();
+    WriteAheadLog log(v, "stress.log");
+    std::vector<std::thread> threads;
+    threads.reserve(concurrency);
+    for (size_t i = 0; i < concurrency; ++i) {
+      threads.emplace_back([&v, i]() {
+        auto d = v->Create(std::to_string(i))->Open();
+        for (size_t j = 0; j < iterations; ++j) {
+          d->Write(std::to_string(j), j);
+        }
+      });
+    }
+
+    for (auto& thread : threads) {
+      thread.join();
+    }
+  }
+
+  auto v = CreateVolume();
+  WriteAheadLog log(v, "stress.log");
+  EXPECT_EQ(v->Enumerate().size(), concurrency);
+  for (size_t i = 0; i < concurrency; ++i) {
+    EXPECT_EQ(v->Find(std::to_string(i))->Open()->Enumerate().size(),
+              iterations);
+  }
+}
+
+TEST(WriteAheadLog, UnlinksWhileWriting) {
+  const size_t rounds = 100;
+  const size_t writers = 4;
+  const size_t iterations = 100;
+
+  std::filesystem::remove("stress.log");
+  {
+    auto v = CreateVolume();
+    WriteAheadLog log(v, "stress.log");
+    for (size_t round = 0; round < rounds; ++round) {
+      auto d = v->Create("a")->Create("x")->Open();
+      std::atomic<size_t> started = 0;
+      std::vector<std::thread> threads;
+      for (size_t i = 0; i < writers; ++i) {
+        threads.emplace_back([&d, &started, i]() {
+          ++started;
+          for (size_t j = 0; j < iterations; ++j) {
+            d->Write(std::to_string(i), j);
+          }
+        });
+      }
+
+      while (started < writers) {
+        std::this_thread::yield();
+      }
+
+      EXPECT_TRUE(v->Unlink("a"));
+      for (auto& thread : threads) {
+        thread.join();
+      }
+    }
+
+    EXPECT_TRUE(v->Enumerate().empty());
+  }
+
+  /// writes journaled after unlink would create unlinked node again
+  auto v = CreateVolume();
+  WriteAheadLog log(v, "stress.log");
+  EXPECT_TRUE(v->Enumerate().empty());
+}
+
+TEST(Volume, CheckpointsWhileWriting) {
+  const size_t nodes = 2000;
+  const size_t checkpoints = 20;
+
+  auto v = CreateVolume();
+  for (size_t i = 0; i < nodes; ++i) {
+    v->Create(std::to_string(i))->Open()->Write("round", uint64_t(0));
+  }
+
+  /// writer stamps nodes with rounds in order, so any point-in-time view has
+  /// round r + 1 in a prefix of nodes and round r in the rest of them
+  std::atomic<bool> stop = false;
+  std::thread writer([&]() {
+    for (uint64_t round = 1; !stop; ++round) {
+      for (size_t i = 0; i < nodes; ++i) {
+        v->Find(std::to_string(i))->Open()->Write("round", round);
+      }
+    }
+  });
+
+  for (size_t c = 0; c < checkpoints; ++c) {
+    CheckpointAsync(v, "stress_checkpoint.bin").get();
+
+    auto loaded = CreateVolume();
+    Load(loaded, "stress_checkpoint.bin");
+    const auto first =
+        *loaded->Find("0")->Open()->Read<uint64_t>("round");
+    bool prefix = true;
+    for (size_t i = 0; i < nodes; ++i) {
+      const auto round =
+          *loaded->Find(std::to_string(i))->Open()->Read<uint64_t>("round");
+      if (prefix && round + 1 == first) {
+        prefix = false;
+      }
+
+      ASSERT_EQ(round, prefix ? first : first - 1) << "node " << i;
+    }
+  }
+
+  stop = true;
+  writer.join();
+  std::filesystem::remove("stress_checkpoint.bin");
+}
+
+TEST(LsmVolume, ReadsWhileCompacting) {
+  const size_t keys = 500;
+  const uint64_t rounds = 20;
+  std::filesystem::remove_all("stress_lsm");
+
+  LsmOptions options;
+  options.memtable_size = 16 << 10;
+  options.level0_segments = 2;
+  options.level1_size = 32 << 10;
+  options.level_ratio = 2;
+  options.segment_size = 16 << 10;
+  options.sync = false;
+  auto v = OpenLsmVolume("stress_lsm", options);
+  auto data = v->Create("data")->Open();
+  for (size_t i = 0; i < keys; ++i) {
+    data->Write(std::to_string(i), uint64_t(0));
+  }
+
+  /// rounds only grow, so reader never sees a value older than previous one
+  std::atomic<bool> stop = false;
+  std::thread writer([&]() {
+    for (uint64_t round = 1; round <= rounds; ++round) {
+      for (size_t i = 0; i < keys; ++i) {
+        data->Write(std::to_string(i), round);
+      }
+    }
+
+    stop = true;
+  });
+
+  std::vector<uint64_t> seen(keys);
+  while (!stop) {
+    for (size_t i = 0; i < keys; ++i) {
+      const auto round = v->Find("data")->Open()->Read<uint64_t>(
+          std::to_string(i));
+      ASSERT_TRUE(round);
+      ASSERT_GE(*round, seen[i]) << "key " << i;
+      seen[i] = *round;
+    }
+
+    const auto entries = data->Enumerate();
+    ASSERT_EQ(entries.size(), keys);
+  }
+
+  writer.join();
+  for (size_t i = 0; i < keys; ++i) {
+    EXPECT_EQ(data->Read<uint64_t>(std::to_string(i)), rounds);
+  }
+
+  v.reset();
+  data.reset();
+  std::filesystem::remove_all("stress_lsm");
+}
+
+TEST(LsmVolume, SyncedWritersSeeChangesBeingSynced) {
+  const size_t children = 50;
+  const size_t threads = 4;
+  std::filesystem::remove_all("stress_lsm_sync");
+
+  LsmOptions options;
+  options.memtable_size = 4 << 10;
+  options.sync = true;
+  auto v = OpenLsmVolume("stress_lsm_sync", options);
+
+  /// writers create the same children, so each of them must find child
+  /// created by another one while its batch is being synced
+  std::vector<std::thread> workers;
+  for (size_t t = 0; t < threads; ++t) {
+    workers.emplace_back([&v, t, children]() {
+      for (size_t i = 0; i < children; ++i) {
+        v->Create(std::to_string(i))->Open()->Write(std::to_string(t), t);
+      }
+    });
+  }
+
+  for (auto& worker : workers) {
+    worker.join();
+  }
+
+  ASSERT_EQ(v->Enumerate().size(), children);
+  for (size_t i = 0; i < children; ++i) {
+    EXPECT_EQ(v->Find(std::to_string(i))->Open()->Enumerate().size(), threads)
+        << "child " << i;
+  }
+
+  v.reset();
+  std::filesystem::remove_all("stress_lsm_sync");
+}
+
+TEST(SpillingVolume, SpillsWhileModifying) {
+  const size_t subtrees = 50;
+  const size_t threads = 4;
+  const size_t rounds = 20;
+  std::filesystem::remove_all("stress_spill");
+
+  SpillOptions options;
+  options.directory = "stress_spill";
+  options.memory_budget = 32 << 10;
+  options.interval = std::chrono::milliseconds(1);
+  auto v = CreateSpillingVolume(options);
+
+  /// every thread owns a key in every subtree and counts its writes there
+  std::atomic<size_t> finished = 0;
+  std::vector<std::thread> workers;
+  for (size_t t = 0; t < threads; ++t) {
+    workers.emplace_back([&, t]() {
+      const auto key = std::to_string(t);
+      for (size_t round = 0; round < rounds; ++round) {
+        for (size_t i = 0; i < subtrees; ++i) {
+          auto data = v->Create(std::to_string(i))->Create("data")->Open();
+          const auto count = data->Read<uint64_t>(key).value_or(0);
+          ASSERT_EQ(count, round);
+          data->Write(key, count + 1);
+        }
+      }
+
+      ++finished;
+    });
+  }
+
+  std::thread spiller([&]() {
+    while (finished < threads) {
+      SpillCold(v);
+    }
+  });
+
+  for (auto& worker : workers) {
+    worker.join();
+  }
+
+  spiller.join();
+  /// workers may finish before spiller gets to run
+  SpillCold(v);
+  EXPECT_FALSE(std::filesystem::is_empty("stress_spill"));
+  for (size_t i = 0; i < subtrees; ++i) {
+    auto data = v->Find(std::to_string(i))->Find("data")->Open();
+    for (size_t t = 0; t < threads; ++t) {
+      EXPECT_EQ(data->Read<uint64_t>(std::to_string(t)), rounds);
+    }
+  }
+
+  v.reset();
+  std::filesystem::remove_all("stress_spill");
+}
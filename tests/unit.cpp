@@ -1,6 +1,15 @@
 
+#include "lib/async_mutex.h"
+#include "lib/buffered_io.h"
+#include "lib/crc32c.h"
+#include "lib/epoch.h"
 #include "lib/jbkv.h"
+#include "lib/scalar_slots.h"
 #include <gtest/gtest.h>
+#include <atomic>
+#include <functional>
+#include <future>
+#include <limits>
 #include <sstream>
 
 using namespace jbkv;
@@ -147,6 +156,104 @@ TEST(VolumeNodeData, ReadNull) {
   EXPECT_FALSE(d->Read<double>("number").has_value());
 }
 
+TEST(VolumeNodeData, ReadsScalars) {
+  auto d = CreateVolume()->Open();
+  d->Write("bool", true);
+  d->Write("char", 'a');
+  d->Write("int16", int16_t(-5));
+  d->Write("uint64", std::numeric_limits<uint64_t>::max());
+  d->Write("float", 1.5f);
+  d->Write("double", -2.25);
+  EXPECT_EQ(d->Read<bool>("bool"), true);
+  EXPECT_EQ(d->Read<char>("char"), 'a');
+  EXPECT_EQ(d->Read<int16_t>("int16"), -5);
+  EXPECT_EQ(d->Read<uint64_t>("uint64"), std::numeric_limits<uint64_t>::max());
+  EXPECT_EQ(d->Read<float>("float"), 1.5f);
+  EXPECT_EQ(d->Read<double>("double"), -2.25);
+  EXPECT_FALSE(d->Read<int64_t>("uint64"));
+
+  EXPECT_TRUE(d->Update("double", 3.5));
+  EXPECT_EQ(d->Read<double>("double"), 3.5);
+  d->Write("double", "string");
+  EXPECT_FALSE(d->Read<double>("double"));
+  d->Write("double", 4.5);
+  EXPECT_EQ(d->Read<double>("double"), 4.5);
+  EXPECT_TRUE(d->Remove("double"));
+  EXPECT_FALSE(d->Read<double>("double"));
+
+  for (uint64_t i = 0; i < 100; ++i) {
+    d->Write("key" + std::to_string(i), i);
+  }
+
+  for (uint64_t i = 0; i < 100; ++i) {
+    EXPECT_EQ(d->Read<uint64_t>("key" + std::to_string(i)), i);
+  }
+
+  VolumeBuilder builder;
+  builder.Add({}, "built", 7.0);
+  EXPECT_EQ(builder.Build()->Open()->Read<double>("built"), 7.0);
+
+  /// data without slots reads scalars through Read
+  auto v = CreateVolume();
+  v->Open()->Write("number", 42);
+  EXPECT_EQ(MountStorage({v})->Open()->Read<int>("number"), 42);
+  EXPECT_FALSE(MountStorage({v})->Open()->Read<double>("number"));
+}
+
+TEST(ScalarSlots, FootprintIsBoundedUnderKeyChurn) {
+  ScalarSlots slots;
+  EXPECT_EQ(slots.Footprint(), 0);
+
+  /// footprint changes with rebuilds, so peaks are compared
+  constexpr uint64_t kLive = 16;
+  size_t early_peak = 0;
+  size_t late_peak = 0;
+  for (uint64_t i = 0; i < 100000; ++i) {
+    const Value value(i);
+    slots.Store("key" + std::to_string(i), &value);
+    if (i >= kLive) {
+      slots.Store("key" + std::to_string(i - kLive), nullptr);
+    }
+
+    auto& peak = i < 10000 ? early_peak : late_peak;
+    peak = std::max(peak, slots.Footprint());
+  }
+
+  EXPECT_GT(early_peak, 0);
+  EXPECT_LE(late_peak, early_peak);
+  Value::Data data;
+  EXPECT_TRUE(slots.Read("key99999", data));
+  EXPECT_FALSE(slots.Read("key0", data));
+}
+
+TEST(Epoch, RetiredMemoryOutlivesPinnedReaders) {
+  bool freed = false;
+  RetireAfterEpoch([&freed] { freed = true; });
+  EXPECT_TRUE(freed);
+
+  std::promise<void> pinned;
+  std::promise<void> release;
+  auto reader = std::async(std::launch::async, [&] {
+    EpochGuard guard;
+    pinned.set_value();
+    release.get_future().wait();
+  });
+  pinned.get_future().wait();
+
+  freed = false;
+  RetireAfterEpoch([&freed] { freed = true; });
+  EXPECT_FALSE(freed);
+  auto synchronized = std::async(std::launch::async, SynchronizeEpoch);
+  EXPECT_EQ(synchronized.wait_for(std::chrono::milliseconds(10)),
+            std::future_status::timeout);
+
+  release.set_value();
+  reader.wait();
+  synchronized.wait();
+  RetireAfterEpoch([] {});
+  EXPECT_TRUE(freed);
+}
+
 TEST(VolumeNodeData, ValueOut) {
   std::stringstream str;
   str << Value(true) << Value('a') << Value((unsigned char)'b')
@@ -326,12 +433,527 @@ TEST(VolumeNode, SaveLoadHierarchyInMemory) {
   EXPECT_EQ(v2->Find("c2")->Find("c22")->Open()->Read<int>("name"), 22);
 }
 
+TEST(VolumeNode, SaveParallelLoadsSameContents) {
+  auto v1 = CreateVolume();
+  std::vector<VolumeNode::Ptr> level{v1};
+  for (int depth = 0; depth < 4; ++depth) {
+    std::vector<VolumeNode::Ptr> next;
+    for (const auto& node : level) {
+      for (int i = 0; i < 5; ++i) {
+        auto child = node->Create(std::to_string(i));
+        child->Open()->Write("depth", depth);
+        child->Open()->Write("index", i);
+        next.push_back(std::move(child));
+      }
+    }
+
+    level = std::move(next);
+  }
+
+  ThreadPool pool(4);
+  std::stringstream stream;
+  Save(v1, stream, pool);
+
+  auto v2 = CreateVolume();
+  Load(v2, stream);
+
+  std::function<void(const VolumeNode::Ptr&, const VolumeNode::Ptr&)> compare =
+      [&compare](const VolumeNode::Ptr& expected, const VolumeNode::Ptr& node) {
+        for (const auto* key : {"depth", "index"}) {
+          EXPECT_EQ(node->Open()->Read<int>(key),
+                    expected->Open()->Read<int>(key));
+        }
+
+        const auto children = expected->Enumerate();
+        EXPECT_EQ(node->Enumerate().size(), children.size());
+        for (const auto& child : children) {
+          auto loaded = node->Find(child->GetName());
+          ASSERT_TRUE(loaded);
+          compare(child, loaded);
+        }
+      };
+
+  compare(v1, v2);
+}
+
+TEST(VolumeNode, SaveDeltaAppliesOnBase) {
+  auto v1 = CreateVolume();
+  for (int i = 0; i < 100; ++i) {
+    auto child = v1->Create(std::to_string(i));
+    child->Open()->Write("name", i);
+    child->Create("leaf")->Open()->Write("value", Value::String{"leaf"});
+  }
+
+  v1->Find("5")->Open()->Write("removed", 5);
+  v1->Find("6")->Create("unlinked");
+  auto generation = AdvanceGeneration(v1);
+  std::stringstream base;
+  Save(v1, base);
+
+  v1->Open()->Write("root", true);
+  v1->Find("1")->Open()->Update("name", 100);
+  v1->Find("2")->Find("leaf")->Open()->Write("value", 2);
+  v1->Find("5")->Open()->Remove("removed");
+  v1->Find("6")->Unlink("unlinked");
+  v1->Unlink("7");
+  v1->Unlink("8");
+  v1->Create("8")->Open()->Write("recreated", true);
+  v1->Create("new")->Create("empty");
+
+  std::stringstream delta;
+  generation = SaveDelta(v1, delta, generation);
+  EXPECT_LT(delta.str().size(), base.str().size() / 10);
+
+  v1->Find("3")->Open()->Write("second", 3);
+  std::stringstream second_delta;
+  SaveDelta(v1, second_delta, generation);
+  EXPECT_LT(second_delta.str().size(), delta.str().size());
+
+  auto v2 = CreateVolume();
+  Load(v2, base);
+  Load(v2, delta);
+  Load(v2, second_delta);
+
+  EXPECT_EQ(v2->Open()->Read<bool>("root"), true);
+  EXPECT_EQ(v2->Find("1")->Open()->Read<int>("name"), 100);
+  EXPECT_EQ(v2->Find("2")->Find("leaf")->Open()->Read<int>("value"), 2);
+  EXPECT_FALSE(v2->Find("5")->Open()->Read("removed"));
+  EXPECT_FALSE(v2->Find("6")->Find("unlinked")->IsValid());
+  EXPECT_FALSE(v2->Find("7")->IsValid());
+  EXPECT_FALSE(v2->Find("8")->Find("leaf")->IsValid());
+  EXPECT_EQ(v2->Find("8")->Open()->Read<bool>("recreated"), true);
+  EXPECT_TRUE(v2->Find("new")->Find("empty")->IsValid());
+  EXPECT_EQ(v2->Find("3")->Open()->Read<int>("second"), 3);
+  EXPECT_EQ(v2->Find("4")->Open()->Read<int>("name"), 4);
+  EXPECT_EQ(v2->Enumerate().size(), size_t(100));
+}
+
+TEST(VolumeNode, SaveDeltaUntrackedThrows) {
+  std::stringstream stream;
+  Save(CreateVolume(), stream);
+  auto frozen = Freeze(CreateVolume());
+  EXPECT_THROW(AdvanceGeneration(frozen), std::exception);
+  EXPECT_THROW(SaveDelta(frozen, stream, 0), std::exception);
+  EXPECT_THROW(SaveDelta(nullptr, stream, 0), std::exception);
+}
+
+TEST(VolumeNode, LoadLegacyFormat) {
+  std::stringstream stream;
+  auto put = [&stream](const auto& value) {
+    stream.write(reinterpret_cast<const char*>(&value), sizeof(value));
+  };
+
+  /// version 1: BFS records without ids and index
+  stream.write("jbkv", 4);
+  put(uint8_t(1));
+  /// root: child "c" and key "k" = int32 7
+  put(size_t(1));
+  put(uint64_t(1));
+  stream.write("c", 1);
+  put(size_t(1));
+  put(uint64_t(1));
+  stream.write("k", 1);
+  put(uint8_t(9));
+  put(int32_t(7));
+  put(uint8_t('c' ^ 'k' ^ 7));
+  /// child: empty
+  put(size_t(0));
+  put(size_t(0));
+  put(uint8_t(0));
+
+  auto v = CreateVolume();
+  Load(v, stream);
+  EXPECT_EQ(v->Open()->Read<int32_t>("k"), 7);
+  EXPECT_TRUE(v->Find("c")->IsValid());
+}
+
+TEST(VolumeNode, LoadUnreleasedFormatsThrows) {
+  for (const auto* header : {"jbkv\x02", "jbkv\x03", "jbkd\x01"}) {
+    std::stringstream stream;
+    stream.write(header, 5);
+    stream.write(std::string(64, '\0').data(), 64);
+    EXPECT_THROW(Load(CreateVolume(), stream), std::exception) << header;
+  }
+}
+
+TEST(VolumeNode, SaveLoadIntegerLimits) {
+  auto v = CreateVolume();
+  auto d = v->Open();
+  d->Write("int16 min", std::numeric_limits<int16_t>::min());
+  d->Write("int16 max", std::numeric_limits<int16_t>::max());
+  d->Write("uint16 max", std::numeric_limits<uint16_t>::max());
+  d->Write("int32 min", std::numeric_limits<int32_t>::min());
+  d->Write("uint32 max", std::numeric_limits<uint32_t>::max());
+  d->Write("int64 min", std::numeric_limits<int64_t>::min());
+  d->Write("int64 max", std::numeric_limits<int64_t>::max());
+  d->Write("uint64 max", std::numeric_limits<uint64_t>::max());
+  d->Write("minus one", int64_t(-1));
+
+  std::stringstream stream;
+  Save(v, stream);
+  auto v2 = CreateVolume();
+  Load(v2, stream);
+  auto d2 = v2->Open();
+  EXPECT_EQ(d2->Read<int16_t>("int16 min"),
+            std::numeric_limits<int16_t>::min());
+  EXPECT_EQ(d2->Read<int16_t>("int16 max"),
+            std::numeric_limits<int16_t>::max());
+  EXPECT_EQ(d2->Read<uint16_t>("uint16 max"),
+            std::numeric_limits<uint16_t>::max());
+  EXPECT_EQ(d2->Read<int32_t>("int32 min"),
+            std::numeric_limits<int32_t>::min());
+  EXPECT_EQ(d2->Read<uint32_t>("uint32 max"),
+            std::numeric_limits<uint32_t>::max());
+  EXPECT_EQ(d2->Read<int64_t>("int64 min"),
+            std::numeric_limits<int64_t>::min());
+  EXPECT_EQ(d2->Read<int64_t>("int64 max"),
+            std::numeric_limits<int64_t>::max());
+  EXPECT_EQ(d2->Read<uint64_t>("uint64 max"),
+            std::numeric_limits<uint64_t>::max());
+  EXPECT_EQ(d2->Read<int64_t>("minus one"), -1);
+}
+
+TEST(VolumeNode, SaveCodesRepeatedKeys) {
+  const std::string key(40, 'k');
+  const std::string long_key(100, 'l');
+  auto v = CreateVolume();
+  for (int i = 0; i < 1000; ++i) {
+    auto d = v->Create(std::to_string(i))->Create("leaf")->Open();
+    d->Write(key, i);
+    d->Write(long_key, i);
+    d->Write(std::to_string(i), Value::String{std::string(200, 'v')});
+  }
+
+  std::stringstream stream;
+  Save(v, stream);
+  /// long key is written in full every time, other key only twice
+  EXPECT_LT(stream.str().size(), size_t(1000 * (100 + 200 + 100)));
+
+  auto v2 = CreateVolume();
+  Load(v2, stream);
+  for (int i = 0; i < 1000; ++i) {
+    auto d = v2->Find(std::to_string(i))->Find("leaf")->Open();
+    EXPECT_EQ(d->Read<int>(key), i);
+    EXPECT_EQ(d->Read<int>(long_key), i);
+    EXPECT_EQ(d->Read<Value::String>(std::to_string(i))->Ref().size(),
+              size_t(200));
+  }
+}
+
+TEST(VolumeNode, SaveCompressedInMemory) {
+  auto v = CreateVolume();
+  for (int i = 0; i < 100; ++i) {
+    auto d = v->Create(std::to_string(i))->Open();
+    d->Write("name", Value::String{"repetitive value " + std::to_string(i)});
+    d->Write("index", i);
+  }
+
+  std::stringstream raw;
+  std::stringstream compressed;
+  Save(v, raw);
+  Save(v, compressed, *LzCodec());
+  EXPECT_LT(compressed.str().size(), raw.str().size() / 2);
+
+  auto v2 = CreateVolume();
+  Load(v2, compressed);
+  EXPECT_EQ(v2->Enumerate().size(), size_t(100));
+  EXPECT_EQ(v2->Find("42")->Open()->Read<Value::String>("name"),
+            "repetitive value 42");
+  EXPECT_EQ(v2->Find("99")->Open()->Read<int>("index"), 99);
+}
+
 TEST(VolumeNode, SaveLoadNullThrows) {
   std::stringstream stream;
   EXPECT_THROW(Save(nullptr, stream), std::exception);
   EXPECT_THROW(Load(nullptr, stream), std::exception);
 }
 
+TEST(FrozenVolume, CopiesSubtree) {
+  auto v = CreateVolume();
+  v->Open()->Write("root", 1);
+  v->Create("c2")->Open()->Write("name", "c2");
+  v->Create("c1")->Create("c11")->Open()->Write("name", "c11");
+
+  auto f = Freeze(v);
+  v->Unlink("c1");
+  v->Open()->Write("root", 2);
+
+  EXPECT_EQ(f->GetName(), v->GetName());
+  EXPECT_EQ(f->Open()->Read<int>("root"), 1);
+  EXPECT_EQ(f->Find("c2")->Open()->Read<Value::String>("name"), "c2");
+  EXPECT_EQ(f->Find("c1")->Find("c11")->Open()->Read<Value::String>("name"),
+            "c11");
+  EXPECT_FALSE(f->Find("c3")->IsValid());
+  EXPECT_FALSE(f->Open()->Read("unknown").has_value());
+
+  auto children = f->Enumerate();
+  ASSERT_EQ(children.size(), size_t(2));
+  EXPECT_EQ(children[0]->GetName(), "c1");
+  EXPECT_EQ(children[1]->GetName(), "c2");
+}
+
+TEST(FrozenVolume, MutationsThrow) {
+  auto v = CreateVolume();
+  v->Create("c1");
+  v->Open()->Write("num", 1);
+
+  auto f = Freeze(v);
+  auto d = f->Open();
+  EXPECT_THROW(f->Create("c2"), std::exception);
+  EXPECT_THROW(d->Write("num", 2), std::exception);
+
+  EXPECT_THROW(f->Unlink("c1"), std::exception);
+  EXPECT_THROW(d->Update("num", 2), std::exception);
+  EXPECT_THROW(d->Remove("num"), std::exception);
+  EXPECT_TRUE(f->IsReadOnly());
+  EXPECT_TRUE(d->IsReadOnly());
+
+  EXPECT_FALSE(f->Unlink("c2"));
+  EXPECT_FALSE(d->Update("other", 2));
+  EXPECT_FALSE(d->Remove("other"));
+  EXPECT_EQ(d->Read<int>("num"), 1);
+  EXPECT_THROW(Freeze(nullptr), std::exception);
+}
+
+TEST(FrozenVolume, MountsAsLowerLayer) {
+  auto v = CreateVolume();
+  v->Create("c1")->Open()->Write("num", 1);
+
+  auto s = MountStorage({Freeze(v), CreateVolume()});
+  auto d = s->Find("c1")->Open();
+  EXPECT_EQ(d->Read<int>("num"), 1);
+
+  s->Create("c2")->Open()->Write("num", 2);
+  EXPECT_EQ(s->Find("c2")->Open()->Read<int>("num"), 2);
+  EXPECT_FALSE(s->Unlink("c3"));
+  EXPECT_THROW(s->Find("c1")->Create("c11"), std::exception);
+}
+
+TEST(FrozenVolume, UpperLayerOverridesInheritedKey) {
+  auto v = CreateVolume();
+  v->Open()->Write("num", 1);
+  v->Open()->Write("other", 1);
+  v->Create("c1")->Open()->Write("num", 1);
+
+  auto f = Freeze(v);
+  auto s = MountStorage({f, CreateVolume()});
+  s->Open()->Write("num", 2);
+  EXPECT_EQ(s->Open()->Read<int>("num"), 2);
+  EXPECT_EQ(f->Open()->Read<int>("num"), 1);
+  EXPECT_TRUE(s->Open()->Update("num", 3));
+  EXPECT_EQ(s->Open()->Read<int>("num"), 3);
+  EXPECT_TRUE(s->Open()->Update("other", 2));
+  EXPECT_EQ(s->Open()->Read<int>("other"), 2);
+  EXPECT_FALSE(s->Open()->Update("absent", 2));
+
+  /// inherited entries cannot be removed
+  EXPECT_THROW(s->Open()->Remove("num"), std::exception);
+  EXPECT_EQ(s->Open()->Read<int>("num"), 3);
+  EXPECT_THROW(s->Unlink("c1"), std::exception);
+  EXPECT_EQ(s->Find("c1")->Open()->Read<int>("num"), 1);
+}
+
+TEST(FrozenVolume, StorageWithFrozenLayerRunsTransactions) {
+  auto v = CreateVolume();
+  v->Open()->Write("num", 1);
+  auto s = MountStorage({Freeze(v), CreateVolume()});
+  auto d = s->Open();
+
+  RunTransaction([&d](Transaction& transaction) {
+    transaction.Write(d, "num", *transaction.Read<int>(d, "num") + 1);
+    transaction.Write(d, "new", 1);
+  });
+  EXPECT_EQ(d->Read<int>("num"), 2);
+  EXPECT_EQ(d->Read<int>("new"), 1);
+
+  Transaction transaction;
+  transaction.Write(d, "new", 2);
+  transaction.Remove(d, "num");
+  EXPECT_THROW(transaction.Commit(), std::exception);
+  EXPECT_EQ(d->Read<int>("new"), 1);
+}
+
+TEST(SpillingVolume, OtherVolumeThrows) {
+  EXPECT_THROW(SpillCold(CreateVolume()), std::exception);
+  EXPECT_THROW(SpillCold(nullptr), std::exception);
+}
+
+TEST(Transaction, CommitsWrites) {
+  auto v = CreateVolume();
+  auto d1 = v->Create("c1")->Open();
+  auto d2 = v->Create("c2")->Open();
+  d1->Write("num", 10);
+  d2->Write("removed", true);
+
+  Transaction transaction;
+  EXPECT_EQ(transaction.Read<int>(d1, "num"), 10);
+  transaction.Write(d1, "num", 5);
+  transaction.Write(d2, "num", 5);
+  transaction.Remove(d2, "removed");
+  EXPECT_EQ(transaction.Read<int>(d1, "num"), 5);
+  EXPECT_FALSE(transaction.Read(d2, "removed"));
+  /// nothing is applied before commit
+  EXPECT_EQ(d1->Read<int>("num"), 10);
+  EXPECT_FALSE(d2->Read<int>("num"));
+
+  EXPECT_TRUE(transaction.Commit());
+  EXPECT_EQ(d1->Read<int>("num"), 5);
+  EXPECT_EQ(d2->Read<int>("num"), 5);
+  EXPECT_FALSE(d2->Read("removed"));
+  EXPECT_TRUE(transaction.Commit());
+}
+
+TEST(Transaction, FailsOnConflict) {
+  auto v = CreateVolume();
+  auto d1 = v->Create("c1")->Open();
+  auto d2 = v->Create("c2")->Open();
+
+  Transaction transaction;
+  EXPECT_FALSE(transaction.Read(d1, "num"));
+  transaction.Write(d2, "num", 1);
+  /// change of other key of read node conflicts too
+  d1->Write("other", 1);
+  EXPECT_FALSE(transaction.Commit());
+  EXPECT_FALSE(d2->Read("num"));
+
+  size_t attempts = 0;
+  RunTransaction([&](Transaction& transaction) {
+    const auto num = transaction.Read<int>(d1, "other");
+    if (++attempts == 1) {
+      d1->Write("other", 2);
+    }
+
+    transaction.Write(d2, "num", *num + 1);
+  });
+  EXPECT_EQ(attempts, size_t(2));
+  EXPECT_EQ(d2->Read<int>("num"), 3);
+}
+
+TEST(Transaction, SpansStorageLayers) {
+  auto bottom = CreateVolume();
+  auto top = CreateVolume();
+  bottom->Open()->Write("bottom", 1);
+  bottom->Open()->Write("both", 1);
+  top->Open()->Write("both", 2);
+  auto s = MountStorage({bottom, top})->Open();
+
+  Transaction transaction;
+  EXPECT_EQ(transaction.Read<int>(s, "bottom"), 1);
+  EXPECT_EQ(transaction.Read<int>(s, "both"), 2);
+  transaction.Write(s, "bottom", 3);
+  transaction.Write(s, "new", 4);
+  transaction.Remove(s, "both");
+  EXPECT_TRUE(transaction.Commit());
+
+  EXPECT_EQ(bottom->Open()->Read<int>("bottom"), 3);
+  EXPECT_EQ(top->Open()->Read<int>("new"), 4);
+  EXPECT_FALSE(bottom->Open()->Read("both"));
+  EXPECT_FALSE(top->Open()->Read("both"));
+
+  /// write to lower layer conflicts with read through storage node
+  EXPECT_FALSE(transaction.Read(s, "both"));
+  transaction.Write(s, "both", 5);
+  bottom->Open()->Write("unrelated", 1);
+  EXPECT_FALSE(transaction.Commit());
+  EXPECT_FALSE(s->Read("both"));
+}
+
+TEST(Transaction, RejectsUnsupportedData) {
+  auto d = CreateShardedVolume({1, false})->Open();
+  Transaction transaction;
+  EXPECT_THROW(transaction.Read(d, "num"), std::runtime_error);
+  EXPECT_THROW(transaction.Write(d, "num", 1), std::runtime_error);
+  EXPECT_TRUE(transaction.Commit());
+}
+
+TEST(ShardedVolume, ReadWriteHierarchy) {
+  ShardOptions options;
+  options.shards = 3;
+  auto v = CreateShardedVolume(options);
+  EXPECT_EQ(v->GetName(), "/");
+  v->Open()->Write("root", 1);
+  auto c1 = v->Create("c1");
+  EXPECT_EQ(c1->GetName(), "c1");
+  c1->Open()->Write("num", 1);
+  c1->Create("c11")->Open()->Write("num", 11);
+  v->Create("c2");
+
+  EXPECT_EQ(v->Open()->Read<int>("root"), 1);
+  EXPECT_EQ(v->Create("c1")->Open()->Read<int>("num"), 1);
+  EXPECT_EQ(v->Find("c1")->Find("c11")->Open()->Read<int>("num"), 11);
+  EXPECT_FALSE(v->Find("c3")->IsValid());
+  EXPECT_EQ(v->Enumerate().size(), size_t(2));
+
+  auto d = c1->Open();
+  EXPECT_TRUE(d->Update("num", 2));
+  EXPECT_FALSE(d->Update("none", 2));
+  EXPECT_EQ(d->Read<int>("num"), 2);
+  EXPECT_TRUE(d->Remove("num"));
+  EXPECT_FALSE(d->Remove("num"));
+  d->Write("other", 3);
+  EXPECT_EQ(d->Enumerate().size(), size_t(1));
+
+  /// unlinked subtree reads as empty and ignores changes
+  auto c11 = c1->Find("c11");
+  EXPECT_TRUE(v->Unlink("c1"));
+  EXPECT_FALSE(v->Unlink("c1"));
+  EXPECT_FALSE(v->Find("c1")->IsValid());
+  EXPECT_FALSE(c11->Open()->Read<int>("num"));
+  c11->Open()->Write("num", 1);
+  EXPECT_FALSE(c11->Open()->Read<int>("num"));
+  EXPECT_TRUE(c11->Enumerate().empty());
+  EXPECT_TRUE(v->Create("c1")->Enumerate().empty());
+}
+
+TEST(VolumeBuilder, LaterEntryReplacesEarlier) {
+  VolumeBuilder builder;
+  builder.Add({}, "root", 1);
+  builder.Reserve({"c1"}, 1, 2);
+  builder.Add({"c1"}, "num", 1);
+  builder.Add({"c1", "c11"}, "num", 11);
+  builder.Add({"c1"}, "num", 2);
+  builder.Add({}, "root", Value::String{"two"});
+
+  auto v = builder.Build();
+  EXPECT_EQ(v->GetName(), "/");
+  EXPECT_EQ(v->Open()->Read<Value::String>("root"), "two");
+  EXPECT_EQ(v->Find("c1")->Open()->Read<int>("num"), 2);
+  EXPECT_EQ(v->Find("c1")->Open()->Enumerate().size(), size_t(1));
+  EXPECT_EQ(v->Find("c1")->Find("c11")->Open()->Read<int>("num"), 11);
+}
+
+TEST(VolumeBuilder, AddsEntriesOfNodeAtOnce) {
+  VolumeBuilder builder;
+  builder.Add({"c1"}, "num", 1);
+  NodeData::KeyValueList entries;
+  entries.emplace_back("num", Value(uint64_t(2)));
+  entries.emplace_back("text", Value("text"));
+  builder.Add({"c1"}, std::move(entries));
+  builder.Add({"c1"}, "last", 3.5);
+
+  auto v = builder.Build();
+  auto d = v->Find("c1")->Open();
+  EXPECT_EQ(d->Read<uint64_t>("num"), uint64_t(2));
+  EXPECT_EQ(d->Read<Value::String>("text"), "text");
+  EXPECT_EQ(d->Read<double>("last"), 3.5);
+  EXPECT_EQ(d->Enumerate().size(), size_t(3));
+
+  /// scalar slots filled by Build are kept up to date by writes
+  d->Write("num", 4);
+  d->Remove("last");
+  EXPECT_EQ(d->Read<int>("num"), 4);
+  EXPECT_FALSE(d->Read<double>("last"));
+}
+
+TEST(VolumeBuilder, BuildsEmptyVolume) {
+  VolumeBuilder builder;
+  auto v = builder.Build();
+  EXPECT_TRUE(v->Enumerate().empty());
+  EXPECT_TRUE(v->Open()->Enumerate().empty());
+  v->Create("c1")->Open()->Write("num", 1);
+  EXPECT_EQ(v->Find("c1")->Open()->Read<int>("num"), 1);
+}
+
 TEST(StorageNode, MountsVolumeNodes) {
   auto v1 = CreateVolume();
   v1->Create("first");
@@ -407,6 +1029,99 @@ TEST(StorageNode, MountSubtree) {
   EXPECT_FALSE(s->Find("c1")->Find("c1")->IsValid());
 }
 
+TEST(StorageNode, MountVisibleFromEarlierNodes) {
+  auto v1 = CreateVolume();
+  v1->Create("a")->Create("b");
+  auto v2 = CreateVolume();
+  v2->Create("x");
+
+  auto s = MountStorage(v1);
+  auto a = s->Find("a");
+  auto m = s->Find("a")->Find("b")->Mount(v2);
+  EXPECT_TRUE(a->Find("b")->Find("x")->IsValid());
+  EXPECT_TRUE(s->Find("a")->Find("b")->Find("x")->IsValid());
+
+  m.reset();  // unmount
+  EXPECT_FALSE(a->Find("b")->Find("x")->IsValid());
+  EXPECT_FALSE(s->Find("a")->Find("b")->Find("x")->IsValid());
+}
+
+TEST(StorageNode, DeepNodesSeeLaterMountsAndUnlinks) {
+  auto v1 = CreateVolume();
+  v1->Create("a")->Create("b")->Create("c")->Create("d");
+  auto v2 = CreateVolume();
+  v2->Create("x");
+
+  auto s = MountStorage(v1);
+  auto b = s->Find("a")->Find("b");
+  EXPECT_FALSE(b->Find("c")->Find("x")->IsValid());
+
+  auto m = s->Find("a")->Find("b")->Find("c")->Mount(v2);
+  EXPECT_TRUE(b->Find("c")->Find("x")->IsValid());
+
+  m.reset();  // unmount
+  EXPECT_FALSE(b->Find("c")->Find("x")->IsValid());
+
+  m = s->Find("a")->Find("b")->Find("c")->Mount(v2);
+  EXPECT_TRUE(b->Find("c")->Find("x")->IsValid());
+
+  EXPECT_TRUE(s->Unlink("a"));
+  EXPECT_FALSE(b->Find("c")->Find("x")->IsValid());
+}
+
+TEST(StorageNode, DeepNodesResolveAcrossUnrelatedChanges) {
+  auto v1 = CreateVolume();
+  v1->Create("a")->Create("b")->Create("c");
+  v1->Create("p")->Create("q");
+  auto v2 = CreateVolume();
+  v2->Create("x");
+
+  auto s = MountStorage(v1);
+  auto b = s->Find("a")->Find("b");
+  EXPECT_FALSE(b->Find("c")->Find("x")->IsValid());
+
+  auto other = s->Find("p")->Find("q")->Mount(CreateVolume());
+  EXPECT_FALSE(b->Find("c")->Find("x")->IsValid());
+
+  auto m = s->Find("a")->Find("b")->Find("c")->Mount(v2);
+  EXPECT_TRUE(b->Find("c")->Find("x")->IsValid());
+
+  other.reset();  // unmount
+  EXPECT_TRUE(s->Unlink("p"));
+  EXPECT_TRUE(b->Find("c")->Find("x")->IsValid());
+
+  m.reset();  // unmount
+  EXPECT_FALSE(b->Find("c")->Find("x")->IsValid());
+}
+
+TEST(StorageNode, UnlinkDropsMounts) {
+  auto v = CreateVolume();
+  v->Create("a");
+
+  auto s = MountStorage(v);
+  auto m = s->Find("a")->Mount(CreateVolume());
+  m->Create("b");
+  EXPECT_TRUE(s->Find("a")->Find("b")->IsValid());
+
+  EXPECT_TRUE(s->Unlink("a"));
+  EXPECT_FALSE(s->Find("a")->IsValid());
+  EXPECT_TRUE(m->Find("b")->IsValid());
+}
+
+TEST(StorageNode, UnmountReleasesVolume) {
+  auto s = MountStorage(CreateVolume());
+  auto v = CreateVolume();
+  std::weak_ptr<VolumeNode> weak_v = v;
+
+  auto m1 = s->Mount(std::move(v));
+  auto m2 = s->Mount(CreateVolume());
+  EXPECT_FALSE(weak_v.expired());
+
+  m1.reset();  // unmount
+  EXPECT_TRUE(weak_v.expired());
+  EXPECT_TRUE(m2->IsValid());
+}
+
 TEST(StorageNode, CreatesOnTopLayer) {
   auto v1 = CreateVolume();
   auto v2 = CreateVolume();
@@ -488,6 +1203,28 @@ TEST(StorageNode, EnumerateAggregation) {
   EXPECT_EQ(d->Read<int>("num2"), 2);
 }
 
+TEST(StorageNode, EnumerateMergesLayersSorted) {
+  auto v1 = CreateVolume();
+  v1->Create("d");
+  v1->Create("b")->Open()->Write("from", "v1");
+
+  auto v2 = CreateVolume();
+  v2->Create("c");
+  v2->Create("b")->Open()->Write("from", "v2");
+
+  auto v3 = CreateVolume();
+  v3->Create("a");
+  v3->Create("d");
+
+  auto children = MountStorage({v1, v2, v3})->Enumerate();
+  ASSERT_EQ(children.size(), size_t(4));
+  EXPECT_EQ(children[0]->GetName(), "a");
+  EXPECT_EQ(children[1]->GetName(), "b");
+  EXPECT_EQ(children[2]->GetName(), "c");
+  EXPECT_EQ(children[3]->GetName(), "d");
+  EXPECT_EQ(children[1]->Open()->Read<Value::String>("from"), "v2");
+}
+
 TEST(StorageNode, FindInvalid) {
   auto v = CreateVolume();
   auto s = MountStorage(v);
@@ -502,6 +1239,199 @@ TEST(StorageNode, FindInvalid) {
   EXPECT_THROW({ auto m = c->Mount(v); }, std::exception);
 }
 
+TEST(StorageNode, Flatten) {
+  auto v1 = CreateVolume();
+  v1->Open()->Write("num", 1);
+  v1->Create("a")->Open()->Write("from", "v1");
+  v1->Create("b")->Create("b1");
+
+  auto v2 = CreateVolume();
+  v2->Open()->Write("num", 2);
+  v2->Create("a")->Open()->Write("only", "v2");
+
+  auto v3 = CreateVolume();
+  v3->Open()->Write("from", "v3");
+  v3->Create("c3");
+
+  auto s = MountStorage({v1, v2});
+  auto m = s->Find("b")->Find("b1")->Mount(v3);
+
+  ThreadPool pool(2);
+  auto f = Flatten(s, pool);
+  m.reset();  // unmount does not affect result
+
+  EXPECT_EQ(f->Open()->Read<int>("num"), 2);
+  EXPECT_EQ(f->Find("a")->Open()->Read<Value::String>("from"), "v1");
+  EXPECT_EQ(f->Find("a")->Open()->Read<Value::String>("only"), "v2");
+  auto b1 = f->Find("b")->Find("b1");
+  ASSERT_TRUE(b1->IsValid());
+  EXPECT_EQ(b1->Open()->Read<Value::String>("from"), "v3");
+  EXPECT_TRUE(b1->Find("c3")->IsValid());
+  EXPECT_FALSE(v1->Find("b")->Find("b1")->Find("c3")->IsValid());
+  EXPECT_THROW(Flatten(nullptr), std::exception);
+}
+
+TEST(ThreadPool, TaskGroupRethrows) {
+  ThreadPool pool(2);
+  TaskGroup group(pool);
+  std::atomic<size_t> done = 0;
+  for (size_t i = 0; i < 10; ++i) {
+    group.Submit([i, &done, &group]() {
+      if (i == 5) {
+        throw std::runtime_error("task failed");
+      }
+
+      group.Submit([&done]() {
+        ++done;
+      });
+    });
+  }
+
+  EXPECT_THROW(group.Wait(), std::runtime_error);
+  EXPECT_EQ(done, size_t(9));
+}
+
+TEST(Task, ReturnsValueAndRethrows) {
+  auto twice = [](int value) -> Task<int> {
+    co_return value * 2;
+  };
+
+  auto sum = [&twice]() -> Task<int> {
+    const auto first = co_await twice(1);
+    co_return first + co_await twice(2);
+  };
+
+  EXPECT_EQ(SyncWait(sum()), 6);
+  EXPECT_THROW(SyncWait([]() -> Task<> {
+                 co_await ScheduleOn(DefaultExecutor());
+                 throw std::runtime_error("task failed");
+               }()),
+               std::runtime_error);
+  EXPECT_EQ(SyncWait(Offload([]() { return 7; }, DefaultExecutor())), 7);
+}
+
+TEST(AsyncSharedMutex, SuspendsUntilUnlocked) {
+  ThreadPool pool(1);
+  PoolExecutor executor(pool);
+  AsyncSharedMutex mutex;
+  mutex.lock();
+
+  std::atomic<int> shared = 0;
+  auto read = [&]() -> Task<> {
+    const auto lock = co_await mutex.LockSharedAsync(executor);
+    ++shared;
+  };
+
+  auto readers = std::async(std::launch::async, [&]() {
+    SyncWait(read());
+  });
+  auto more_readers = std::async(std::launch::async, [&]() {
+    SyncWait(read());
+  });
+
+  /// executor stays free while readers wait
+  std::promise<void> ran;
+  pool.Submit([&ran]() {
+    ran.set_value();
+  });
+  ran.get_future().get();
+  EXPECT_EQ(shared, 0);
+
+  mutex.unlock();
+  readers.get();
+  more_readers.get();
+  EXPECT_EQ(shared, 2);
+  EXPECT_TRUE(mutex.try_lock());
+  EXPECT_FALSE(mutex.try_lock_shared());
+  mutex.unlock();
+}
+
+TEST(AsyncSharedMutex, WriterWaitsForReaders) {
+  AsyncSharedMutex mutex;
+  /// first reader enables reader bias, so second one takes lock by it if
+  /// bias is enabled at build time
+  mutex.lock_shared();
+  mutex.unlock_shared();
+  mutex.lock_shared();
+  EXPECT_FALSE(mutex.try_lock());
+  ASSERT_TRUE(mutex.try_lock_shared());
+  mutex.unlock_shared();
+
+  std::atomic<bool> locked = false;
+  std::thread writer([&mutex, &locked]() {
+    mutex.lock();
+    locked = true;
+    mutex.unlock();
+  });
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  EXPECT_FALSE(locked);
+  mutex.unlock_shared();
+  writer.join();
+  EXPECT_TRUE(locked);
+  ASSERT_TRUE(mutex.try_lock());
+  mutex.unlock();
+}
+
+TEST(AsyncSharedMutex, AsyncWriterLeavesExecutorWhileReadersDrain) {
+  ThreadPool pool(1);
+  PoolExecutor executor(pool);
+  AsyncSharedMutex mutex;
+  /// second reader takes lock by bias if it is enabled at build time
+  mutex.lock_shared();
+  mutex.unlock_shared();
+  mutex.lock_shared();
+
+  std::atomic<bool> locked = false;
+  auto write = [&]() -> Task<> {
+    co_await ScheduleOn(executor);
+    const auto lock = co_await mutex.LockAsync(executor);
+    locked = true;
+  };
+
+  auto writer = std::async(std::launch::async, [&]() {
+    SyncWait(write());
+  });
+
+  /// thread of executor is not taken by writer waiting for reader
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  std::promise<void> ran;
+  pool.Submit([&ran]() {
+    ran.set_value();
+  });
+  EXPECT_EQ(ran.get_future().wait_for(std::chrono::seconds(5)),
+            std::future_status::ready);
+  EXPECT_FALSE(locked);
+
+  mutex.unlock_shared();
+  writer.get();
+  EXPECT_TRUE(locked);
+  ASSERT_TRUE(mutex.try_lock_shared());
+  mutex.unlock_shared();
+}
+
+TEST(VolumeNodeData, AsyncReadWrite) {
+  auto v = CreateVolume();
+  auto d = v->Create("c1")->Open();
+  SyncWait(d->AsyncWrite("num", Value(Value::Data(1))));
+  EXPECT_EQ(d->Read<int>("num"), 1);
+  EXPECT_EQ(*SyncWait(d->AsyncRead("num"))->Try<int32_t>(), 1);
+  EXPECT_FALSE(SyncWait(d->AsyncRead("none")));
+
+  EXPECT_TRUE(SyncWait(v->AsyncFind("c1"))->IsValid());
+  EXPECT_FALSE(SyncWait(v->AsyncFind("c2"))->IsValid());
+
+  /// storage reads, writes and finds in layers asynchronously
+  auto v2 = CreateVolume();
+  v2->Create("c1")->Open()->Write("top", 2);
+  auto s = MountStorage({v, v2});
+  auto c1 = SyncWait(s->AsyncFind("c1"));
+  EXPECT_EQ(*SyncWait(c1->Open()->AsyncRead("num"))->Try<int32_t>(), 1);
+  EXPECT_EQ(*SyncWait(c1->Open()->AsyncRead("top"))->Try<int32_t>(), 2);
+  SyncWait(c1->Open()->AsyncWrite("new", Value(Value::Data(3))));
+  EXPECT_EQ(v2->Find("c1")->Open()->Read<int>("new"), 3);
+}
+
 TEST(StorageNodeData, ValueSideEffects) {
   auto v = CreateVolume();
   v->Open()->Write("num", 34);
@@ -585,3 +1515,161 @@ TEST(StorageNodeData, EnumerateValues) {
   EXPECT_EQ(kv[1].first, "num2");
   EXPECT_EQ(*kv[1].second.Try<int>(), 2);
 }
+
+TEST(StorageNodeData, EnumerateTopLayerWins) {
+  auto v1 = CreateVolume();
+  v1->Open()->Write("c", 1);
+  v1->Open()->Write("a", 1);
+
+  auto v2 = CreateVolume();
+  v2->Open()->Write("c", 2);
+  v2->Open()->Write("b", 2);
+
+  auto v3 = CreateVolume();
+  v3->Open()->Write("a", 3);
+
+  auto kv = MountStorage({v1, v2, v3})->Open()->Enumerate();
+  ASSERT_EQ(kv.size(), size_t(3));
+  EXPECT_EQ(kv[0].first, "a");
+  EXPECT_EQ(*kv[0].second.Try<int>(), 3);
+  EXPECT_EQ(kv[1].first, "b");
+  EXPECT_EQ(*kv[1].second.Try<int>(), 2);
+  EXPECT_EQ(kv[2].first, "c");
+  EXPECT_EQ(*kv[2].second.Try<int>(), 2);
+}
+
+TEST(Crc32c, KnownVectors) {
+  const std::string digits = "123456789";
+  EXPECT_EQ(Crc32c(0, digits.data(), digits.size()), 0xE3069283u);
+  EXPECT_EQ(Crc32c(0, nullptr, 0), 0u);
+
+  const std::vector<uint8_t> zeros(32, 0);
+  const std::vector<uint8_t> ones(32, 0xFF);
+  EXPECT_EQ(Crc32c(0, zeros.data(), zeros.size()), 0x8A9136AAu);
+  EXPECT_EQ(Crc32c(0, ones.data(), ones.size()), 0x62A8AB43u);
+}
+
+TEST(Crc32c, ContinuesAcrossChunks) {
+  std::vector<uint8_t> data(100);
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = static_cast<uint8_t>(i * 31 + 7);
+  }
+
+  const auto whole = Crc32c(0, data.data(), data.size());
+  for (size_t split = 0; split <= data.size(); ++split) {
+    const auto head = Crc32c(0, data.data(), split);
+    EXPECT_EQ(Crc32c(head, data.data() + split, data.size() - split), whole);
+  }
+}
+
+TEST(Crc32c, BufferedStreamsChecksumAcrossBlocks) {
+  std::vector<uint8_t> data(1000);
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = static_cast<uint8_t>(i * 31 + 7);
+  }
+
+  /// fields smaller and larger than buffer, and a prefix left out of crc
+  const std::vector<size_t> sizes = {3, 1, 5, 8, 2, 40, 7, 100, 1, 13, 6};
+  const size_t prefix = 4;
+  size_t total = prefix;
+  for (const auto size : sizes) {
+    total += size;
+  }
+
+  const auto expected = Crc32c(0, data.data() + prefix, total - prefix);
+
+  std::ostringstream stream;
+  io::StreamSink sink(stream);
+  io::BufferedWriter out(sink, 16);
+  out.Write(data.data(), prefix);
+  out.StartCrc();
+  size_t offset = prefix;
+  for (const auto size : sizes) {
+    out.Write(data.data() + offset, size);
+    offset += size;
+  }
+
+  EXPECT_EQ(out.Crc(), expected);
+  out.StopCrc();
+  out.Flush();
+
+  std::istringstream input(stream.str());
+  io::StreamSource source(input);
+  io::BufferedReader in(source, 16);
+  std::vector<uint8_t> read(total);
+  in.Read(read.data(), prefix);
+  in.StartCrc();
+  offset = prefix;
+  for (const auto size : sizes) {
+    in.Read(read.data() + offset, size);
+    offset += size;
+  }
+
+  EXPECT_EQ(in.Crc(), expected);
+  in.StopCrc();
+  EXPECT_TRUE(std::equal(read.begin(), read.end(), data.begin()));
+}
+
+TEST(LzCodec, RoundTrips) {
+  std::vector<std::vector<uint8_t>> inputs = {{}, {'a'}};
+  std::vector<uint8_t> noise(1000);
+  uint32_t state = 1;
+  for (auto& byte : noise) {
+    state = state * 1103515245 + 12345;
+    byte = static_cast<uint8_t>(state >> 24);
+  }
+
+  inputs.push_back(noise);
+  inputs.emplace_back(100000, 0);
+  std::vector<uint8_t> text;
+  for (int i = 0; i < 10000; ++i) {
+    const auto line = "key" + std::to_string(i % 37) + "=abcabcab;";
+    text.insert(text.end(), line.begin(), line.end());
+  }
+
+  inputs.push_back(text);
+  const auto& codec = *LzCodec();
+  for (const auto& input : inputs) {
+    std::vector<uint8_t> compressed(codec.CompressBound(input.size()));
+    compressed.resize(
+        codec.Compress(input.data(), input.size(), compressed.data()));
+
+    std::vector<uint8_t> output(input.size());
+    codec.Decompress(compressed.data(), compressed.size(), output.data(),
+                     output.size());
+    EXPECT_EQ(output, input);
+  }
+
+  std::vector<uint8_t> compressed(codec.CompressBound(text.size()));
+  EXPECT_LT(codec.Compress(text.data(), text.size(), compressed.data()),
+            text.size() / 10);
+}
+
+TEST(LzCodec, CorruptedThrows) {
+  const auto& codec = *LzCodec();
+  const std::vector<uint8_t> input(1000, 'z');
+  std::vector<uint8_t> compressed(codec.CompressBound(input.size()));
+  compressed.resize(
+      codec.Compress(input.data(), input.size(), compressed.data()));
+
+  std::vector<uint8_t> output(input.size());
+  EXPECT_THROW(codec.Decompress(compressed.data(), compressed.size() - 1,
+                                output.data(), output.size()),
+               std::exception);
+  EXPECT_THROW(codec.Decompress(compressed.data(), compressed.size(),
+                                output.data(), output.size() - 1),
+               std::exception);
+
+  /// match before the beginning of output
+  const std::vector<uint8_t> bad_offset = {0x10, 'a', 0x02, 0x00, 0x00};
+  EXPECT_THROW(codec.Decompress(bad_offset.data(), bad_offset.size(),
+                                output.data(), 5),
+               std::exception);
+}
+
+TEST(Codec, Registry) {
+  EXPECT_EQ(FindCodec(LzCodec()->Id()), LzCodec());
+  EXPECT_THROW(FindCodec(0), std::exception);
+  EXPECT_THROW(RegisterCodec(LzCodec()), std::exception);
+  EXPECT_THROW(RegisterCodec(nullptr), std::exception);
+}